@@ -0,0 +1,41 @@
+/*
+ * Dimensionado de tramas según el MTU ATT negociado
+ *
+ * Todos los buffers de trama se reservan para ATT_MTU_TARGET; en tiempo de
+ * ejecución cada enlace usa attPayload(mtu) = mtu - 3 (cabecera ATT), que
+ * vale 20 hasta que termina el intercambio de MTU.
+ *
+ * 247 hace que una trama ATT completa quepa en un único PDU de enlace con
+ * Data Length Extension (251 bytes - 4 de L2CAP). Subir a 517 solo
+ * compensa para transferencias muy grandes.
+ */
+
+#ifndef ATT_MTU_H
+#define ATT_MTU_H
+
+#include <Arduino.h>
+#include <esp_gap_ble_api.h>
+
+#define ATT_MTU_DEFAULT     23
+#define ATT_MTU_TARGET      247
+#define ATT_HEADER_LEN      3                              // Opcode + handle
+#define ATT_MAX_PAYLOAD     (ATT_MTU_TARGET - ATT_HEADER_LEN)
+#define BLE_DLE_TX_OCTETS   251                            // Máximo de LE Data Length
+
+inline size_t attPayload(uint16_t mtu) {
+  if (mtu < ATT_MTU_DEFAULT) mtu = ATT_MTU_DEFAULT;
+  if (mtu > ATT_MTU_TARGET) mtu = ATT_MTU_TARGET;
+  return mtu - ATT_HEADER_LEN;
+}
+
+// Pide al controlador PDUs largos (DLE) y, si el chip es BLE 5 (C3/S3),
+// PHY de 2M. En el ESP32 clásico (BT 4.2) solo aplica DLE.
+inline void attRequestLinkUpgrade(esp_bd_addr_t peer) {
+  esp_ble_gap_set_pkt_data_len(peer, BLE_DLE_TX_OCTETS);
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+  esp_ble_gap_set_preferred_phy(peer, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+#endif
+}
+
+#endif // ATT_MTU_H
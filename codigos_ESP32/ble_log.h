@@ -0,0 +1,428 @@
+/*
+ * Logging común a los tres firmwares (master, P1, P2)
+ *
+ * - hexEncode(): volcado hexadecimal por tabla en un buffer del llamante,
+ *   sin sprintf/strcat y sin desbordar aunque el payload llegue al MTU.
+ * - logSegments() / logHex(): encolan un registro binario (timestamp,
+ *   dispositivo, categoría, payload) en un anillo sin locks.
+ * - logTask: tarea de baja prioridad, fijada al núcleo que no ejecuta
+ *   Bluedroid, que vacía el anillo, formatea y escribe al UART.
+ * - Modo binario: en lugar de líneas de texto, logTask escribe cada
+ *   registro como una trama COBS con CRC-16 a LOG_BINARY_BAUD. Se cambia
+ *   en marcha enviando LOG_BINARY_CMD / LOG_TEXT_CMD por el puerto serie.
+ *
+ * Pensado para ejecutarse dentro de los callbacks de la pila BLE: no usa
+ * heap, no toma locks y nunca espera al UART. Si el anillo está lleno el
+ * registro se descarta y se cuenta en logDropped.
+ *
+ * device, category y action deben ser cadenas de vida estática (literales
+ * o tablas constantes): el registro guarda solo el puntero, que actúa
+ * como identificador.
+ */
+
+#ifndef BLE_LOG_H
+#define BLE_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define LOG_LINE_MAX        256   // Línea completa, incluido el prefijo
+#define LOG_HEX_MAX_BYTES   64    // Bytes volcados como máximo por trama
+#define LOG_RING_SIZE       32    // Registros en el anillo (potencia de 2)
+#define LOG_PAYLOAD_MAX     152   // Texto o bytes crudos por registro
+#define LOG_DRAIN_PERIOD_MS 10    // Periodo de vaciado del anillo
+#define LOG_TASK_PRIORITY   1
+#define LOG_TEXT_BAUD       115200  // Serial.begin() de los firmwares
+#define LOG_BINARY_BAUD     921600  // Modo binario (sin efecto con USB-CDC)
+#define LOG_BINARY_DEFAULT  0       // 1 = arrancar ya en modo binario
+#define LOG_BINARY_CMD      'B'     // Byte recibido por Serial: pasar a binario
+#define LOG_TEXT_CMD        'T'     // Byte recibido por Serial: volver a texto
+
+// Núcleo del logger: el contrario al de la pila Bluedroid
+#if defined(CONFIG_BT_BLUEDROID_PINNED_TO_CORE)
+#define LOG_TASK_CORE       (1 - CONFIG_BT_BLUEDROID_PINNED_TO_CORE)
+#else
+#define LOG_TASK_CORE       1
+#endif
+
+// Tamaño de buffer necesario para volcar n bytes con hexEncode()
+#define HEX_BUFFER_SIZE(n)  ((n) * 3 + 3)
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+// Escribe "AA BB CC" en out (siempre terminado en '\0'). Si no cabe todo,
+// termina en ".." para que el corte sea visible. Devuelve los caracteres escritos.
+inline size_t hexEncode(const uint8_t* data, size_t length, char* out, size_t outSize) {
+  if (outSize == 0) return 0;
+  size_t pos = 0;
+  for (size_t i = 0; i < length; i++) {
+    size_t needed = (i > 0 ? 3 : 2);
+    if (pos + needed + 1 > outSize || (i == LOG_HEX_MAX_BYTES)) {
+      if (pos + 3 <= outSize) {
+        out[pos++] = '.';
+        out[pos++] = '.';
+      }
+      break;
+    }
+    if (i > 0) out[pos++] = ' ';
+    out[pos++] = HEX_DIGITS[data[i] >> 4];
+    out[pos++] = HEX_DIGITS[data[i] & 0x0F];
+  }
+  out[pos] = '\0';
+  return pos;
+}
+
+// Añade src a buf[pos..] sin pasar de size - 1; devuelve la nueva posición
+inline size_t logAppend(char* buf, size_t pos, size_t size, const char* src) {
+  while (*src && pos + 1 < size) {
+    buf[pos++] = *src++;
+  }
+  return pos;
+}
+
+// Decimal con ceros a la izquierda hasta width dígitos
+inline size_t logAppendU32(char* buf, size_t pos, size_t size, uint32_t value, uint8_t width) {
+  char digits[10];
+  uint8_t n = 0;
+  do {
+    digits[n++] = '0' + (value % 10);
+    value /= 10;
+  } while (value && n < sizeof(digits));
+  while (n < width && n < sizeof(digits)) digits[n++] = '0';
+  while (n && pos + 1 < size) buf[pos++] = digits[--n];
+  return pos;
+}
+
+// ==================== ANILLO DE REGISTROS ====================
+#define LOG_REC_HEX         0x01  // payload son bytes crudos: volcar como "<action>: [..]"
+#define LOG_REC_FRAME       0x02  // payload es [tipo][cuerpo] de una trama binaria (logFrame())
+#define LOG_REC_TRUNCATED   0x80  // La trama original era más larga que el payload
+
+struct LogRecord {
+  std::atomic<uint32_t> seq;      // Secuencia de la celda (cola MPSC acotada)
+  uint32_t timestamp;
+  const char* device;
+  const char* category;
+  const char* action;             // Solo registros LOG_REC_HEX
+  uint8_t flags;
+  uint8_t length;
+  uint8_t payload[LOG_PAYLOAD_MAX];
+};
+
+static LogRecord logRing[LOG_RING_SIZE];
+static std::atomic<uint32_t> logHead(0);     // Siguiente posición a reservar
+static uint32_t logTail = 0;                 // Solo lo usa logTask
+static std::atomic<uint32_t> logDropped(0);  // Registros perdidos por anillo lleno
+static std::atomic<bool> logBinary(false);   // Modo de salida; solo lo cambia logTask
+
+// Los productores consultan el modo para no construir lo que no se va a
+// escribir (texto con floats en binario, tramas en texto)
+inline bool logBinaryActive() {
+  return logBinary.load(std::memory_order_relaxed);
+}
+
+// Reserva una celda libre; nullptr si el anillo está lleno
+inline LogRecord* logReserve(uint32_t* position) {
+  uint32_t pos = logHead.load(std::memory_order_relaxed);
+  for (;;) {
+    LogRecord* rec = &logRing[pos & (LOG_RING_SIZE - 1)];
+    int32_t diff = (int32_t)(rec->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (logHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        *position = pos;
+        return rec;
+      }
+    } else if (diff < 0) {
+      logDropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      pos = logHead.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// Publica la celda para logTask
+inline void logCommit(LogRecord* rec, uint32_t position) {
+  rec->seq.store(position + 1, std::memory_order_release);
+}
+
+// Encola "seg0seg1..." como texto
+inline void logSegments(const char* device, const char* category,
+                        const char* const* segments, size_t count) {
+  uint32_t position;
+  LogRecord* rec = logReserve(&position);
+  if (!rec) return;
+  
+  rec->timestamp = millis();
+  rec->device = device;
+  rec->category = category;
+  rec->action = nullptr;
+  rec->flags = 0;
+  size_t pos = 0;
+  for (size_t i = 0; i < count; i++) {
+    for (const char* c = segments[i]; *c && pos < LOG_PAYLOAD_MAX; c++) {
+      rec->payload[pos++] = *c;
+    }
+  }
+  rec->length = pos;
+  logCommit(rec, position);
+}
+
+// Encola una trama cruda; el volcado hex "<action>: [AA BB CC]" lo hace logTask
+inline void logHex(const char* device, const char* category, const char* action,
+                   const uint8_t* data, size_t length) {
+  uint32_t position;
+  LogRecord* rec = logReserve(&position);
+  if (!rec) return;
+  
+  size_t n = min(length, (size_t)LOG_HEX_MAX_BYTES);
+  rec->timestamp = millis();
+  rec->device = device;
+  rec->category = category;
+  rec->action = action;
+  rec->flags = LOG_REC_HEX | (n < length ? LOG_REC_TRUNCATED : 0);
+  memcpy(rec->payload, data, n);
+  rec->length = n;
+  logCommit(rec, position);
+}
+
+// Encola el cuerpo de una trama binaria de tipo type (LOG_FRAME_* o los del
+// firmware). Si llega a logTask ya en modo texto se vuelca como hex.
+inline void logFrame(const char* device, uint8_t type, const uint8_t* body, size_t length) {
+  uint32_t position;
+  LogRecord* rec = logReserve(&position);
+  if (!rec) return;
+  
+  size_t n = min(length, (size_t)LOG_PAYLOAD_MAX - 1);
+  rec->timestamp = millis();
+  rec->device = device;
+  rec->category = "FRAME";
+  rec->action = "Binary record";
+  rec->flags = LOG_REC_HEX | LOG_REC_FRAME | (n < length ? LOG_REC_TRUNCATED : 0);
+  rec->payload[0] = type;
+  memcpy(rec->payload + 1, body, n);
+  rec->length = n + 1;
+  logCommit(rec, position);
+}
+
+// "[%08lu] [device-category] ...\n" en una sola escritura
+inline void logFormatRecord(const LogRecord* rec) {
+  char line[LOG_LINE_MAX];
+  size_t pos = 0;
+  pos = logAppend(line, pos, sizeof(line), "[");
+  pos = logAppendU32(line, pos, sizeof(line), rec->timestamp, 8);
+  pos = logAppend(line, pos, sizeof(line), "] [");
+  pos = logAppend(line, pos, sizeof(line), rec->device);
+  pos = logAppend(line, pos, sizeof(line), "-");
+  pos = logAppend(line, pos, sizeof(line), rec->category);
+  pos = logAppend(line, pos, sizeof(line), "] ");
+  
+  if (rec->flags & LOG_REC_HEX) {
+    pos = logAppend(line, pos, sizeof(line), rec->action);
+    pos = logAppend(line, pos, sizeof(line), ": [");
+    pos += hexEncode(rec->payload, rec->length, line + pos, sizeof(line) - pos);
+    if (rec->flags & LOG_REC_TRUNCATED) pos = logAppend(line, pos, sizeof(line), "..");
+    pos = logAppend(line, pos, sizeof(line), "]");
+  } else {
+    size_t n = min((size_t)rec->length, sizeof(line) - 1 - pos);
+    memcpy(line + pos, rec->payload, n);
+    pos += n;
+  }
+  line[pos++] = '\n';
+  Serial.write((const uint8_t*)line, pos);
+}
+
+// ==================== MODO BINARIO ====================
+// Trama antes de COBS, little-endian:
+//
+//   [tipo] [seq] [ms:4] [cuerpo] [crc16:2]
+//
+// seq cuenta tramas (módulo 256) para que el PC detecte huecos; el CRC es
+// CRC-16/CCITT-FALSE de tipo..cuerpo. En el cable cada trama va codificada
+// con COBS y terminada en 0x00, así que el lector se resincroniza en el
+// siguiente 0x00 tras basura o texto. Cuerpos de ble_log.h:
+//
+//   LOG_FRAME_TEXT  device\0 category\0 texto
+//   LOG_FRAME_HEX   [flags] device\0 category\0 action\0 bytes
+//   LOG_FRAME_DROP  [registros perdidos:4]
+//
+// Los tipos desde LOG_FRAME_USER los define cada firmware (logFrame()).
+// Lectura en el PC: dataset/read_stream.py.
+#define LOG_FRAME_MAX       256   // Trama sin codificar, cabecera y CRC incluidos
+#define LOG_FRAME_HEADER    6
+#define COBS_BUFFER_SIZE(n) ((n) + (n) / 254 + 2)
+
+enum LogFrameType : uint8_t {
+  LOG_FRAME_TEXT = 0x01,
+  LOG_FRAME_HEX  = 0x02,
+  LOG_FRAME_DROP = 0x03,
+  LOG_FRAME_USER = 0x10
+};
+
+static uint8_t logFrameSeq = 0;   // Solo lo usa logTask
+
+inline uint16_t crc16Ccitt(const uint8_t* data, size_t length) {
+  static const uint16_t NIBBLE_TABLE[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+  };
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc = (crc << 4) ^ NIBBLE_TABLE[(crc >> 12) ^ (data[i] >> 4)];
+    crc = (crc << 4) ^ NIBBLE_TABLE[(crc >> 12) ^ (data[i] & 0x0F)];
+  }
+  return crc;
+}
+
+// COBS de in[0..length) en out (COBS_BUFFER_SIZE(length)), sin el 0x00
+// final; devuelve los bytes escritos
+inline size_t cobsEncode(const uint8_t* in, size_t length, uint8_t* out) {
+  size_t codeAt = 0;  // Byte de código del bloque abierto
+  size_t pos = 1;
+  for (size_t i = 0; i < length; i++) {
+    if (in[i] != 0) out[pos++] = in[i];
+    if (in[i] == 0 || pos - codeAt == 0xFF) {
+      out[codeAt] = pos - codeAt;
+      codeAt = pos++;
+    }
+  }
+  out[codeAt] = pos - codeAt;
+  return pos;
+}
+
+// Cadena terminada en '\0' sin pasar de size - 1 (el '\0' siempre cabe)
+inline size_t logAppendZ(uint8_t* buf, size_t pos, size_t size, const char* src) {
+  pos = logAppend((char*)buf, pos, size, src);
+  buf[pos++] = '\0';
+  return pos;
+}
+
+// Cierra la trama en frame[0..length) (cabecera ya escrita) y la envía
+inline void logWriteFrame(uint8_t* frame, size_t length) {
+  frame[1] = logFrameSeq++;
+  uint16_t crc = crc16Ccitt(frame, length);
+  frame[length++] = crc;
+  frame[length++] = crc >> 8;
+  
+  uint8_t wire[COBS_BUFFER_SIZE(LOG_FRAME_MAX)];
+  size_t n = cobsEncode(frame, length, wire);
+  wire[n++] = 0x00;
+  Serial.write(wire, n);
+}
+
+inline size_t logFrameHeader(uint8_t* frame, uint8_t type, uint32_t timestamp) {
+  frame[0] = type;
+  frame[2] = timestamp;
+  frame[3] = timestamp >> 8;
+  frame[4] = timestamp >> 16;
+  frame[5] = timestamp >> 24;
+  return LOG_FRAME_HEADER;
+}
+
+// Equivalente binario de logFormatRecord(): sin formatear números ni hex
+inline void logFrameRecord(const LogRecord* rec) {
+  uint8_t frame[LOG_FRAME_MAX];
+  const size_t limit = sizeof(frame) - 2;  // Sitio para el CRC
+  size_t pos;
+  const uint8_t* body = rec->payload;
+  size_t length = rec->length;
+  
+  if (rec->flags & LOG_REC_FRAME) {
+    pos = logFrameHeader(frame, rec->payload[0], rec->timestamp);
+    body++;
+    length--;
+  } else if (rec->flags & LOG_REC_HEX) {
+    pos = logFrameHeader(frame, LOG_FRAME_HEX, rec->timestamp);
+    frame[pos++] = rec->flags;
+    pos = logAppendZ(frame, pos, limit, rec->device);
+    pos = logAppendZ(frame, pos, limit, rec->category);
+    pos = logAppendZ(frame, pos, limit, rec->action);
+  } else {
+    pos = logFrameHeader(frame, LOG_FRAME_TEXT, rec->timestamp);
+    pos = logAppendZ(frame, pos, limit, rec->device);
+    pos = logAppendZ(frame, pos, limit, rec->category);
+  }
+  length = min(length, limit - pos);
+  memcpy(frame + pos, body, length);
+  logWriteFrame(frame, pos + length);
+}
+
+inline void logFrameDrop(uint32_t dropped) {
+  uint8_t frame[LOG_FRAME_HEADER + 4 + 2];
+  size_t pos = logFrameHeader(frame, LOG_FRAME_DROP, millis());
+  frame[pos++] = dropped;
+  frame[pos++] = dropped >> 8;
+  frame[pos++] = dropped >> 16;
+  frame[pos++] = dropped >> 24;
+  logWriteFrame(frame, pos);
+}
+
+// Cambia el modo de salida (logTask). El aviso sale ya en el modo nuevo:
+// en binario es la primera trama a LOG_BINARY_BAUD.
+inline void logSetBinary(bool binary) {
+  if (binary == logBinaryActive()) return;
+  Serial.flush();
+#if !ARDUINO_USB_CDC_ON_BOOT
+  Serial.updateBaudRate(binary ? LOG_BINARY_BAUD : LOG_TEXT_BAUD);
+#endif
+  logBinary.store(binary, std::memory_order_relaxed);
+  const char* message = binary ? "Binary stream" : "Text log";
+  logSegments("LOG", "MODE", &message, 1);
+}
+
+// Órdenes del PC por el puerto serie; cualquier otro byte se ignora
+inline void logPollMode() {
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c == LOG_BINARY_CMD) logSetBinary(true);
+    else if (c == LOG_TEXT_CMD) logSetBinary(false);
+  }
+}
+
+// Vacía todo lo publicado; devuelve el número de registros escritos
+inline size_t logDrain() {
+  size_t written = 0;
+  bool binary = logBinaryActive();
+  for (;;) {
+    LogRecord* rec = &logRing[logTail & (LOG_RING_SIZE - 1)];
+    if (rec->seq.load(std::memory_order_acquire) != logTail + 1) break;
+    if (binary) logFrameRecord(rec);
+    else logFormatRecord(rec);
+    rec->seq.store(logTail + LOG_RING_SIZE, std::memory_order_release);
+    logTail++;
+    written++;
+  }
+  return written;
+}
+
+inline void logTask(void* param) {
+  uint32_t reportedDrops = 0;
+  for (;;) {
+    logPollMode();
+    logDrain();
+    uint32_t dropped = logDropped.load(std::memory_order_relaxed);
+    if (dropped != reportedDrops) {
+      if (logBinaryActive()) {
+        logFrameDrop(dropped - reportedDrops);
+      } else {
+        Serial.printf("[%08lu] [LOG-DROP] %u records dropped (ring full)\n",
+                      millis(), (unsigned)(dropped - reportedDrops));
+      }
+      reportedDrops = dropped;
+    }
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_PERIOD_MS));
+  }
+}
+
+// Inicializa el anillo y lanza logTask. Llamar al inicio de setup(), justo
+// después de Serial.begin(LOG_TEXT_BAUD).
+inline void logBegin() {
+  for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+    logRing[i].seq.store(i, std::memory_order_relaxed);
+  }
+  if (LOG_BINARY_DEFAULT) logSetBinary(true);
+  xTaskCreatePinnedToCore(logTask, "logTask", 4096, nullptr, LOG_TASK_PRIORITY,
+                          nullptr, LOG_TASK_CORE);
+}
+
+#endif // BLE_LOG_H
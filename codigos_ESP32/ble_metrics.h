@@ -0,0 +1,187 @@
+/*
+ * Métricas del camino caliente (master, P1, P2)
+ *
+ * Contadores, máximos, recuento por opcode e histograma de latencia en
+ * ciclos de CPU. Cada núcleo escribe solo en su propio bloque
+ * (metricsCores[xPortGetCoreID()]), así que registrar una muestra es un
+ * incremento en memoria local sin locks ni atómicos; metricsTotal() y
+ * metricsEncode() suman los bloques al leer.
+ *
+ * Las tareas que registran están fijadas a un núcleo (Bluedroid, cmdTask,
+ * loop, logTask y, en el master, ioTask, appTask y linkTask). Dos tareas del mismo núcleo que se expropian a mitad de
+ * un incremento pueden perder una cuenta: se acepta, son diagnósticos.
+ *
+ * Instantánea binaria (característica de diagnóstico, big-endian):
+ *
+ *   [0xD0] [MHz] [uptime s:4] [contadores:4 x MET_COUNT] [logDropped:4]
+ *   [heap libre:4] [mínimo histórico:4] [bloque mayor:4]
+ *   [máximos:2 x MET_GAUGE_COUNT] [histograma:2 x METRICS_HIST_BUCKETS]
+ *   [opcode, cuenta:2]...          (solo opcodes con cuenta, mientras quepan)
+ *
+ * El cubo 0 del histograma son las muestras de menos de 2^METRICS_HIST_SHIFT
+ * ciclos; el cubo i > 0 cubre [2^(SHIFT+i-1), 2^(SHIFT+i)).
+ */
+
+#ifndef BLE_METRICS_H
+#define BLE_METRICS_H
+
+#include <Arduino.h>
+#include "ble_log.h"
+#include "ble_protocol.h"
+
+#define METRICS_FRAME           0xD0
+#define METRICS_HIST_BUCKETS    16
+#define METRICS_HIST_SHIFT      10    // Cubo 0: < 1024 ciclos (~4 µs a 240 MHz)
+#define METRICS_SNAPSHOT_MAX    160   // Instantánea completa (lectura larga)
+#define METRICS_REPORT_MS       30000 // Periodo del resumen en el log
+
+enum MetricCounter : uint8_t {
+  MET_COMMANDS,       // Comandos procesados (periférico) o enviados (master)
+  MET_CMD_DROPPED,    // Escrituras descartadas: pool agotado o trama demasiado larga
+  MET_NOTIFY_SENT,    // Notificaciones STATE aceptadas por la pila
+  MET_NOTIFY_FAIL,    // Notificaciones STATE rechazadas (sin cliente, CCCD, GATT)
+  MET_NOTIFY_RX,      // Notificaciones recibidas (master)
+  MET_NOTIFY_DROPPED, // Notificaciones descartadas: anillo de decodificación lleno (master)
+  MET_WRITE_FAIL,     // Escrituras GATT fallidas (master)
+  MET_CONNECTS,       // Conexiones establecidas
+  MET_RECONNECTS,     // Conexiones posteriores a la primera
+  MET_CMD_LIMITED,    // Escrituras descartadas por el limitador (rate_limit.h)
+  MET_COUNT
+};
+
+enum MetricGauge : uint8_t {
+  MET_QUEUE_MAX,      // Profundidad máxima observada de la cola de trabajo
+  MET_READY_MS_MAX,   // Máximo tiempo de conexión a READY (master)
+  MET_GAUGE_COUNT
+};
+
+struct MetricsCore {
+  uint32_t counters[MET_COUNT];
+  uint32_t gauges[MET_GAUGE_COUNT];
+  uint32_t histogram[METRICS_HIST_BUCKETS];
+  uint32_t opcodes[256];
+};
+
+static MetricsCore metricsCores[portNUM_PROCESSORS];
+
+inline MetricsCore& metricsLocal() {
+  return metricsCores[xPortGetCoreID()];
+}
+
+inline uint32_t metricsCycles() {
+  return ESP.getCycleCount();
+}
+
+inline void metricsCount(MetricCounter counter) {
+  metricsLocal().counters[counter]++;
+}
+
+inline void metricsGaugeMax(MetricGauge gauge, uint32_t value) {
+  MetricsCore& core = metricsLocal();
+  if (value > core.gauges[gauge]) core.gauges[gauge] = value;
+}
+
+inline uint8_t metricsBucket(uint32_t cycles) {
+  if (cycles < (1UL << METRICS_HIST_SHIFT)) return 0;
+  uint8_t bucket = 32 - __builtin_clz(cycles) - METRICS_HIST_SHIFT;
+  return bucket < METRICS_HIST_BUCKETS ? bucket : METRICS_HIST_BUCKETS - 1;
+}
+
+// Una muestra del camino caliente: opcode procesado y ciclos empleados
+inline void metricsSample(uint8_t opcode, uint32_t cycles) {
+  MetricsCore& core = metricsLocal();
+  core.opcodes[opcode]++;
+  core.histogram[metricsBucket(cycles)]++;
+}
+
+// ==================== LECTURA ====================
+inline uint32_t metricsTotal(MetricCounter counter) {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < portNUM_PROCESSORS; i++) total += metricsCores[i].counters[counter];
+  return total;
+}
+
+inline uint32_t metricsGauge(MetricGauge gauge) {
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < portNUM_PROCESSORS; i++) value = max(value, metricsCores[i].gauges[gauge]);
+  return value;
+}
+
+inline uint32_t metricsBucketTotal(uint8_t bucket) {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < portNUM_PROCESSORS; i++) total += metricsCores[i].histogram[bucket];
+  return total;
+}
+
+inline uint32_t metricsOpcodeTotal(uint8_t opcode) {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < portNUM_PROCESSORS; i++) total += metricsCores[i].opcodes[opcode];
+  return total;
+}
+
+// Límite superior del cubo en µs (el último cubo es abierto)
+inline uint32_t metricsBucketLimitUs(uint8_t bucket) {
+  return (1UL << (METRICS_HIST_SHIFT + bucket)) / getCpuFrequencyMhz();
+}
+
+// Instantánea con el formato de la cabecera; devuelve su longitud
+inline size_t metricsEncode(ByteSpan out) {
+  ByteWriter writer(out);
+  writer.put8(METRICS_FRAME);
+  writer.put8((uint8_t)getCpuFrequencyMhz());
+  writer.put32(millis() / 1000);
+  for (uint8_t i = 0; i < MET_COUNT; i++) writer.put32(metricsTotal((MetricCounter)i));
+  writer.put32(logDropped.load(std::memory_order_relaxed));
+  writer.put32(ESP.getFreeHeap());
+  writer.put32(ESP.getMinFreeHeap());
+  writer.put32(ESP.getMaxAllocHeap());
+  for (uint8_t i = 0; i < MET_GAUGE_COUNT; i++) writer.put16(min(metricsGauge((MetricGauge)i), (uint32_t)0xFFFF));
+  for (uint8_t i = 0; i < METRICS_HIST_BUCKETS; i++) writer.put16(min(metricsBucketTotal(i), (uint32_t)0xFFFF));
+  
+  for (uint16_t op = 0; op < 256 && writer.pos + 3 <= out.size; op++) {
+    uint32_t count = metricsOpcodeTotal(op);
+    if (count == 0) continue;
+    writer.put8(op);
+    writer.put16(min(count, (uint32_t)0xFFFF));
+  }
+  return writer.length();
+}
+
+// Resumen legible en el log: contadores y cubos del histograma con muestras
+inline void metricsLogSummary(const char* device) {
+  char line[LOG_PAYLOAD_MAX];
+  const char* segments[] = {line};
+  snprintf(line, sizeof(line), "cmds %u, dropped %u, notify %u (fail %u), rx %u (drop %u), write fail %u",
+           (unsigned)metricsTotal(MET_COMMANDS), (unsigned)metricsTotal(MET_CMD_DROPPED),
+           (unsigned)metricsTotal(MET_NOTIFY_SENT), (unsigned)metricsTotal(MET_NOTIFY_FAIL),
+           (unsigned)metricsTotal(MET_NOTIFY_RX), (unsigned)metricsTotal(MET_NOTIFY_DROPPED),
+           (unsigned)metricsTotal(MET_WRITE_FAIL));
+  logSegments(device, "METRICS", segments, 1);
+  
+  snprintf(line, sizeof(line), "connects %u (re %u), limited %u, queue max %u, ready max %u ms, log drops %u",
+           (unsigned)metricsTotal(MET_CONNECTS), (unsigned)metricsTotal(MET_RECONNECTS),
+           (unsigned)metricsTotal(MET_CMD_LIMITED),
+           (unsigned)metricsGauge(MET_QUEUE_MAX), (unsigned)metricsGauge(MET_READY_MS_MAX),
+           (unsigned)logDropped.load(std::memory_order_relaxed));
+  logSegments(device, "METRICS", segments, 1);
+  
+  // Heap: sin reservas en régimen permanente los tres valores deben mantenerse planos
+  snprintf(line, sizeof(line), "heap free %u, min %u, largest block %u",
+           (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap(), (unsigned)ESP.getMaxAllocHeap());
+  logSegments(device, "METRICS", segments, 1);
+  
+  size_t pos = logAppend(line, 0, sizeof(line), "latency");
+  for (uint8_t i = 0; i < METRICS_HIST_BUCKETS; i++) {
+    uint32_t count = metricsBucketTotal(i);
+    if (count == 0) continue;
+    pos = logAppend(line, pos, sizeof(line), i == METRICS_HIST_BUCKETS - 1 ? " >=" : " <");
+    pos = logAppendU32(line, pos, sizeof(line),
+                       metricsBucketLimitUs(i == METRICS_HIST_BUCKETS - 1 ? i - 1 : i), 1);
+    pos = logAppend(line, pos, sizeof(line), "us:");
+    pos = logAppendU32(line, pos, sizeof(line), count, 1);
+  }
+  line[pos] = '\0';
+  logSegments(device, "METRICS", segments, 1);
+}
+
+#endif // BLE_METRICS_H
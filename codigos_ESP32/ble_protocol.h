@@ -0,0 +1,385 @@
+/*
+ * Protocolo de aplicación P1 / P2 (compartido por master y periféricos)
+ *
+ * Cada mensaje es un struct con su opcode (o bit de telemetría), su tamaño
+ * fijo de payload y un par write()/read() sobre ByteWriter/ByteReader. Los
+ * dos extremos compilan el mismo código, así que el orden de bytes
+ * (big-endian) y los tamaños solo se definen aquí.
+ *
+ *   encodeInto(msg, span)   payload del mensaje, sin cabecera de trama
+ *   decodeFrom(span, msg)   false si el span es más corto que el mensaje
+ *   p1::encodeFrame / p2::encodeFrame   cabecera de trama de cada familia
+ *
+ * Ni el escritor ni el lector copian: trabajan directamente sobre el buffer
+ * de la trama (ATT en recepción, buffer de notificación en emisión).
+ */
+
+#ifndef BLE_PROTOCOL_H
+#define BLE_PROTOCOL_H
+
+#include <Arduino.h>
+#include "telemetry_frame.h"
+
+// ==================== SPANS Y CURSORES ====================
+struct ByteSpan {
+  uint8_t* data;
+  size_t size;
+  ByteSpan(uint8_t* d, size_t n) : data(d), size(n) {}
+};
+
+struct ConstByteSpan {
+  const uint8_t* data;
+  size_t size;
+  ConstByteSpan(const uint8_t* d, size_t n) : data(d), size(n) {}
+};
+
+// Escritura secuencial; si algo no cabe, length() devuelve 0
+struct ByteWriter {
+  ByteSpan out;
+  size_t pos;
+  bool ok;
+
+  ByteWriter(ByteSpan span) : out(span), pos(0), ok(true) {}
+
+  void put8(uint8_t value) {
+    if (pos < out.size) out.data[pos++] = value;
+    else ok = false;
+  }
+  void put16(uint16_t value) {
+    put8(value >> 8);
+    put8(value & 0xFF);
+  }
+  void put32(uint32_t value) {
+    put16(value >> 16);
+    put16(value & 0xFFFF);
+  }
+  void putBytes(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) put8(data[i]);
+  }
+  size_t length() const { return ok ? pos : 0; }
+};
+
+// Lectura secuencial; leer de más devuelve 0 y marca ok = false
+struct ByteReader {
+  ConstByteSpan in;
+  size_t pos;
+  bool ok;
+
+  ByteReader(ConstByteSpan span) : in(span), pos(0), ok(true) {}
+
+  uint8_t get8() {
+    if (pos < in.size) return in.data[pos++];
+    ok = false;
+    return 0;
+  }
+  uint16_t get16() {
+    uint16_t high = get8();
+    return (uint16_t)((high << 8) | get8());
+  }
+  uint32_t get32() {
+    uint32_t high = get16();
+    return (high << 16) | get16();
+  }
+  void getBytes(uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) data[i] = get8();
+  }
+};
+
+template <typename T>
+inline size_t encodeInto(const T& msg, ByteSpan out) {
+  ByteWriter writer(out);
+  msg.write(writer);
+  return writer.length();
+}
+
+template <typename T>
+inline bool decodeFrom(ConstByteSpan in, T& msg) {
+  ByteReader reader(in);
+  msg.read(reader);
+  return reader.ok;
+}
+
+// Campo de telemetría (telemetry_frame.h) a partir de un mensaje tipado
+template <typename T>
+inline TelemetryField telemetryField(const T& msg) {
+  TelemetryField field;
+  field.bit = T::BIT;
+  field.size = T::SIZE;
+  encodeInto(msg, ByteSpan(field.data, sizeof(field.data)));
+  return field;
+}
+
+template <typename T>
+inline bool decodeField(const TelemetryFieldView& field, T& msg) {
+  return field.bit == T::BIT && decodeFrom(ConstByteSpan(field.data, field.size), msg);
+}
+
+// ==================== P1 ====================
+// CMD: 4 bytes fijos [CMD, P1, P2, P3]; STATE: [TIPO, V1, V2, V3]
+namespace p1 {
+
+enum : uint8_t { FRAME_LEN = 4 };
+
+inline size_t encodeFrame(uint8_t opcode, const uint8_t* payload, uint8_t payloadLen, ByteSpan out) {
+  if (out.size < FRAME_LEN || payloadLen > FRAME_LEN - 1) return 0;
+  out.data[0] = opcode;
+  out.data[1] = out.data[2] = out.data[3] = 0;
+  memcpy(out.data + 1, payload, payloadLen);
+  return FRAME_LEN;
+}
+
+// Comandos de un solo byte de parámetro
+template <uint8_t Op>
+struct ByteCommand {
+  enum : uint8_t { OPCODE = Op, SIZE = 1 };
+  uint8_t value;
+  void write(ByteWriter& w) const { w.put8(value); }
+  void read(ByteReader& r) { value = r.get8(); }
+};
+
+// Comandos sin parámetros
+template <uint8_t Op>
+struct EmptyCommand {
+  enum : uint8_t { OPCODE = Op, SIZE = 0 };
+  void write(ByteWriter&) const {}
+  void read(ByteReader&) {}
+};
+
+typedef ByteCommand<0x01> SetMode;         // 0=Normal, 1=Eco, 2=Turbo
+typedef EmptyCommand<0x02> GetStatus;
+typedef ByteCommand<0x03> SetBrightness;
+typedef EmptyCommand<0x04> ResetCounters;
+typedef EmptyCommand<0x05> GetTelemetry;
+typedef ByteCommand<0x06> SetTimer;        // Segundos
+typedef ByteCommand<0x08> TelemetryAck;    // SEQ de la instantánea reconstruida
+
+// Telemetría por cambios (telemetry_frame.h): keyframe cada keyframeEvery
+// ticks (0 = baja) y umbral de cada campo en sus propias unidades
+struct TelemetrySubscribe {
+  enum : uint8_t { OPCODE = 0x07, SIZE = 3 };
+  uint8_t keyframeEvery;
+  uint8_t thresholds[2];  // Temperature, Humidity
+  void write(ByteWriter& w) const { w.put8(keyframeEvery); w.putBytes(thresholds, sizeof(thresholds)); }
+  void read(ByteReader& r) { keyframeEvery = r.get8(); r.getBytes(thresholds, sizeof(thresholds)); }
+};
+
+// Respuesta de GET_STATUS
+struct StatusReport {
+  enum : uint8_t { SIZE = 3 };
+  uint8_t mode;
+  uint8_t brightness;
+  uint8_t flags;          // bit0 = LED
+  void write(ByteWriter& w) const { w.put8(mode); w.put8(brightness); w.put8(flags); }
+  void read(ByteReader& r) { mode = r.get8(); brightness = r.get8(); flags = r.get8(); }
+};
+
+// Confirmación del resto de comandos: [valor, 0, 0]
+struct StateEcho {
+  enum : uint8_t { SIZE = 3 };
+  uint8_t value;
+  void write(ByteWriter& w) const { w.put8(value); w.put8(0); w.put8(0); }
+  void read(ByteReader& r) { value = r.get8(); r.get8(); r.get8(); }
+};
+
+namespace telemetry {
+
+struct Temperature {
+  enum : uint8_t { BIT = 0x01, SIZE = 2, COMPONENTS = 1, WIDE = 0x01 };
+  int16_t deciCelsius;
+  void write(ByteWriter& w) const { w.put16(deciCelsius); }
+  void read(ByteReader& r) { deciCelsius = (int16_t)r.get16(); }
+};
+
+struct Humidity {
+  enum : uint8_t { BIT = 0x02, SIZE = 2, COMPONENTS = 1, WIDE = 0x01 };
+  uint16_t permille;      // % * 10
+  void write(ByteWriter& w) const { w.put16(permille); }
+  void read(ByteReader& r) { permille = r.get16(); }
+};
+
+static const uint8_t FIELD_SIZES[] = {Temperature::SIZE, Humidity::SIZE};
+static const TelemetryLayout FIELD_LAYOUTS[] = {
+  {Temperature::COMPONENTS, Temperature::WIDE},
+  {Humidity::COMPONENTS, Humidity::WIDE},
+};
+
+}  // namespace telemetry
+}  // namespace p1
+
+// ==================== P2 ====================
+// CMD: [CMD, LEN, DATA...]; STATE: [TIPO, DATA...]
+namespace p2 {
+
+enum : uint8_t { HEADER_LEN = 2 };
+
+inline size_t encodeFrame(uint8_t opcode, const uint8_t* payload, uint8_t payloadLen, ByteSpan out) {
+  if ((size_t)payloadLen + HEADER_LEN > out.size) return 0;
+  out.data[0] = opcode;
+  out.data[1] = payloadLen;
+  memcpy(out.data + HEADER_LEN, payload, payloadLen);
+  return HEADER_LEN + payloadLen;
+}
+
+// Cabecera y payload tipado escritos directamente en la trama de salida
+template <typename T>
+inline size_t encodeFrame(const T& msg, ByteSpan out) {
+  if (out.size < (size_t)HEADER_LEN + T::SIZE) return 0;
+  out.data[0] = T::OPCODE;
+  out.data[1] = T::SIZE;
+  return HEADER_LEN + encodeInto(msg, ByteSpan(out.data + HEADER_LEN, out.size - HEADER_LEN));
+}
+
+struct AuthPin {
+  enum : uint8_t { OPCODE = 0x01, SIZE = 6 };
+  uint16_t userId;
+  uint8_t pin[4];         // BCD: "123456" -> 12 34 56 00
+  void write(ByteWriter& w) const { w.put16(userId); w.putBytes(pin, sizeof(pin)); }
+  void read(ByteReader& r) { userId = r.get16(); r.getBytes(pin, sizeof(pin)); }
+};
+
+enum : uint8_t { TICKET_LEN = 8 };
+
+// Reanudación tras reconectar: ticket recibido en el último AUTH_PIN (o
+// SESSION_RESUME) aceptado. Cada ticket sirve una sola vez.
+struct SessionResume {
+  enum : uint8_t { OPCODE = 0x04, SIZE = 2 + TICKET_LEN };
+  uint16_t userId;
+  uint8_t ticket[TICKET_LEN];
+  void write(ByteWriter& w) const { w.put16(userId); w.putBytes(ticket, sizeof(ticket)); }
+  void read(ByteReader& r) { userId = r.get16(); r.getBytes(ticket, sizeof(ticket)); }
+};
+
+struct SessionStart {
+  enum : uint8_t { OPCODE = 0x02, SIZE = 5 };
+  uint32_t timestamp;
+  uint8_t sessionType;    // 0=normal, 1=infantil
+  void write(ByteWriter& w) const { w.put32(timestamp); w.put8(sessionType); }
+  void read(ByteReader& r) { timestamp = r.get32(); sessionType = r.get8(); }
+};
+
+template <uint8_t Op>
+struct ByteCommand {
+  enum : uint8_t { OPCODE = Op, SIZE = 1 };
+  uint8_t value;
+  void write(ByteWriter& w) const { w.put8(value); }
+  void read(ByteReader& r) { value = r.get8(); }
+};
+
+typedef ByteCommand<0x03> Keepalive;
+typedef ByteCommand<0x10> SetMode;         // 0=Eco, 1=Normal, 2=Turbo, 3=Noche
+typedef ByteCommand<0x11> SetIntensity;    // 0-100
+typedef ByteCommand<0x15> TelemetryAck;    // SEQ de la instantánea reconstruida
+
+struct SetTimer {
+  enum : uint8_t { OPCODE = 0x12, SIZE = 2 };
+  uint16_t minutes;
+  void write(ByteWriter& w) const { w.put16(minutes); }
+  void read(ByteReader& r) { minutes = r.get16(); }
+};
+
+struct SetProfile {
+  enum : uint8_t { OPCODE = 0x13, SIZE = 2 };
+  uint8_t ageProfile;
+  uint8_t preferences;
+  void write(ByteWriter& w) const { w.put8(ageProfile); w.put8(preferences); }
+  void read(ByteReader& r) { ageProfile = r.get8(); preferences = r.get8(); }
+};
+
+// Telemetría por cambios (telemetry_frame.h): keyframe cada keyframeEvery
+// ticks (0 = baja) y umbral de cada campo en sus propias unidades
+struct TelemetrySubscribe {
+  enum : uint8_t { OPCODE = 0x14, SIZE = 4 };
+  uint8_t keyframeEvery;
+  uint8_t thresholds[3];  // Vitals, Activity, Gps
+  void write(ByteWriter& w) const { w.put8(keyframeEvery); w.putBytes(thresholds, sizeof(thresholds)); }
+  void read(ByteReader& r) { keyframeEvery = r.get8(); r.getBytes(thresholds, sizeof(thresholds)); }
+};
+
+struct Event {
+  enum : uint8_t { OPCODE = 0x20, SIZE = 3 };
+  uint8_t type;           // 0=Button, 1=Game Complete, 2=Error
+  uint16_t value;
+  void write(ByteWriter& w) const { w.put8(type); w.put16(value); }
+  void read(ByteReader& r) { type = r.get8(); value = r.get16(); }
+};
+
+struct Reward {
+  enum : uint8_t { OPCODE = 0x21, SIZE = 2 };
+  uint8_t level;
+  uint8_t badges;
+  void write(ByteWriter& w) const { w.put8(level); w.put8(badges); }
+  void read(ByteReader& r) { level = r.get8(); badges = r.get8(); }
+};
+
+struct Logout {
+  enum : uint8_t { OPCODE = 0x99, SIZE = 0 };
+  void write(ByteWriter&) const {}
+  void read(ByteReader&) {}
+};
+
+// Respuesta a AUTH_PIN y SESSION_RESUME: [0x01, userId, ticket] si acepta,
+// [0x00] si no. Sin ticket (firmware antiguo) el central no puede reanudar.
+struct AuthResult {
+  bool ok;
+  uint16_t userId;
+  bool hasTicket;
+  uint8_t ticket[TICKET_LEN];
+  void write(ByteWriter& w) const {
+    w.put8(ok ? 0x01 : 0x00);
+    if (ok) w.put16(userId);
+    if (ok && hasTicket) w.putBytes(ticket, sizeof(ticket));
+  }
+  void read(ByteReader& r) {
+    ok = r.get8() == 0x01;
+    userId = ok ? r.get16() : 0;
+    hasTicket = ok && r.ok && r.in.size - r.pos >= sizeof(ticket);
+    if (hasTicket) r.getBytes(ticket, sizeof(ticket));
+  }
+};
+
+// Respuesta a SESSION_START
+struct SessionAck {
+  enum : uint8_t { SIZE = 2 };
+  uint8_t status;
+  uint8_t sessionType;
+  void write(ByteWriter& w) const { w.put8(status); w.put8(sessionType); }
+  void read(ByteReader& r) { status = r.get8(); sessionType = r.get8(); }
+};
+
+namespace telemetry {
+
+struct Vitals {
+  enum : uint8_t { BIT = 0x01, SIZE = 3, COMPONENTS = 2, WIDE = 0x01 };
+  int16_t deciCelsius;
+  uint8_t heartRate;
+  void write(ByteWriter& w) const { w.put16(deciCelsius); w.put8(heartRate); }
+  void read(ByteReader& r) { deciCelsius = (int16_t)r.get16(); heartRate = r.get8(); }
+};
+
+struct Activity {
+  enum : uint8_t { BIT = 0x02, SIZE = 3, COMPONENTS = 2, WIDE = 0x01 };
+  uint16_t steps;
+  uint8_t battery;
+  void write(ByteWriter& w) const { w.put16(steps); w.put8(battery); }
+  void read(ByteReader& r) { steps = r.get16(); battery = r.get8(); }
+};
+
+struct Gps {
+  enum : uint8_t { BIT = 0x04, SIZE = 4, COMPONENTS = 2, WIDE = 0x03 };
+  int16_t latitude;       // * 100
+  int16_t longitude;      // * 100
+  void write(ByteWriter& w) const { w.put16(latitude); w.put16(longitude); }
+  void read(ByteReader& r) { latitude = (int16_t)r.get16(); longitude = (int16_t)r.get16(); }
+};
+
+static const uint8_t FIELD_SIZES[] = {Vitals::SIZE, Activity::SIZE, Gps::SIZE};
+static const TelemetryLayout FIELD_LAYOUTS[] = {
+  {Vitals::COMPONENTS, Vitals::WIDE},
+  {Activity::COMPONENTS, Activity::WIDE},
+  {Gps::COMPONENTS, Gps::WIDE},
+};
+
+}  // namespace telemetry
+}  // namespace p2
+
+#endif // BLE_PROTOCOL_H
@@ -0,0 +1,432 @@
+/*
+ * Recepción de transferencias masivas en los periféricos (P1, P2)
+ *
+ * Lado periférico de bulk_transfer.h. Tres etapas unidas por anillos SPSC:
+ *
+ *   tarea BLE     onWrite copia BEGIN y DATA a bulkRxRing (bulkPush())
+ *   bulkTask      sesión, chunks al bloque en RAM y ACKs (bulkProcess())
+ *   bulkWriter    CRC del bloque, borrado y escritura del sector en la
+ *                 partición de staging y relectura final (bulkWriterRun())
+ *
+ * El escritor trabaja con doble búfer: mientras un bloque se borra y se
+ * escribe (~50 ms con la caché de flash parada), el otro sigue recibiendo.
+ * Si los dos están ocupados, los chunks del bloque siguiente se descartan y,
+ * al liberarse uno, un ACK BULK_RESEND pide al master que los repita; el
+ * master nunca espera a la flash más allá de eso.
+ *
+ * La sesión sobrevive a la desconexión (los bloques escritos y el bitmap del
+ * bloque en curso): un BEGIN con el mismo id y tamaño la retoma desde
+ * cualquier enlace autenticado. Un BEGIN distinto la sustituye. La imagen
+ * completa queda en la partición; aplicarla (configuración, horario o
+ * firmware) es cosa del firmware, que la encuentra en bulkStaged.
+ */
+
+#ifndef BULK_RECEIVER_H
+#define BULK_RECEIVER_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "ble_log.h"
+#include "ble_metrics.h"
+#include "bulk_transfer.h"
+#include "cmd_queue.h"
+#include "spsc_ring.h"
+
+#define BULK_PARTITION_LABEL  "spiffs"  // Partición de datos de la tabla por defecto
+#define BULK_RX_RING          32        // Tramas pendientes de bulkTask (potencia de 2, > BULK_WINDOW)
+#define BULK_BUFFERS          2         // Bloques en RAM: uno recibe mientras otro se escribe
+#define BULK_NO_BUFFER        0xFF
+#define BULK_NO_LINK          0xFF
+#define BULK_TASK_PRIORITY    2         // Por debajo de cmdTask
+#define BULK_WRITER_PRIORITY  1
+#define BULK_TASK_STACK       3072
+#define BULK_VERIFY_CHUNK     256       // Bytes por lectura al releer la imagen
+
+// ACK a un enlace concreto (Peripheral::sendBulkFrame)
+typedef void (*BulkSink)(uint8_t link, const uint8_t* frame, size_t length);
+
+struct BulkRxFrame {
+  uint8_t link;
+  bool authenticated;           // Sesión del enlace vista por la tarea BLE (seqlock)
+  uint16_t length;
+  uint8_t data[ATT_MAX_PAYLOAD];
+};
+
+// Bloque en RAM: de bulkTask mientras recibe, del escritor hasta su resultado
+struct BulkBuffer {
+  uint16_t block;
+  uint16_t length;              // Bytes de imagen (el CRC va detrás)
+  uint16_t chunks;
+  uint16_t received;
+  uint16_t next;                // Primer chunk que falta
+  uint8_t map[BULK_CHUNK_MAP];
+  uint8_t data[BULK_BLOCK_SIZE + BULK_CRC_LEN];
+};
+
+enum BulkJobType : uint8_t {
+  BULK_JOB_WRITE,               // Comprobar el CRC y escribir el bloque
+  BULK_JOB_VERIFY               // Releer la imagen y compararla con id
+};
+
+struct BulkJob {
+  uint8_t type;
+  uint8_t buffer;
+  uint8_t epoch;                // Sesión que lo encargó
+  uint32_t size;
+  uint32_t id;
+};
+
+struct BulkResult {
+  uint8_t type;
+  uint8_t buffer;
+  uint8_t epoch;
+  bool ok;
+};
+
+// Estado de la sesión (bulkTask)
+struct BulkSession {
+  bool active;
+  bool done;
+  uint8_t owner;                // Enlace que la alimenta
+  uint8_t epoch;                // Cambia con cada sesión nueva: descarta resultados viejos
+  uint8_t kind;
+  uint32_t id;
+  uint32_t size;
+  uint16_t chunk;
+  uint16_t blocks;
+  uint16_t rxBlock;             // Bloque en recepción
+  uint8_t rxBuffer;             // Su búfer (BULK_NO_BUFFER = los dos ocupados)
+  uint16_t written;             // Bloques escritos y verificados, en orden
+  uint16_t gapNext;             // next del último ACK por hueco (uno por pérdida)
+  bool dropped;                 // Chunks descartados sin búfer: BULK_RESEND al liberar uno
+  bool ackPending;
+  unsigned long startedAt;
+};
+
+// Imagen completa en la partición, para el firmware (bulkTask la escribe)
+struct BulkStaged {
+  uint8_t kind;
+  uint32_t id;
+  uint32_t size;                // 0 = ninguna (o una sesión nueva la está sobrescribiendo)
+};
+
+static const esp_partition_t* bulkPartition = nullptr;
+static const char* bulkTag = "BULK";
+static BulkSink bulkSink = nullptr;
+static SpscRing<BulkRxFrame, BULK_RX_RING> bulkRxRing;  // Tarea BLE -> bulkTask
+static SpscRing<BulkJob, 4> bulkJobs;                    // bulkTask -> escritor
+static SpscRing<BulkResult, 4> bulkResults;              // Escritor -> bulkTask
+static BulkBuffer bulkBuffers[BULK_BUFFERS];
+static bool bulkBufferBusy[BULK_BUFFERS];               // bulkTask
+static BulkSession bulkSession;
+static volatile BulkStaged bulkStaged;
+static TaskHandle_t bulkTaskHandle = nullptr;
+static TaskHandle_t bulkWriterHandle = nullptr;
+
+inline void bulkLog(const char* message) {
+  logSegments(bulkTag, "BULK", &message, 1);
+}
+
+// ==================== TAREA BLE ====================
+inline bool bulkIsFrame(const uint8_t* data, size_t length) {
+  return length > 0 && (data[0] == BULK_FRAME_BEGIN || data[0] == BULK_FRAME_DATA);
+}
+
+// Copia la trama para bulkTask; con el anillo lleno se descarta (el ACK
+// selectivo la pedirá de nuevo)
+inline bool bulkPush(uint8_t link, bool authenticated, const uint8_t* data, size_t length) {
+  BulkRxFrame* frame = length <= ATT_MAX_PAYLOAD ? bulkRxRing.reserve() : nullptr;
+  if (!frame) {
+    metricsCount(MET_CMD_DROPPED);
+    return false;
+  }
+  frame->link = link;
+  frame->authenticated = authenticated;
+  frame->length = length;
+  memcpy(frame->data, data, length);
+  bulkRxRing.commit();
+  xTaskNotifyGive(bulkTaskHandle);
+  return true;
+}
+
+// ==================== ESCRITOR ====================
+// Un trabajo: bloque con CRC correcto al sector que le toca, o relectura
+// completa de la imagen
+inline bool bulkWriteBlock(const BulkBuffer* buffer) {
+  const uint8_t* trailer = buffer->data + buffer->length;
+  uint32_t expected = ((uint32_t)trailer[0] << 24) | ((uint32_t)trailer[1] << 16) | (trailer[2] << 8) | trailer[3];
+  if (crc32Update(0, buffer->data, buffer->length) != expected) return false;
+  
+  uint32_t offset = (uint32_t)buffer->block * BULK_BLOCK_SIZE;
+  return esp_partition_erase_range(bulkPartition, offset, BULK_BLOCK_SIZE) == ESP_OK &&
+         esp_partition_write(bulkPartition, offset, buffer->data, buffer->length) == ESP_OK;
+}
+
+inline bool bulkVerifyImage(uint32_t size, uint32_t id) {
+  uint8_t chunk[BULK_VERIFY_CHUNK];
+  uint32_t crc = 0;
+  for (uint32_t offset = 0; offset < size; offset += sizeof(chunk)) {
+    size_t length = min(size - offset, (uint32_t)sizeof(chunk));
+    if (esp_partition_read(bulkPartition, offset, chunk, length) != ESP_OK) return false;
+    crc = crc32Update(crc, chunk, length);
+  }
+  return crc == id;
+}
+
+inline void bulkWriterRun() {
+  while (BulkJob* job = bulkJobs.front()) {
+    BulkResult* result = bulkResults.reserve();
+    if (!result) return;  // bulkTask no ha recogido: hay tantos huecos como trabajos
+    result->type = job->type;
+    result->buffer = job->buffer;
+    result->epoch = job->epoch;
+    result->ok = job->type == BULK_JOB_WRITE ? bulkWriteBlock(&bulkBuffers[job->buffer])
+                                             : bulkVerifyImage(job->size, job->id);
+    bulkResults.commit();
+    bulkJobs.pop();
+    xTaskNotifyGive(bulkTaskHandle);
+  }
+}
+
+inline void bulkWriterTask(void* param) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    bulkWriterRun();
+  }
+}
+
+// ==================== SESIÓN (bulkTask) ====================
+inline void bulkSendAck(uint8_t link, uint8_t status, uint16_t block, uint16_t next, uint32_t bits) {
+  if (link == BULK_NO_LINK || !bulkSink) return;
+  BulkAck ack = {status, block, next, bits};
+  uint8_t frame[1 + BulkAck::SIZE];
+  bulkSink(link, frame, bulkEncode(BULK_FRAME_ACK, ack, ByteSpan(frame, sizeof(frame))));
+}
+
+// ACK del bloque en recepción: next y los 32 chunks siguientes
+inline void bulkAckProgress(uint8_t status) {
+  BulkSession& s = bulkSession;
+  s.ackPending = false;
+  if (s.rxBuffer == BULK_NO_BUFFER) {
+    bulkSendAck(s.owner, status, s.rxBlock, 0, 0);
+    return;
+  }
+  const BulkBuffer& buffer = bulkBuffers[s.rxBuffer];
+  uint32_t bits = 0;
+  for (uint8_t i = 0; i < 32 && buffer.next + 1 + i < buffer.chunks; i++) {
+    if (bulkMapGet(buffer.map, buffer.next + 1 + i)) bits |= 1UL << i;
+  }
+  bulkSendAck(s.owner, status, s.rxBlock, buffer.next, bits);
+}
+
+// Búfer libre para rxBlock; BULK_NO_BUFFER si los dos están en el escritor
+inline void bulkStartBlock() {
+  BulkSession& s = bulkSession;
+  s.rxBuffer = BULK_NO_BUFFER;
+  if (s.rxBlock >= s.blocks) return;
+  for (uint8_t i = 0; i < BULK_BUFFERS; i++) {
+    if (bulkBufferBusy[i]) continue;
+    BulkBuffer& buffer = bulkBuffers[i];
+    buffer.block = s.rxBlock;
+    buffer.length = bulkBlockLength(s.size, s.rxBlock);
+    buffer.chunks = bulkChunks(buffer.length, s.chunk);
+    buffer.received = 0;
+    buffer.next = 0;
+    memset(buffer.map, 0, sizeof(buffer.map));
+    bulkBufferBusy[i] = true;
+    s.rxBuffer = i;
+    s.gapNext = UINT16_MAX;
+    return;
+  }
+}
+
+inline void bulkQueueJob(uint8_t type, uint8_t buffer) {
+  BulkJob job = {type, buffer, bulkSession.epoch, bulkSession.size, bulkSession.id};
+  bulkJobs.push(job);  // Cabe: BULK_BUFFERS escrituras más una relectura
+  xTaskNotifyGive(bulkWriterHandle);
+}
+
+inline void bulkOnBegin(const BulkRxFrame& frame) {
+  BulkSession& s = bulkSession;
+  BulkBegin begin;
+  bool valid = decodeFrom(ConstByteSpan(frame.data + 1, frame.length - 1), begin);
+  if (!valid || !frame.authenticated || !bulkPartition || begin.size == 0 || begin.size > bulkPartition->size ||
+      begin.chunk < BULK_CHUNK_MIN || begin.chunk > BULK_CHUNK_MAX) {
+    bulkSendAck(frame.link, BULK_REJECTED, 0, 0, 0);
+    bulkLog("Bulk transfer rejected");
+    return;
+  }
+  
+  char msg[80];
+  if (s.active && s.id == begin.id && s.size == begin.size && s.kind == begin.kind) {
+    s.owner = frame.link;
+    if (s.done) {
+      bulkSendAck(s.owner, BULK_DONE, s.blocks, 0, 0);
+      return;
+    }
+    // Otro MTU, otros chunks: solo se pierde lo recibido del bloque en curso
+    if (s.chunk != begin.chunk) {
+      s.chunk = begin.chunk;
+      if (s.rxBuffer != BULK_NO_BUFFER) bulkBufferBusy[s.rxBuffer] = false;
+      bulkStartBlock();
+    }
+    snprintf(msg, sizeof(msg), "Bulk transfer resumed at block %u/%u", s.rxBlock, s.blocks);
+    bulkLog(msg);
+    bulkAckProgress(BULK_OK);
+    return;
+  }
+  
+  // Sesión nueva: los búferes en el escritor vuelven con la época anterior.
+  // La partición se va a sobrescribir desde el bloque 0: la imagen anterior
+  // deja de estar disponible antes de aceptar el primer chunk.
+  if (s.rxBuffer != BULK_NO_BUFFER) bulkBufferBusy[s.rxBuffer] = false;
+  bulkStaged.size = 0;
+  s.active = true;
+  s.done = false;
+  s.owner = frame.link;
+  s.epoch++;
+  s.kind = begin.kind;
+  s.id = begin.id;
+  s.size = begin.size;
+  s.chunk = begin.chunk;
+  s.blocks = bulkBlocks(begin.size);
+  s.rxBlock = 0;
+  s.written = 0;
+  s.dropped = false;
+  s.startedAt = millis();
+  bulkStartBlock();
+  snprintf(msg, sizeof(msg), "Bulk transfer started: kind %u, %lu bytes, chunk %u", begin.kind,
+           (unsigned long)begin.size, begin.chunk);
+  bulkLog(msg);
+  bulkAckProgress(BULK_OK);
+}
+
+inline void bulkOnData(const BulkRxFrame& frame) {
+  BulkSession& s = bulkSession;
+  if (!s.active || s.done || frame.link != s.owner || !frame.authenticated || frame.length < BULK_DATA_HEADER) return;
+  uint16_t block = (frame.data[1] << 8) | frame.data[2];
+  uint16_t index = (frame.data[3] << 8) | frame.data[4];
+  
+  // Bloque ya completo: el ACK que lo cerraba se perdió
+  if (block < s.rxBlock) {
+    bulkSendAck(s.owner, BULK_OK, block, bulkChunks(bulkBlockLength(s.size, block), s.chunk), 0);
+    return;
+  }
+  if (block > s.rxBlock || s.rxBuffer == BULK_NO_BUFFER) {
+    s.dropped = true;
+    return;
+  }
+  
+  BulkBuffer& buffer = bulkBuffers[s.rxBuffer];
+  uint16_t length = frame.length - BULK_DATA_HEADER;
+  if (index >= buffer.chunks || length != bulkChunkLength(buffer.length, s.chunk, index)) return;
+  s.ackPending = true;
+  if (bulkMapGet(buffer.map, index)) return;  // Repetido
+  
+  memcpy(buffer.data + (uint32_t)index * s.chunk, frame.data + BULK_DATA_HEADER, length);
+  bulkMapSet(buffer.map, index);
+  buffer.received++;
+  while (buffer.next < buffer.chunks && bulkMapGet(buffer.map, buffer.next)) buffer.next++;
+  
+  if (buffer.received == buffer.chunks) {
+    bulkQueueJob(BULK_JOB_WRITE, s.rxBuffer);
+    s.ackPending = false;
+    bulkSendAck(s.owner, BULK_OK, block, buffer.chunks, 0);
+    s.rxBlock++;
+    bulkStartBlock();
+  } else if (index > buffer.next && s.gapNext != buffer.next) {
+    s.gapNext = buffer.next;  // Hueco: el master lo repite sin esperar al timeout
+    bulkAckProgress(BULK_OK);
+  }
+}
+
+inline void bulkOnResult(const BulkResult& result) {
+  BulkSession& s = bulkSession;
+  char msg[80];
+  if (result.type == BULK_JOB_WRITE) bulkBufferBusy[result.buffer] = false;
+  if (result.epoch != s.epoch || !s.active) return;
+  
+  if (result.type == BULK_JOB_VERIFY) {
+    if (result.ok) {
+      s.done = true;
+      bulkStaged.kind = s.kind;
+      bulkStaged.id = s.id;
+      bulkStaged.size = s.size;
+      snprintf(msg, sizeof(msg), "Bulk transfer complete: kind %u, %lu bytes in %lu ms", s.kind,
+               (unsigned long)s.size, (unsigned long)(millis() - s.startedAt));
+    } else {
+      s.active = false;
+      bulkStaged.size = 0;  // La partición no contiene ninguna imagen válida
+      snprintf(msg, sizeof(msg), "Bulk image CRC mismatch, transfer failed");
+    }
+    bulkLog(msg);
+    bulkSendAck(s.owner, result.ok ? BULK_DONE : BULK_FAILED, s.blocks, 0, 0);
+    return;
+  }
+  
+  uint16_t block = bulkBuffers[result.buffer].block;
+  if (result.ok) {
+    if (block == s.written && ++s.written == s.blocks) bulkQueueJob(BULK_JOB_VERIFY, 0);
+  } else if (block >= s.written && block < s.rxBlock) {
+    // CRC o flash: se vuelve a pedir desde ese bloque
+    snprintf(msg, sizeof(msg), "Bulk block %u failed, resending", block);
+    bulkLog(msg);
+    if (s.rxBuffer != BULK_NO_BUFFER) bulkBufferBusy[s.rxBuffer] = false;
+    s.rxBlock = block;
+    bulkStartBlock();
+    s.dropped = true;
+  }
+  
+  if (s.rxBuffer == BULK_NO_BUFFER) bulkStartBlock();
+  if (s.dropped && s.rxBuffer != BULK_NO_BUFFER) {
+    s.dropped = false;
+    bulkAckProgress(BULK_RESEND);
+  }
+}
+
+// Vacía los resultados del escritor y las tramas recibidas; un ACK por
+// tanda salvo huecos y bloques completos, que se confirman en el momento
+inline void bulkProcess() {
+  while (BulkResult* result = bulkResults.front()) {
+    bulkOnResult(*result);
+    bulkResults.pop();
+  }
+  while (BulkRxFrame* frame = bulkRxRing.front()) {
+    if (frame->data[0] == BULK_FRAME_BEGIN) bulkOnBegin(*frame);
+    else bulkOnData(*frame);
+    bulkRxRing.pop();
+  }
+  if (bulkSession.ackPending) bulkAckProgress(BULK_OK);
+}
+
+inline void bulkTask(void* param) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    bulkProcess();
+  }
+}
+
+// ==================== ARRANQUE ====================
+// Partición de staging y tareas. Sin partición bulkTask sigue respondiendo,
+// con BULK_REJECTED a todo BEGIN.
+inline void bulkBegin(const char* tag, BulkSink sink) {
+  bulkTag = tag;
+  bulkSink = sink;
+  bulkSession.owner = BULK_NO_LINK;
+  bulkSession.rxBuffer = BULK_NO_BUFFER;
+  xTaskCreatePinnedToCore(bulkTask, "bulkTask", BULK_TASK_STACK, nullptr, BULK_TASK_PRIORITY,
+                          &bulkTaskHandle, CMD_TASK_CORE);
+  bulkPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, BULK_PARTITION_LABEL);
+  if (!bulkPartition) {
+    bulkLog("No staging partition, bulk transfer disabled");
+    return;
+  }
+  xTaskCreatePinnedToCore(bulkWriterTask, "bulkWriter", BULK_TASK_STACK, nullptr, BULK_WRITER_PRIORITY,
+                          &bulkWriterHandle, CMD_TASK_CORE);
+  
+  char message[64];
+  snprintf(message, sizeof(message), "Bulk staging partition %u KiB", (unsigned)(bulkPartition->size / 1024));
+  bulkLog(message);
+}
+
+#endif // BULK_RECEIVER_H
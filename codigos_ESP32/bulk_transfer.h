@@ -0,0 +1,137 @@
+/*
+ * Transferencia masiva por CMD/STATE (master -> P1, P2)
+ *
+ * Blobs de configuración, horarios de uso o imágenes de firmware, del tamaño
+ * que admita la partición de staging del periférico (bulk_receiver.h). La
+ * imagen se parte en bloques de BULK_BLOCK_SIZE (un sector de flash); en el
+ * cable cada bloque lleva detrás su CRC-32 (big-endian) y se trocea en
+ * chunks iguales, los que caben en una escritura sin respuesta con el MTU
+ * del enlace:
+ *
+ *   CMD:   [0xB0] [kind] [id:4] [size:4] [chunk:2]        BEGIN (abre o reanuda)
+ *          [0xB2] [block:2] [index:2] [bytes...]          DATA (Write Command)
+ *   STATE: [0xB1] [status] [block:2] [next:2] [bits:4]    ACK
+ *
+ * id es el CRC-32 de la imagen completa: identifica la sesión al reanudar y
+ * el periférico lo comprueba al final releyendo la flash.
+ *
+ * El ACK es selectivo sobre el bloque en curso: next es el primer chunk que
+ * falta y el bit i de bits, el chunk next + 1 + i ya recibido; next igual
+ * al número de chunks del bloque lo da por completo. La capa de enlace
+ * entrega en orden, así que un hueco por debajo del último chunk confirmado
+ * es un descarte en el periférico y se reenvía sin esperar al timeout.
+ *
+ * Tras una desconexión, BEGIN con el mismo id y tamaño reanuda: el ACK de
+ * respuesta dice en qué bloque sigue la sesión y qué chunks de él ya están,
+ * de modo que solo se repite lo que iba en vuelo.
+ */
+
+#ifndef BULK_TRANSFER_H
+#define BULK_TRANSFER_H
+
+#include <Arduino.h>
+#include "att_mtu.h"
+#include "ble_protocol.h"
+
+#define BULK_FRAME_BEGIN      0xB0
+#define BULK_FRAME_ACK        0xB1
+#define BULK_FRAME_DATA       0xB2
+#define BULK_BLOCK_SIZE       4096  // Sector de flash: se borra y escribe entero
+#define BULK_CRC_LEN          4
+#define BULK_DATA_HEADER      5     // Tipo + bloque + índice
+#define BULK_WINDOW           24    // Chunks sin confirmar por sesión (máx. 32, los bits del ACK)
+#define BULK_ACK_TIMEOUT_MS   300   // Sin ACK en este tiempo: se reenvía lo no confirmado
+
+// Chunk más pequeño (MTU por defecto) y, con él, el máximo de chunks de un bloque
+#define BULK_CHUNK_MIN        (ATT_MTU_DEFAULT - ATT_HEADER_LEN - BULK_DATA_HEADER)
+#define BULK_CHUNK_MAX        (ATT_MAX_PAYLOAD - BULK_DATA_HEADER)
+#define BULK_MAX_CHUNKS       ((BULK_BLOCK_SIZE + BULK_CRC_LEN + BULK_CHUNK_MIN - 1) / BULK_CHUNK_MIN)
+#define BULK_CHUNK_MAP        ((BULK_MAX_CHUNKS + 7) / 8)
+
+enum BulkKind : uint8_t {
+  BULK_KIND_CONFIG   = 0x01,
+  BULK_KIND_SCHEDULE = 0x02,
+  BULK_KIND_FIRMWARE = 0x03
+};
+
+enum BulkStatus : uint8_t {
+  BULK_OK,          // Progreso del bloque en curso
+  BULK_RESEND,      // El periférico descartó chunks: reenviar todo lo no confirmado
+  BULK_DONE,        // Imagen escrita y verificada (block = número de bloques)
+  BULK_REJECTED,    // BEGIN no aceptado: sin sesión, sin partición o tamaño fuera de rango
+  BULK_FAILED       // La imagen releída no coincide con id
+};
+
+// ==================== MENSAJES ====================
+struct BulkBegin {
+  enum : uint8_t { SIZE = 11 };
+  uint8_t kind;
+  uint32_t id;                  // CRC-32 de la imagen
+  uint32_t size;
+  uint16_t chunk;               // Bytes de bloque + CRC por chunk
+  void write(ByteWriter& w) const { w.put8(kind); w.put32(id); w.put32(size); w.put16(chunk); }
+  void read(ByteReader& r) { kind = r.get8(); id = r.get32(); size = r.get32(); chunk = r.get16(); }
+};
+
+struct BulkAck {
+  enum : uint8_t { SIZE = 9 };
+  uint8_t status;
+  uint16_t block;
+  uint16_t next;
+  uint32_t bits;
+  void write(ByteWriter& w) const { w.put8(status); w.put16(block); w.put16(next); w.put32(bits); }
+  void read(ByteReader& r) { status = r.get8(); block = r.get16(); next = r.get16(); bits = r.get32(); }
+};
+
+// Trama [tipo][mensaje]; 0 si no cabe
+template <typename T>
+inline size_t bulkEncode(uint8_t type, const T& msg, ByteSpan out) {
+  if (out.size < 1 + T::SIZE) return 0;
+  out.data[0] = type;
+  return 1 + encodeInto(msg, ByteSpan(out.data + 1, out.size - 1));
+}
+
+// ==================== GEOMETRÍA ====================
+inline uint16_t bulkBlocks(uint32_t size) {
+  return (size + BULK_BLOCK_SIZE - 1) / BULK_BLOCK_SIZE;
+}
+
+// Bytes de imagen del bloque: todos menos, quizá, en el último
+inline uint16_t bulkBlockLength(uint32_t size, uint16_t block) {
+  return min(size - (uint32_t)block * BULK_BLOCK_SIZE, (uint32_t)BULK_BLOCK_SIZE);
+}
+
+// Chunks del bloque en el cable (datos + CRC)
+inline uint16_t bulkChunks(uint16_t blockLength, uint16_t chunk) {
+  return (blockLength + BULK_CRC_LEN + chunk - 1) / chunk;
+}
+
+inline uint16_t bulkChunkLength(uint16_t blockLength, uint16_t chunk, uint16_t index) {
+  return min((uint32_t)chunk, (uint32_t)blockLength + BULK_CRC_LEN - (uint32_t)index * chunk);
+}
+
+inline bool bulkMapGet(const uint8_t* map, uint16_t i) {
+  return map[i >> 3] & (1 << (i & 7));
+}
+
+inline void bulkMapSet(uint8_t* map, uint16_t i) {
+  map[i >> 3] |= 1 << (i & 7);
+}
+
+// ==================== CRC-32 ====================
+// CRC-32 IEEE (el de zlib), por nibbles como crc16Ccitt() de ble_log.h.
+// Encadenable: crc32Update(crc32Update(0, a), b) = CRC de a + b.
+inline uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+  static const uint32_t NIBBLE_TABLE[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = (crc >> 4) ^ NIBBLE_TABLE[(crc ^ data[i]) & 0x0F];
+    crc = (crc >> 4) ^ NIBBLE_TABLE[(crc ^ (data[i] >> 4)) & 0x0F];
+  }
+  return ~crc;
+}
+
+#endif // BULK_TRANSFER_H
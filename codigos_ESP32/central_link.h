@@ -0,0 +1,151 @@
+/*
+ * Conexiones simultáneas de los periféricos (P1, P2)
+ *
+ * Cada periférico atiende hasta CENTRAL_MAX_LINKS centrales a la vez y
+ * sigue anunciándose mientras quede hueco. Cada conexión tiene su
+ * CentralLink en una tabla fija, y el índice en la tabla es su identidad
+ * dentro del firmware:
+ *
+ *   connId, peer, mtu, interval    tarea BLE (callbacks y eventos GATTS/GAP)
+ *   subscriptions                  CCCD de STATE y DIAG de esa conexión
+ *   limiter                        cubetas de rate_limit.h (tarea BLE)
+ *   session                        estado del firmware por central (cmdTask)
+ *
+ * La tarea BLE abre y cierra enlaces y solo marca reset; cmdTask lo aplica
+ * con applyResets() antes de la siguiente trama o evento, así cada sesión
+ * sigue teniendo un único escritor. Las tramas llegan a cmdTask con el
+ * índice del enlace como origen (cmdQueuePush()), la respuesta vuelve solo
+ * a ese enlace y lo periódico se reparte con notify() entre los enlaces
+ * cuya CCCD está activa.
+ *
+ * notify() envía a una única conexión con esp_ble_gatts_send_indicate():
+ * BLECharacteristic::notify() recorre todas y consulta un BLE2902 que
+ * comparten todos los centrales. Usar solo como global (atómicos a cero).
+ */
+
+#ifndef CENTRAL_LINK_H
+#define CENTRAL_LINK_H
+
+#include <Arduino.h>
+#include <esp_gatts_api.h>
+#include <atomic>
+#include "att_mtu.h"
+#include "ble_metrics.h"
+#include "cmd_queue.h"
+#include "conn_params.h"
+#include "rate_limit.h"
+
+#define CENTRAL_MAX_LINKS   3       // CONFIG_BTDM_CTRL_BLE_MAX_CONN del core de Arduino
+#define CENTRAL_NONE        0xFF    // Índice de enlace inválido
+#define CENTRAL_SUB_STATE   0x01    // CCCD de STATE activa
+#define CENTRAL_SUB_DIAG    0x02    // CCCD de DIAG activa
+#define CENTRAL_CCCD_ENABLE 0x03    // Bits de notificación e indicación de la CCCD
+
+static_assert(CENTRAL_MAX_LINKS <= CMD_ORIGIN_MAX, "Every link needs its own command origin");
+
+template <typename Session>
+struct CentralLink {
+  std::atomic<bool> active;             // Conexión abierta en este hueco
+  std::atomic<bool> reset;              // Abierto o cerrado desde el último applyResets()
+  std::atomic<uint16_t> connId;
+  std::atomic<uint8_t> subscriptions;   // CENTRAL_SUB_*
+  volatile uint16_t mtu;                // MTU negociado por este central
+  volatile uint16_t interval;           // x 1.25 ms
+  volatile uint16_t latency;            // Slave latency aplicada por el central
+  esp_bd_addr_t peer;
+  RateLimiter limiter;
+  Session session;
+};
+
+template <typename Session>
+struct CentralTable {
+  CentralLink<Session> links[CENTRAL_MAX_LINKS];
+
+  // ==================== TAREA BLE ====================
+  // Hueco para una conexión nueva; CENTRAL_NONE si la tabla está llena
+  uint8_t open(uint16_t connId, const uint8_t* peer, uint32_t now) {
+    for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+      CentralLink<Session>& link = links[i];
+      if (link.active.load(std::memory_order_relaxed)) continue;
+      link.connId.store(connId, std::memory_order_relaxed);
+      link.subscriptions.store(0, std::memory_order_relaxed);
+      link.mtu = ATT_MTU_DEFAULT;
+      link.interval = CONN_PROFILES[LINK_PROFILE_BALANCED].minInterval;
+      link.latency = 0;
+      memcpy(link.peer, peer, sizeof(link.peer));
+      rateReset(&link.limiter, now);
+      link.reset.store(true, std::memory_order_relaxed);
+      link.active.store(true, std::memory_order_release);
+      return i;
+    }
+    return CENTRAL_NONE;
+  }
+
+  uint8_t close(uint16_t connId) {
+    uint8_t i = find(connId);
+    if (i == CENTRAL_NONE) return i;
+    links[i].active.store(false, std::memory_order_relaxed);
+    links[i].subscriptions.store(0, std::memory_order_relaxed);
+    links[i].reset.store(true, std::memory_order_release);
+    return i;
+  }
+
+  uint8_t find(uint16_t connId) const {
+    for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+      if (isOpen(i) && links[i].connId.load(std::memory_order_relaxed) == connId) return i;
+    }
+    return CENTRAL_NONE;
+  }
+
+  // Eventos GAP: solo traen la dirección del central
+  uint8_t findPeer(const uint8_t* peer) const {
+    for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+      if (isOpen(i) && memcmp(links[i].peer, peer, sizeof(links[i].peer)) == 0) return i;
+    }
+    return CENTRAL_NONE;
+  }
+
+  // Escritura en una CCCD (ESP_GATTS_WRITE_EVT) de la conexión connId
+  void subscribe(uint16_t connId, uint8_t subscription, const uint8_t* value, uint16_t length) {
+    uint8_t i = find(connId);
+    if (i == CENTRAL_NONE || length != 2) return;
+    if (value[0] & CENTRAL_CCCD_ENABLE) links[i].subscriptions.fetch_or(subscription, std::memory_order_relaxed);
+    else links[i].subscriptions.fetch_and(~subscription, std::memory_order_relaxed);
+  }
+
+  uint8_t count() const {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) n += isOpen(i);
+    return n;
+  }
+
+  // ==================== CONSULTA (cualquier tarea) ====================
+  bool isOpen(uint8_t i) const {
+    return i < CENTRAL_MAX_LINKS && links[i].active.load(std::memory_order_acquire);
+  }
+
+  bool subscribed(uint8_t i, uint8_t subscription) const {
+    return isOpen(i) && (links[i].subscriptions.load(std::memory_order_relaxed) & subscription);
+  }
+
+  // ==================== cmdTask ====================
+  // Llama a clear(i) por cada enlace abierto o cerrado desde la última vez
+  void applyResets(void (*clear)(uint8_t link)) {
+    for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+      if (links[i].reset.exchange(false, std::memory_order_acquire)) clear(i);
+    }
+  }
+
+  // Notificación de una característica solo al enlace i, si tiene la CCCD
+  // activa; alimenta MET_NOTIFY_SENT / MET_NOTIFY_FAIL
+  bool notify(uint8_t i, uint8_t subscription, uint16_t gattsIf, uint16_t handle,
+              const uint8_t* frame, size_t length) {
+    if (!subscribed(i, subscription)) return false;
+    esp_err_t err = esp_ble_gatts_send_indicate(gattsIf, links[i].connId.load(std::memory_order_relaxed), handle,
+                                                min(length, attPayload(links[i].mtu)), (uint8_t*)frame, false);
+    metricsCount(err == ESP_OK ? MET_NOTIFY_SENT : MET_NOTIFY_FAIL);
+    return err == ESP_OK;
+  }
+};
+
+#endif // CENTRAL_LINK_H
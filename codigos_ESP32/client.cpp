@@ -9,165 +9,280 @@
  * 
  * Características GATT:
  * - cmd (UUID: 0x2A57): Write - Recibe comandos del central
- * - state (UUID: 0x2A58): Notify - Envía estado al central
+ * - state (UUID: 0x2A58): Read/Notify - Envía estado al central; leerla
+ *   devuelve lo mismo que GET_STATUS sin pasar por la cola (seqlock.h)
+ * - diag: Read/Notify - Instantánea de métricas (ble_metrics.h)
+ *
+ * Telemetría bajo demanda (GET_TELEMETRY) o, si el central se suscribe,
+ * solo los cambios en cada tick (telemetry_frame.h).
+ *
+ * Las escrituras de CMD pasan por un token bucket por clase antes de
+ * encolarse: un flood de opcodes inválidos se descarta en la tarea BLE y
+ * sus errores 0xFF salen agrupados, con la cuenta en el último byte
+ * (rate_limit.h).
+ *
+ * Hasta CENTRAL_MAX_LINKS centrales a la vez, cada uno con su MTU, su
+ * suscripción de telemetría y sus cubetas (central_link.h). El advertising
+ * sigue activo mientras quede hueco; las respuestas van solo al central
+ * que escribió el comando y la telemetría y el diagnóstico solo a los que
+ * tienen la CCCD activa.
+ *
+ * Sin loop(): telemetría y diagnóstico son temporizadores esp_timer que
+ * cmdTask atiende como eventos, y el advertising se relanza desde los
+ * callbacks de conexión (light sleep entre eventos, power_save.h).
+ *
+ * Servidor GATT, centrales, limitador y diagnóstico son el periférico
+ * genérico Peripheral<P1Device> (peripheral.h); aquí quedan el estado, las
+ * acciones y la tabla de comandos. UUIDs y formato de trama vienen de
+ * P1Profile (device_profile.h), el mismo tipo que usa el master.
  */
 
 #include <Arduino.h>
 #include <BLEDevice.h>
 #include <BLEUtils.h>
-#include <BLEServer.h>
-#include <BLE2902.h>
+#include "att_mtu.h"
+#include "ble_log.h"
+#include "ble_metrics.h"
+#include "ble_protocol.h"
+#include "cmd_dispatch.h"
+#include "cmd_queue.h"
+#include "device_profile.h"
+#include "peripheral.h"
+#include "power_save.h"
+#include "seqlock.h"
 
 // ==================== CONFIGURACIÓN ====================
-// UUIDs del servicio y características (deben coincidir con el central)
-#define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
-#define CMD_CHAR_UUID       "beb5483e-36e1-4688-b7f5-ea07361b26a8"
-#define STATE_CHAR_UUID     "beb5483f-36e1-4688-b7f5-ea07361b26a8"
-
-// Configuración del dispositivo
-#define DEVICE_NAME "ESP32_P1"
+// Nombre y UUIDs en P1Profile (device_profile.h), compartido con el master
+#define LOG_TAG "PERIPH"  // Prefijo de los logs
 #define LED_PIN 2  // LED integrado para indicación visual
+#define DIAG_INTERVAL_MS 10000  // Periodo de la notificación de diagnóstico
 
 // ==================== VARIABLES GLOBALES ====================
-BLEServer* pServer = nullptr;
-BLECharacteristic* pCmdCharacteristic = nullptr;
-BLECharacteristic* pStateCharacteristic = nullptr;
-bool deviceConnected = false;
-bool oldDeviceConnected = false;
-
-// Estado del dispositivo IoT simulado
+// Estado del dispositivo IoT simulado. Solo lo modifica cmdTask; el resto
+// de tareas lee la copia publicada en statePublished (seqlock.h).
 struct DeviceState {
-  uint8_t mode;           // 0=Normal, 1=Eco, 2=Turbo
-  uint8_t brightness;     // 0-255
-  uint16_t timer;         // Segundos
-  uint32_t uptime;        // Tiempo encendido
-  uint16_t cmdCounter;    // Contador de comandos recibidos
+  // Telemetría y contadores, cambian en cada tick o comando
   int16_t temperature;    // Temperatura simulada (°C * 10)
   uint16_t humidity;      // Humedad simulada (% * 10)
+  uint32_t uptime;        // Tiempo encendido
+  uint16_t cmdCounter;    // Contador de comandos recibidos
   bool ledState;          // Estado del LED
-} deviceState = {0, 100, 0, 0, 0, 250, 650, false};
+  
+  // Configuración, solo cambia con SET_*
+  uint8_t mode;           // 0=Normal, 1=Eco, 2=Turbo
+  uint8_t brightness;     // 0-255
+  uint16_t timer;         // Segundos
+} deviceState = {250, 650, 0, 0, false, 0, 100, 0};
+
+Seqlock<DeviceState> statePublished;            // Última versión publicada por cmdTask
 
-unsigned long lastTelemetryUpdate = 0;
 const unsigned long TELEMETRY_INTERVAL = 5000; // Actualizar telemetría cada 5s
 
+// Lo que cada central conectado tiene propio (cmdTask)
+struct CentralSession {
+  TelemetryStream telemetry;  // Suscripción a cambios de ese central
+};
+
+// Lo propio de P1 sobre el periférico genérico (peripheral.h)
+struct P1Device : P1Profile {
+  typedef CentralSession Session;
+  struct Commands;                             // Tabla de comandos, tras las acciones
+  static constexpr const char* TAG = LOG_TAG;
+  
+  static void linkOpened(uint8_t count);
+  static void linkClosed(uint8_t count);
+  static bool writeAuthenticated(uint8_t link) { return true; }  // Sin sesión en P1
+  static void clearLink(uint8_t link);
+  static void handleCommand(uint8_t* data, size_t length);
+  static void statePublish();
+};
+
+Peripheral<P1Device> peripheral;               // Servidor GATT y centrales conectados
+
+// Eventos de cmdTask (cmd_queue.h), publicados por los temporizadores
+enum PeripheralEvent : uint8_t {
+  EVT_TELEMETRY,          // Cada TELEMETRY_INTERVAL, siempre
+  EVT_DIAG                // Cada DIAG_INTERVAL_MS con un central conectado
+};
+
+esp_timer_handle_t telemetryTimer = nullptr;
+esp_timer_handle_t diagTimer = nullptr;
+
 // ==================== LOGGING ====================
 void logEvent(const char* category, const char* message) {
-  unsigned long timestamp = millis();
-  Serial.printf("[%08lu] [PERIPH-%s] %s\n", timestamp, category, message);
+  logSegments(LOG_TAG, category, &message, 1);
 }
 
 void logCommand(const char* action, uint8_t* data, size_t length) {
-  char hexStr[64] = "";
-  char temp[8];
-  for (size_t i = 0; i < length; i++) {
-    sprintf(temp, "%02X ", data[i]);
-    strcat(hexStr, temp);
-  }
-  
-  char logMsg[128];
-  sprintf(logMsg, "%s: [%s]", action, hexStr);
-  logEvent("CMD", logMsg);
+  logHex(LOG_TAG, "CMD", action, data, length);
 }
 
-// ==================== CALLBACKS ====================
-// Callback para conexión/desconexión del servidor
-class ServerCallbacks : public BLEServerCallbacks {
-  void onConnect(BLEServer* pServer) {
-    deviceConnected = true;
-    logEvent("BLE", "Central connected");
-    digitalWrite(LED_PIN, HIGH);
-  }
+// ==================== CONEXIONES ====================
+// Tarea BLE, tras abrir o cerrar un enlace: LED y diagnóstico activos
+// mientras quede algún central
+void P1Device::linkOpened(uint8_t count) {
+  digitalWrite(LED_PIN, HIGH);
+  if (count == 1) cmdTimerStart(diagTimer, DIAG_INTERVAL_MS);
+}
 
-  void onDisconnect(BLEServer* pServer) {
-    deviceConnected = false;
-    logEvent("BLE", "Central disconnected");
+void P1Device::linkClosed(uint8_t count) {
+  if (count == 0) {
+    cmdTimerStop(diagTimer);
     digitalWrite(LED_PIN, LOW);
   }
-};
+}
 
 // ==================== PROCESAMIENTO DE COMANDOS ====================
 void sendStateNotification(uint8_t stateType, uint8_t value1, uint8_t value2 = 0, uint8_t value3 = 0) {
-  if (!deviceConnected) return;
-  
   uint8_t stateData[4] = {stateType, value1, value2, value3};
-  pStateCharacteristic->setValue(stateData, 4);
-  pStateCharacteristic->notify();
-  
+  peripheral.sendStateFrame(stateData, 4);
+}
+
+// Temperatura y humedad para txLink en una sola notificación empaquetada o,
+// con suscripción (subscribed), solo lo que ha cambiado desde su última confirmada
+void sendTelemetrySnapshot(bool subscribed = false) {
+  CentralLink<CentralSession>& link = peripheral.link();
+  p1::telemetry::Temperature temperature = {deviceState.temperature};
+  p1::telemetry::Humidity humidity = {deviceState.humidity};
+  TelemetryField fields[] = {telemetryField(temperature), telemetryField(humidity)};
+  if (subscribed) {
+    telemStreamSend(&link.session.telemetry, P1Profile::fieldLayouts(), fields, 2, attPayload(link.mtu),
+                    peripheral.sendStateFrame);
+  } else {
+    telemetrySendPacked(fields, 2, attPayload(link.mtu), peripheral.sendStateFrame);
+  }
+}
+
+// Acciones: el mensaje llega decodificado y con la longitud ya validada
+bool onSetMode(const p1::SetMode& msg) {
+  if (msg.value > 2) return false;
+  deviceState.mode = msg.value;
+  const char* modes[] = {"NORMAL", "ECO", "TURBO"};
+  char logMsg[64];
+  sprintf(logMsg, "Mode changed to %s", modes[msg.value]);
+  logEvent("STATE", logMsg);
+  return true;
+}
+
+bool onGetStatus(const p1::GetStatus& msg) {
+  logEvent("STATE", "Status requested");
+  return true;
+}
+
+bool onSetBrightness(const p1::SetBrightness& msg) {
+  deviceState.brightness = msg.value;
   char logMsg[64];
-  sprintf(logMsg, "STATE sent: [%02X %02X %02X %02X]", stateData[0], stateData[1], stateData[2], stateData[3]);
-  logEvent("TX", logMsg);
+  sprintf(logMsg, "Brightness set to %d", deviceState.brightness);
+  logEvent("STATE", logMsg);
+  return true;
 }
 
-void processCommand(uint8_t* data, size_t length) {
+bool onResetCounters(const p1::ResetCounters& msg) {
+  deviceState.cmdCounter = 0;
+  deviceState.uptime = 0;
+  logEvent("STATE", "Counters reset");
+  return true;
+}
+
+bool onGetTelemetry(const p1::GetTelemetry& msg) {
+  logEvent("STATE", "Telemetry requested");
+  // [0xA1, bitmap, tempH, tempL, humH, humL]
+  sendTelemetrySnapshot();
+  return true;
+}
+
+bool onSetTimer(const p1::SetTimer& msg) {
+  deviceState.timer = msg.value;
+  char logMsg[64];
+  sprintf(logMsg, "Timer set to %d seconds", deviceState.timer);
+  logEvent("STATE", logMsg);
+  return true;
+}
+
+// La respuesta es el keyframe que sale en cuanto hay suscripción
+bool onTelemetrySubscribe(const p1::TelemetrySubscribe& msg) {
+  TelemetryStream* stream = &peripheral.session().telemetry;
+  telemStreamSubscribe(stream, msg.keyframeEvery, msg.thresholds, sizeof(msg.thresholds));
+  char logMsg[64];
+  sprintf(logMsg, "Telemetry subscription: keyframe every %d, thresholds %d/%d",
+          msg.keyframeEvery, msg.thresholds[0], msg.thresholds[1]);
+  logEvent("STATE", logMsg);
+  if (telemStreamActive(stream)) sendTelemetrySnapshot(true);
+  return true;
+}
+
+bool onTelemetryAck(const p1::TelemetryAck& msg) {
+  telemStreamAck(&peripheral.session().telemetry, msg.value);
+  return true;
+}
+
+// Respuestas: [tipo, v1, v2, v3] con el tipo puesto por dispatch()
+size_t respMode(const uint8_t* args, ByteSpan out) {
+  p1::StateEcho echo = {deviceState.mode};
+  return encodeInto(echo, out);
+}
+
+// Estado actual: [tipo, modo, brightness, flags]
+p1::StatusReport statusReport(const DeviceState& state) {
+  p1::StatusReport report = {state.mode, state.brightness, (uint8_t)(state.ledState ? 0x01 : 0x00)};
+  return report;
+}
+
+size_t respStatus(const uint8_t* args, ByteSpan out) {
+  return encodeInto(statusReport(deviceState), out);
+}
+
+size_t respBrightness(const uint8_t* args, ByteSpan out) {
+  p1::StateEcho echo = {deviceState.brightness};
+  return encodeInto(echo, out);
+}
+
+size_t respZero(const uint8_t* args, ByteSpan out) {
+  p1::StateEcho echo = {0x00};
+  return encodeInto(echo, out);
+}
+
+size_t respTimer(const uint8_t* args, ByteSpan out) {
+  p1::StateEcho echo = {(uint8_t)deviceState.timer};
+  return encodeInto(echo, out);
+}
+
+// Trama [CMD][PARAM...]: args empieza en el byte 1 (P1Profile::ARGS_OFFSET)
+struct P1Device::Commands : CommandSet<
+  Command<p1::SetMode,            onSetMode,            respMode>,
+  Command<p1::GetStatus,          onGetStatus,          respStatus>,
+  Command<p1::SetBrightness,      onSetBrightness,      respBrightness>,
+  Command<p1::ResetCounters,      onResetCounters,      respZero>,
+  Command<p1::GetTelemetry,       onGetTelemetry,       nullptr>,  // Telemetría empaquetada
+  Command<p1::SetTimer,           onSetTimer,           respTimer>,
+  Command<p1::TelemetrySubscribe, onTelemetrySubscribe, nullptr>,  // Responde con un keyframe
+  Command<p1::TelemetryAck,       onTelemetryAck,       nullptr>   // Sin respuesta
+> {};
+
+// Trama de CMD escrita por el central txLink; la respuesta vuelve solo a él
+void P1Device::handleCommand(uint8_t* data, size_t length) {
+  uint32_t started = metricsCycles();
   if (length < 2) {
     logEvent("ERROR", "Command too short");
     return;
   }
   
   deviceState.cmdCounter++;
+  metricsCount(MET_COMMANDS);
   logCommand("Received", data, length);
   
   uint8_t cmdType = data[0];
-  uint8_t cmdParam = data[1];
-  
-  switch (cmdType) {
-    case 0x01: // SET_MODE
-      if (cmdParam <= 2) {
-        deviceState.mode = cmdParam;
-        const char* modes[] = {"NORMAL", "ECO", "TURBO"};
-        char msg[64];
-        sprintf(msg, "Mode changed to %s", modes[cmdParam]);
-        logEvent("STATE", msg);
-        
-        // Responder con confirmación
-        sendStateNotification(0x01, deviceState.mode, 0x00, 0x00);
-      }
-      break;
-      
-    case 0x02: // GET_STATUS
-      logEvent("STATE", "Status requested");
-      // Enviar estado actual: [tipo, modo, brightness, flags]
-      sendStateNotification(0x02, deviceState.mode, deviceState.brightness, deviceState.ledState ? 0x01 : 0x00);
-      break;
-      
-    case 0x03: // SET_BRIGHTNESS
-      deviceState.brightness = cmdParam;
-      char brightMsg[64];
-      sprintf(brightMsg, "Brightness set to %d", deviceState.brightness);
-      logEvent("STATE", brightMsg);
-      
-      // Confirmar nuevo brillo
-      sendStateNotification(0x03, deviceState.brightness, 0x00, 0x00);
-      break;
-      
-    case 0x04: // RESET_COUNTERS
-      deviceState.cmdCounter = 0;
-      deviceState.uptime = 0;
-      logEvent("STATE", "Counters reset");
-      sendStateNotification(0x04, 0x00, 0x00, 0x00);
-      break;
-      
-    case 0x05: // GET_TELEMETRY
-      logEvent("STATE", "Telemetry requested");
-      // Enviar temperatura (2 bytes)
-      sendStateNotification(0x05, 0x01, (deviceState.temperature >> 8) & 0xFF, deviceState.temperature & 0xFF);
-      delay(50);
-      // Enviar humedad (2 bytes)
-      sendStateNotification(0x05, 0x02, (deviceState.humidity >> 8) & 0xFF, deviceState.humidity & 0xFF);
+  RateLimiter* limiter = &peripheral.link().limiter;
+  switch (peripheral.dispatch(data, length, true)) {
+    case CMD_UNKNOWN:
+      logEvent("ERROR", "Unknown command");
+      sendStateNotification(0xFF, cmdType, 0xE0, rateErrorBatch(limiter)); // Error: comando desconocido
       break;
-      
-    case 0x06: // SET_TIMER
-      deviceState.timer = cmdParam;
-      char timerMsg[64];
-      sprintf(timerMsg, "Timer set to %d seconds", deviceState.timer);
-      logEvent("STATE", timerMsg);
-      sendStateNotification(0x06, deviceState.timer, 0x00, 0x00);
+    case CMD_TOO_SHORT:
+      logEvent("ERROR", "Command arguments too short");
+      sendStateNotification(0xFF, cmdType, 0xE2, rateErrorBatch(limiter)); // Error: argumentos insuficientes
       break;
-      
     default:
-      logEvent("ERROR", "Unknown command");
-      // Enviar error
-      sendStateNotification(0xFF, cmdType, 0xE0, 0x01); // Error: comando desconocido
       break;
   }
   
@@ -175,60 +290,93 @@ void processCommand(uint8_t* data, size_t length) {
   char counterMsg[64];
   sprintf(counterMsg, "Commands processed: %d", deviceState.cmdCounter);
   logEvent("INFO", counterMsg);
+  
+  metricsSample(cmdType, metricsCycles() - started);
 }
 
-// Callback para escritura en característica CMD
-class CmdCharacteristicCallbacks : public BLECharacteristicCallbacks {
-  void onWrite(BLECharacteristic* pCharacteristic) {
-    std::string value = pCharacteristic->getValue();
-    
-    if (value.length() > 0) {
-      uint8_t* data = (uint8_t*)value.data();
-      processCommand(data, value.length());
-    }
-  }
-};
+// ==================== ESTADO PUBLICADO ====================
+// cmdTask, al aplicar el reset de un enlace abierto o cerrado
+void P1Device::clearLink(uint8_t link) {
+  peripheral.centrals.links[link].session.telemetry.keyframeEvery = 0;  // Cada central se suscribe de nuevo
+}
+
+// Nueva versión para los lectores de otras tareas (cmdTask, tras cada cambio)
+void P1Device::statePublish() {
+  statePublished.publish(deviceState);
+}
 
 // ==================== SIMULACIÓN DE TELEMETRÍA ====================
+// Evento EVT_TELEMETRY (cmdTask)
 void updateTelemetry() {
-  unsigned long currentTime = millis();
+  // Simular cambios en telemetría basados en el modo
+  switch (deviceState.mode) {
+    case 0: // Normal
+      deviceState.temperature = 250 + random(-20, 20); // 25°C ±2°C
+      deviceState.humidity = 650 + random(-50, 50);     // 65% ±5%
+      break;
+    case 1: // Eco
+      deviceState.temperature = 220 + random(-15, 15); // 22°C ±1.5°C
+      deviceState.humidity = 700 + random(-30, 30);     // 70% ±3%
+      break;
+    case 2: // Turbo
+      deviceState.temperature = 350 + random(-30, 30); // 35°C ±3°C
+      deviceState.humidity = 550 + random(-60, 60);     // 55% ±6%
+      break;
+  }
+  
+  deviceState.uptime = millis() / 1000;
+  
+  // Toggle LED state periodically
+  deviceState.ledState = !deviceState.ledState;
   
-  if (currentTime - lastTelemetryUpdate >= TELEMETRY_INTERVAL) {
-    lastTelemetryUpdate = currentTime;
-    
-    // Simular cambios en telemetría basados en el modo
-    switch (deviceState.mode) {
-      case 0: // Normal
-        deviceState.temperature = 250 + random(-20, 20); // 25°C ±2°C
-        deviceState.humidity = 650 + random(-50, 50);     // 65% ±5%
-        break;
-      case 1: // Eco
-        deviceState.temperature = 220 + random(-15, 15); // 22°C ±1.5°C
-        deviceState.humidity = 700 + random(-30, 30);     // 70% ±3%
-        break;
-      case 2: // Turbo
-        deviceState.temperature = 350 + random(-30, 30); // 35°C ±3°C
-        deviceState.humidity = 550 + random(-60, 60);     // 55% ±6%
-        break;
-    }
-    
-    deviceState.uptime = millis() / 1000;
-    
-    // Toggle LED state periodically
-    deviceState.ledState = !deviceState.ledState;
-    
-    char telemetryMsg[128];
-    sprintf(telemetryMsg, "Telemetry update - Temp: %.1f°C, Humidity: %.1f%%, Uptime: %lus", 
-            deviceState.temperature / 10.0, 
-            deviceState.humidity / 10.0,
-            deviceState.uptime);
-    logEvent("TELEM", telemetryMsg);
+  char telemetryMsg[128];
+  sprintf(telemetryMsg, "Telemetry update - Temp: %.1f°C, Humidity: %.1f%%, Uptime: %lus", 
+          deviceState.temperature / 10.0, 
+          deviceState.humidity / 10.0,
+          deviceState.uptime);
+  logEvent("TELEM", telemetryMsg);
+}
+
+// ==================== DIAGNÓSTICO ====================
+class StateCharacteristicCallbacks : public BLECharacteristicCallbacks {
+  // Lectura de STATE (tarea BLE): la respuesta de GET_STATUS sin pasar por
+  // la cola, desde la última versión publicada
+  void onRead(BLECharacteristic* pCharacteristic) {
+    uint8_t frame[1 + p1::StatusReport::SIZE] = {p1::GetStatus::OPCODE};
+    size_t length = encodeInto(statusReport(statePublished.read()), ByteSpan(frame + 1, sizeof(frame) - 1));
+    pCharacteristic->setValue(frame, 1 + length);
+  }
+};
+
+// Cambios de telemetría a cada central con suscripción, contra su propia base
+void sendTelemetryStreams() {
+  for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+    if (!peripheral.centrals.isOpen(i) || !telemStreamActive(&peripheral.centrals.links[i].session.telemetry)) continue;
+    peripheral.txLink = i;
+    sendTelemetrySnapshot(true);
+  }
+}
+
+// ==================== EVENTOS ====================
+// Temporizadores atendidos en cmdTask, en serie con los comandos
+void handleEvent(uint8_t event) {
+  peripheral.applyResets();
+  switch (event) {
+    case EVT_TELEMETRY:
+      updateTelemetry();
+      P1Device::statePublish();
+      sendTelemetryStreams();
+      break;
+    case EVT_DIAG:
+      peripheral.sendDiagnostics();  // Instantánea para los centrales suscritos a diag
+      break;
   }
 }
 
 // ==================== SETUP ====================
 void setup() {
-  Serial.begin(115200);
+  Serial.begin(LOG_TEXT_BAUD);
+  logBegin();
   delay(1000);
   
   pinMode(LED_PIN, OUTPUT);
@@ -236,78 +384,33 @@ void setup() {
   
   Serial.println("\n\n========================================");
   Serial.println("ESP32 BLE Peripheral - IoT Sensor");
-  Serial.println("Device: " DEVICE_NAME);
+  Serial.printf("Device: %s\n", P1Device::NAME);
   Serial.println("========================================\n");
   
   logEvent("SYSTEM", "Initializing BLE...");
   
-  // Inicializar BLE
-  BLEDevice::init(DEVICE_NAME);
-  
-  // Crear servidor BLE
-  pServer = BLEDevice::createServer();
-  pServer->setCallbacks(new ServerCallbacks());
-  logEvent("BLE", "BLE Server created");
-  
-  // Crear servicio
-  BLEService* pService = pServer->createService(SERVICE_UUID);
-  logEvent("GATT", "Service created");
-  
-  // Crear característica CMD (Write)
-  pCmdCharacteristic = pService->createCharacteristic(
-    CMD_CHAR_UUID,
-    BLECharacteristic::PROPERTY_WRITE
-  );
-  pCmdCharacteristic->setCallbacks(new CmdCharacteristicCallbacks());
-  logEvent("GATT", "CMD characteristic created (Write)");
-  
-  // Crear característica STATE (Notify)
-  pStateCharacteristic = pService->createCharacteristic(
-    STATE_CHAR_UUID,
-    BLECharacteristic::PROPERTY_NOTIFY
-  );
-  pStateCharacteristic->addDescriptor(new BLE2902());
-  logEvent("GATT", "STATE characteristic created (Notify)");
-  
-  // Iniciar servicio
-  pService->start();
-  logEvent("GATT", "Service started");
-  
-  // Iniciar advertising
-  BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
-  pAdvertising->addServiceUUID(SERVICE_UUID);
-  pAdvertising->setScanResponse(true);
-  pAdvertising->setMinPreferred(0x06);
-  pAdvertising->setMinPreferred(0x12);
-  BLEDevice::startAdvertising();
+  // Worker de comandos y eventos: debe existir antes de aceptar escrituras
+  P1Device::statePublish();
+  cmdQueueBegin(peripheral.processCommand, handleEvent);
+  telemetryTimer = cmdTimerCreate(EVT_TELEMETRY, "telemetry");
+  diagTimer = cmdTimerCreate(EVT_DIAG, "diag");
+  cmdTimerStart(telemetryTimer, TELEMETRY_INTERVAL);
   
-  logEvent("BLE", "Advertising started");
+  // Servidor GATT y advertising de P1Profile; STATE también se lee
+  peripheral.begin(new StateCharacteristicCallbacks());
   logEvent("SYSTEM", "== PERIPHERAL READY - Waiting for central ==");
   
   Serial.println("\nDevice info:");
-  Serial.printf("  Name: %s\n", DEVICE_NAME);
-  Serial.printf("  Service UUID: %s\n", SERVICE_UUID);
-  Serial.printf("  CMD UUID: %s\n", CMD_CHAR_UUID);
-  Serial.printf("  STATE UUID: %s\n\n", STATE_CHAR_UUID);
+  Serial.printf("  Name: %s\n", P1Device::NAME);
+  Serial.printf("  Service UUID: %s\n", P1Device::SERVICE_UUID);
+  Serial.printf("  CMD UUID: %s\n", P1Device::CMD_UUID);
+  Serial.printf("  STATE UUID: %s\n\n", P1Device::STATE_UUID);
+  
+  powerBegin(LOG_TAG);
 }
 
 // ==================== LOOP ====================
+// Todo ocurre en callbacks BLE y cmdTask: la tarea de loop() sobra
 void loop() {
-  // Gestionar reconexión si es necesario
-  if (!deviceConnected && oldDeviceConnected) {
-    delay(500);
-    logEvent("BLE", "Restarting advertising...");
-    pServer->startAdvertising();
-    oldDeviceConnected = deviceConnected;
-  }
-  
-  // Conectado por primera vez
-  if (deviceConnected && !oldDeviceConnected) {
-    oldDeviceConnected = deviceConnected;
-  }
-  
-  // Actualizar telemetría simulada
-  updateTelemetry();
-  
-  delay(100);
+  vTaskDelete(nullptr);
 }
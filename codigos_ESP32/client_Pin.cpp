@@ -8,306 +8,677 @@
  * 
  * VULNERABILIDAD DEMOSTRADA:
  * El PIN viaja sin cifrar → Atacante puede capturarlo y reutilizarlo
+ *
+ * Un AUTH_PIN aceptado devuelve un ticket de reanudación de un solo uso:
+ * tras reconectar, el central lo presenta con SESSION_RESUME y la sesión
+ * vuelve en un único intercambio, sin repetir el PIN.
+ *
+ * Las escrituras de CMD pasan por un token bucket por clase (comando,
+ * credencial, inválida) antes de encolarse; un flood de basura se descarta
+ * en la tarea BLE y sus errores 0xFF salen agrupados (rate_limit.h).
+ *
+ * El estado solo lo escribe cmdTask; la tarea BLE consulta la sesión en
+ * la última versión publicada con seqlock (seqlock.h), sin mutex.
+ *
+ * Hasta CENTRAL_MAX_LINKS centrales a la vez, cada uno con su propia
+ * sesión (autenticación, usuario, pipeline, suscripción de telemetría) y
+ * sus cubetas (central_link.h): un PIN aceptado solo abre la conexión que
+ * lo envió. El advertising sigue activo mientras quede hueco; la
+ * telemetría va a cada central autenticado con la CCCD de STATE activa.
+ *
+ * Telemetría completa cada TELEMETRY_INTERVAL_MS o, si el central se
+ * suscribe, solo los cambios en cada tick (telemetry_frame.h).
+ *
+ * Sin loop(): telemetría y diagnóstico son temporizadores esp_timer que
+ * solo corren con algún central conectado y cmdTask atiende como eventos;
+ * el advertising se relanza desde los callbacks de conexión (power_save.h).
+ *
+ * Servidor GATT, centrales, limitador, pipeline y diagnóstico son el
+ * periférico genérico Peripheral<P2Device> (peripheral.h); aquí quedan el
+ * estado, la autenticación, las acciones y la tabla de comandos. UUIDs y
+ * formato de trama vienen de P2Profile (device_profile.h), el mismo tipo
+ * que usa el master.
  */
 
 #include <Arduino.h>
 #include <BLEDevice.h>
 #include <BLEUtils.h>
-#include <BLEServer.h>
-#include <BLE2902.h>
+#include "att_mtu.h"
+#include "ble_log.h"
+#include "ble_metrics.h"
+#include "ble_protocol.h"
+#include "cmd_dispatch.h"
+#include "cmd_queue.h"
+#include "device_profile.h"
+#include "peripheral.h"
+#include "power_save.h"
+#include "seqlock.h"
 
 // ==================== CONFIGURACIÓN ====================
-#define SERVICE_UUID        "5fafc301-2fb5-459e-8fcc-c5c9c331915c"
-#define CMD_CHAR_UUID       "ceb5483e-46e1-4688-b7f5-ea07361b27a9"
-#define STATE_CHAR_UUID     "ceb5483f-46e1-4688-b7f5-ea07361b27a9"
-
-#define DEVICE_NAME "ESP32_P2"
+// Nombre y UUIDs en P2Profile (device_profile.h), compartido con el master
+#define LOG_TAG "P2"  // Prefijo de los logs
 #define LED_PIN 2
+#define DIAG_INTERVAL_MS 10000  // Periodo de la notificación de diagnóstico
+#define TELEMETRY_INTERVAL_MS 10000  // Telemetría automática con sesión autenticada
 #define CORRECT_PIN "123456"  // PIN en texto claro (4-6 dígitos)
+#define TICKET_TABLE_SIZE 4  // Usuarios con ticket de reanudación a la vez
+#define AUTH_TABLE_SIZE 4  // Centrales con intentos de PIN registrados a la vez
+#define AUTH_MAX_FAILURES 5  // Fallos seguidos antes del bloqueo
+#define AUTH_LOCKOUT_MS 30000  // Duración del bloqueo
+#define TICKET_TTL_MS 300000  // Vida de un ticket (5 min)
 
 // ==================== VARIABLES GLOBALES ====================
-BLEServer* pServer = nullptr;
-BLECharacteristic* pCmdCharacteristic = nullptr;
-BLECharacteristic* pStateCharacteristic = nullptr;
-bool deviceConnected = false;
-bool oldDeviceConnected = false;
+// Eventos de cmdTask (cmd_queue.h), publicados por los temporizadores
+enum PeripheralEvent : uint8_t {
+  EVT_TELEMETRY,          // Cada TELEMETRY_INTERVAL_MS con algún central conectado
+  EVT_DIAG                // Cada DIAG_INTERVAL_MS con algún central conectado
+};
+
+esp_timer_handle_t telemetryTimer = nullptr;
+esp_timer_handle_t diagTimer = nullptr;
+
+// Sesión de cada central conectado (cmdTask). Si está autenticada lo dice
+// su bit en deviceState.authLinks, que es lo que ve la tarea BLE.
+struct CentralSession {
+  uint16_t userId;            // Usuario de la sesión
+  uint32_t sessionStart;      // Timestamp de inicio sesión
+  TelemetryStream telemetry;  // Suscripción a cambios de ese central
+};
+
+// Lo propio de P2 sobre el periférico genérico (peripheral.h)
+struct P2Device : P2Profile {
+  typedef CentralSession Session;
+  struct Commands;                      // Tabla de comandos, tras las acciones
+  static constexpr const char* TAG = LOG_TAG;
+  
+  static void linkOpened(uint8_t count);
+  static void linkClosed(uint8_t count);
+  static bool writeAuthenticated(uint8_t link);
+  static void clearLink(uint8_t link);
+  static void handleCommand(uint8_t* data, size_t length);
+  static void statePublish();
+};
+
+Peripheral<P2Device> peripheral;        // Servidor GATT y centrales conectados
+
+// Tickets de reanudación por usuario (cmdTask); sobreviven a la desconexión
+struct SessionTicket {
+  uint16_t userId;
+  uint8_t ticket[p2::TICKET_LEN];
+  uint32_t issuedAt;    // millis() de emisión
+  bool valid;
+};
 
-// Estado del dispositivo con autenticación
+SessionTicket ticketTable[TICKET_TABLE_SIZE];
+
+// PIN esperado en el mismo BCD que AUTH_PIN ("123456" -> 12 34 56 00),
+// calculado una vez en setup(): la verificación no formatea nada
+uint8_t expectedPin[sizeof(p2::AuthPin::pin)];
+
+// Intentos de PIN por dirección del central (cmdTask). El userId lo elige
+// quien escribe y el PIN es el mismo para todos, así que no sirve de clave;
+// la entrada sobrevive a la desconexión y reconectar no reinicia la cuenta.
+struct AuthAttempts {
+  esp_bd_addr_t peer;
+  uint8_t failures;       // >= AUTH_MAX_FAILURES = bloqueado hasta lockedUntil
+  bool used;
+  uint32_t lastAttempt;   // millis()
+  uint32_t lockedUntil;
+};
+
+AuthAttempts authTable[AUTH_TABLE_SIZE];
+
+// Estado del dispositivo con autenticación. Solo lo modifica cmdTask; el
+// resto de tareas lee la copia publicada en statePublished (seqlock.h).
 struct SecureDeviceState {
-  bool authenticated;      // ¿Sesión autenticada?
-  uint16_t userId;        // ID de usuario actual
-  uint32_t sessionStart;  // Timestamp de inicio sesión
-  uint8_t sessionType;    // 0=normal, 1=infantil
+  // Telemetría simulada, cambia en cada tick
+  int16_t temperature;    // Temperatura °C * 10
+  uint8_t heartRate;      // Frecuencia cardíaca
+  uint16_t steps;         // Pasos del día
+  uint8_t battery;        // Batería %
+  int16_t latitude;       // Latitud * 100
+  int16_t longitude;      // Longitud * 100
+  
+  // Sesiones y contadores, cambian con cada comando
+  uint8_t authLinks;      // Bit por enlace con sesión autenticada
   uint8_t keepaliveCount; // Contador de latidos
+  uint16_t cmdCounter;
   
-  // Configuración
+  // Configuración y progreso
+  uint8_t sessionType;    // 0=normal, 1=infantil
   uint8_t mode;           // 0=Eco, 1=Normal, 2=Turbo, 3=Noche
   uint8_t intensity;      // 0-100 (brightness/volumen)
   uint16_t timerMinutes;  // Límite de uso en minutos
   uint8_t ageProfile;     // 0=3-5, 1=6-8, 2=9-12 años
   uint8_t preferences;    // Flags: bit0=sonido, bit1=luz, bit2=vibración
-  
-  // Estadísticas
-  uint16_t cmdCounter;
   uint8_t currentLevel;   // Nivel de progreso (0-10)
   uint8_t badges;         // Logros desbloqueados
-  
-  // Telemetría simulada
-  int16_t temperature;    // Temperatura °C * 10
-  uint8_t heartRate;      // Frecuencia cardíaca
-  uint16_t steps;         // Pasos del día
-  uint8_t battery;        // Batería %
-  int16_t latitude;       // Latitud * 100
-  int16_t longitude;      // Longitud * 100
-} deviceState = {false, 0, 0, 0, 0, 0, 50, 30, 0, 0x07, 0, 0, 0, 365, 75, 1250, 85, 4047, -374};
+} deviceState = {365, 75, 1250, 85, 4047, -374, 0, 0, 0, 0, 0, 50, 30, 0, 0x07, 0, 0};
+
+Seqlock<SecureDeviceState> statePublished;  // Última versión publicada por cmdTask
 
 // ==================== LOGGING ====================
 void logEvent(const char* category, const char* message) {
-  unsigned long timestamp = millis();
-  Serial.printf("[%08lu] [P2-%s] %s\n", timestamp, category, message);
+  logSegments(LOG_TAG, category, &message, 1);
 }
 
 void logCommand(const char* action, uint8_t* data, size_t length) {
-  char hexStr[128] = "";
-  char temp[8];
-  for (size_t i = 0; i < length && i < 32; i++) {
-    sprintf(temp, "%02X ", data[i]);
-    strcat(hexStr, temp);
-  }
-  char logMsg[256];
-  sprintf(logMsg, "%s: [%s]", action, hexStr);
-  logEvent("CMD", logMsg);
+  logHex(LOG_TAG, "CMD", action, data, length);
 }
 
 // ==================== NOTIFICACIONES ====================
 void sendStateNotification(uint8_t stateType, uint8_t* payload, size_t payloadLen) {
-  if (!deviceConnected) return;
-  
-  uint8_t stateData[20] = {stateType};
+  uint8_t stateData[ATT_MAX_PAYLOAD] = {stateType};
   size_t totalLen = 1 + payloadLen;
-  if (totalLen > 20) totalLen = 20;
+  size_t maxLen = attPayload(peripheral.link().mtu);
+  if (totalLen > maxLen) totalLen = maxLen;
   
-  memcpy(stateData + 1, payload, payloadLen);
-  pStateCharacteristic->setValue(stateData, totalLen);
-  pStateCharacteristic->notify();
-  
-  char logMsg[128];
-  sprintf(logMsg, "STATE sent: Type=0x%02X, Len=%d", stateType, payloadLen);
-  logEvent("TX", logMsg);
+  memcpy(stateData + 1, payload, totalLen - 1);
+  peripheral.sendStateFrame(stateData, totalLen);
 }
 
-// ==================== PROCESAMIENTO DE COMANDOS ====================
-void processCommand(uint8_t* data, size_t length) {
-  if (length < 2) {
-    logEvent("ERROR", "Command too short");
-    return;
+// ==================== TICKETS DE SESIÓN ====================
+// Ticket nuevo para userId en result: sustituye al suyo o al más antiguo
+void ticketIssue(uint16_t userId, p2::AuthResult& result) {
+  SessionTicket* entry = &ticketTable[0];
+  for (uint8_t i = 0; i < TICKET_TABLE_SIZE; i++) {
+    SessionTicket* candidate = &ticketTable[i];
+    if (candidate->valid && candidate->userId == userId) {
+      entry = candidate;
+      break;
+    }
+    if (!candidate->valid) entry = candidate;
+    else if (entry->valid && (int32_t)(candidate->issuedAt - entry->issuedAt) < 0) entry = candidate;
   }
   
-  deviceState.cmdCounter++;
-  logCommand("Received", data, length);
+  entry->userId = userId;
+  static_assert(p2::TICKET_LEN % 4 == 0, "TICKET_LEN must be a multiple of 4");
+  for (uint8_t i = 0; i < p2::TICKET_LEN; i += 4) {
+    uint32_t word = esp_random();  // RNG hardware (entropía real con la radio activa)
+    memcpy(entry->ticket + i, &word, sizeof(word));
+  }
+  entry->issuedAt = millis();
+  entry->valid = true;
+  result.hasTicket = true;
+  memcpy(result.ticket, entry->ticket, sizeof(result.ticket));
+}
+
+// Consume el ticket si coincide y no ha caducado. Uno equivocado no lo
+// toca: si no, cualquiera que adivine el userId dejaría sin ticket a su
+// dueño. La comparación recorre siempre el ticket entero.
+bool ticketRedeem(const p2::SessionResume& msg) {
+  for (uint8_t i = 0; i < TICKET_TABLE_SIZE; i++) {
+    SessionTicket* entry = &ticketTable[i];
+    if (!entry->valid || entry->userId != msg.userId) continue;
+    if (millis() - entry->issuedAt > TICKET_TTL_MS) {
+      entry->valid = false;
+      return false;
+    }
+    uint8_t diff = 0;
+    for (uint8_t j = 0; j < p2::TICKET_LEN; j++) diff |= entry->ticket[j] ^ msg.ticket[j];
+    if (diff != 0) return false;
+    entry->valid = false;  // Un solo uso
+    return true;
+  }
+  return false;
+}
+
+// LOGOUT: el ticket del usuario deja de servir para reanudar
+void ticketRevoke(uint16_t userId) {
+  for (uint8_t i = 0; i < TICKET_TABLE_SIZE; i++) {
+    if (ticketTable[i].userId == userId) ticketTable[i].valid = false;
+  }
+}
+
+// ==================== VERIFICACIÓN DEL PIN ====================
+// Dígitos ASCII a BCD, dos por byte y relleno con 0
+void pinEncode(const char* digits, uint8_t* out, size_t size) {
+  memset(out, 0, size);
+  for (size_t i = 0; digits[i] && i < size * 2; i++) {
+    out[i / 2] |= (digits[i] - '0') << (i % 2 ? 0 : 4);
+  }
+}
+
+// Comparación de tiempo fijo: recorre siempre los 4 bytes
+bool pinMatches(const uint8_t* pin) {
+  uint8_t diff = 0;
+  for (size_t i = 0; i < sizeof(expectedPin); i++) diff |= pin[i] ^ expectedPin[i];
+  return diff == 0;
+}
+
+bool authLocked(const AuthAttempts* entry, uint32_t now) {
+  return entry->used && entry->failures >= AUTH_MAX_FAILURES && (int32_t)(entry->lockedUntil - now) > 0;
+}
+
+// Orden de reciclado: libre, sin bloqueo, bloqueada
+uint8_t authEvictRank(const AuthAttempts* entry, uint32_t now) {
+  return !entry->used ? 0 : authLocked(entry, now) ? 2 : 1;
+}
+
+// Entrada del central; si no tiene, la de menor authEvictRank() y, entre
+// iguales, la más antigua. Nunca falta: un central nuevo siempre llega a
+// que se compruebe su PIN, aunque los demás estén bloqueados.
+AuthAttempts* authEntry(const uint8_t* peer, uint32_t now) {
+  AuthAttempts* victim = nullptr;
+  for (uint8_t i = 0; i < AUTH_TABLE_SIZE; i++) {
+    AuthAttempts* entry = &authTable[i];
+    if (entry->used && memcmp(entry->peer, peer, sizeof(entry->peer)) == 0) return entry;
+    if (!victim) {
+      victim = entry;
+      continue;
+    }
+    uint8_t rank = authEvictRank(entry, now);
+    uint8_t victimRank = authEvictRank(victim, now);
+    if (rank < victimRank || (rank == victimRank && (int32_t)(entry->lastAttempt - victim->lastAttempt) < 0)) {
+      victim = entry;
+    }
+  }
+  *victim = {{0}, 0, true, now, 0};
+  memcpy(victim->peer, peer, sizeof(victim->peer));
+  return victim;
+}
+
+// ==================== SESIONES ====================
+bool linkAuthenticated(uint8_t link) {
+  return deviceState.authLinks & (1 << link);
+}
+
+// Sesión de userId en el central que envió la credencial
+void sessionOpen(uint16_t userId) {
+  CentralSession& session = peripheral.session();
+  deviceState.authLinks |= 1 << peripheral.txLink;
+  session.userId = userId;
+  session.sessionStart = millis();
+  digitalWrite(LED_PIN, HIGH);
+}
+
+// El LED sigue encendido mientras quede alguna sesión abierta
+void sessionClose(uint8_t link) {
+  deviceState.authLinks &= ~(1 << link);
+  peripheral.centrals.links[link].session.userId = 0;
+  if (!deviceState.authLinks) digitalWrite(LED_PIN, LOW);
+}
+
+// ==================== PROCESAMIENTO DE COMANDOS ====================
+// Acciones: el mensaje llega decodificado y con la longitud ya validada
+bool onAuthPin(const p2::AuthPin& msg) {
+  // Volcado crudo [userId, PIN]: se formatea en logTask, no aquí
+  uint8_t raw[p2::AuthPin::SIZE];
+  logHex(LOG_TAG, "AUTH", "🔐 Auth attempt (user, PIN in PLAINTEXT!)", raw, encodeInto(msg, ByteSpan(raw, sizeof(raw))));
   
-  uint8_t cmdType = data[0];
-  uint8_t cmdLen = data[1];
-  uint8_t* cmdData = (cmdLen > 0 && length >= 2 + cmdLen) ? &data[2] : nullptr;
+  p2::AuthResult result = {false, msg.userId, false, {0}};
+  uint32_t now = millis();
+  AuthAttempts* attempts = authEntry(peripheral.link().peer, now);
+  if (attempts->failures >= AUTH_MAX_FAILURES && !authLocked(attempts, now)) {
+    attempts->failures = 0;  // Bloqueo cumplido
+  }
+  bool locked = attempts->failures >= AUTH_MAX_FAILURES;
+  bool match = pinMatches(msg.pin);  // Siempre, también bloqueado: mismo coste
+  attempts->lastAttempt = now;
   
-  // Comandos que NO requieren autenticación
-  if (cmdType == 0x01) { // CMD_AUTH_PIN
-    if (cmdLen < 6) {
-      logEvent("AUTH", "❌ PIN packet too short");
-      uint8_t response[] = {0x00}; // Auth failed
-      sendStateNotification(0x01, response, 1);
-      return;
-    }
-    
-    uint16_t userId = (cmdData[0] << 8) | cmdData[1];
-    char receivedPin[7] = "";
-    sprintf(receivedPin, "%02X%02X%02X%02X", cmdData[2], cmdData[3], cmdData[4], cmdData[5]);
+  if (locked) {
+    logEvent("SEC", "⛔ Auth rejected - Central locked out");
+  } else if (match) {
+    attempts->failures = 0;
+    sessionOpen(msg.userId);
     
-    char logMsg[128];
-    sprintf(logMsg, "🔐 Auth attempt - User: %d, PIN: %s (PLAINTEXT!)", userId, receivedPin);
+    char logMsg[64];
+    sprintf(logMsg, "✅ Authentication SUCCESS - User %d logged in", msg.userId);
     logEvent("AUTH", logMsg);
-    
-    // Verificar PIN (en producción sería hash, aquí texto claro)
-    if (strcmp(receivedPin, CORRECT_PIN) == 0) {
-      deviceState.authenticated = true;
-      deviceState.userId = userId;
-      deviceState.sessionStart = millis();
-      
-      sprintf(logMsg, "✅ Authentication SUCCESS - User %d logged in", userId);
-      logEvent("AUTH", logMsg);
-      
-      uint8_t response[] = {0x01, (uint8_t)(userId >> 8), (uint8_t)(userId & 0xFF)};
-      sendStateNotification(0x01, response, 3);
-      digitalWrite(LED_PIN, HIGH);
-    } else {
-      logEvent("AUTH", "❌ Authentication FAILED - Wrong PIN");
-      uint8_t response[] = {0x00};
-      sendStateNotification(0x01, response, 1);
-    }
-    return;
+    result.ok = true;
+    ticketIssue(msg.userId, result);
+  } else {
+    if (++attempts->failures >= AUTH_MAX_FAILURES) attempts->lockedUntil = now + AUTH_LOCKOUT_MS;
+    logEvent("AUTH", "❌ Authentication FAILED - Wrong PIN");
+  }
+  
+  uint8_t response[3 + p2::TICKET_LEN];
+  sendStateNotification(p2::AuthPin::OPCODE, response, encodeInto(result, ByteSpan(response, sizeof(response))));
+  return true;
+}
+
+// Reanudación con ticket: misma respuesta que AUTH_PIN, con un ticket nuevo
+bool onSessionResume(const p2::SessionResume& msg) {
+  p2::AuthResult result = {false, msg.userId, false, {0}};
+  char logMsg[64];
+  if (ticketRedeem(msg)) {
+    sessionOpen(msg.userId);
+    result.ok = true;
+    ticketIssue(msg.userId, result);
+    sprintf(logMsg, "✅ Session resumed - User %d", msg.userId);
+  } else {
+    sprintf(logMsg, "❌ Session resume rejected - User %d", msg.userId);
   }
+  logEvent("AUTH", logMsg);
   
-  // Comandos que SÍ requieren autenticación
-  if (!deviceState.authenticated) {
-    logEvent("SEC", "⚠️  Command rejected - Not authenticated");
-    uint8_t response[] = {0xE1}; // Error: no autenticado
-    sendStateNotification(0xFF, response, 1);
+  uint8_t response[3 + p2::TICKET_LEN];
+  sendStateNotification(p2::SessionResume::OPCODE, response, encodeInto(result, ByteSpan(response, sizeof(response))));
+  return true;
+}
+
+bool onSessionStart(const p2::SessionStart& msg) {
+  deviceState.sessionType = msg.sessionType;
+  
+  char logMsg[64];
+  sprintf(logMsg, "Session started - Type: %d, TS: %lu", deviceState.sessionType, (unsigned long)msg.timestamp);
+  logEvent("SESSION", logMsg);
+  return true;
+}
+
+bool onKeepalive(const p2::Keepalive& msg) {
+  deviceState.keepaliveCount = msg.value;
+  char logMsg[32];
+  sprintf(logMsg, "Keepalive #%d", deviceState.keepaliveCount);
+  logEvent("SESSION", logMsg);
+  return true;
+}
+
+bool onSetMode(const p2::SetMode& msg) {
+  deviceState.mode = msg.value;
+  const char* modes[] = {"ECO", "NORMAL", "TURBO", "NOCHE"};
+  char logMsg[64];
+  sprintf(logMsg, "Mode changed to %s", modes[deviceState.mode % 4]);
+  logEvent("CONFIG", logMsg);
+  return true;
+}
+
+bool onSetIntensity(const p2::SetIntensity& msg) {
+  deviceState.intensity = msg.value;
+  char logMsg[64];
+  sprintf(logMsg, "Intensity set to %d%%", deviceState.intensity);
+  logEvent("CONFIG", logMsg);
+  return true;
+}
+
+bool onSetTimer(const p2::SetTimer& msg) {
+  deviceState.timerMinutes = msg.minutes;
+  char logMsg[64];
+  sprintf(logMsg, "Timer set to %d minutes", deviceState.timerMinutes);
+  logEvent("CONFIG", logMsg);
+  return true;
+}
+
+bool onSetProfile(const p2::SetProfile& msg) {
+  deviceState.ageProfile = msg.ageProfile;
+  deviceState.preferences = msg.preferences;
+  const char* profiles[] = {"3-5 años", "6-8 años", "9-12 años"};
+  char logMsg[64];
+  sprintf(logMsg, "Profile: %s, Prefs: 0x%02X", profiles[deviceState.ageProfile % 3], deviceState.preferences);
+  logEvent("CONFIG", logMsg);
+  return true;
+}
+
+void sendTelemetryFrame(bool subscribed);
+
+// La respuesta es el keyframe que sale en cuanto hay suscripción
+bool onTelemetrySubscribe(const p2::TelemetrySubscribe& msg) {
+  TelemetryStream* stream = &peripheral.session().telemetry;
+  telemStreamSubscribe(stream, msg.keyframeEvery, msg.thresholds, sizeof(msg.thresholds));
+  char logMsg[80];
+  sprintf(logMsg, "Telemetry subscription: keyframe every %d, thresholds %d/%d/%d",
+          msg.keyframeEvery, msg.thresholds[0], msg.thresholds[1], msg.thresholds[2]);
+  logEvent("CONFIG", logMsg);
+  if (telemStreamActive(stream)) sendTelemetryFrame(true);
+  return true;
+}
+
+bool onTelemetryAck(const p2::TelemetryAck& msg) {
+  telemStreamAck(&peripheral.session().telemetry, msg.value);
+  return true;
+}
+
+bool onEvent(const p2::Event& msg) {
+  const char* events[] = {"Button", "Game Complete", "Error"};
+  char logMsg[64];
+  sprintf(logMsg, "Event: %s, Value: %d", events[msg.type % 3], msg.value);
+  logEvent("EVENT", logMsg);
+  return true;
+}
+
+bool onReward(const p2::Reward& msg) {
+  deviceState.currentLevel = msg.level;
+  deviceState.badges = msg.badges;
+  char logMsg[64];
+  sprintf(logMsg, "🎮 Reward - Level: %d, Badges: %d", deviceState.currentLevel, deviceState.badges);
+  logEvent("EVENT", logMsg);
+  return true;
+}
+
+bool onLogout(const p2::Logout& msg) {
+  logEvent("AUTH", "🔓 User logged out");
+  ticketRevoke(peripheral.session().userId);
+  sessionClose(peripheral.txLink);
+  return true;
+}
+
+// Respuestas: payload tras el tipo, que pone dispatch()
+size_t respSessionStart(const uint8_t* args, ByteSpan out) {
+  p2::SessionAck ack = {0x01, deviceState.sessionType};
+  return encodeInto(ack, out);
+}
+
+size_t respKeepalive(const uint8_t* args, ByteSpan out) {
+  p2::Keepalive echo = {deviceState.keepaliveCount};
+  return encodeInto(echo, out);
+}
+
+size_t respMode(const uint8_t* args, ByteSpan out) {
+  p2::SetMode echo = {deviceState.mode};
+  return encodeInto(echo, out);
+}
+
+size_t respIntensity(const uint8_t* args, ByteSpan out) {
+  p2::SetIntensity echo = {deviceState.intensity};
+  return encodeInto(echo, out);
+}
+
+size_t respTimer(const uint8_t* args, ByteSpan out) {
+  p2::SetTimer echo = {deviceState.timerMinutes};
+  return encodeInto(echo, out);
+}
+
+size_t respProfile(const uint8_t* args, ByteSpan out) {
+  p2::SetProfile echo = {deviceState.ageProfile, deviceState.preferences};
+  return encodeInto(echo, out);
+}
+
+// Eco del evento recibido
+size_t respEvent(const uint8_t* args, ByteSpan out) {
+  p2::Event echo;
+  decodeFrom(ConstByteSpan(args, p2::Event::SIZE), echo);
+  return encodeInto(echo, out);
+}
+
+size_t respReward(const uint8_t* args, ByteSpan out) {
+  p2::Reward echo = {deviceState.currentLevel, deviceState.badges};
+  return encodeInto(echo, out);
+}
+
+size_t respLogout(const uint8_t* args, ByteSpan out) {
+  p2::AuthResult result = {false, 0, false, {0}};
+  return encodeInto(result, out);
+}
+
+// Trama [CMD][LEN][DATA]: args = DATA (P2Profile::ARGS_OFFSET)
+struct P2Device::Commands : CommandSet<
+  Command<p2::AuthPin,            onAuthPin,            nullptr,          CMD_FLAG_CREDENTIAL>,  // Según el resultado
+  Command<p2::SessionStart,       onSessionStart,       respSessionStart, CMD_FLAG_AUTH>,
+  Command<p2::Keepalive,          onKeepalive,          respKeepalive,    CMD_FLAG_AUTH>,
+  Command<p2::SessionResume,      onSessionResume,      nullptr,          CMD_FLAG_CREDENTIAL>,  // Como AUTH_PIN, con ticket
+  Command<p2::SetMode,            onSetMode,            respMode,         CMD_FLAG_AUTH>,
+  Command<p2::SetIntensity,       onSetIntensity,       respIntensity,    CMD_FLAG_AUTH>,
+  Command<p2::SetTimer,           onSetTimer,           respTimer,        CMD_FLAG_AUTH>,
+  Command<p2::SetProfile,         onSetProfile,         respProfile,      CMD_FLAG_AUTH>,
+  Command<p2::TelemetrySubscribe, onTelemetrySubscribe, nullptr,          CMD_FLAG_AUTH>,  // Responde con un keyframe
+  Command<p2::TelemetryAck,       onTelemetryAck,       nullptr,          CMD_FLAG_AUTH>,  // Sin respuesta
+  Command<p2::Event,              onEvent,              respEvent,        CMD_FLAG_AUTH>,
+  Command<p2::Reward,             onReward,             respReward,       CMD_FLAG_AUTH>,
+  Command<p2::Logout,             onLogout,             respLogout,       CMD_FLAG_AUTH>   // Cerrar sesión
+> {};
+
+// Trama [CMD][LEN][DATA] del central txLink, con la sesión de ese enlace
+void P2Device::handleCommand(uint8_t* data, size_t length) {
+  uint32_t started = metricsCycles();
+  if (length < 2) {
+    logEvent("ERROR", "Command too short");
     return;
   }
   
-  switch (cmdType) {
-    case 0x02: { // CMD_SESSION_START
-      if (cmdLen < 5) break;
-      uint32_t timestamp = (cmdData[0] << 24) | (cmdData[1] << 16) | (cmdData[2] << 8) | cmdData[3];
-      deviceState.sessionType = cmdData[4];
-      
-      char msg[64];
-      sprintf(msg, "Session started - Type: %d, TS: %lu", deviceState.sessionType, timestamp);
-      logEvent("SESSION", msg);
-      
-      uint8_t response[] = {0x01, deviceState.sessionType};
-      sendStateNotification(0x02, response, 2);
-      break;
-    }
-    
-    case 0x03: { // CMD_KEEPALIVE
-      deviceState.keepaliveCount = cmdData[0];
-      char msg[32];
-      sprintf(msg, "Keepalive #%d", deviceState.keepaliveCount);
-      logEvent("SESSION", msg);
-      
-      uint8_t response[] = {deviceState.keepaliveCount};
-      sendStateNotification(0x03, response, 1);
-      break;
-    }
-    
-    case 0x10: { // CMD_SET_MODE
-      deviceState.mode = cmdData[0];
-      const char* modes[] = {"ECO", "NORMAL", "TURBO", "NOCHE"};
-      char msg[64];
-      sprintf(msg, "Mode changed to %s", modes[deviceState.mode % 4]);
-      logEvent("CONFIG", msg);
-      
-      uint8_t response[] = {deviceState.mode};
-      sendStateNotification(0x10, response, 1);
-      break;
-    }
-    
-    case 0x11: { // CMD_SET_INTENSITY
-      deviceState.intensity = cmdData[0];
-      char msg[64];
-      sprintf(msg, "Intensity set to %d%%", deviceState.intensity);
-      logEvent("CONFIG", msg);
-      
-      uint8_t response[] = {deviceState.intensity};
-      sendStateNotification(0x11, response, 1);
-      break;
-    }
-    
-    case 0x12: { // CMD_SET_TIMER
-      deviceState.timerMinutes = (cmdData[0] << 8) | cmdData[1];
-      char msg[64];
-      sprintf(msg, "Timer set to %d minutes", deviceState.timerMinutes);
-      logEvent("CONFIG", msg);
-      
-      uint8_t response[] = {(uint8_t)(deviceState.timerMinutes >> 8), (uint8_t)(deviceState.timerMinutes & 0xFF)};
-      sendStateNotification(0x12, response, 2);
-      break;
-    }
-    
-    case 0x13: { // CMD_SET_PROFILE
-      deviceState.ageProfile = cmdData[0];
-      deviceState.preferences = cmdData[1];
-      const char* profiles[] = {"3-5 años", "6-8 años", "9-12 años"};
-      char msg[64];
-      sprintf(msg, "Profile: %s, Prefs: 0x%02X", profiles[deviceState.ageProfile % 3], deviceState.preferences);
-      logEvent("CONFIG", msg);
-      
-      uint8_t response[] = {deviceState.ageProfile, deviceState.preferences};
-      sendStateNotification(0x13, response, 2);
-      break;
-    }
-    
-    case 0x20: { // CMD_EVENT
-      uint8_t eventType = cmdData[0];
-      uint16_t eventValue = (cmdData[1] << 8) | cmdData[2];
-      const char* events[] = {"Button", "Game Complete", "Error"};
-      char msg[64];
-      sprintf(msg, "Event: %s, Value: %d", events[eventType % 3], eventValue);
-      logEvent("EVENT", msg);
-      
-      uint8_t response[] = {eventType, (uint8_t)(eventValue >> 8), (uint8_t)(eventValue & 0xFF)};
-      sendStateNotification(0x20, response, 3);
+  deviceState.cmdCounter++;
+  metricsCount(MET_COMMANDS);
+  logCommand("Received", data, length);
+  
+  uint8_t cmdType = data[0];
+  bool authenticated = linkAuthenticated(peripheral.txLink);
+  RateLimiter* limiter = &peripheral.link().limiter;
+  switch (peripheral.dispatch(data, length, authenticated)) {
+    case CMD_UNKNOWN: {
+      logEvent("ERROR", "Unknown command");
+      uint8_t response[] = {cmdType, 0xE0, rateErrorBatch(limiter)};
+      sendStateNotification(0xFF, response, 3);
       break;
     }
-    
-    case 0x21: { // CMD_REWARD
-      deviceState.currentLevel = cmdData[0];
-      deviceState.badges = cmdData[1];
-      char msg[64];
-      sprintf(msg, "🎮 Reward - Level: %d, Badges: %d", deviceState.currentLevel, deviceState.badges);
-      logEvent("EVENT", msg);
-      
-      uint8_t response[] = {deviceState.currentLevel, deviceState.badges};
-      sendStateNotification(0x21, response, 2);
-      break;
+    case CMD_UNAUTHORIZED: {
+      logEvent("SEC", "⚠️  Command rejected - Not authenticated");
+      uint8_t response[] = {0xE1, rateErrorBatch(limiter)}; // Error: no autenticado
+      sendStateNotification(0xFF, response, 2);
+      metricsSample(cmdType, metricsCycles() - started);
+      return;
     }
-    
-    case 0x99: { // CMD_LOGOUT (cerrar sesión)
-      logEvent("AUTH", "🔓 User logged out");
-      deviceState.authenticated = false;
-      deviceState.userId = 0;
-      digitalWrite(LED_PIN, LOW);
-      
-      uint8_t response[] = {0x00};
-      sendStateNotification(0x99, response, 1);
+    case CMD_TOO_SHORT: {
+      logEvent("ERROR", "Command arguments too short");
+      uint8_t response[] = {cmdType, 0xE2, rateErrorBatch(limiter)}; // Error: argumentos insuficientes
+      sendStateNotification(0xFF, response, 3);
       break;
     }
-    
     default:
-      logEvent("ERROR", "Unknown command");
-      uint8_t response[] = {cmdType, 0xE0};
-      sendStateNotification(0xFF, response, 2);
       break;
   }
   
   char counterMsg[64];
   sprintf(counterMsg, "Commands processed: %d (Auth: %s)", 
           deviceState.cmdCounter, 
-          deviceState.authenticated ? "YES" : "NO");
+          linkAuthenticated(peripheral.txLink) ? "YES" : "NO");
   logEvent("INFO", counterMsg);
+  
+  metricsSample(cmdType, metricsCycles() - started);
 }
 
-// Callback para escritura en CMD
-class CmdCharacteristicCallbacks : public BLECharacteristicCallbacks {
-  void onWrite(BLECharacteristic* pCharacteristic) {
-    std::string value = pCharacteristic->getValue();
-    if (value.length() > 0) {
-      uint8_t* data = (uint8_t*)value.data();
-      processCommand(data, value.length());
-    }
+// ==================== ESTADO PUBLICADO ====================
+// cmdTask, al aplicar el reset de un enlace abierto o cerrado
+void P2Device::clearLink(uint8_t link) {
+  sessionClose(link);                                                   // Limpiar sesión
+  peripheral.centrals.links[link].session.telemetry.keyframeEvery = 0;  // Cada central se suscribe de nuevo
+}
+
+// Nueva versión para los lectores de otras tareas (cmdTask, tras cada cambio)
+void P2Device::statePublish() {
+  statePublished.publish(deviceState);
+}
+
+// Sesión que ve la tarea BLE al clasificar una escritura (rate_limit.h)
+bool P2Device::writeAuthenticated(uint8_t link) {
+  return statePublished.read().authLinks & (1 << link);
+}
+
+// ==================== CONEXIONES ====================
+// Batería simulada: cada 10 s se pierde un 1 % con probabilidad proporcional
+// a los eventos de conexión por segundo de todos los enlaces (LOW_LATENCY
+// ≈ 133/s → siempre, LOW_POWER ≈ 1/s → casi nunca)
+uint8_t batteryDrain() {
+  uint32_t eventsPerSecond = 0;
+  for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+    if (!peripheral.centrals.isOpen(i)) continue;
+    const CentralLink<CentralSession>& link = peripheral.centrals.links[i];
+    eventsPerSecond += 800 / max(1, link.interval * (1 + link.latency));
   }
-};
+  return random(0, 133) < (long)eventsPerSecond ? 1 : 0;
+}
 
-// Callback de conexión
-class ServerCallbacks : public BLEServerCallbacks {
-  void onConnect(BLEServer* pServer) {
-    deviceConnected = true;
-    logEvent("BLE", "Central connected");
-    // NO encender LED hasta autenticación exitosa
+// Tarea BLE, tras abrir o cerrar un enlace: telemetría y diagnóstico solo
+// con algún central conectado. NO encender LED hasta autenticación exitosa
+void P2Device::linkOpened(uint8_t count) {
+  if (count == 1) {
+    cmdTimerStart(telemetryTimer, TELEMETRY_INTERVAL_MS);
+    cmdTimerStart(diagTimer, DIAG_INTERVAL_MS);
   }
+}
 
-  void onDisconnect(BLEServer* pServer) {
-    deviceConnected = false;
-    deviceState.authenticated = false; // Limpiar sesión
-    logEvent("BLE", "Central disconnected - Session cleared");
-    digitalWrite(LED_PIN, LOW);
+// La sesión del enlace la limpia cmdTask (clearLink)
+void P2Device::linkClosed(uint8_t count) {
+  if (count == 0) {
+    cmdTimerStop(telemetryTimer);
+    cmdTimerStop(diagTimer);
   }
-};
+}
+
+// ==================== TELEMETRÍA ====================
+// Vitales, actividad y GPS para txLink en una sola notificación empaquetada
+// o, con suscripción (subscribed), solo lo que ha cambiado desde su última
+// confirmada
+void sendTelemetryFrame(bool subscribed) {
+  CentralLink<CentralSession>& link = peripheral.link();
+  p2::telemetry::Vitals vitals = {deviceState.temperature, deviceState.heartRate};
+  p2::telemetry::Activity activity = {deviceState.steps, deviceState.battery};
+  p2::telemetry::Gps gps = {deviceState.latitude, deviceState.longitude};
+  TelemetryField fields[] = {telemetryField(vitals), telemetryField(activity), telemetryField(gps)};
+  if (subscribed) {
+    telemStreamSend(&link.session.telemetry, P2Profile::fieldLayouts(), fields, 3, attPayload(link.mtu),
+                    peripheral.sendStateFrame);
+  } else {
+    telemetrySendPacked(fields, 3, attPayload(link.mtu), peripheral.sendStateFrame);
+  }
+}
+
+// Evento EVT_TELEMETRY (cmdTask): una muestra para todos los centrales con
+// sesión autenticada, cada uno con su suscripción
+void sendTelemetry() {
+  if (!deviceState.authLinks) return;
+  
+  // Simular cambios en telemetría
+  deviceState.temperature = 360 + random(-20, 30); // 36°C ±2°C
+  deviceState.heartRate = 75 + random(-10, 15);    // 75 bpm ±10
+  deviceState.steps += random(50, 200);            // Incremento de pasos
+  deviceState.battery = max(0, deviceState.battery - batteryDrain()); // Según el perfil de conexión
+  deviceState.latitude += random(-5, 5);           // Pequeño movimiento GPS
+  deviceState.longitude += random(-5, 5);
+  
+  for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+    if (!linkAuthenticated(i)) continue;
+    peripheral.txLink = i;
+    sendTelemetryFrame(telemStreamActive(&peripheral.centrals.links[i].session.telemetry));
+  }
+  
+  char telemetryLog[256];
+  sprintf(telemetryLog, "📡 Telemetry: Temp=%.1f°C, HR=%d bpm, Steps=%d, Battery=%d%%, GPS=(%.2f,%.2f)",
+          deviceState.temperature / 10.0,
+          deviceState.heartRate,
+          deviceState.steps,
+          deviceState.battery,
+          deviceState.latitude / 100.0,
+          deviceState.longitude / 100.0);
+  logEvent("TELEM", telemetryLog);
+}
+
+// ==================== EVENTOS ====================
+// Temporizadores atendidos en cmdTask, en serie con los comandos
+void handleEvent(uint8_t event) {
+  peripheral.applyResets();
+  switch (event) {
+    case EVT_TELEMETRY:
+      sendTelemetry();
+      P2Device::statePublish();
+      break;
+    case EVT_DIAG:
+      peripheral.sendDiagnostics();  // Instantánea para los centrales suscritos a diag
+      break;
+  }
+}
 
 // ==================== SETUP ====================
 void setup() {
-  Serial.begin(115200);
+  Serial.begin(LOG_TEXT_BAUD);
+  logBegin();
   delay(1000);
   
   pinMode(LED_PIN, OUTPUT);
@@ -315,119 +686,33 @@ void setup() {
   
   Serial.println("\n\n========================================");
   Serial.println("ESP32 BLE Peripheral - Secure Device (P2)");
-  Serial.println("Device: " DEVICE_NAME);
+  Serial.printf("Device: %s\n", P2Device::NAME);
   Serial.println("⚠️  PIN-based auth (PLAINTEXT - VULNERABLE)");
   Serial.println("========================================\n");
   
   logEvent("SYSTEM", "Initializing BLE...");
   
-  BLEDevice::init(DEVICE_NAME);
-  
-  pServer = BLEDevice::createServer();
-  pServer->setCallbacks(new ServerCallbacks());
-  logEvent("BLE", "BLE Server created");
+  // Worker de comandos y eventos: debe existir antes de aceptar escrituras
+  pinEncode(CORRECT_PIN, expectedPin, sizeof(expectedPin));
+  P2Device::statePublish();
+  cmdQueueBegin(peripheral.processCommand, handleEvent);
+  telemetryTimer = cmdTimerCreate(EVT_TELEMETRY, "telemetry");
+  diagTimer = cmdTimerCreate(EVT_DIAG, "diag");
   
-  BLEService* pService = pServer->createService(SERVICE_UUID);
-  logEvent("GATT", "Service created");
-  
-  pCmdCharacteristic = pService->createCharacteristic(
-    CMD_CHAR_UUID,
-    BLECharacteristic::PROPERTY_WRITE
-  );
-  pCmdCharacteristic->setCallbacks(new CmdCharacteristicCallbacks());
-  logEvent("GATT", "CMD characteristic created (Write)");
-  
-  pStateCharacteristic = pService->createCharacteristic(
-    STATE_CHAR_UUID,
-    BLECharacteristic::PROPERTY_NOTIFY
-  );
-  pStateCharacteristic->addDescriptor(new BLE2902());
-  logEvent("GATT", "STATE characteristic created (Notify)");
-  
-  pService->start();
-  logEvent("GATT", "Service started");
-  
-  BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
-  pAdvertising->addServiceUUID(SERVICE_UUID);
-  pAdvertising->setScanResponse(true);
-  pAdvertising->setMinPreferred(0x06);
-  pAdvertising->setMinPreferred(0x12);
-  BLEDevice::startAdvertising();
-  
-  logEvent("BLE", "Advertising started");
+  // Servidor GATT y advertising de P2Profile; STATE solo notifica
+  peripheral.begin();
   logEvent("SYSTEM", "== PERIPHERAL READY - Awaiting authentication ==");
   
   Serial.println("\nDevice info:");
-  Serial.printf("  Name: %s\n", DEVICE_NAME);
+  Serial.printf("  Name: %s\n", P2Device::NAME);
   Serial.printf("  Correct PIN: %s (VISIBLE IN CODE!)\n", CORRECT_PIN);
-  Serial.printf("  Service UUID: %s\n\n", SERVICE_UUID);
+  Serial.printf("  Service UUID: %s\n\n", P2Device::SERVICE_UUID);
+  
+  powerBegin(LOG_TAG);
 }
 
 // ==================== LOOP ====================
+// Todo ocurre en callbacks BLE y cmdTask: la tarea de loop() sobra
 void loop() {
-  if (!deviceConnected && oldDeviceConnected) {
-    delay(500);
-    logEvent("BLE", "Restarting advertising...");
-    pServer->startAdvertising();
-    oldDeviceConnected = deviceConnected;
-  }
-  
-  if (deviceConnected && !oldDeviceConnected) {
-    oldDeviceConnected = deviceConnected;
-  }
-  
-  // Enviar telemetría automática cada 10 segundos SI está autenticado
-  static unsigned long lastTelemetry = 0;
-  unsigned long currentTime = millis();
-  
-  if (deviceConnected && deviceState.authenticated && (currentTime - lastTelemetry > 10000)) {
-    lastTelemetry = currentTime;
-    
-    // Simular cambios en telemetría
-    deviceState.temperature = 360 + random(-20, 30); // 36°C ±2°C
-    deviceState.heartRate = 75 + random(-10, 15);    // 75 bpm ±10
-    deviceState.steps += random(50, 200);            // Incremento de pasos
-    deviceState.battery = max(0, deviceState.battery - random(0, 2)); // Batería baja lentamente
-    deviceState.latitude += random(-5, 5);           // Pequeño movimiento GPS
-    deviceState.longitude += random(-5, 5);
-    
-    // Enviar telemetría en múltiples notificaciones
-    uint8_t telemetryData[10];
-    
-    // Paquete 1: Temperatura y frecuencia cardíaca
-    telemetryData[0] = 0x01; // Tipo: vitales
-    telemetryData[1] = (deviceState.temperature >> 8) & 0xFF;
-    telemetryData[2] = deviceState.temperature & 0xFF;
-    telemetryData[3] = deviceState.heartRate;
-    sendStateNotification(0xA0, telemetryData, 4); // 0xA0 = TELEMETRY
-    delay(50);
-    
-    // Paquete 2: Actividad
-    telemetryData[0] = 0x02; // Tipo: actividad
-    telemetryData[1] = (deviceState.steps >> 8) & 0xFF;
-    telemetryData[2] = deviceState.steps & 0xFF;
-    telemetryData[3] = deviceState.battery;
-    sendStateNotification(0xA0, telemetryData, 4);
-    delay(50);
-    
-    // Paquete 3: Ubicación
-    telemetryData[0] = 0x03; // Tipo: GPS
-    telemetryData[1] = (deviceState.latitude >> 8) & 0xFF;
-    telemetryData[2] = deviceState.latitude & 0xFF;
-    telemetryData[3] = (deviceState.longitude >> 8) & 0xFF;
-    telemetryData[4] = deviceState.longitude & 0xFF;
-    sendStateNotification(0xA0, telemetryData, 5);
-    
-    char telemetryLog[256];
-    sprintf(telemetryLog, "📡 Telemetry: Temp=%.1f°C, HR=%d bpm, Steps=%d, Battery=%d%%, GPS=(%.2f,%.2f)",
-            deviceState.temperature / 10.0,
-            deviceState.heartRate,
-            deviceState.steps,
-            deviceState.battery,
-            deviceState.latitude / 100.0,
-            deviceState.longitude / 100.0);
-    logEvent("TELEM", telemetryLog);
-  }
-  
-  delay(100);
+  vTaskDelete(nullptr);
 }
@@ -0,0 +1,157 @@
+/*
+ * Despacho de comandos por tabla (P1, P2)
+ *
+ * Cada firmware declara su tabla como un tipo: CommandSet<Command<...>...>,
+ * una fila por mensaje de ble_protocol.h con su acción, su constructor de
+ * respuesta y sus flags. dispatch() concentra las comprobaciones comunes
+ * (opcode conocido, autenticación, longitud) antes de llamar a la acción,
+ * de modo que las acciones no validan nada y añadir un opcode es añadir
+ * una fila.
+ *
+ * La tabla se resuelve al compilar: un índice constexpr de 256 entradas
+ * (en flash, sin construirlo al arrancar) da la fila de cada opcode, y la
+ * fila, su run() con la acción integrada y sus longitudes y flags
+ * inmediatos. Despachar es una carga y una llamada, igual para el primer
+ * opcode de la tabla que para el último.
+ *
+ * Respuesta: [opcode] [bytes escritos por respond()], entregada al sink
+ * del firmware (sendStateFrame).
+ */
+
+#ifndef CMD_DISPATCH_H
+#define CMD_DISPATCH_H
+
+#include <Arduino.h>
+#include "ble_protocol.h"
+
+#define CMD_FLAG_AUTH       0x01  // Requiere sesión autenticada
+#define CMD_FLAG_CREDENTIAL 0x02  // Presenta credenciales: cubeta propia (rate_limit.h)
+#define CMD_RESPONSE_MAX    16    // Opcode + payload de la respuesta
+#define CMD_NO_ROW          0xFF  // Opcode sin fila en el índice
+
+// Escribe el payload de la respuesta en out; devuelve su longitud
+typedef size_t (*CmdResponder)(const uint8_t* args, ByteSpan out);
+typedef void (*CmdResponseSink)(const uint8_t* frame, size_t length);
+
+enum CmdStatus : uint8_t {
+  CMD_OK,
+  CMD_UNKNOWN,
+  CMD_UNAUTHORIZED,
+  CMD_TOO_SHORT,
+  CMD_REJECTED
+};
+
+// Longitud mínima y flags de una fila, para quien clasifica sin despachar
+struct CommandInfo {
+  uint8_t minLen;
+  uint8_t flags;
+};
+
+// Respond = nullptr: la acción responde por su cuenta
+template <CmdResponder Respond>
+struct CmdResponds { enum : bool { VALUE = true }; };
+
+template <>
+struct CmdResponds<nullptr> { enum : bool { VALUE = false }; };
+
+// Fila de la tabla. Action recibe el mensaje ya decodificado (args tiene
+// al menos Msg::SIZE bytes) y devuelve false si lo rechaza (sin respuesta).
+template <typename Msg, bool (*Action)(const Msg&), CmdResponder Respond, uint8_t Flags = 0>
+struct Command {
+  enum : uint8_t { OPCODE = Msg::OPCODE, MIN_LEN = Msg::SIZE, FLAGS = Flags };
+
+  static CmdStatus run(const uint8_t* args, uint8_t argLen, bool authenticated, CmdResponseSink sink) {
+    if ((FLAGS & CMD_FLAG_AUTH) && !authenticated) return CMD_UNAUTHORIZED;
+    if (argLen < MIN_LEN) return CMD_TOO_SHORT;
+    Msg msg;
+    decodeFrom(ConstByteSpan(args, argLen), msg);
+    if (!Action(msg)) return CMD_REJECTED;
+    
+    if (CmdResponds<Respond>::VALUE) {
+      uint8_t frame[CMD_RESPONSE_MAX];
+      frame[0] = OPCODE;
+      size_t len = Respond(args, ByteSpan(frame + 1, sizeof(frame) - 1));
+      sink(frame, 1 + len);
+    }
+    return CMD_OK;
+  }
+};
+
+// ==================== ÍNDICE ====================
+// Fila de opcode entre Rows (a partir de row); CMD_NO_ROW si no está
+template <typename... Rows>
+struct CmdRowOf {
+  static constexpr uint8_t find(uint8_t, uint8_t) { return CMD_NO_ROW; }
+};
+
+template <typename Row, typename... Rest>
+struct CmdRowOf<Row, Rest...> {
+  static constexpr uint8_t find(uint8_t opcode, uint8_t row) {
+    return opcode == Row::OPCODE ? row : CmdRowOf<Rest...>::find(opcode, row + 1);
+  }
+};
+
+// Los 256 opcodes como paquete de parámetros, para expandir el índice
+template <uint8_t... Opcodes>
+struct CmdOpcodes {};
+
+template <unsigned N, uint8_t... Opcodes>
+struct CmdAllOpcodes : CmdAllOpcodes<N - 1, N - 1, Opcodes...> {};
+
+template <uint8_t... Opcodes>
+struct CmdAllOpcodes<0, Opcodes...> { typedef CmdOpcodes<Opcodes...> Type; };
+
+template <typename Opcodes, typename... Rows>
+struct CmdIndex;
+
+template <uint8_t... Opcodes, typename... Rows>
+struct CmdIndex<CmdOpcodes<Opcodes...>, Rows...> {
+  static constexpr uint8_t ROW[256] = {CmdRowOf<Rows...>::find(Opcodes, 0)...};
+};
+
+template <uint8_t... Opcodes, typename... Rows>
+constexpr uint8_t CmdIndex<CmdOpcodes<Opcodes...>, Rows...>::ROW[256];
+
+// ==================== TABLA ====================
+template <typename... Rows>
+struct CommandSet {
+  enum : uint8_t { COUNT = sizeof...(Rows) };
+  static_assert(COUNT > 0 && COUNT < CMD_NO_ROW, "CommandSet needs between 1 and 254 rows");
+
+  typedef CmdStatus (*Runner)(const uint8_t* args, uint8_t argLen, bool authenticated, CmdResponseSink sink);
+  typedef CmdIndex<typename CmdAllOpcodes<256>::Type, Rows...> Index;
+
+  static constexpr Runner RUN[COUNT] = {&Rows::run...};
+  static constexpr CommandInfo INFO[COUNT] = {{Rows::MIN_LEN, Rows::FLAGS}...};
+  static constexpr uint8_t OPCODE[COUNT] = {Rows::OPCODE...};
+
+  static CmdStatus dispatch(uint8_t opcode, const uint8_t* args, uint8_t argLen,
+                            bool authenticated, CmdResponseSink sink) {
+    uint8_t row = Index::ROW[opcode];
+    if (row == CMD_NO_ROW) return CMD_UNKNOWN;
+    return RUN[row](args, argLen, authenticated, sink);
+  }
+
+  static bool lookup(uint8_t opcode, CommandInfo* info) {
+    uint8_t row = Index::ROW[opcode];
+    if (row == CMD_NO_ROW) return false;
+    *info = INFO[row];
+    return true;
+  }
+
+  // Opcode de la fila i (orden de la tabla), para recorrerla
+  static uint8_t opcodeAt(uint8_t i) {
+    return i < COUNT ? OPCODE[i] : 0;
+  }
+};
+
+template <typename... Rows>
+constexpr typename CommandSet<Rows...>::Runner CommandSet<Rows...>::RUN[];
+
+template <typename... Rows>
+constexpr CommandInfo CommandSet<Rows...>::INFO[];
+
+template <typename... Rows>
+constexpr uint8_t CommandSet<Rows...>::OPCODE[];
+
+#endif // CMD_DISPATCH_H
@@ -0,0 +1,41 @@
+/*
+ * Modo pipeline de comandos (master -> P2)
+ *
+ * Cada comando se envía como Write Command (sin respuesta ATT) envuelto en
+ * una trama secuenciada:
+ *
+ *   CMD:   [0xF0] [SEQ] [CMD] [LEN] [DATA...]
+ *   STATE: [0xF1] [SEQ]                         (ack acumulativo)
+ *
+ * El periférico procesa los comandos en orden y, cuando su cola queda vacía,
+ * confirma con un único ack el último SEQ procesado: un ack cubre todos los
+ * anteriores. El master mantiene hasta PIPE_WINDOW comandos sin confirmar
+ * por enlace (créditos), de modo que varios caben en el mismo evento de
+ * conexión en lugar de uno por ida y vuelta.
+ *
+ * Las tramas sin cabecera 0xF0 se siguen procesando como hasta ahora.
+ */
+
+#ifndef CMD_PIPELINE_H
+#define CMD_PIPELINE_H
+
+#include <Arduino.h>
+
+#define PIPE_FRAME_CMD        0xF0
+#define PIPE_FRAME_ACK        0xF1
+#define PIPE_HEADER_LEN       2     // Tipo + SEQ
+#define PIPE_WINDOW           4     // Comandos sin confirmar por enlace
+#define PIPE_ACK_TIMEOUT_MS   1000  // Sin ack en este tiempo: se liberan los créditos
+
+// Comandos enviados y aún no confirmados (aritmética módulo 256)
+inline uint8_t pipeInFlight(uint8_t sent, uint8_t acked) {
+  return (uint8_t)(sent - acked);
+}
+
+// true si seq confirma al menos un comando pendiente
+inline bool pipeAckAdvances(uint8_t seq, uint8_t sent, uint8_t acked) {
+  uint8_t advance = (uint8_t)(seq - acked);
+  return advance != 0 && advance <= pipeInFlight(sent, acked);
+}
+
+#endif // CMD_PIPELINE_H
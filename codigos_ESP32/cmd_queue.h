@@ -0,0 +1,167 @@
+/*
+ * Cola de comandos de los periféricos (P1, P2)
+ *
+ * El callback onWrite de Bluedroid solo copia la trama recibida a una
+ * celda de un pool preasignado y encola su índice. cmdTask la decodifica
+ * y procesa (estado, logs, notificaciones) fuera de la tarea BLE, de modo
+ * que la pila puede seguir aceptando escrituras mientras tanto.
+ *
+ * Dos colas de índices: cmdFreeQueue (celdas libres) y cmdReadyQueue
+ * (pendientes de procesar). Ninguna operación del lado BLE espera: si no
+ * queda celda libre la trama se descarta y se cuenta en MET_CMD_DROPPED.
+ * Cada trama lleva su origen (el enlace que la escribió, central_link.h),
+ * que cmdTask pasa al procesador junto con los datos.
+ *
+ * cmdTask atiende también los eventos del firmware (temporizadores
+ * esp_timer, p. ej. telemetría): viajan por cmdReadyQueue como índices
+ * >= CMD_EVENT_BASE. Un evento que ya está en cola no se vuelve a encolar
+ * (cmdEventPending), así que cmdReadyQueue siempre tiene sitio para todas
+ * las celdas del pool más un aviso por código de evento. Todo el estado del dispositivo se modifica desde esa
+ * única tarea y, entre evento y evento, no hay nada que sondear: el CPU
+ * queda en idle (light sleep automático con power_save.h).
+ */
+
+#ifndef CMD_QUEUE_H
+#define CMD_QUEUE_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+#include "att_mtu.h"
+#include "ble_metrics.h"
+
+#define CMD_POOL_SIZE       8     // Tramas en vuelo como máximo
+#define CMD_MAX_LEN         ATT_MAX_PAYLOAD  // Escritura más larga con el MTU objetivo
+#define CMD_TASK_PRIORITY   3     // Por encima de loop() y de logTask
+#define CMD_TASK_STACK      4096
+#define CMD_EVENT_BASE      0x80  // Índices de cmdReadyQueue a partir de aquí son eventos
+#define CMD_EVENT_MAX       4     // Códigos de evento distintos; cada uno, como mucho una vez en cola
+#define CMD_ORIGIN_MAX      4     // Orígenes distintos de las tramas (enlaces)
+
+// Mismo criterio que logTask: fuera del núcleo de Bluedroid
+#if defined(CONFIG_BT_BLUEDROID_PINNED_TO_CORE)
+#define CMD_TASK_CORE       (1 - CONFIG_BT_BLUEDROID_PINNED_TO_CORE)
+#else
+#define CMD_TASK_CORE       1
+#endif
+
+typedef void (*CmdHandler)(uint8_t* data, size_t length, uint8_t origin);
+typedef void (*CmdEventHandler)(uint8_t event);
+
+struct CmdSlot {
+  uint16_t length;
+  uint8_t origin;
+  uint8_t data[CMD_MAX_LEN];
+};
+
+static CmdSlot cmdPool[CMD_POOL_SIZE];
+static QueueHandle_t cmdFreeQueue = nullptr;
+static QueueHandle_t cmdReadyQueue = nullptr;
+static CmdHandler cmdHandler = nullptr;
+static CmdEventHandler cmdEventHandler = nullptr;
+static std::atomic<uint8_t> cmdOriginQueued[CMD_ORIGIN_MAX];  // Tramas en cmdReadyQueue por origen
+static std::atomic<bool> cmdEventPending[CMD_EVENT_MAX];      // Evento en cmdReadyQueue sin atender
+
+// Copia la trama al pool y la encola. Se llama desde el callback BLE.
+inline bool cmdQueuePush(const uint8_t* data, size_t length, uint8_t origin = 0) {
+  uint8_t index;
+  if (length > CMD_MAX_LEN || origin >= CMD_ORIGIN_MAX || xQueueReceive(cmdFreeQueue, &index, 0) != pdTRUE) {
+    metricsCount(MET_CMD_DROPPED);
+    return false;
+  }
+
+  cmdPool[index].length = length;
+  cmdPool[index].origin = origin;
+  cmdOriginQueued[origin].fetch_add(1, std::memory_order_relaxed);
+  memcpy(cmdPool[index].data, data, length);
+  if (xQueueSend(cmdReadyQueue, &index, 0) != pdTRUE) {
+    // No debería ocurrir (hay sitio para cada celda y cada evento), pero
+    // si ocurre la celda vuelve al pool en lugar de perderse
+    cmdOriginQueued[origin].fetch_sub(1, std::memory_order_relaxed);
+    xQueueSend(cmdFreeQueue, &index, 0);
+    metricsCount(MET_CMD_DROPPED);
+    return false;
+  }
+  metricsGaugeMax(MET_QUEUE_MAX, uxQueueMessagesWaiting(cmdReadyQueue));
+  return true;
+}
+
+// Tramas de un origen que cmdTask aún no ha empezado a procesar
+inline uint8_t cmdQueuePending(uint8_t origin) {
+  return origin < CMD_ORIGIN_MAX ? cmdOriginQueued[origin].load(std::memory_order_relaxed) : 0;
+}
+
+// Encola un evento para cmdEventHandler (tarea esp_timer o callbacks BLE).
+// Si el mismo evento sigue en cola, este disparo se funde con el pendiente.
+inline bool cmdQueuePostEvent(uint8_t event) {
+  if (event >= CMD_EVENT_MAX) return false;
+  if (cmdEventPending[event].exchange(true, std::memory_order_acq_rel)) return true;
+  uint8_t code = CMD_EVENT_BASE + event;
+  if (xQueueSend(cmdReadyQueue, &code, 0) != pdTRUE) {
+    cmdEventPending[event].store(false, std::memory_order_release);
+    return false;
+  }
+  return true;
+}
+
+inline void cmdTask(void* param) {
+  uint8_t index;
+  for (;;) {
+    if (xQueueReceive(cmdReadyQueue, &index, portMAX_DELAY) != pdTRUE) continue;
+    if (index >= CMD_EVENT_BASE) {
+      // Se libera antes de atenderlo: un disparo durante el handler vuelve a encolarse
+      cmdEventPending[index - CMD_EVENT_BASE].store(false, std::memory_order_release);
+      if (cmdEventHandler) cmdEventHandler(index - CMD_EVENT_BASE);
+      continue;
+    }
+    uint8_t origin = cmdPool[index].origin;
+    cmdOriginQueued[origin].fetch_sub(1, std::memory_order_relaxed);
+    cmdHandler(cmdPool[index].data, cmdPool[index].length, origin);
+    xQueueSend(cmdFreeQueue, &index, 0);
+  }
+}
+
+// ==================== TEMPORIZADORES ====================
+// Un esp_timer no necesita tick ni tarea propia que despierte: el CPU solo
+// sale de light sleep cuando vence y el callback solo publica el evento
+inline void cmdTimerCallback(void* arg) {
+  cmdQueuePostEvent((uint8_t)(uintptr_t)arg);
+}
+
+inline esp_timer_handle_t cmdTimerCreate(uint8_t event, const char* name) {
+  esp_timer_create_args_t args = {};
+  args.callback = cmdTimerCallback;
+  args.arg = (void*)(uintptr_t)event;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = name;
+  args.skip_unhandled_events = true;  // Tras un light sleep largo, un solo disparo
+  esp_timer_handle_t timer = nullptr;
+  esp_timer_create(&args, &timer);
+  return timer;
+}
+
+// (Re)arranca el temporizador con periodo periodMs (seguro desde callbacks BLE)
+inline void cmdTimerStart(esp_timer_handle_t timer, uint32_t periodMs) {
+  esp_timer_stop(timer);  // ESP_ERR_INVALID_STATE si no estaba en marcha
+  esp_timer_start_periodic(timer, periodMs * 1000ULL);
+}
+
+inline void cmdTimerStop(esp_timer_handle_t timer) {
+  esp_timer_stop(timer);
+}
+
+// Crea el pool y lanza cmdTask con el procesador de comandos del firmware
+// y, opcionalmente, el de eventos
+inline void cmdQueueBegin(CmdHandler handler, CmdEventHandler eventHandler = nullptr) {
+  cmdHandler = handler;
+  cmdEventHandler = eventHandler;
+  cmdFreeQueue = xQueueCreate(CMD_POOL_SIZE, sizeof(uint8_t));
+  cmdReadyQueue = xQueueCreate(CMD_POOL_SIZE + CMD_EVENT_MAX, sizeof(uint8_t));
+  for (uint8_t i = 0; i < CMD_POOL_SIZE; i++) {
+    xQueueSend(cmdFreeQueue, &i, 0);
+  }
+  xTaskCreatePinnedToCore(cmdTask, "cmdTask", CMD_TASK_STACK, nullptr, CMD_TASK_PRIORITY,
+                          nullptr, CMD_TASK_CORE);
+}
+
+#endif // CMD_QUEUE_H
@@ -0,0 +1,71 @@
+/*
+ * Perfiles de parámetros de conexión (latencia frente a consumo)
+ *
+ * El central elige el perfil de cada enlace con connParamsRequest() y
+ * Bluedroid lanza el procedimiento de actualización; el resultado llega
+ * a ambos extremos como ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT.
+ *
+ *   LOW_LATENCY  7.5 ms, sin slave latency: ráfagas de configuración
+ *   BALANCED     30-50 ms, sin slave latency
+ *   LOW_POWER    100-200 ms, slave latency 4: reposo a ritmo de telemetría
+ *
+ * Intervalos en unidades de 1.25 ms y timeout de supervisión en unidades
+ * de 10 ms. El timeout cumple timeout > (1 + latency) * interval * 2.
+ */
+
+#ifndef CONN_PARAMS_H
+#define CONN_PARAMS_H
+
+#include <Arduino.h>
+#include <esp_gap_ble_api.h>
+
+// Intervalo preferido que anuncian los periféricos (7.5-22.5 ms)
+#define CONN_ADV_MIN_INTERVAL   0x06
+#define CONN_ADV_MAX_INTERVAL   0x12
+
+enum LinkProfile : uint8_t {
+  LINK_PROFILE_LOW_LATENCY,
+  LINK_PROFILE_BALANCED,
+  LINK_PROFILE_LOW_POWER,
+  LINK_PROFILE_COUNT
+};
+
+struct ConnParamsProfile {
+  const char* name;
+  uint16_t minInterval;     // x 1.25 ms
+  uint16_t maxInterval;     // x 1.25 ms
+  uint16_t latency;         // Eventos que el periférico puede saltarse
+  uint16_t timeout;         // x 10 ms
+};
+
+static const ConnParamsProfile CONN_PROFILES[LINK_PROFILE_COUNT] = {
+  {"LOW_LATENCY", 6,  6,   0, 200},
+  {"BALANCED",    24, 40,  0, 400},
+  {"LOW_POWER",   80, 160, 4, 600},
+};
+
+// Intervalo en décimas de ms (unidades de 1.25 ms)
+inline uint32_t connIntervalTenthsMs(uint16_t interval) {
+  return interval * 125UL / 10;
+}
+
+// Solicita el perfil al controlador; el resultado llega como evento GAP
+inline bool connParamsRequest(esp_bd_addr_t peer, LinkProfile profile) {
+  const ConnParamsProfile& p = CONN_PROFILES[profile];
+  esp_ble_conn_update_params_t params;
+  memcpy(params.bda, peer, sizeof(esp_bd_addr_t));
+  params.min_int = p.minInterval;
+  params.max_int = p.maxInterval;
+  params.latency = p.latency;
+  params.timeout = p.timeout;
+  return esp_ble_gap_update_conn_params(&params) == ESP_OK;
+}
+
+// "Conn params: interval 7.5 ms, latency 0, timeout 2000 ms" en out
+inline void connParamsFormat(char* out, size_t outSize, uint16_t interval, uint16_t latency, uint16_t timeout) {
+  uint32_t tenths = connIntervalTenthsMs(interval);
+  snprintf(out, outSize, "Conn params: interval %lu.%lu ms, latency %u, timeout %lu ms",
+           (unsigned long)(tenths / 10), (unsigned long)(tenths % 10), latency, timeout * 10UL);
+}
+
+#endif // CONN_PARAMS_H
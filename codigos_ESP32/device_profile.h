@@ -0,0 +1,99 @@
+/*
+ * Perfiles de dispositivo en tiempo de compilación (master, P1, P2)
+ *
+ * Cada tipo de periférico es un struct sin estado con lo que distingue a
+ * su familia en el cable. Los periféricos se generan con Peripheral<Device>
+ * (peripheral.h), donde Device hereda de su perfil y añade las acciones del
+ * firmware; el master toma de los mismos tipos los UUIDs, el codificador y
+ * la telemetría de cada slot. Todo son constantes y funciones inline: el
+ * compilador resuelve cada llamada contra el perfil, sin tablas ni saltos
+ * indirectos.
+ *
+ *   NAME, SERVICE_UUID, CMD_UUID,   nombre anunciado y atributos GATT
+ *   STATE_UUID, DIAG_UUID
+ *   argLength(frame, length)        bytes de argumento de una trama CMD
+ *                                   (empiezan en ARGS_OFFSET)
+ *   encodeFrame(...)                trama CMD de la familia (ble_protocol.h)
+ *   AUTH_REQUIRED                   los comandos CMD_FLAG_AUTH piden sesión
+ *   PIPELINED                       acepta tramas secuenciadas (cmd_pipeline.h)
+ *   Subscribe, Ack, TELEMETRY_FIELDS, fieldSizes(), fieldLayouts()
+ *                                   telemetría (telemetry_frame.h)
+ *
+ * Un tipo de dispositivo nuevo es un perfil más aquí, sus mensajes en
+ * ble_protocol.h y, en su firmware, el Device con su tabla de comandos.
+ */
+
+#ifndef DEVICE_PROFILE_H
+#define DEVICE_PROFILE_H
+
+#include <Arduino.h>
+#include "ble_protocol.h"
+
+// ==================== P1 ====================
+// Sensor IoT sin autenticación: CMD de 4 bytes fijos [CMD, P1, P2, P3]
+struct P1Profile {
+  static constexpr const char* NAME         = "ESP32_P1";
+  static constexpr const char* SERVICE_UUID = "4fafc201-1fb5-459e-8fcc-c5c9c331914b";
+  static constexpr const char* CMD_UUID     = "beb5483e-36e1-4688-b7f5-ea07361b26a8";
+  static constexpr const char* STATE_UUID   = "beb5483f-36e1-4688-b7f5-ea07361b26a8";
+  static constexpr const char* DIAG_UUID    = "beb54840-36e1-4688-b7f5-ea07361b26a8";
+
+  enum : uint8_t {
+    ARGS_OFFSET = 1,
+    AUTH_REQUIRED = false,
+    PIPELINED = false,
+    TELEMETRY_FIELDS = sizeof(p1::telemetry::FIELD_SIZES)
+  };
+
+  typedef p1::TelemetrySubscribe Subscribe;
+  typedef p1::TelemetryAck Ack;
+
+  // Bytes tras el opcode, 0 si no hay y como mucho 255 (argLen es uint8_t)
+  static uint8_t argLength(const uint8_t* frame, size_t length) {
+    if (length <= ARGS_OFFSET) return 0;
+    return min(length - ARGS_OFFSET, (size_t)UINT8_MAX);
+  }
+
+  static size_t encodeFrame(uint8_t opcode, const uint8_t* payload, uint8_t payloadLen, ByteSpan out) {
+    return p1::encodeFrame(opcode, payload, payloadLen, out);
+  }
+
+  static constexpr const uint8_t* fieldSizes() { return p1::telemetry::FIELD_SIZES; }
+  static constexpr const TelemetryLayout* fieldLayouts() { return p1::telemetry::FIELD_LAYOUTS; }
+};
+
+// ==================== P2 ====================
+// Wearable con PIN, tickets y pipeline: CMD [CMD, LEN, DATA...]
+struct P2Profile {
+  static constexpr const char* NAME         = "ESP32_P2";
+  static constexpr const char* SERVICE_UUID = "5fafc301-2fb5-459e-8fcc-c5c9c331915c";
+  static constexpr const char* CMD_UUID     = "ceb5483e-46e1-4688-b7f5-ea07361b27a9";
+  static constexpr const char* STATE_UUID   = "ceb5483f-46e1-4688-b7f5-ea07361b27a9";
+  static constexpr const char* DIAG_UUID    = "ceb54840-46e1-4688-b7f5-ea07361b27a9";
+
+  enum : uint8_t {
+    ARGS_OFFSET = p2::HEADER_LEN,
+    AUTH_REQUIRED = true,
+    PIPELINED = true,
+    TELEMETRY_FIELDS = sizeof(p2::telemetry::FIELD_SIZES)
+  };
+
+  typedef p2::TelemetrySubscribe Subscribe;
+  typedef p2::TelemetryAck Ack;
+
+  // LEN mayor que la trama: solo cuentan los bytes realmente recibidos.
+  // Sin cabecera completa, 0 (frame[1] no se lee).
+  static uint8_t argLength(const uint8_t* frame, size_t length) {
+    if (length <= ARGS_OFFSET) return 0;
+    return min((size_t)frame[1], length - ARGS_OFFSET);
+  }
+
+  static size_t encodeFrame(uint8_t opcode, const uint8_t* payload, uint8_t payloadLen, ByteSpan out) {
+    return p2::encodeFrame(opcode, payload, payloadLen, out);
+  }
+
+  static constexpr const uint8_t* fieldSizes() { return p2::telemetry::FIELD_SIZES; }
+  static constexpr const TelemetryLayout* fieldLayouts() { return p2::telemetry::FIELD_LAYOUTS; }
+};
+
+#endif // DEVICE_PROFILE_H
@@ -0,0 +1,52 @@
+/*
+ * Utilidades del micro-benchmark de host
+ *
+ * benchRun() mide fn en tandas de BENCH_BATCH llamadas y devuelve la
+ * mediana de ns por llamada. Entre tandas se vacía el anillo de logs fuera
+ * de la medida: así el coste incluye encolar los registros (lo que paga la
+ * tarea BLE en el firmware) pero no formatearlos (lo hace logTask).
+ */
+
+#ifndef HOST_BENCH_H
+#define HOST_BENCH_H
+
+#include <Arduino.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include "ble_log.h"
+
+#define BENCH_BATCH     4     // Llamadas por tanda (sin llenar el anillo de logs)
+#define BENCH_ROUNDS    20000
+#define BENCH_WARMUP    1000
+
+inline uint64_t benchNowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+template <typename F>
+inline double benchRun(F fn) {
+  for (int i = 0; i < BENCH_WARMUP; i++) {
+    fn();
+    logDrain();
+  }
+
+  std::vector<double> samples;
+  samples.reserve(BENCH_ROUNDS);
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    uint64_t start = benchNowNs();
+    for (int i = 0; i < BENCH_BATCH; i++) fn();
+    samples.push_back((double)(benchNowNs() - start) / BENCH_BATCH);
+    logDrain();
+  }
+  std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+  return samples[samples.size() / 2];
+}
+
+inline void benchReport(const char* group, const char* label, double ns) {
+  ::printf("%-8s %-28s %9.1f ns/op\n", group, label, ns);
+}
+
+#endif // HOST_BENCH_H
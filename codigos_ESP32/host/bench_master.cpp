@@ -0,0 +1,149 @@
+// Micro-benchmark del master: notificaciones (copia + decodificación) y comandos (planificación + escritura)
+#include "../master.cpp"
+#include "master_host.h"
+#include "bench.h"
+
+struct NotifyCase {
+  const char* tag;        // Slot de la flota
+  const char* label;
+  uint8_t length;
+  uint8_t data[16];
+};
+
+static const NotifyCase NOTIFY_CASES[] = {
+  {"P1", "notify state echo",         4,  {0x01, 0x01, 0x00, 0x00}},
+  {"P1", "notify telemetry 0xA1",     6,  {0xA1, 0x03, 0x00, 0xFA, 0x02, 0x8A}},
+  {"P2", "notify auth result",        4,  {0x01, 0x01, 0x00, 0x01}},
+  {"P2", "notify auth + ticket",      12, {0x01, 0x01, 0x00, 0x01, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17}},
+  {"P2", "notify telemetry 0xA1",     12, {0xA1, 0x07, 0x01, 0x6D, 0x4B, 0x04, 0xE2, 0x55, 0x0F, 0xCF, 0xFE, 0x8A}},
+  {"P2", "notify vitals 0xA0",        5,  {0xA0, 0x01, 0x01, 0x6D, 0x4B}},
+  {"P2", "notify pipeline ack",       2,  {0xF1, 0x00}},
+  // Suscripción: keyframe SEQ 1 y un delta que se reaplica sobre él (SEQ = BASE = 1)
+  // para que la base no salga nunca del historial
+  {"P2", "notify keyframe 0xA3",      13, {0xA3, 0x07, 0x01, 0x01, 0x6D, 0x4B, 0x04, 0xE2, 0x55, 0x0F, 0xCF, 0xFE, 0x8A}},
+  {"P2", "notify delta 0xA2",         9,  {0xA2, 0x05, 0x00, 0x01, 0x01, 0x03, 0xFE, 0x01, 0xFF}},
+};
+
+#define BENCH_WHEEL_TIMERS  512
+
+// Flujo de prueba: se reprograma con un periodo que depende de su posición
+void benchWheelFire(WheelTimer* timer, uint32_t now) {
+  uint32_t period = 100 + ((uintptr_t)timer / sizeof(WheelTimer) % 97) * 50;
+  wheelAdd((TimerWheel*)timer->owner, timer, timer->expires + period);
+}
+
+PeripheralSlot* slotByTag(const char* tag) {
+  for (uint8_t i = 0; i < slotCount; i++) {
+    if (strcmp(slots[i].tag, tag) == 0) return &slots[i];
+  }
+  return nullptr;
+}
+
+int main() {
+  hostMasterBegin();
+
+  for (size_t i = 0; i < sizeof(NOTIFY_CASES) / sizeof(NOTIFY_CASES[0]); i++) {
+    const NotifyCase& c = NOTIFY_CASES[i];
+    PeripheralSlot* slot = slotByTag(c.tag);
+    benchReport(c.tag, c.label, benchRun([&]() {
+      hostNotify(slot, c.data, c.length);
+      hostDrain();
+    }));
+  }
+
+  // Coste en la tarea BLE: solo la copia a notifyRing
+  PeripheralSlot* p2Slot = slotByTag("P2");
+  const NotifyCase& burst = NOTIFY_CASES[4];
+  benchReport("P2", "notify enqueue (BLE task)", benchRun([&]() {
+    hostNotify(p2Slot, burst.data, burst.length);
+    notifyRing.pop();
+  }));
+
+  PeripheralSlot* p1Slot = slotByTag("P1");
+  uint8_t brightness[] = {80};
+  benchReport("P1", "encode+write cmd 0x03", benchRun([&]() {
+    sendCommand(p1Slot, p1::SetBrightness::OPCODE, brightness, sizeof(brightness));
+  }));
+
+  uint8_t timer[] = {0x00, 0x2D};
+  benchReport("P2", "encode+write cmd 0x12", benchRun([&]() {
+    sendCommand(p2Slot, p2::SetTimer::OPCODE, timer, sizeof(timer));
+  }));
+
+  // Pipeline: se devuelven los créditos en cada llamada
+  p2Slot->handlesVerified = true;
+  benchReport("P2", "pipelined cmd 0x12", benchRun([&]() {
+    p2Slot->pipeAcked = p2Slot->pipeSent;
+    sendCommand(p2Slot, p2::SetTimer::OPCODE, timer, sizeof(timer));
+  }));
+
+  // Secuencia de P1: encolar en appTask y escribir en ioTask
+  WheelTimer* p1Stream = &p1Slot->streams[0].timer;
+  benchReport("P1", "stream fire+flush step", benchRun([&]() {
+    streamFire(p1Stream, millis());
+    flushCommands(p1Slot);
+  }));
+
+  // Modo soak: sonda desde ioTask y emparejado con su respuesta en appTask
+  benchReport("SOAK", "probe + match + record", benchRun([&]() {
+    soakSent(p1Slot, 0x02, true, micros());
+    soakMatch(p1Slot, 0x02, micros());
+  }));
+
+  // Captura: un campo por registro, con la escritura a flash cada página
+  static const uint8_t field[] = {0x00, 0xFA};
+  benchReport("CAPTURE", "record + page flush", benchRun([&]() {
+    captureRecord(0, CAPTURE_P1, field, sizeof(field));
+    captureFlush();
+  }));
+
+  // Salida completa de una notificación de telemetría, incluido el trabajo
+  // de logTask: línea de texto con floats frente a tramas COBS
+  const NotifyCase& telemetry = NOTIFY_CASES[4];
+  benchReport("LOG", "telemetry text + drain", benchRun([&]() {
+    hostNotify(p2Slot, telemetry.data, telemetry.length);
+    hostDrain();
+    logDrain();
+  }));
+  logSetBinary(true);
+  logDrain();
+  benchReport("LOG", "telemetry binary + drain", benchRun([&]() {
+    hostNotify(p2Slot, telemetry.data, telemetry.length);
+    hostDrain();
+    logDrain();
+  }));
+  logSetBinary(false);
+
+  // Rueda: BENCH_WHEEL_TIMERS flujos periódicos repartidos, coste por disparo
+  static WheelTimer wheelTimers[BENCH_WHEEL_TIMERS];
+  static TimerWheel wheel;
+  wheelInit(&wheel, 0);
+  for (uint16_t i = 0; i < BENCH_WHEEL_TIMERS; i++) {
+    wheelTimerInit(&wheelTimers[i], benchWheelFire, &wheel, i & 3);
+    wheelAdd(&wheel, &wheelTimers[i], i * 7);
+  }
+  uint32_t wheelNow = 0;
+  benchReport("SCHED", "wheel fire (512 timers)", benchRun([&]() {
+    while (wheelAdvance(&wheel, wheelNow) == 0) wheelNow = wheelNextEvent(&wheel);
+  }));
+
+  // Filtro de escaneo: anuncio ajeno (otro UUID) y anuncio de P2
+  static const uint8_t addr[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+  uint8_t adv[31] = {2, 0x01, 0x06, 17, ESP_BLE_AD_TYPE_128SRV_CMPL};
+  memcpy(adv + 5, p2Slot->serviceUuid, 16);
+  adv[21] = 9;
+  adv[22] = ESP_BLE_AD_TYPE_NAME_CMPL;
+  memcpy(adv + 23, "ESP32_P2", 8);
+  uint8_t foreign[31];
+  memcpy(foreign, adv, sizeof(adv));
+  foreign[5] ^= 0xFF;
+  p2Slot->state = LINK_SCANNING;
+  benchReport("SCAN", "foreign advertisement", benchRun([&]() {
+    hostScanResult(addr, foreign, sizeof(foreign));
+  }));
+  benchReport("SCAN", "P2 advertisement", benchRun([&]() {
+    deviceRelease(p2Slot);
+    hostScanResult(addr, adv, sizeof(adv));
+  }));
+  return 0;
+}
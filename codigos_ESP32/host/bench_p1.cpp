@@ -0,0 +1,64 @@
+// Micro-benchmark de processCommand() de P1, una fila por opcode de la tabla
+#include "../client.cpp"
+#include "bench.h"
+#include "periph_host.h"
+
+int main() {
+  setup();
+  hostCentralConnect(0);
+
+  const uint8_t count = P1Device::Commands::COUNT;
+  for (uint8_t i = 0; i <= count; i++) {
+    // Última fila: opcode desconocido (camino de error)
+    uint8_t frame[p1::FRAME_LEN] = {(uint8_t)(i < count ? P1Device::Commands::opcodeAt(i) : 0x7F), 0, 0, 0};
+    double ns = benchRun([&]() { peripheral.processCommand(frame, sizeof(frame)); });
+
+    char label[32];
+    snprintf(label, sizeof(label), "cmd 0x%02X%s", frame[0], i < count ? "" : " (unknown)");
+    benchReport("P1", label, ns);
+  }
+
+  // Flood de opcodes desconocidos en onWrite: tras vaciar la cubeta
+  // RATE_INVALID cada escritura se descarta sin encolar ni responder
+  uint8_t unknown[p1::FRAME_LEN] = {0x7F, 0, 0, 0};
+  benchReport("P1", "write 0x7F flood (limited)", benchRun([&]() {
+    hostCentralWrite(0, unknown, sizeof(unknown));
+  }));
+
+  // Lectura de STATE desde la tarea BLE: copia de la versión publicada
+  benchReport("P1", "read state (seqlock)", benchRun([&]() {
+    peripheral.stateCharacteristic->callbacks->onRead(peripheral.stateCharacteristic);
+  }));
+
+  // Lectura de la característica de diagnóstico con las muestras anteriores
+  uint8_t snapshot[METRICS_SNAPSHOT_MAX];
+  double ns = benchRun([&]() { metricsEncode(ByteSpan(snapshot, sizeof(snapshot))); });
+  benchReport("P1", "diag snapshot", ns);
+
+  // Eventos de los temporizadores, como los atiende cmdTask
+  benchReport("P1", "event telemetry", benchRun([&]() { handleEvent(EVT_TELEMETRY); }));
+  benchReport("P1", "event diag", benchRun([&]() { handleEvent(EVT_DIAG); }));
+
+  // Con suscripción: delta contra la base, confirmada en cada llamada
+  p1::TelemetrySubscribe subscribe = {6, {5, 10}};
+  peripheral.txLink = 0;
+  onTelemetrySubscribe(subscribe);
+  TelemetryStream* stream = &peripheral.centrals.links[0].session.telemetry;
+  benchReport("P1", "event telemetry (subscribed)", benchRun([&]() {
+    handleEvent(EVT_TELEMETRY);
+    telemStreamAck(stream, stream->sent.seq);
+  }));
+
+  // Tres centrales suscritos: un delta por central, cada uno contra su base
+  hostCentralConnect(1);
+  hostCentralConnect(2);
+  for (peripheral.txLink = 1; peripheral.txLink < CENTRAL_MAX_LINKS; peripheral.txLink++) onTelemetrySubscribe(subscribe);
+  benchReport("P1", "event telemetry (3 centrals)", benchRun([&]() {
+    handleEvent(EVT_TELEMETRY);
+    for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+      TelemetryStream* s = &peripheral.centrals.links[i].session.telemetry;
+      telemStreamAck(s, s->sent.seq);
+    }
+  }));
+  return 0;
+}
@@ -0,0 +1,121 @@
+// Micro-benchmark de processCommand() de P2, una fila por opcode de la tabla
+#include "../client_Pin.cpp"
+#include "bench.h"
+#include "periph_host.h"
+
+int main() {
+  setup();
+  hostCentralConnect(0);
+
+  for (uint8_t i = 0; i < P2Device::Commands::COUNT; i++) {
+    uint8_t opcode = P2Device::Commands::opcodeAt(i);
+    CommandInfo info = {};
+    P2Device::Commands::lookup(opcode, &info);
+    uint8_t frame[CMD_MAX_LEN] = {opcode, info.minLen};
+    size_t length = p2::HEADER_LEN + info.minLen;
+
+    // Sesión abierta en cada llamada (LOGOUT la cierra)
+    double ns = benchRun([&]() {
+      deviceState.authLinks = 0x01;
+      peripheral.processCommand(frame, length);
+    });
+
+    char label[32];
+    snprintf(label, sizeof(label), "cmd 0x%02X", opcode);
+    benchReport("P2", label, ns);
+  }
+
+  // Caminos comunes: trama secuenciada, sin sesión y opcode desconocido
+  uint8_t piped[] = {PIPE_FRAME_CMD, 0x01, p2::SetMode::OPCODE, 1, 0x02};
+  benchReport("P2", "pipelined cmd 0x10", benchRun([&]() {
+    deviceState.authLinks = 0x01;
+    peripheral.processCommand(piped, sizeof(piped));
+  }));
+
+  uint8_t locked[] = {p2::SetMode::OPCODE, 1, 0x02};
+  benchReport("P2", "cmd 0x10 (not authenticated)", benchRun([&]() {
+    deviceState.authLinks = 0;
+    peripheral.processCommand(locked, sizeof(locked));
+  }));
+
+  uint8_t unknown[] = {0x7F, 0};
+  benchReport("P2", "cmd 0x7F (unknown)", benchRun([&]() {
+    deviceState.authLinks = 0x01;
+    peripheral.processCommand(unknown, sizeof(unknown));
+  }));
+
+  // Flood de opcodes desconocidos en onWrite: tras vaciar la cubeta
+  // RATE_INVALID cada escritura se descarta sin encolar ni responder
+  benchReport("P2", "write 0x7F flood (limited)", benchRun([&]() {
+    hostCentralWrite(0, unknown, sizeof(unknown));
+  }));
+
+  // Chunk masivo en bulkTask: copia al bloque en RAM, bitmap y ACK por
+  // tanda. Cada bloque completo pasa por el escritor (CRC y sector) y, al
+  // llenar la partición, la sesión se verifica y se abre otra.
+  uint8_t wire[BULK_BLOCK_SIZE + BULK_CRC_LEN] = {};
+  uint32_t crc = crc32Update(0, wire, BULK_BLOCK_SIZE);
+  for (uint8_t i = 0; i < BULK_CRC_LEN; i++) wire[BULK_BLOCK_SIZE + i] = crc >> (24 - 8 * i);
+  uint32_t id = 0;
+  for (uint32_t offset = 0; offset < HOST_PARTITION_SIZE; offset += BULK_BLOCK_SIZE) {
+    id = crc32Update(id, wire, BULK_BLOCK_SIZE);
+  }
+  BulkBegin begin = {BULK_KIND_CONFIG, id, HOST_PARTITION_SIZE, BULK_CHUNK_MAX};
+  uint16_t chunks = bulkChunks(BULK_BLOCK_SIZE, BULK_CHUNK_MAX);
+  uint16_t index = 0;
+  uint8_t chunk[ATT_MAX_PAYLOAD];
+  benchReport("P2", "bulk chunk", benchRun([&]() {
+    if (!bulkSession.active || bulkSession.done) {
+      begin.kind ^= BULK_KIND_CONFIG ^ BULK_KIND_SCHEDULE;  // Otra sesión, misma imagen
+      bulkPush(0, true, chunk, bulkEncode(BULK_FRAME_BEGIN, begin, ByteSpan(chunk, sizeof(chunk))));
+      bulkProcess();
+    }
+    uint16_t block = bulkSession.rxBlock;
+    uint16_t length = bulkChunkLength(BULK_BLOCK_SIZE, BULK_CHUNK_MAX, index);
+    chunk[0] = BULK_FRAME_DATA;
+    chunk[1] = block >> 8;
+    chunk[2] = block;
+    chunk[3] = index >> 8;
+    chunk[4] = index;
+    memcpy(chunk + BULK_DATA_HEADER, wire + index * BULK_CHUNK_MAX, length);
+    bulkPush(0, true, chunk, BULK_DATA_HEADER + length);
+    bulkProcess();
+    if (++index < chunks) return;
+    index = 0;
+    while (!bulkJobs.empty()) {
+      bulkWriterRun();
+      bulkProcess();
+    }
+  }));
+
+  // Evento de telemetría con sesión: paquete 0xA1 + log
+  benchReport("P2", "event telemetry", benchRun([&]() {
+    deviceState.authLinks = 0x01;
+    handleEvent(EVT_TELEMETRY);
+  }));
+
+  // Con suscripción: delta contra la base, confirmada en cada llamada
+  p2::TelemetrySubscribe subscribe = {6, {3, 0, 2}};
+  peripheral.txLink = 0;
+  onTelemetrySubscribe(subscribe);
+  TelemetryStream* stream = &peripheral.centrals.links[0].session.telemetry;
+  benchReport("P2", "event telemetry (subscribed)", benchRun([&]() {
+    deviceState.authLinks = 0x01;
+    handleEvent(EVT_TELEMETRY);
+    telemStreamAck(stream, stream->sent.seq);
+  }));
+
+  // Tres centrales autenticados y suscritos: un delta por central
+  hostCentralConnect(1);
+  hostCentralConnect(2);
+  for (peripheral.txLink = 1; peripheral.txLink < CENTRAL_MAX_LINKS; peripheral.txLink++) onTelemetrySubscribe(subscribe);
+  benchReport("P2", "event telemetry (3 centrals)", benchRun([&]() {
+    deviceState.authLinks = 0x07;
+    handleEvent(EVT_TELEMETRY);
+    for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+      TelemetryStream* s = &peripheral.centrals.links[i].session.telemetry;
+      telemStreamAck(s, s->sent.seq);
+    }
+  }));
+  return 0;
+}
@@ -0,0 +1,30 @@
+// Fuzz de los decodificadores de notificaciones y del filtro de escaneo del
+// master. Entrada = [selector] + valor notificado en STATE, o + datos de
+// anuncio si el bit 7 del selector está activo. El bit 6 activa el modo binario
+// del log (tramas COBS en vez de texto); el resto del selector elige el slot.
+#include "../master.cpp"
+#include "master_host.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static bool ready = false;
+  if (!ready) {
+    hostMasterBegin();
+    ready = true;
+  }
+  if (size < 1 || size - 1 > ATT_MAX_PAYLOAD) return 0;
+
+  PeripheralSlot* slot = &slots[(data[0] & 0x3F) % slotCount];
+  logSetBinary(data[0] & 0x40);
+  if (data[0] & 0x80) {
+    static const uint8_t addr[6] = {0xEC, 0xE3, 0x34, 0xB2, 0xE0, 0xC2};
+    slot->state = LINK_SCANNING;
+    deviceRelease(slot);
+    hostScanResult(addr, data + 1, size - 1);
+  } else {
+    slot->state = LINK_READY;
+    hostNotify(slot, data + 1, size - 1);
+    hostDrain();
+  }
+  logDrain();
+  return 0;
+}
@@ -0,0 +1,20 @@
+// Fuzz de processCommand() de P1. Entrada = valor escrito en la característica CMD.
+#include "../client.cpp"
+#include "periph_host.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static bool ready = false;
+  if (!ready) {
+    setup();
+    hostCentralConnect(0);
+    ready = true;
+  }
+  // Mismo filtro que onWrite() + cmdQueuePush()
+  if (size == 0 || size > CMD_MAX_LEN) return 0;
+
+  uint8_t frame[CMD_MAX_LEN];
+  memcpy(frame, data, size);
+  peripheral.processCommand(frame, size);
+  logDrain();
+  return 0;
+}
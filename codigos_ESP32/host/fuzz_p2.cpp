@@ -0,0 +1,35 @@
+// Fuzz de processCommand() de P2. Entrada = [sesión] + valor escrito en CMD;
+// el bit 0 del primer byte decide si hay sesión autenticada y el bit 1 si
+// la trama llega del segundo central (cada uno con su sesión). Las tramas
+// masivas van por bulkTask como en onWrite, con el escritor en el momento.
+#include "../client_Pin.cpp"
+#include "periph_host.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static bool ready = false;
+  if (!ready) {
+    setup();
+    hostCentralConnect(0);
+    hostCentralConnect(1);
+    ready = true;
+  }
+  if (size < 2 || size - 1 > ATT_MAX_PAYLOAD) return 0;
+
+  uint8_t link = (data[0] >> 1) & 0x01;
+  if (data[0] & 0x01) deviceState.authLinks |= 1 << link;
+  else deviceState.authLinks &= ~(1 << link);
+  if (bulkIsFrame(data + 1, size - 1)) {
+    bulkPush(link, data[0] & 0x01, data + 1, size - 1);
+    bulkProcess();
+    bulkWriterRun();
+    bulkProcess();
+    logDrain();
+    return 0;
+  }
+  if (size - 1 > CMD_MAX_LEN) return 0;
+  uint8_t frame[CMD_MAX_LEN];
+  memcpy(frame, data + 1, size - 1);
+  peripheral.processCommand(frame, size - 1, link);
+  logDrain();
+  return 0;
+}
@@ -0,0 +1,39 @@
+// main() para los fuzz targets sin libFuzzer (g++): ejecuta cada fichero
+// (o cada fichero de cada directorio) pasado como argumento, p. ej. el corpus
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+static bool runFile(const std::string& path) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  std::vector<uint8_t> buf;
+  uint8_t chunk[256];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) buf.insert(buf.end(), chunk, chunk + n);
+  fclose(f);
+  LLVMFuzzerTestOneInput(buf.empty() ? nullptr : buf.data(), buf.size());
+  return true;
+}
+
+int main(int argc, char** argv) {
+  size_t runs = 0;
+  for (int i = 1; i < argc; i++) {
+    DIR* dir = opendir(argv[i]);
+    if (!dir) {
+      if (runFile(argv[i])) runs++;
+      continue;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+      if (entry->d_name[0] == '.') continue;
+      if (runFile(std::string(argv[i]) + "/" + entry->d_name)) runs++;
+    }
+    closedir(dir);
+  }
+  printf("%zu inputs replayed\n", runs);
+  return 0;
+}
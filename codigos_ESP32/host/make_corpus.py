@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+Genera el corpus semilla de los fuzz targets de host a partir del dataset.
+
+- Escrituras ATT (Write Request 0x12 / Write Command 0x52) -> corpus p1 y p2
+- Notificaciones ATT (Handle Value Notification 0x1B)      -> corpus master
+- Anuncios de P1 y P2 (UUID de servicio + nombre), sintéticos -> corpus master
+- Telemetría suscrita (alta, ack, keyframe y delta), sintética  -> los tres
+- Reanudación de sesión con ticket (petición y respuesta)       -> p2 y master
+
+Cada semilla es un fichero binario con nombre = SHA-1 del contenido
+(convención de libFuzzer). Para p2 y master se antepone el byte selector
+que esperan fuzz_p2.cpp (sesión) y fuzz_master.cpp (slot).
+
+Uso: python3 make_corpus.py [dataset.csv] [directorio_salida]
+"""
+
+import csv
+import hashlib
+import os
+import sys
+
+DATASET_FILE = os.path.join(os.path.dirname(__file__), "..", "..", "dataset", "bluetooth_gatt_dataset.csv")
+OUTPUT_DIR = os.path.join(os.path.dirname(__file__), "build", "corpus")
+
+ATT_WRITE_REQUEST = 18   # btatt.opcode en decimal, como en el CSV
+ATT_WRITE_COMMAND = 82
+ATT_NOTIFICATION = 27
+
+SCAN_SELECTOR = 0x80     # Bit del selector de fuzz_master.cpp: datos de anuncio
+ADVERTISERS = [           # (slot, UUID de servicio, nombre) como en los firmwares
+    (0, "4fafc201-1fb5-459e-8fcc-c5c9c331914b", "ESP32_P1"),
+    (1, "5fafc301-2fb5-459e-8fcc-c5c9c331915c", "ESP32_P2"),
+]
+
+# Telemetría por cambios (telemetry_frame.h): no aparece en el dataset
+SUBSCRIBE_P1 = [bytes([0x07, 6, 5, 10, 0]), bytes([0x08, 0x00, 0, 0])]
+SUBSCRIBE_P2 = [bytes([0x14, 4, 6, 3, 0, 2]), bytes([0x15, 1, 0x00])]
+# Reanudación de sesión de P2: SESSION_RESUME y respuesta [0x01, userId, ticket]
+TICKET = bytes(range(0x10, 0x18))
+RESUME_P2 = [bytes([0x04, 10, 0x00, 0x01]) + TICKET]
+RESUME_FRAMES = [(1, bytes([0x04, 0x01, 0x00, 0x01]) + TICKET), (1, bytes([0x04, 0x00]))]
+TELEMETRY_FRAMES = [      # (slot, trama STATE); cada delta va contra el keyframe de su slot (SEQ 0)
+    (0, bytes([0xA3, 0x03, 0x00, 0x00, 0xFA, 0x02, 0x8A])),
+    (0, bytes([0xA2, 0x01, 0x00, 0x01, 0x00, 0x06])),
+    (1, bytes([0xA3, 0x07, 0x00, 0x01, 0x6D, 0x4B, 0x04, 0xE2, 0x55, 0x0F, 0xCF, 0xFE, 0x8A])),
+    (1, bytes([0xA2, 0x07, 0x02, 0x01, 0x00, 0x03, 0xFE, 0x04, 0xF0, 0x55, 0x01, 0xFF])),
+]
+
+def advertisement(uuid, name):
+    """Flags + UUID de 128 bits completo + nombre completo, como BLEAdvertising."""
+    uuid_le = bytes.fromhex(uuid.replace("-", ""))[::-1]
+    name_bytes = name.encode()
+    return (bytes([2, 0x01, 0x06]) + bytes([17, 0x07]) + uuid_le +
+            bytes([len(name_bytes) + 1, 0x09]) + name_bytes)
+
+def read_values(filename):
+    """Devuelve (escrituras, notificaciones) como listas de bytes únicos."""
+    writes, notifications = set(), set()
+    with open(filename, newline="") as f:
+        for row in csv.DictReader(f):
+            value = row["btatt.value"].strip()
+            if not value:
+                continue
+            try:
+                opcode = int(row["btatt.opcode"])
+                payload = bytes.fromhex(value)
+            except ValueError:
+                continue
+            if opcode in (ATT_WRITE_REQUEST, ATT_WRITE_COMMAND):
+                writes.add(payload)
+            elif opcode == ATT_NOTIFICATION:
+                notifications.add(payload)
+    return sorted(writes), sorted(notifications)
+
+def write_seeds(directory, seeds):
+    """Escribe cada semilla en directory; devuelve cuántas hay."""
+    os.makedirs(directory, exist_ok=True)
+    for seed in seeds:
+        name = hashlib.sha1(seed).hexdigest()
+        with open(os.path.join(directory, name), "wb") as f:
+            f.write(seed)
+    return len(seeds)
+
+def main():
+    dataset = sys.argv[1] if len(sys.argv) > 1 else DATASET_FILE
+    output = sys.argv[2] if len(sys.argv) > 2 else OUTPUT_DIR
+
+    writes, notifications = read_values(dataset)
+    counts = {
+        "p1": write_seeds(os.path.join(output, "p1"), writes + SUBSCRIBE_P1),
+        # Con y sin sesión autenticada
+        "p2": write_seeds(os.path.join(output, "p2"),
+                          [bytes([auth]) + w for w in writes + SUBSCRIBE_P2 + RESUME_P2 for auth in (0, 1)]),
+        # La misma notificación hacia P1 (slot 0) y P2 (slot 1)
+        "master": write_seeds(os.path.join(output, "master"),
+                              [bytes([slot]) + n for n in notifications for slot in (0, 1)] +
+                              [bytes([slot]) + frame for slot, frame in TELEMETRY_FRAMES + RESUME_FRAMES] +
+                              [bytes([SCAN_SELECTOR | slot]) + advertisement(uuid, name)
+                               for slot, uuid, name in ADVERTISERS]),
+    }
+    for target, count in counts.items():
+        print(f"✓ {target}: {count} semillas en {os.path.join(output, target)}")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,67 @@
+/*
+ * Enlaces simulados del master para el harness de host
+ *
+ * Incluir después de master.cpp. hostMasterBegin() ejecuta setup() y deja
+ * los slots de la flota en READY con handles fijos, como tras connectSlot(),
+ * para que hostNotify() entre por gattcEventHandler() igual que en el ESP32.
+ * Las tareas no corren: hostDrain() hace en el mismo hilo el trabajo de
+ * appTask (decodificar notifyRing), de ioTask (escribir los cmdRing) y de
+ * captureTask (páginas a la partición emulada del shim).
+ * hostScanResult() entrega un anuncio por gapEventHandler().
+ */
+
+#ifndef HOST_MASTER_HOST_H
+#define HOST_MASTER_HOST_H
+
+#define HOST_CMD_HANDLE     0x2A  // Handles de P1 en el dataset
+#define HOST_STATE_HANDLE   0x2C
+
+inline void hostMasterBegin() {
+  setup();
+  for (uint8_t i = 0; i < slotCount; i++) {
+    PeripheralSlot* slot = &slots[i];
+    slot->gattcIf = i + 1;
+    slot->connId = 0;
+    slot->mtu = ATT_MTU_DEFAULT;
+    slot->handles.cmd = HOST_CMD_HANDLE;
+    slot->handles.state = HOST_STATE_HANDLE;
+    slot->handles.stateCccd = HOST_STATE_HANDLE + 1;
+    slot->state = LINK_READY;
+  }
+}
+
+// Notificación STATE recibida en el enlace del slot
+inline void hostNotify(PeripheralSlot* slot, const uint8_t* data, size_t length) {
+  esp_ble_gattc_cb_param_t param;
+  memset(&param, 0, sizeof(param));
+  param.notify.conn_id = slot->connId;
+  param.notify.handle = slot->handles.state;
+  param.notify.value_len = length;
+  param.notify.value = (uint8_t*)data;
+  param.notify.is_notify = true;
+  gattcEventHandler(ESP_GATTC_NOTIFY_EVT, slot->gattcIf, &param);
+}
+
+// Vacía los anillos entre núcleos como lo harían appTask e ioTask
+inline void hostDrain() {
+  decodeNotifications(NOTIFY_RING_SIZE);
+  for (uint8_t i = 0; i < slotCount; i++) {
+    flushCommands(&slots[i]);
+  }
+  if (capturePartition) captureFlush();  // Trabajo de captureTask
+}
+
+// Anuncio (datos AD + respuesta de escaneo) recibido desde addr
+inline void hostScanResult(const uint8_t* addr, const uint8_t* adv, size_t length) {
+  esp_ble_gap_cb_param_t param;
+  memset(&param, 0, sizeof(param));
+  param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_RES_EVT;
+  memcpy(param.scan_rst.bda, addr, sizeof(esp_bd_addr_t));
+  param.scan_rst.ble_addr_type = BLE_ADDR_TYPE_PUBLIC;
+  length = min(length, sizeof(param.scan_rst.ble_adv));
+  memcpy(param.scan_rst.ble_adv, adv, length);
+  param.scan_rst.adv_data_len = length;
+  gapEventHandler(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+}
+
+#endif // HOST_MASTER_HOST_H
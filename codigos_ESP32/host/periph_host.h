@@ -0,0 +1,43 @@
+/*
+ * Centrales simulados de los periféricos para el harness de host
+ *
+ * Incluir después de client.cpp o client_Pin.cpp (su global peripheral,
+ * peripheral.h). hostCentralConnect() abre una conexión por ServerCallbacks
+ * y activa las CCCD de STATE y DIAG por gattsEventHandler(), como hace el
+ * master al conectar, y deja la sesión limpia (cmdTask ya aplicó el reset
+ * del enlace).
+ * hostCentralWrite() entra por onWrite() igual que una escritura de CMD.
+ */
+
+#ifndef HOST_PERIPH_HOST_H
+#define HOST_PERIPH_HOST_H
+
+inline void hostCentralConnect(uint16_t connId) {
+  esp_ble_gatts_cb_param_t param = {};
+  param.connect.conn_id = connId;
+  param.connect.remote_bda[5] = (uint8_t)connId;
+  peripheral.server->callbacks->onConnect(peripheral.server, &param);
+
+  uint8_t enable[] = {0x01, 0x00};
+  uint16_t cccds[] = {peripheral.stateCccd->getHandle(), peripheral.diagCccd->getHandle()};
+  for (uint16_t handle : cccds) {
+    param = {};
+    param.write.conn_id = connId;
+    param.write.handle = handle;
+    param.write.len = sizeof(enable);
+    param.write.value = enable;
+    BLEDevice::gattsHandler()(ESP_GATTS_WRITE_EVT, 0, &param);
+  }
+  peripheral.applyResets();
+}
+
+inline void hostCentralWrite(uint16_t connId, const uint8_t* data, size_t length) {
+  esp_ble_gatts_cb_param_t param = {};
+  param.write.conn_id = connId;
+  param.write.len = length;
+  BLECharacteristic* cmd = peripheral.cmdCharacteristic;
+  cmd->value.assign((const char*)data, length);
+  cmd->callbacks->onWrite(cmd, &param);
+}
+
+#endif // HOST_PERIPH_HOST_H
@@ -0,0 +1,64 @@
+/*
+ * Shim mínimo de Arduino-ESP32 para compilar los firmwares en el host
+ *
+ * Declara solo lo que usan master.cpp, client.cpp y client_Pin.cpp. Las
+ * implementaciones están en shim.cpp. Serial descarta la salida salvo que
+ * hostSerialEcho sea true.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include "freertos/FreeRTOS.h"
+// Como std::min/max pero admitiendo tipos mixtos (p. ej. max(0, long))
+template <class A, class B> inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+template <class A, class B> inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+typedef bool boolean;
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long);
+void pinMode(int, int);
+void digitalWrite(int, int);
+long random(long);
+long random(long, long);
+uint32_t esp_random();
+class String : public std::string {
+ public:
+  String() {}
+  String(const char* s) : std::string(s ? s : "") {}
+  String(const std::string& s) : std::string(s) {}
+};
+class HardwareSerial {
+ public:
+  void begin(unsigned long) {}
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+  size_t println(const char* s);
+  size_t print(const char* s);
+  size_t write(const uint8_t* d, size_t n);
+  int available();
+  int read();
+  void flush() {}
+  void updateBaudRate(unsigned long) {}
+};
+extern HardwareSerial Serial;
+// Contador de ciclos simulado a 240 MHz sobre el reloj monotónico; heap fijo
+class EspClass {
+ public:
+  uint32_t getCycleCount();
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getMinFreeHeap() { return 180000; }
+  uint32_t getMaxAllocHeap() { return 110000; }
+};
+extern EspClass ESP;
+uint32_t getCpuFrequencyMhz();
+extern bool hostSerialEcho;
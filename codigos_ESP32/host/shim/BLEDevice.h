@@ -0,0 +1,187 @@
+// Shim de la librería BLE (Bluedroid) de Arduino-ESP32: sin radio, las
+// llamadas no hacen nada y setValue() guarda el valor para inspeccionarlo
+#pragma once
+#include <Arduino.h>
+#include <map>
+#include <functional>
+#include "esp_gattc_api.h"
+#include "esp_gatts_api.h"
+#include "esp_gap_ble_api.h"
+class BLEUUID {
+ public:
+  BLEUUID() {}
+  BLEUUID(const char* s) : m(s) {}
+  BLEUUID(uint16_t) {}
+  bool equals(const BLEUUID& o) const { return m == o.m; }
+  std::string toString() const { return m; }
+  std::string m;
+};
+class BLEAddress {
+ public:
+  BLEAddress() { memset(n, 0, 6); }
+  explicit BLEAddress(const uint8_t* a) { memcpy(n, a, 6); }
+  esp_bd_addr_t* getNative() { return &n; }
+  std::string toString() const { return "00:00:00:00:00:00"; }
+  bool equals(const BLEAddress& o) const { return memcmp(n, o.n, 6) == 0; }
+  esp_bd_addr_t n;
+};
+class BLEAdvertisedDevice {
+ public:
+  std::string getName() { return name; }
+  BLEAddress getAddress() { return addr; }
+  bool haveServiceUUID() { return true; }
+  bool isAdvertisingService(BLEUUID) { return true; }
+  int getRSSI() { return -50; }
+  esp_ble_addr_type_t getAddressType() { return BLE_ADDR_TYPE_PUBLIC; }
+  std::string name; BLEAddress addr;
+};
+class BLEScanResults { public: int getCount() { return 0; } };
+class BLEAdvertisedDeviceCallbacks {
+ public:
+  virtual ~BLEAdvertisedDeviceCallbacks() {}
+  virtual void onResult(BLEAdvertisedDevice advertisedDevice) = 0;
+};
+class BLEScan {
+ public:
+  void setAdvertisedDeviceCallbacks(BLEAdvertisedDeviceCallbacks*, bool wantDuplicates = false, bool shouldParse = true) {}
+  void setActiveScan(bool) {}
+  void setInterval(uint16_t) {}
+  void setWindow(uint16_t) {}
+  BLEScanResults start(uint32_t duration, bool is_continue = false) { return BLEScanResults(); }
+  bool start(uint32_t duration, void (*cb)(BLEScanResults), bool is_continue = false) { return true; }
+  void stop() {}
+  void clearResults() {}
+};
+class BLERemoteDescriptor {
+ public:
+  uint16_t getHandle() { return 0; }
+  void writeValue(uint8_t* data, size_t length, bool response = false) {}
+};
+class BLERemoteCharacteristic;
+typedef std::function<void(BLERemoteCharacteristic*, uint8_t*, size_t, bool)> notify_callback;
+class BLERemoteCharacteristic {
+ public:
+  void writeValue(uint8_t* data, size_t length, bool response = false) {}
+  void registerForNotify(notify_callback cb, bool notifications = true, bool descriptorRequiresRegistration = true) {}
+  uint16_t getHandle() { return 0; }
+  BLERemoteDescriptor* getDescriptor(BLEUUID) { return nullptr; }
+  bool canWriteNoResponse() { return true; }
+};
+class BLERemoteService {
+ public:
+  BLERemoteCharacteristic* getCharacteristic(const char*) { return nullptr; }
+  BLERemoteCharacteristic* getCharacteristic(BLEUUID) { return nullptr; }
+};
+class BLEClient;
+class BLEClientCallbacks {
+ public:
+  virtual ~BLEClientCallbacks() {}
+  virtual void onConnect(BLEClient*) = 0;
+  virtual void onDisconnect(BLEClient*) = 0;
+};
+class BLEClient {
+ public:
+  bool connect(BLEAdvertisedDevice*) { return true; }
+  bool connect(BLEAddress, esp_ble_addr_type_t type = BLE_ADDR_TYPE_PUBLIC) { return true; }
+  void disconnect() {}
+  bool isConnected() { return false; }
+  BLERemoteService* getService(const char*) { return nullptr; }
+  BLERemoteService* getService(BLEUUID) { return nullptr; }
+  void setClientCallbacks(BLEClientCallbacks*) {}
+  uint16_t getConnId() { return 0; }
+  esp_gatt_if_t getGattcIf() { return 0; }
+  BLEAddress getPeerAddress() { return BLEAddress(); }
+  uint16_t getMTU() { return 23; }
+  bool setMTU(uint16_t) { return true; }
+};
+class BLEServer;
+class BLECharacteristic;
+// Handles distintos por atributo, como en la tabla GATT real
+inline uint16_t hostNextHandle() { static uint16_t next = 0x0020; return next++; }
+class BLEDescriptor {
+ public:
+  virtual ~BLEDescriptor() {}
+  uint16_t getHandle() { return handle; }
+  uint16_t handle = hostNextHandle();
+};
+class BLE2902 : public BLEDescriptor {
+ public:
+  bool getNotifications() { return true; }
+};
+class BLECharacteristicCallbacks {
+ public:
+  virtual ~BLECharacteristicCallbacks() {}
+  virtual void onWrite(BLECharacteristic*) {}
+  virtual void onWrite(BLECharacteristic*, esp_ble_gatts_cb_param_t*) {}
+  virtual void onRead(BLECharacteristic*) {}
+  virtual void onRead(BLECharacteristic*, esp_ble_gatts_cb_param_t*) {}
+  enum Status { SUCCESS_INDICATE, SUCCESS_NOTIFY, ERROR_INDICATE_DISABLED, ERROR_NOTIFY_DISABLED,
+                ERROR_GATT, ERROR_NO_CLIENT, ERROR_INDICATE_TIMEOUT, ERROR_INDICATE_FAILURE };
+  virtual void onStatus(BLECharacteristic*, Status, uint32_t) {}
+};
+class BLECharacteristic {
+ public:
+  static const uint32_t PROPERTY_READ = 1 << 0;
+  static const uint32_t PROPERTY_WRITE = 1 << 1;
+  static const uint32_t PROPERTY_NOTIFY = 1 << 2;
+  static const uint32_t PROPERTY_WRITE_NR = 1 << 5;
+  void setValue(uint8_t* data, size_t len);
+  std::string getValue() { return value; }
+  void notify(bool is_notification = true);
+  void addDescriptor(BLEDescriptor*) {}
+  void setCallbacks(BLECharacteristicCallbacks* cb) { callbacks = cb; }
+  uint16_t getHandle() { return handle; }
+  std::string value;
+  BLECharacteristicCallbacks* callbacks = nullptr;
+  uint16_t handle = hostNextHandle();
+};
+class BLEService {
+ public:
+  BLECharacteristic* createCharacteristic(const char*, uint32_t) { return new BLECharacteristic(); }
+  void start() {}
+};
+class BLEServerCallbacks {
+ public:
+  virtual ~BLEServerCallbacks() {}
+  virtual void onConnect(BLEServer*) {}
+  virtual void onConnect(BLEServer*, esp_ble_gatts_cb_param_t*) {}
+  virtual void onDisconnect(BLEServer*) {}
+  virtual void onDisconnect(BLEServer*, esp_ble_gatts_cb_param_t*) {}
+};
+class BLEServer {
+ public:
+  BLEService* createService(const char*) { return new BLEService(); }
+  void setCallbacks(BLEServerCallbacks* cb) { callbacks = cb; }
+  void startAdvertising() {}
+  void disconnect(uint16_t connId) {}
+  uint16_t getGattsIf() { return 0; }
+  BLEServerCallbacks* callbacks = nullptr;
+};
+class BLEAdvertising {
+ public:
+  void addServiceUUID(const char*) {}
+  void setScanResponse(bool) {}
+  void setMinPreferred(uint16_t) {}
+  void setMaxPreferred(uint16_t) {}
+  void start() {}
+  void stop() {}
+};
+typedef void (*gatts_event_handler)(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t* param);
+typedef void (*gap_event_handler)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+typedef void (*gattc_event_handler)(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t* param);
+class BLEDevice {
+ public:
+  static void setCustomGattcHandler(gattc_event_handler h) {}
+  static void setCustomGattsHandler(gatts_event_handler h) { gattsHandler() = h; }
+  static gatts_event_handler& gattsHandler() { static gatts_event_handler h = nullptr; return h; }
+  static void setCustomGapHandler(gap_event_handler h) {}
+  static esp_err_t setMTU(uint16_t mtu) { return ESP_OK; }
+  static uint16_t getMTU() { return 23; }
+  static void init(const char*) {}
+  static BLEAddress getAddress() { return BLEAddress(); }
+  static BLEScan* getScan() { static BLEScan s; return &s; }
+  static BLEClient* createClient() { return new BLEClient(); }
+  static BLEServer* createServer() { return new BLEServer(); }
+  static BLEAdvertising* getAdvertising() { static BLEAdvertising a; return &a; }
+  static void startAdvertising() {}
+};
@@ -0,0 +1,12 @@
+#pragma once
+#include <Arduino.h>
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false) { return true; }
+  void end() {}
+  size_t putBytes(const char* key, const void* value, size_t len) { return len; }
+  size_t getBytes(const char* key, void* buf, size_t maxLen) { return 0; }
+  size_t getBytesLength(const char* key) { return 0; }
+  bool remove(const char* key) { return true; }
+  bool clear() { return true; }
+};
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+typedef uint8_t esp_bd_addr_t[6];
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+typedef enum { BLE_ADDR_TYPE_PUBLIC = 0, BLE_ADDR_TYPE_RANDOM = 1, BLE_ADDR_TYPE_RPA_PUBLIC = 2, BLE_ADDR_TYPE_RPA_RANDOM = 3 } esp_ble_addr_type_t;
+typedef enum { ESP_GATT_OK = 0, ESP_GATT_INVALID_HANDLE = 1, ESP_GATT_ERROR = 0x85 } esp_gatt_status_t;
+typedef uint8_t esp_gatt_if_t;
+typedef enum { ESP_GATT_WRITE_TYPE_NO_RSP = 1, ESP_GATT_WRITE_TYPE_RSP = 2 } esp_gatt_write_type_t;
+typedef enum { ESP_GATT_AUTH_REQ_NONE = 0 } esp_gatt_auth_req_t;
+typedef enum { ESP_BT_STATUS_SUCCESS = 0, ESP_BT_STATUS_FAIL = 1 } esp_bt_status_t;
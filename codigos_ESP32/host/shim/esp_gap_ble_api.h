@@ -0,0 +1,42 @@
+#pragma once
+#include "esp_bt_defs.h"
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length);
+typedef struct {
+  esp_bd_addr_t bda; uint16_t min_int; uint16_t max_int; uint16_t latency; uint16_t timeout;
+} esp_ble_conn_update_params_t;
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t* params);
+typedef enum {
+  ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT = 2, ESP_GAP_BLE_SCAN_RESULT_EVT = 3,
+  ESP_GAP_BLE_SCAN_START_COMPLETE_EVT = 7, ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT = 18,
+  ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT = 20
+} esp_gap_ble_cb_event_t;
+typedef enum { ESP_GAP_SEARCH_INQ_RES_EVT = 0, ESP_GAP_SEARCH_INQ_CMPL_EVT = 1 } esp_gap_search_evt_t;
+#define ESP_BLE_AD_TYPE_128SRV_PART 0x06
+#define ESP_BLE_AD_TYPE_128SRV_CMPL 0x07
+#define ESP_BLE_AD_TYPE_NAME_SHORT 0x08
+#define ESP_BLE_AD_TYPE_NAME_CMPL 0x09
+typedef union {
+  struct { esp_bt_status_t status; } scan_param_cmpl;
+  struct { esp_bt_status_t status; } scan_start_cmpl;
+  struct { esp_bt_status_t status; } scan_stop_cmpl;
+  struct {
+    esp_gap_search_evt_t search_evt; esp_bd_addr_t bda; esp_ble_addr_type_t ble_addr_type;
+    int rssi; uint8_t ble_adv[62]; int flag; int num_resps; uint8_t adv_data_len; uint8_t scan_rsp_len;
+  } scan_rst;
+  struct {
+    esp_bt_status_t status; esp_bd_addr_t bda; uint16_t min_int; uint16_t max_int;
+    uint16_t latency; uint16_t conn_int; uint16_t timeout;
+  } update_conn_params;
+} esp_ble_gap_cb_param_t;
+typedef enum { BLE_SCAN_TYPE_PASSIVE = 0, BLE_SCAN_TYPE_ACTIVE = 1 } esp_ble_scan_type_t;
+typedef enum { BLE_SCAN_FILTER_ALLOW_ALL = 0, BLE_SCAN_FILTER_ALLOW_ONLY_WLST = 1 } esp_ble_scan_filter_t;
+typedef enum { BLE_SCAN_DUPLICATE_DISABLE = 0, BLE_SCAN_DUPLICATE_ENABLE = 1 } esp_ble_scan_duplicate_t;
+typedef enum { BLE_WL_ADDR_TYPE_PUBLIC = 0, BLE_WL_ADDR_TYPE_RANDOM = 1 } esp_ble_wl_addr_type_t;
+typedef struct {
+  esp_ble_scan_type_t scan_type; esp_ble_addr_type_t own_addr_type; esp_ble_scan_filter_t scan_filter_policy;
+  uint16_t scan_interval; uint16_t scan_window; esp_ble_scan_duplicate_t scan_duplicate;
+} esp_ble_scan_params_t;
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t* params);
+esp_err_t esp_ble_gap_start_scanning(uint32_t duration);
+esp_err_t esp_ble_gap_stop_scanning(void);
+esp_err_t esp_ble_gap_update_whitelist(bool add_remove, esp_bd_addr_t remote_bda, esp_ble_wl_addr_type_t wl_addr_type);
@@ -0,0 +1,19 @@
+#pragma once
+#include "esp_bt_defs.h"
+typedef enum {
+  ESP_GATTC_REG_EVT = 0, ESP_GATTC_OPEN_EVT = 2, ESP_GATTC_WRITE_CHAR_EVT = 5, ESP_GATTC_CLOSE_EVT = 6,
+  ESP_GATTC_NOTIFY_EVT = 10, ESP_GATTC_WRITE_DESCR_EVT = 9, ESP_GATTC_CFG_MTU_EVT = 18,
+  ESP_GATTC_REG_FOR_NOTIFY_EVT = 38, ESP_GATTC_CONNECT_EVT = 40, ESP_GATTC_DISCONNECT_EVT = 41
+} esp_gattc_cb_event_t;
+typedef union {
+  struct { uint16_t conn_id; esp_bd_addr_t remote_bda; uint16_t handle; uint16_t value_len; uint8_t* value; bool is_notify; } notify;
+  struct { esp_gatt_status_t status; uint16_t conn_id; uint16_t handle; uint16_t offset; } write;
+  struct { esp_gatt_status_t status; uint16_t conn_id; esp_bd_addr_t remote_bda; uint16_t mtu; } open;
+  struct { esp_gatt_status_t status; uint16_t conn_id; uint16_t mtu; } cfg_mtu;
+  struct { uint16_t conn_id; esp_bd_addr_t remote_bda; } connect;
+  struct { int reason; uint16_t conn_id; esp_bd_addr_t remote_bda; } disconnect;
+} esp_ble_gattc_cb_param_t;
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len, uint8_t* value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req);
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len, uint8_t* value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req);
+esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle);
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t gattc_if, uint16_t conn_id);
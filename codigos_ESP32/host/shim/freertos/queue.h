@@ -0,0 +1,10 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef struct QueueShim* QueueHandle_t;
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t, const void* item, TickType_t wait);
+BaseType_t xQueueSendToBack(QueueHandle_t, const void* item, TickType_t wait);
+BaseType_t xQueueSendFromISR(QueueHandle_t, const void* item, BaseType_t* woken);
+BaseType_t xQueueReceive(QueueHandle_t, void* item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t);
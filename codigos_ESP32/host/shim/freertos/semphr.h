@@ -0,0 +1,7 @@
+#pragma once
+#include "freertos/queue.h"
+typedef QueueHandle_t SemaphoreHandle_t;
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t);
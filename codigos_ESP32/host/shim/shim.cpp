@@ -0,0 +1,156 @@
+// Implementaciones del shim de host: reloj real, Serial a stdout (opcional),
+// colas FreeRTOS sobre std::deque y API de Bluedroid sin efecto
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <time.h>
+#include <deque>
+#include <vector>
+
+HardwareSerial Serial;
+EspClass ESP;
+bool hostSerialEcho = false;
+
+static uint64_t hostNowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t hostNowUs() { return hostNowNs() / 1000; }
+
+uint32_t EspClass::getCycleCount() { return (uint32_t)(hostNowNs() * 240 / 1000); }
+uint32_t getCpuFrequencyMhz() { return 240; }
+unsigned long millis() { return (unsigned long)(hostNowUs() / 1000); }
+unsigned long micros() { return (unsigned long)hostNowUs(); }
+void delay(unsigned long) {}
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+long random(long m) { return m > 0 ? rand() % m : 0; }
+long random(long a, long b) { return b > a ? a + rand() % (b - a) : a; }
+uint32_t esp_random() { return (uint32_t)rand() ^ ((uint32_t)rand() << 16); }
+
+size_t HardwareSerial::printf(const char* fmt, ...) {
+  if (!hostSerialEcho) return 0;
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vprintf(fmt, ap);
+  va_end(ap);
+  return n;
+}
+size_t HardwareSerial::println(const char* s) { return hostSerialEcho ? ::printf("%s\n", s) : 0; }
+size_t HardwareSerial::print(const char* s) { return hostSerialEcho ? ::printf("%s", s) : 0; }
+size_t HardwareSerial::write(const uint8_t* d, size_t n) { return hostSerialEcho ? fwrite(d, 1, n, stdout) : n; }
+int HardwareSerial::available() { return 0; }
+int HardwareSerial::read() { return -1; }
+
+void BLECharacteristic::setValue(uint8_t* d, size_t n) { value.assign((const char*)d, n); }
+void BLECharacteristic::notify(bool) {
+  if (callbacks) callbacks->onStatus(this, BLECharacteristicCallbacks::SUCCESS_NOTIFY, 0);
+}
+
+// ==================== FREERTOS ====================
+// Las tareas no se lanzan: el harness llama directamente a las funciones
+struct QueueShim {
+  UBaseType_t len, size;
+  std::deque<std::vector<uint8_t> > items;
+};
+
+BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* h) {
+  if (h) *h = (TaskHandle_t)1;
+  return pdPASS;
+}
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* h, BaseType_t) {
+  if (h) *h = (TaskHandle_t)1;
+  return pdPASS;
+}
+void vTaskDelay(TickType_t) {}
+void vTaskDelete(TaskHandle_t) {}
+TickType_t xTaskGetTickCount() { return (TickType_t)millis(); }
+TaskHandle_t xTaskGetCurrentTaskHandle() { return (TaskHandle_t)1; }
+BaseType_t xPortGetCoreID() { return 0; }
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*) {}
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+
+struct esp_timer { esp_timer_create_args_t args; uint64_t periodUs; };
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+  *out = new esp_timer();
+  (*out)->args = *args;
+  return ESP_OK;
+}
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t t, uint64_t us) { t->periodUs = us; return ESP_OK; }
+esp_err_t esp_timer_stop(esp_timer_handle_t t) { t->periodUs = 0; return ESP_OK; }
+int64_t esp_timer_get_time() { return (int64_t)hostNowUs(); }
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t size) {
+  QueueShim* q = new QueueShim();
+  q->len = len;
+  q->size = size;
+  return q;
+}
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t) {
+  if (q->items.size() >= q->len) return pdFAIL;
+  const uint8_t* p = (const uint8_t*)item;
+  q->items.push_back(std::vector<uint8_t>(p, p + q->size));
+  return pdPASS;
+}
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void* item, TickType_t w) { return xQueueSend(q, item, w); }
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void* item, BaseType_t*) { return xQueueSend(q, item, 0); }
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t) {
+  if (q->items.empty()) return pdFAIL;
+  memcpy(item, q->items.front().data(), q->size);
+  q->items.pop_front();
+  return pdPASS;
+}
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) { return q->items.size(); }
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) { return q->len - q->items.size(); }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return xQueueCreate(1, 0); }
+SemaphoreHandle_t xSemaphoreCreateMutex() { return xQueueCreate(1, 0); }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+
+// ==================== BLUEDROID ====================
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t, uint16_t, uint16_t, uint16_t, uint8_t*, esp_gatt_write_type_t, esp_gatt_auth_req_t) { return ESP_OK; }
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t, uint16_t, uint16_t, uint16_t, uint8_t*, esp_gatt_write_type_t, esp_gatt_auth_req_t) { return ESP_OK; }
+esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t, esp_bd_addr_t, uint16_t) { return ESP_OK; }
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t, uint16_t) { return ESP_OK; }
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t, uint16_t) { return ESP_OK; }
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t*) { return ESP_OK; }
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t*) { return ESP_OK; }
+esp_err_t esp_ble_gap_start_scanning(uint32_t) { return ESP_OK; }
+esp_err_t esp_ble_gap_stop_scanning(void) { return ESP_OK; }
+esp_err_t esp_ble_gap_update_whitelist(bool, esp_bd_addr_t, esp_ble_wl_addr_type_t) { return ESP_OK; }
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t, uint16_t, uint16_t, uint16_t, uint8_t*, bool) { return ESP_OK; }
+
+// ==================== FLASH ====================
+uint8_t hostPartitionData[HOST_PARTITION_SIZE];
+static const esp_partition_t hostPartition = {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS,
+                                              0x290000, HOST_PARTITION_SIZE, "spiffs", false};
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t, const char* label) {
+  static bool erased = false;
+  if (!erased) {
+    memset(hostPartitionData, 0xFF, sizeof(hostPartitionData));
+    erased = true;
+  }
+  if (type != hostPartition.type || (label && strcmp(label, hostPartition.label) != 0)) return nullptr;
+  return &hostPartition;
+}
+esp_err_t esp_partition_read(const esp_partition_t* p, size_t offset, void* dst, size_t size) {
+  if (offset + size > p->size) return -1;
+  memcpy(dst, hostPartitionData + offset, size);
+  return ESP_OK;
+}
+esp_err_t esp_partition_write(const esp_partition_t* p, size_t offset, const void* src, size_t size) {
+  if (offset + size > p->size) return -1;
+  const uint8_t* in = (const uint8_t*)src;
+  for (size_t i = 0; i < size; i++) hostPartitionData[offset + i] &= in[i];
+  return ESP_OK;
+}
+esp_err_t esp_partition_erase_range(const esp_partition_t* p, size_t offset, size_t size) {
+  if (offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE || offset + size > p->size) return -1;
+  memset(hostPartitionData + offset, 0xFF, size);
+  return ESP_OK;
+}
@@ -0,0 +1,29 @@
+/*
+ * Comprobaciones mínimas para los tests de host (make test)
+ *
+ * TEST_CHECK() anota el fallo con fichero y línea y sigue; testReport()
+ * resume y da el código de salida.
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+static int testChecks = 0;
+static int testFailures = 0;
+
+#define TEST_CHECK(cond) do { \
+    testChecks++; \
+    if (!(cond)) { \
+      testFailures++; \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while (0)
+
+inline int testReport(const char* name) {
+  printf("%-7s %d/%d checks passed\n", name, testChecks - testFailures, testChecks);
+  return testFailures ? 1 : 0;
+}
+
+#endif // HOST_TEST_H
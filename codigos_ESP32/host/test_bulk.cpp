@@ -0,0 +1,169 @@
+// Tests del receptor de transferencias masivas (bulk_receiver.h): ACK
+// selectivo, RESEND sin búfer, bloque con CRC roto y reanudación con BEGIN
+#include "../client.cpp"
+#include "test.h"
+
+#define IMAGE_SIZE  (2 * BULK_BLOCK_SIZE + 1000)  // Dos bloques enteros y uno corto
+#define CHUNK       BULK_CHUNK_MAX
+
+static uint8_t image[IMAGE_SIZE];
+static uint32_t imageId;
+
+// Últimos ACKs que bulkTask manda al master (ackAt(n) = el n-ésimo)
+#define ACK_HISTORY 8
+static BulkAck acks[ACK_HISTORY];
+static uint16_t ackCount;
+
+static void captureAck(uint8_t link, const uint8_t* frame, size_t length) {
+  if (length == 1 + BulkAck::SIZE && frame[0] == BULK_FRAME_ACK) {
+    decodeFrom(ConstByteSpan(frame + 1, length - 1), acks[ackCount++ % ACK_HISTORY]);
+  }
+}
+
+static const BulkAck& ackAt(uint16_t n) {
+  return acks[n % ACK_HISTORY];
+}
+
+static const BulkAck& lastAck() {
+  return ackAt(ackCount - 1);
+}
+
+static bool ackIs(const BulkAck& ack, uint8_t status, uint16_t block, uint16_t next, uint32_t bits) {
+  return ack.status == status && ack.block == block && ack.next == next && ack.bits == bits;
+}
+
+static void sendBegin(uint8_t link, uint32_t id) {
+  BulkBegin begin = {BULK_KIND_CONFIG, id, IMAGE_SIZE, CHUNK};
+  uint8_t frame[1 + BulkBegin::SIZE];
+  bulkPush(link, true, frame, bulkEncode(BULK_FRAME_BEGIN, begin, ByteSpan(frame, sizeof(frame))));
+  bulkProcess();
+}
+
+// Chunk index del bloque tal como va en el cable: datos y CRC-32 detrás.
+// corrupt cambia un byte de datos sin tocar el CRC.
+static void sendChunk(uint8_t link, uint16_t block, uint16_t index, bool corrupt = false) {
+  uint16_t length = bulkBlockLength(IMAGE_SIZE, block);
+  uint8_t wire[BULK_BLOCK_SIZE + BULK_CRC_LEN];
+  memcpy(wire, image + (uint32_t)block * BULK_BLOCK_SIZE, length);
+  uint32_t crc = crc32Update(0, wire, length);
+  for (uint8_t i = 0; i < BULK_CRC_LEN; i++) wire[length + i] = crc >> (24 - 8 * i);
+  if (corrupt) wire[0] ^= 0x01;
+
+  uint8_t frame[ATT_MAX_PAYLOAD] = {BULK_FRAME_DATA, (uint8_t)(block >> 8), (uint8_t)block,
+                                    (uint8_t)(index >> 8), (uint8_t)index};
+  uint16_t chunkLength = bulkChunkLength(length, CHUNK, index);
+  memcpy(frame + BULK_DATA_HEADER, wire + (uint32_t)index * CHUNK, chunkLength);
+  bulkPush(link, true, frame, BULK_DATA_HEADER + chunkLength);
+  bulkProcess();
+}
+
+static uint16_t blockChunks(uint16_t block) {
+  return bulkChunks(bulkBlockLength(IMAGE_SIZE, block), CHUNK);
+}
+
+static void sendBlock(uint8_t link, uint16_t block, bool corrupt = false) {
+  for (uint16_t i = 0; i < blockChunks(block); i++) sendChunk(link, block, i, corrupt);
+}
+
+// El escritor y bulkTask hasta que no queda trabajo
+static void runWriter() {
+  while (!bulkJobs.empty()) {
+    bulkWriterRun();
+    bulkProcess();
+  }
+}
+
+int main() {
+  setup();
+  bulkSink = captureAck;
+  for (uint32_t i = 0; i < IMAGE_SIZE; i++) image[i] = (uint8_t)(i * 7 + (i >> 8));
+  imageId = crc32Update(0, image, IMAGE_SIZE);
+
+  // BEGIN nuevo: ACK del bloque 0 sin nada recibido
+  sendBegin(0, imageId);
+  TEST_CHECK(ackIs(lastAck(), BULK_OK, 0, 0, 0));
+
+  // Chunk 2 perdido: el 3 abre un hueco y el ACK lo pide ya; el 4 solo
+  // amplía los bits
+  sendChunk(0, 0, 0);
+  sendChunk(0, 0, 1);
+  TEST_CHECK(ackIs(lastAck(), BULK_OK, 0, 2, 0));
+  sendChunk(0, 0, 3);
+  TEST_CHECK(ackIs(lastAck(), BULK_OK, 0, 2, 0x1));
+  sendChunk(0, 0, 4);
+  TEST_CHECK(ackIs(lastAck(), BULK_OK, 0, 2, 0x3));
+
+  // Llega el 2 reenviado: next salta por encima de lo ya recibido
+  sendChunk(0, 0, 2);
+  TEST_CHECK(ackIs(lastAck(), BULK_OK, 0, 5, 0));
+  for (uint16_t i = 5; i < blockChunks(0); i++) sendChunk(0, 0, i);
+  TEST_CHECK(ackIs(lastAck(), BULK_OK, 0, blockChunks(0), 0));
+  TEST_CHECK(bulkSession.rxBlock == 1);
+
+  // Bloque 1 con un byte roto y los dos búferes en el escritor: los chunks
+  // del bloque 2 se descartan
+  sendBlock(0, 1, true);
+  TEST_CHECK(bulkSession.rxBuffer == BULK_NO_BUFFER);
+  uint16_t before = ackCount;
+  sendChunk(0, 2, 0);
+  TEST_CHECK(ackCount == before);
+
+  // El bloque 0 libera un búfer (RESEND del 2); el 1 falla su CRC y la
+  // sesión vuelve a él (RESEND del 1)
+  runWriter();
+  TEST_CHECK(ackCount == before + 2);
+  TEST_CHECK(ackIs(ackAt(before), BULK_RESEND, 2, 0, 0));
+  TEST_CHECK(ackIs(ackAt(before + 1), BULK_RESEND, 1, 0, 0));
+  TEST_CHECK(bulkSession.rxBlock == 1 && bulkSession.written == 1);
+
+  // Un chunk de un bloque ya cerrado vuelve a confirmarlo entero
+  sendChunk(0, 0, 0);
+  TEST_CHECK(ackIs(lastAck(), BULK_OK, 0, blockChunks(0), 0));
+
+  sendBlock(0, 1);
+  runWriter();
+  TEST_CHECK(bulkSession.rxBlock == 2 && bulkSession.written == 2);
+
+  // Desconexión a mitad del bloque 2: BEGIN con el mismo id desde otro
+  // enlace retoma en el bloque 2 con los chunks ya recibidos
+  sendChunk(0, 2, 0);
+  sendChunk(0, 2, 1);
+  sendChunk(0, 2, 3);
+  sendBegin(1, imageId);
+  TEST_CHECK(ackIs(lastAck(), BULK_OK, 2, 2, 0x1));
+  TEST_CHECK(bulkSession.owner == 1);
+
+  // Los chunks del enlace anterior ya no cuentan
+  before = ackCount;
+  sendChunk(0, 2, 2);
+  TEST_CHECK(ackCount == before);
+
+  // Fin: bloque 2, relectura y BULK_DONE con la imagen en bulkStaged
+  TEST_CHECK(bulkStaged.size == 0);
+  sendChunk(1, 2, 2);
+  for (uint16_t i = 4; i < blockChunks(2); i++) sendChunk(1, 2, i);
+  runWriter();
+  TEST_CHECK(ackIs(lastAck(), BULK_DONE, 3, 0, 0));
+  TEST_CHECK(bulkStaged.kind == BULK_KIND_CONFIG && bulkStaged.id == imageId && bulkStaged.size == IMAGE_SIZE);
+  TEST_CHECK(memcmp(hostPartitionData, image, IMAGE_SIZE) == 0);
+
+  // BEGIN repetido tras completar: DONE sin tocar la partición
+  sendBegin(0, imageId);
+  TEST_CHECK(ackIs(lastAck(), BULK_DONE, 3, 0, 0));
+  TEST_CHECK(bulkStaged.size == IMAGE_SIZE);
+
+  // Otra imagen: la anterior deja de estar disponible antes del bloque 0
+  sendBegin(0, imageId ^ 1);
+  TEST_CHECK(ackIs(lastAck(), BULK_OK, 0, 0, 0));
+  TEST_CHECK(bulkStaged.size == 0);
+
+  // La nueva imagen no coincide con su id: BULK_FAILED, nada en staging
+  for (uint16_t block = 0; block < bulkBlocks(IMAGE_SIZE); block++) {
+    sendBlock(0, block);
+    runWriter();
+  }
+  TEST_CHECK(ackIs(lastAck(), BULK_FAILED, 3, 0, 0));
+  TEST_CHECK(bulkStaged.size == 0 && !bulkSession.active);
+
+  return testReport("BULK");
+}
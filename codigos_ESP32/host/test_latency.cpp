@@ -0,0 +1,48 @@
+// Tests del histograma de latencias (latency_histogram.h): límites de los
+// cubos y percentiles
+#include <Arduino.h>
+#include "latency_histogram.h"
+#include "test.h"
+
+static LatencyHistogram hist;
+
+int main() {
+  // Cubos exactos hasta 7 µs; desde 8, LAT_SUB_BUCKETS por potencia de 2
+  TEST_CHECK(latBucket(0) == 0);
+  TEST_CHECK(latBucket(7) == 7 && latBucketLimit(7) == 8);
+  TEST_CHECK(latBucket(8) == 8 && latBucketLimit(8) == 9);
+  TEST_CHECK(latBucket(15) == 15 && latBucketLimit(15) == 16);
+  TEST_CHECK(latBucket(16) == 16 && latBucket(17) == 16 && latBucketLimit(16) == 18);
+  TEST_CHECK(latBucket(18) == 17);
+
+  // Techo del rango: 2^23 - 1 es el último cubo y todo lo que pasa cae ahí
+  TEST_CHECK(latBucket((1UL << LAT_MAX_BITS) - 1) == LAT_BUCKETS - 1);
+  TEST_CHECK(latBucketLimit(LAT_BUCKETS - 1) == 1UL << LAT_MAX_BITS);
+  TEST_CHECK(latBucket(1UL << LAT_MAX_BITS) == LAT_BUCKETS - 1);
+  TEST_CHECK(latBucket(UINT32_MAX) == LAT_BUCKETS - 1);
+
+  // Cada cubo cubre [límite del anterior, su límite) sin huecos
+  bool contiguous = true;
+  for (uint16_t b = 1; b < LAT_BUCKETS; b++) {
+    uint32_t low = latBucketLimit(b - 1);
+    uint32_t high = latBucketLimit(b);
+    contiguous = contiguous && low < high && latBucket(low) == b && latBucket(high - 1) == b;
+  }
+  TEST_CHECK(contiguous);
+
+  // Percentiles: cota superior del cubo, sin pasar del máximo
+  latReset(&hist);
+  TEST_CHECK(latPercentile(&hist, 500) == 0);
+  for (uint32_t i = 0; i < 999; i++) latRecord(&hist, 100);
+  latRecord(&hist, 5000);
+  TEST_CHECK(hist.total == 1000 && hist.maxUs == 5000);
+  TEST_CHECK(latPercentile(&hist, 500) == latBucketLimit(latBucket(100)) - 1);
+  TEST_CHECK(latPercentile(&hist, 999) == latBucketLimit(latBucket(100)) - 1);
+  TEST_CHECK(latPercentile(&hist, 1000) == 5000);
+
+  latReset(&hist);
+  latRecord(&hist, 100);
+  TEST_CHECK(latPercentile(&hist, 500) == 100);  // El cubo llega a 103: manda el máximo
+
+  return testReport("LATENCY");
+}
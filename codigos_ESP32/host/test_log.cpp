@@ -0,0 +1,67 @@
+// Tests del flujo binario del log (ble_log.h): COBS, incluidos los bloques
+// de 254 bytes sin ceros, y CRC-16/CCITT-FALSE
+#include <Arduino.h>
+#include "ble_log.h"
+#include "test.h"
+
+// Decodificador de referencia, como el de dataset/read_stream.py; 0 si mal formada
+static size_t cobsDecode(const uint8_t* in, size_t length, uint8_t* out) {
+  size_t pos = 0;
+  size_t n = 0;
+  while (pos < length) {
+    uint8_t code = in[pos];
+    if (code == 0 || pos + code > length) return 0;
+    memcpy(out + n, in + pos + 1, code - 1);
+    n += code - 1;
+    pos += code;
+    if (code < 0xFF && pos < length) out[n++] = 0;
+  }
+  return n;
+}
+
+// Codifica, comprueba que no queda ningún 0x00 y que decodifica igual
+static bool roundTrip(const uint8_t* data, size_t length) {
+  uint8_t wire[COBS_BUFFER_SIZE(600)];
+  uint8_t back[600];
+  size_t n = cobsEncode(data, length, wire);
+  if (n > COBS_BUFFER_SIZE(length) || memchr(wire, 0, n)) return false;
+  return cobsDecode(wire, n, back) == length && memcmp(back, data, length) == 0;
+}
+
+int main() {
+  uint8_t wire[COBS_BUFFER_SIZE(600)];
+
+  // Vectores cortos con ceros
+  const uint8_t zero[] = {0x00};
+  TEST_CHECK(cobsEncode(zero, 1, wire) == 2 && wire[0] == 0x01 && wire[1] == 0x01);
+  const uint8_t mixed[] = {0x11, 0x00, 0x22};
+  TEST_CHECK(cobsEncode(mixed, 3, wire) == 4);
+  TEST_CHECK(wire[0] == 0x02 && wire[1] == 0x11 && wire[2] == 0x02 && wire[3] == 0x22);
+
+  // 253 bytes sin ceros caben en un bloque; con 254 el bloque se cierra con
+  // 0xFF (sin cero implícito) y el resto sigue en otro
+  uint8_t run[600];
+  for (size_t i = 0; i < sizeof(run); i++) run[i] = (uint8_t)(i % 255 + 1);
+  TEST_CHECK(cobsEncode(run, 253, wire) == 254 && wire[0] == 0xFE);
+  size_t n = cobsEncode(run, 254, wire);
+  TEST_CHECK(n == 256 && wire[0] == 0xFF && wire[255] == 0x01);
+  TEST_CHECK(memcmp(wire + 1, run, 254) == 0);
+  n = cobsEncode(run, 255, wire);
+  TEST_CHECK(n == 257 && wire[0] == 0xFF && wire[255] == 0x02 && wire[256] == run[254]);
+
+  size_t lengths[] = {0, 1, 253, 254, 255, 508, 509, 600};
+  for (size_t length : lengths) TEST_CHECK(roundTrip(run, length));
+
+  // Cero justo tras un bloque lleno y ceros seguidos
+  run[254] = 0x00;
+  run[255] = 0x00;
+  TEST_CHECK(roundTrip(run, 300));
+  uint8_t zeros[300] = {};
+  TEST_CHECK(roundTrip(zeros, sizeof(zeros)));
+
+  // CRC-16/CCITT-FALSE: valor de comprobación del catálogo y cadena vacía
+  TEST_CHECK(crc16Ccitt((const uint8_t*)"123456789", 9) == 0x29B1);
+  TEST_CHECK(crc16Ccitt(nullptr, 0) == 0xFFFF);
+
+  return testReport("LOG");
+}
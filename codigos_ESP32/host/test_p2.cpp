@@ -0,0 +1,97 @@
+// Tests de la autenticación de P2: bloqueo de intentos de PIN por central y
+// tickets de reanudación
+#include "../client_Pin.cpp"
+#include "periph_host.h"
+#include "test.h"
+
+static void authPin(uint8_t link, uint16_t userId, bool correct) {
+  uint8_t frame[p2::HEADER_LEN + p2::AuthPin::SIZE] = {p2::AuthPin::OPCODE, p2::AuthPin::SIZE};
+  p2::AuthPin msg = {userId, {0x12, 0x34, 0x56, (uint8_t)(correct ? 0x00 : 0x99)}};
+  encodeInto(msg, ByteSpan(frame + p2::HEADER_LEN, p2::AuthPin::SIZE));
+  peripheral.processCommand(frame, sizeof(frame), link);
+  logDrain();
+}
+
+// SESSION_RESUME con el ticket que devolvió el último AUTH_PIN aceptado
+static void sessionResume(uint8_t link, uint16_t userId, const uint8_t* ticket) {
+  uint8_t frame[p2::HEADER_LEN + p2::SessionResume::SIZE] = {p2::SessionResume::OPCODE, p2::SessionResume::SIZE};
+  p2::SessionResume msg = {userId, {0}};
+  memcpy(msg.ticket, ticket, sizeof(msg.ticket));
+  encodeInto(msg, ByteSpan(frame + p2::HEADER_LEN, p2::SessionResume::SIZE));
+  peripheral.processCommand(frame, sizeof(frame), link);
+  logDrain();
+}
+
+static void logout(uint8_t link) {
+  uint8_t frame[p2::HEADER_LEN] = {p2::Logout::OPCODE, 0};
+  peripheral.processCommand(frame, sizeof(frame), link);
+  logDrain();
+}
+
+static const uint8_t* userTicket(uint16_t userId) {
+  for (uint8_t i = 0; i < TICKET_TABLE_SIZE; i++) {
+    if (ticketTable[i].valid && ticketTable[i].userId == userId) return ticketTable[i].ticket;
+  }
+  return nullptr;
+}
+
+// Mismo enlace con otra dirección: otro central para la tabla de intentos
+static void setPeer(uint8_t link, uint8_t id) {
+  peripheral.centrals.links[link].peer[5] = id;
+}
+
+static bool authenticated(uint8_t link) {
+  bool open = deviceState.authLinks & (1 << link);
+  deviceState.authLinks = 0;
+  return open;
+}
+
+int main() {
+  setup();
+  for (uint16_t connId = 0; connId < CENTRAL_MAX_LINKS; connId++) hostCentralConnect(connId);
+
+  // Cambiar de userId en cada intento no da intentos nuevos
+  for (uint16_t userId = 1; userId <= AUTH_MAX_FAILURES; userId++) authPin(0, userId, false);
+  authPin(0, 100, true);
+  TEST_CHECK(!authenticated(0));
+
+  // Los fallos de otro central no bloquean a ningún usuario
+  authPin(1, 1, true);
+  TEST_CHECK(authenticated(1));
+
+  // Con la tabla llena de centrales bloqueados, uno nuevo entra con el PIN
+  // correcto y los bloqueados que siguen en la tabla no
+  for (uint8_t id = 10; id < 10 + AUTH_TABLE_SIZE; id++) {
+    setPeer(2, id);
+    for (uint8_t i = 0; i < AUTH_MAX_FAILURES; i++) authPin(2, 1, false);
+  }
+  setPeer(2, 10 + AUTH_TABLE_SIZE);
+  authPin(2, 1, true);
+  TEST_CHECK(authenticated(2));
+  setPeer(2, 11);
+  authPin(2, 1, true);
+  TEST_CHECK(!authenticated(2));
+
+  // Un ticket equivocado no invalida el del usuario
+  uint8_t ticket[p2::TICKET_LEN];
+  authPin(1, 5, true);
+  TEST_CHECK(authenticated(1) && userTicket(5));
+  memcpy(ticket, userTicket(5), sizeof(ticket));
+  uint8_t wrong[p2::TICKET_LEN];
+  memcpy(wrong, ticket, sizeof(wrong));
+  wrong[0] ^= 0x01;
+  sessionResume(0, 5, wrong);
+  TEST_CHECK(!authenticated(0));
+  sessionResume(1, 5, ticket);
+  TEST_CHECK(authenticated(1));
+
+  // Tras LOGOUT el último ticket ya no reanuda
+  memcpy(ticket, userTicket(5), sizeof(ticket));
+  deviceState.authLinks = 1 << 1;
+  logout(1);
+  TEST_CHECK(!userTicket(5));
+  sessionResume(1, 5, ticket);
+  TEST_CHECK(!authenticated(1));
+
+  return testReport("P2");
+}
@@ -0,0 +1,153 @@
+// Tests del modo suscripción de telemetry_frame.h: ida y vuelta de keyframes
+// y deltas por telemStreamSend() y telemMirrorApply()
+#include <Arduino.h>
+#include "telemetry_frame.h"
+#include "test.h"
+
+#define FIELD_COUNT  3
+#define MAX_FRAME    20   // Payload con el ATT por defecto
+
+// Nivel (u8), posición (2 x u16) y ambiente (u16 + u8)
+static const TelemetryLayout LAYOUTS[FIELD_COUNT] = {{1, 0x00}, {2, 0x03}, {2, 0x01}};
+static const uint8_t SIZES[FIELD_COUNT] = {1, 4, 3};
+static const uint8_t THRESHOLDS[FIELD_COUNT] = {2, 0, 0};
+
+static TelemetryStream stream;
+static TelemetryMirror mirror;
+static uint8_t current[FIELD_COUNT][TELEM_FIELD_MAX_SIZE];   // Valores del periférico
+static uint8_t expected[FIELD_COUNT][TELEM_FIELD_MAX_SIZE];  // Lo que debe ver el central
+
+static uint8_t frame[TELEM_DELTA_HEADER_LEN + TELEM_MAX_FIELDS * TELEM_FIELD_MAX_SIZE];
+static size_t frameLen;
+
+static void capture(const uint8_t* data, size_t length) {
+  memcpy(frame, data, length);
+  frameLen = length;
+}
+
+// Un tick del periférico; 0 si no sale trama
+static size_t tick() {
+  TelemetryField fields[FIELD_COUNT];
+  for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+    fields[i].bit = 1 << i;
+    fields[i].size = SIZES[i];
+    memcpy(fields[i].data, current[i], SIZES[i]);
+  }
+  frameLen = 0;
+  return telemStreamSend(&stream, LAYOUTS, fields, FIELD_COUNT, MAX_FRAME, capture);
+}
+
+// La trama capturada en el central: los campos que lleva pasan a valer lo
+// del periférico, el resto se queda como en la base
+static const TelemetrySnapshot* deliver() {
+  const TelemetrySnapshot* snapshot = telemMirrorApply(&mirror, LAYOUTS, FIELD_COUNT, frame, frameLen);
+  if (snapshot) {
+    for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+      if (frame[1] & (1 << i)) memcpy(expected[i], current[i], SIZES[i]);
+    }
+  }
+  return snapshot;
+}
+
+static bool matches(const TelemetrySnapshot* snapshot) {
+  if (!snapshot || snapshot->fields != (1 << FIELD_COUNT) - 1) return false;
+  for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+    if (memcmp(snapshot->data[i], expected[i], SIZES[i]) != 0) return false;
+  }
+  return true;
+}
+
+// Tick entregado y confirmado; devuelve el tipo de trama (0 = ninguna)
+static uint8_t roundTrip() {
+  if (!tick()) return 0;
+  uint8_t type = frame[0];
+  const TelemetrySnapshot* snapshot = deliver();
+  TEST_CHECK(matches(snapshot));
+  if (snapshot) telemStreamAck(&stream, snapshot->seq);
+  return type;
+}
+
+static void setLat(uint16_t value) {
+  telemPut16(current[1], value);
+}
+
+int main() {
+  telemMirrorReset(&mirror);
+  telemStreamSubscribe(&stream, 4, THRESHOLDS, FIELD_COUNT);
+  current[0][0] = 50;
+  setLat(1000);
+  telemPut16(current[1] + 2, 2000);
+  telemPut16(current[2], 215);
+  current[2][2] = 40;
+
+  // Primer tick: keyframe con todo
+  TEST_CHECK(roundTrip() == TELEM_FRAME_KEY);
+  TEST_CHECK(frame[1] == 0x07);
+
+  // Nivel dentro del umbral (|2| <= 2): nada que enviar
+  current[0][0] = 52;
+  TEST_CHECK(tick() == 0);
+
+  // Pasa el umbral: delta solo con el nivel, sin absolutos
+  current[0][0] = 53;
+  TEST_CHECK(roundTrip() == TELEM_FRAME_DELTA);
+  TEST_CHECK(frame[1] == 0x01 && frame[2] == 0x00);
+
+  // Salto de latitud que no cabe en int8: el campo va entero (absoluto)
+  setLat(0xFFF0);
+  TEST_CHECK(roundTrip() == TELEM_FRAME_DELTA);
+  TEST_CHECK(frame[1] == 0x02 && frame[2] == 0x02);
+
+  // Cadencia: el quinto tick desde el keyframe vuelve a ser keyframe
+  setLat(0xFFF1);
+  TEST_CHECK(roundTrip() == TELEM_FRAME_KEY);
+
+  // 0xFFF1 -> 0x0011 cruza el cero de u16: +32 cabe en int8
+  setLat(0x0011);
+  TEST_CHECK(roundTrip() == TELEM_FRAME_DELTA);
+  TEST_CHECK(frame[1] == 0x02 && frame[2] == 0x00);
+
+  // Igual con el u8 del nivel: 53 -> 250 es -59 módulo 256
+  current[0][0] = 250;
+  TEST_CHECK(roundTrip() == TELEM_FRAME_DELTA);
+  TEST_CHECK(frame[2] == 0x00);
+
+  // Campo mixto (u16 + u8): solo cambia el u8, el u16 viaja con delta 0
+  current[2][2] = 45;
+  TEST_CHECK(roundTrip() == TELEM_FRAME_DELTA);
+  TEST_CHECK(frame[1] == 0x04 && frame[2] == 0x00);
+
+  // Keyframe otra vez (quinto tick) y base confirmada para lo que sigue
+  TEST_CHECK(roundTrip() == TELEM_FRAME_KEY);
+  uint8_t base = stream.base.seq;
+
+  // Delta A perdido y sin ack; B va contra la misma base y reconstruye
+  current[0][0] = 10;
+  TEST_CHECK(tick() && frame[4] == base);
+  uint8_t seqA = frame[3];
+  current[0][0] = 20;
+  TEST_CHECK(tick() && frame[4] == base);
+  const TelemetrySnapshot* snapshot = deliver();
+  TEST_CHECK(matches(snapshot));
+
+  // El ack tardío de A no mueve la base; el de B sí
+  telemStreamAck(&stream, seqA);
+  TEST_CHECK(stream.base.seq == base);
+  telemStreamAck(&stream, snapshot->seq);
+  TEST_CHECK(stream.base.seq == snapshot->seq);
+
+  // Central sin la base (p. ej. reiniciado): el delta se rechaza y el
+  // keyframe siguiente lo vuelve a sincronizar
+  telemMirrorReset(&mirror);
+  current[0][0] = 30;
+  TEST_CHECK(tick() && frame[0] == TELEM_FRAME_DELTA);
+  TEST_CHECK(telemMirrorApply(&mirror, LAYOUTS, FIELD_COUNT, frame, frameLen) == nullptr);
+  TEST_CHECK(roundTrip() == TELEM_FRAME_KEY);  // Quinto tick desde el keyframe anterior
+
+  // Un delta contra un campo que la base no tiene está mal formado
+  uint8_t orphan[] = {TELEM_FRAME_DELTA, 0x01, 0x00, 0x50, stream.base.seq, 0x01};
+  mirror.history[(mirror.next + TELEM_HISTORY - 1) % TELEM_HISTORY].fields = 0x06;
+  TEST_CHECK(telemMirrorApply(&mirror, LAYOUTS, FIELD_COUNT, orphan, sizeof(orphan)) == nullptr);
+
+  return testReport("TELEM");
+}
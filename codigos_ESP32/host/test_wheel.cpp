@@ -0,0 +1,99 @@
+// Tests de la rueda de temporizadores (timer_wheel.h): cascada entre
+// niveles, orden por prioridad en el mismo ms y cancelación desde un callback
+#include <Arduino.h>
+#include "timer_wheel.h"
+#include "test.h"
+
+#define START_MS  1000   // Sin alinear con ningún bloque
+
+struct Fire {
+  uint8_t id;
+  uint32_t now;
+};
+
+static TimerWheel wheel;
+static WheelTimer timers[4];
+static uint8_t ids[4] = {0, 1, 2, 3};
+static Fire fires[16];
+static uint8_t fireCount;
+
+static void record(WheelTimer* timer, uint32_t now) {
+  if (fireCount < sizeof(fires) / sizeof(fires[0])) fires[fireCount++] = {*(uint8_t*)timer->owner, now};
+}
+
+// El 0 cancela el 2 (aún en la misma cubeta) y se reprograma 64 ms después
+static void cancelOther(WheelTimer* timer, uint32_t now) {
+  record(timer, now);
+  wheelRemove(&wheel, &timers[2]);
+  wheelAdd(&wheel, timer, now + WHEEL_SIZE);
+}
+
+static void reset(WheelCallback first = record) {
+  wheelInit(&wheel, START_MS);
+  for (uint8_t i = 0; i < 4; i++) wheelTimerInit(&timers[i], i == 0 ? first : record, &ids[i], 0);
+  fireCount = 0;
+}
+
+// Programa un temporizador y comprueba que se dispara justo en su ms
+static bool firesExactlyAt(uint32_t delay) {
+  reset();
+  uint32_t expires = START_MS + delay;
+  wheelAdd(&wheel, &timers[0], expires);
+  if (wheelAdvance(&wheel, expires - 1) != 0) return false;
+  return wheelAdvance(&wheel, expires) == 1 && fires[0].now == expires;
+}
+
+static bool order(uint8_t a, uint8_t b, uint8_t c) {
+  return fireCount == 3 && fires[0].id == a && fires[1].id == b && fires[2].id == c;
+}
+
+int main() {
+  // Nivel 0, cascada desde el nivel 1 (bloques de 64 ms), desde el 2
+  // (4096 ms) y más allá del alcance del último nivel
+  TEST_CHECK(firesExactlyAt(5));
+  TEST_CHECK(firesExactlyAt(WHEEL_SIZE - 1));
+  TEST_CHECK(firesExactlyAt(WHEEL_SIZE));
+  TEST_CHECK(firesExactlyAt(WHEEL_SIZE + 7));
+  TEST_CHECK(firesExactlyAt(2 * WHEEL_SIZE - START_MS % WHEEL_SIZE));  // Justo en un límite de 64 ms
+  TEST_CHECK(firesExactlyAt(4096 - START_MS % 4096));                  // Justo en un límite de 4096 ms
+  TEST_CHECK(firesExactlyAt(4096 + 3));
+  TEST_CHECK(firesExactlyAt(5000));
+  TEST_CHECK(firesExactlyAt(300000));
+
+  // El siguiente evento nunca pasa del vencimiento
+  reset();
+  wheelAdd(&wheel, &timers[0], START_MS + 5000);
+  TEST_CHECK((int32_t)(wheelNextEvent(&wheel) - (START_MS + 5000)) <= 0);
+
+  // Mismo ms: por prioridad, no por orden de alta; también tras la cascada
+  uint32_t delays[] = {10, 200, 6000};
+  for (uint32_t delay : delays) {
+    reset();
+    timers[1].priority = 2;
+    timers[2].priority = 0;
+    timers[3].priority = 1;
+    for (uint8_t i = 1; i <= 3; i++) wheelAdd(&wheel, &timers[i], START_MS + delay);
+    wheelAdvance(&wheel, START_MS + delay);
+    TEST_CHECK(order(2, 3, 1));
+  }
+
+  // Cancelar desde un callback un temporizador de la misma cubeta que aún
+  // no se ha disparado; el que se reprograma vuelve 64 ms después
+  reset(cancelOther);
+  timers[1].priority = 1;
+  timers[2].priority = 2;
+  for (uint8_t i = 0; i <= 2; i++) wheelAdd(&wheel, &timers[i], START_MS + 20);
+  TEST_CHECK(wheelAdvance(&wheel, START_MS + 20) == 2);
+  TEST_CHECK(fires[0].id == 0 && fires[1].id == 1 && !timers[2].pending);
+  TEST_CHECK(wheelAdvance(&wheel, START_MS + 20 + WHEEL_SIZE - 1) == 0);
+  TEST_CHECK(wheelAdvance(&wheel, START_MS + 20 + WHEEL_SIZE) == 1);
+  TEST_CHECK(fires[2].id == 0 && fires[2].now == START_MS + 20 + WHEEL_SIZE);
+
+  // Un vencimiento ya pasado sale en el siguiente avance
+  reset();
+  wheelAdvance(&wheel, START_MS + 100);
+  wheelAdd(&wheel, &timers[0], START_MS + 50);
+  TEST_CHECK(wheelAdvance(&wheel, START_MS + 101) == 1 && fires[0].now == START_MS + 101);
+
+  return testReport("WHEEL");
+}
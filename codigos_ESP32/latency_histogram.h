@@ -0,0 +1,72 @@
+/*
+ * Histograma de latencias log-lineal (master, modo soak)
+ *
+ * LAT_SUB_BUCKETS cubos por cada potencia de 2: el error relativo de un
+ * percentil es como mucho 1/LAT_SUB_BUCKETS (12.5 %) en todo el rango, de
+ * 1 µs a 2^LAT_MAX_BITS µs (~8 s), con 168 contadores. Por debajo de
+ * LAT_SUB_BUCKETS µs los cubos son exactos y lo que pasa del rango cae en
+ * el último.
+ *
+ * Registrar es un clz, un desplazamiento y un incremento; los percentiles
+ * se leen al final del intervalo recorriendo los cubos. Sin reservas de
+ * memoria ni ordenar muestras.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <Arduino.h>
+
+#define LAT_SUB_BITS    3
+#define LAT_SUB_BUCKETS (1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS    23
+#define LAT_BUCKETS     ((LAT_MAX_BITS - LAT_SUB_BITS + 1) * LAT_SUB_BUCKETS)
+
+struct LatencyHistogram {
+  uint32_t counts[LAT_BUCKETS];
+  uint32_t total;
+  uint32_t maxUs;
+};
+
+// Cubo de un valor: exacto por debajo de LAT_SUB_BUCKETS; después, la
+// potencia de 2 elige el grupo y los LAT_SUB_BITS bits siguientes el cubo
+inline uint16_t latBucket(uint32_t us) {
+  if (us < LAT_SUB_BUCKETS) return us;
+  uint8_t msb = 31 - __builtin_clz(us);
+  if (msb >= LAT_MAX_BITS) return LAT_BUCKETS - 1;
+  uint8_t shift = msb - LAT_SUB_BITS;
+  return (shift + 1) * LAT_SUB_BUCKETS + ((us >> shift) - LAT_SUB_BUCKETS);
+}
+
+// Límite superior (excluido) de los valores del cubo
+inline uint32_t latBucketLimit(uint16_t bucket) {
+  if (bucket < LAT_SUB_BUCKETS) return bucket + 1;
+  uint8_t shift = bucket / LAT_SUB_BUCKETS - 1;
+  return (uint32_t)(LAT_SUB_BUCKETS + bucket % LAT_SUB_BUCKETS + 1) << shift;
+}
+
+inline void latRecord(LatencyHistogram* h, uint32_t us) {
+  h->counts[latBucket(us)]++;
+  h->total++;
+  if (us > h->maxUs) h->maxUs = us;
+}
+
+// Percentil en milésimas (500 = p50, 999 = p999): cota superior del cubo
+// donde cae, sin pasar del máximo registrado. 0 sin muestras.
+inline uint32_t latPercentile(const LatencyHistogram* h, uint16_t permille) {
+  if (h->total == 0) return 0;
+  uint32_t rank = ((uint64_t)h->total * permille + 999) / 1000;
+  if (rank == 0) rank = 1;
+  uint32_t seen = 0;
+  for (uint16_t i = 0; i < LAT_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) return min(latBucketLimit(i) - 1, h->maxUs);
+  }
+  return h->maxUs;
+}
+
+inline void latReset(LatencyHistogram* h) {
+  memset(h, 0, sizeof(*h));
+}
+
+#endif // LATENCY_HISTOGRAM_H
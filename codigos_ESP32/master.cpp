@@ -1,7 +1,7 @@
 /*
  * ESP32 BLE Central - Master Controller
  * 
- * Controla dos periféricos:
+ * Controla la flota de periféricos declarada en FLEET (hasta MAX_PERIPHERALS):
  * - ESP32_P1: Sin autenticación
  * - ESP32_P2: Con PIN (vulnerable)
  * 
@@ -9,261 +9,2013 @@
  * - Conexión a múltiples dispositivos
  * - Autenticación con PIN en texto claro
  * - Envío de comandos de configuración y eventos
+ * - Reconexión no bloqueante: cada periférico tiene su máquina de estados
+ * - Telemetría por cambios: suscripción con umbrales y réplica por deltas
+ * - Captura binaria de la telemetría en un anillo de flash (telemetry_capture.h)
+ * - Streaming binario por Serial (modo binario de ble_log.h): payloads ATT
+ *   crudos y telemetría decodificada, sin formatear texto
+ * - UUIDs, tramas y telemetría de cada familia desde los mismos perfiles
+ *   con que se generan los periféricos (device_profile.h)
+ * - Modo soak (SOAK_MODE): carga a ritmo fijo o en lazo cerrado con RTT
+ *   por percentiles, pérdidas y reconexiones en cada intervalo
+ * - Transferencia masiva (bulk_transfer.h): imágenes por bloques con ACK
+ *   selectivo, reanudables tras una desconexión
+ *
+ * Reparto de tareas por núcleo:
+ *   BLE_CORE  Bluedroid (callbacks GATTC/GAP), ioTask (máquina de estados,
+ *             escaneo y escrituras de comandos) y linkTask (conexiones)
+ *   APP_CORE  appTask (planificación en una rueda de temporizadores,
+ *             decodificación de telemetría y métricas) y logTask (Serial)
+ * Entre núcleos solo hay anillos SPSC (spsc_ring.h): notifyRing lleva las
+ * notificaciones de Bluedroid a appTask y el cmdRing de cada slot lleva los
+ * comandos planificados de appTask a ioTask. El estado del enlace y el duty
+ * del escaneo solo los cambian ioTask y linkTask; appTask y Bluedroid los
+ * piden con banderas (authDone, disconnected, scanWindowEmpty...). Una
+ * ráfaga de telemetría de P2 nunca retrasa una escritura a P1.
  */
 
 #include <Arduino.h>
 #include <BLEDevice.h>
 #include <BLEUtils.h>
-#include <BLEScan.h>
-#include <BLEAdvertisedDevice.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gattc_api.h>
+#include <Preferences.h>
+#include "att_mtu.h"
+#include "ble_log.h"
+#include "ble_metrics.h"
+#include "ble_protocol.h"
+#include "bulk_transfer.h"
+#include "cmd_pipeline.h"
+#include "conn_params.h"
+#include "device_profile.h"
+#include "latency_histogram.h"
+#include "spsc_ring.h"
+#include "telemetry_capture.h"
+#include "timer_wheel.h"
 
-// UUIDs para P1
-#define P1_SERVICE_UUID     "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
-#define P1_CMD_UUID         "beb5483e-36e1-4688-b7f5-ea07361b26a8"
-#define P1_STATE_UUID       "beb5483f-36e1-4688-b7f5-ea07361b26a8"
-
-// UUIDs para P2
-#define P2_SERVICE_UUID     "5fafc301-2fb5-459e-8fcc-c5c9c331915c"
-#define P2_CMD_UUID         "ceb5483e-46e1-4688-b7f5-ea07361b27a9"
-#define P2_STATE_UUID       "ceb5483f-46e1-4688-b7f5-ea07361b27a9"
+// UUIDs, tramas y telemetría de cada familia: P1Profile / P2Profile
+// (device_profile.h), los mismos tipos con los que se generan sus firmwares
 
 #define P2_PIN "123456"  // ⚠️ PIN en texto claro visible en código
 
-BLEClient* pClientP1 = nullptr;
-BLEClient* pClientP2 = nullptr;
-BLERemoteCharacteristic* pP1CmdChar = nullptr;
-BLERemoteCharacteristic* pP2CmdChar = nullptr;
-bool p1Connected = false;
-bool p2Connected = false;
+// Estados del enlace con cada periférico. Las operaciones bloqueantes de
+// Bluedroid (connect, descubrimiento, CCCD) se ejecutan en linkTask; ioTask
+// solo avanza la máquina con ticks cortos y nunca espera a un enlace caído.
+enum LinkState : uint8_t {
+  LINK_SCANNING,       // Esperando a que el escaneo encuentre el dispositivo
+  LINK_CONNECTING,     // Trabajo encolado / BLEClient::connect() en curso
+  LINK_DISCOVERING,    // Buscando servicio y características
+  LINK_SUBSCRIBING,    // Escritura del CCCD de STATE enviada, esperando confirmación
+  LINK_AUTHENTICATING, // PIN o ticket enviado, esperando respuesta (solo P2)
+  LINK_READY,          // Recibiendo comandos
+  LINK_BACKOFF         // Fallo o desconexión: espera antes de reintentar
+};
+
+const char* const LINK_STATE_NAMES[] = {
+  "SCANNING", "CONNECTING", "DISCOVERING", "SUBSCRIBING", "AUTHENTICATING", "READY", "BACKOFF"
+};
+
+#define LOOP_TICK_MS          20     // Periodo de ioTask sin eventos
+#define SCAN_DURATION_S       5      // Duración de cada ventana de escaneo (asíncrona)
+#define SCAN_WINDOW_MS        30     // Tiempo de radio escuchando en cada intervalo
+#define SCAN_INTERVAL_MIN_MS  30     // Duty 100 % justo después de una desconexión
+#define SCAN_LEVEL_MAX        5      // Intervalo máximo = MIN << 5 = 960 ms (duty ~3 %)
+#define SCAN_ACCEPT_LIST      1      // 1 = filtro del controlador si todas las direcciones son conocidas
+#define BACKOFF_MIN_MS        500    // Primer reintento tras un fallo
+#define BACKOFF_MAX_MS        8000   // Techo del backoff exponencial
+#define AUTH_TIMEOUT_MS       2000   // Espera máxima de la respuesta al PIN
+#define SUBSCRIBE_TIMEOUT_MS  2000   // Espera máxima de la confirmación del CCCD
+#define GATT_CACHE_PERSIST    1      // 1 = guardar la caché de handles en NVS
+#define TELEMETRY_LOG_TEXT    1      // 0 = telemetría solo en la captura binaria, sin texto por Serial
+#define CMD_PIPELINE          1      // 1 = comandos en ventana sin respuesta (perfiles que lo admiten)
+#define LINK_BOOST_MS         5000   // LOW_LATENCY mínimo tras conectar (descubrimiento y configuración)
+#define NOTIFY_RING_SIZE      16     // Notificaciones pendientes de decodificar (potencia de 2)
+#define CMD_RING_SIZE         8      // Comandos planificados pendientes por enlace (potencia de 2)
+#define APP_DECODE_BATCH      4      // Notificaciones por vuelta de appTask entre planificaciones
+#define MAX_SLOT_STREAMS      4      // Flujos de comandos por perfil
+#define IO_TASK_PRIORITY      3      // Por encima de linkTask: escrituras aunque haya un connect()
+#define APP_TASK_PRIORITY     2      // Por encima de logTask
+#define LINK_TASK_PRIORITY    1
+
+// Modo soak: en lugar de las secuencias de demo, comandos con respuesta
+// STATE a cada enlace en READY. Por encima de 40/s por enlace actúa el
+// limitador RATE_COMMAND de los periféricos (rate_limit.h) y se ve como pérdidas.
+#define SOAK_MODE             0      // 1 = generador de carga
+#define SOAK_RATE_HZ          20     // Comandos por segundo y enlace; 0 = lazo cerrado (SOAK_WINDOW)
+#define SOAK_WINDOW           8      // Comandos sin resolver por enlace (potencia de 2)
+#define SOAK_TIMEOUT_MS       2000   // Sin respuesta en este tiempo: perdido
+#define SOAK_REPORT_MS        10000  // Periodo del informe
+
+// Transferencia masiva: BULK_DEMO_BYTES > 0 envía al arrancar una imagen de
+// prueba de ese tamaño a cada enlace (bulkStart() para imágenes reales)
+#define BULK_DEMO_BYTES       0
+#define BULK_DEMO_KIND        BULK_KIND_CONFIG
+#define BULK_ACK_RING         8      // ACKs pendientes de ioTask por enlace (potencia de 2)
+#define BULK_VERIFY_TIMEOUT_MS 5000  // Espera de BULK_DONE antes de volver a preguntar con BEGIN
+
+// Núcleos: todo lo que llama a la pila junto a Bluedroid; el resto en el
+// contrario, el mismo que usa logTask
+#if defined(CONFIG_BT_BLUEDROID_PINNED_TO_CORE)
+#define BLE_CORE              CONFIG_BT_BLUEDROID_PINNED_TO_CORE
+#else
+#define BLE_CORE              0
+#endif
+#define APP_CORE              LOG_TASK_CORE
+
+// Capacidad de la tabla de periféricos: tantos enlaces como admita el
+// controlador (máx. 9 en ESP32). Toda la RAM de la flota es estática.
+#if defined(CONFIG_BTDM_CTRL_BLE_MAX_CONN)
+#define MAX_PERIPHERALS       CONFIG_BTDM_CTRL_BLE_MAX_CONN
+#elif defined(CONFIG_BT_ACL_CONNECTIONS)
+#define MAX_PERIPHERALS       CONFIG_BT_ACL_CONNECTIONS
+#else
+#define MAX_PERIPHERALS       4
+#endif
+
+struct PeripheralSlot;
+
+// Handles ATT de un periférico, válidos mientras no cambie su tabla GATT
+struct GattHandles {
+  uint16_t cmd;
+  uint16_t state;
+  uint16_t stateCccd;
+};
+
+// Formato de trama de cada familia de dispositivos
+struct ProtocolCodec {
+  // Devuelve la longitud de la trama o 0 si no cabe en out
+  size_t (*encodeCommand)(uint8_t cmd, const uint8_t* payload, uint8_t payloadLen,
+                          uint8_t* out, size_t outSize);
+  void (*decodeNotify)(PeripheralSlot* slot, const uint8_t* data, size_t length);
+};
+
+#define SCHED_STAMP_MILLIS  0x01   // Los 4 primeros bytes del payload = millis() (BE)
+
+struct ScheduledCommand {
+  uint8_t cmd;
+  uint8_t payloadLen;
+  uint8_t payload[5];
+  uint8_t flags;
+  uint8_t reply;                // Opcode de la respuesta que mide el modo soak (0 = ninguna)
+};
+
+// Paso ya resuelto (sello de tiempo aplicado) en el cmdRing del slot
+struct QueuedCommand {
+  uint8_t cmd;
+  uint8_t payloadLen;
+  uint8_t payload[sizeof(ScheduledCommand::payload)];
+  uint8_t reply;
+};
+
+struct StreamState;
+
+// Rellena out con el siguiente comando del flujo; false = nada que enviar
+typedef bool (*CommandGenerator)(StreamState* state, unsigned long now, QueuedCommand* out);
+
+// Flujo periódico de comandos de un perfil. La rueda de appTask lo dispara
+// cada intervalMs; si vencen varios en el mismo ms, antes el de menor priority.
+struct CommandStream {
+  unsigned long intervalMs;
+  uint8_t priority;
+  uint8_t burst;                // Comandos por disparo en modo pipeline (sin él, 1)
+  CommandGenerator generate;
+  const ScheduledCommand* steps;  // Datos del generador
+  uint8_t stepCount;
+};
+
+// Flujo de un slot en la rueda de appTask
+struct StreamState {
+  WheelTimer timer;
+  PeripheralSlot* slot;
+  const CommandStream* stream;
+  uint8_t seq;                  // Comandos generados desde la conexión
+};
+
+// Telemetría por cambios (telemetry_frame.h) que se pide al llegar a READY
+struct TelemetrySubscription {
+  uint8_t subscribeOpcode;
+  uint8_t ackOpcode;
+  const TelemetryLayout* layouts;
+  uint8_t fieldCount;
+  uint8_t keyframeEvery;        // Ticks del periférico entre keyframes
+  uint8_t thresholds[TELEM_MAX_FIELDS];  // Umbral por campo, en sus unidades
+};
+
+// Descripción constante de un tipo de periférico
+struct DeviceProfile {
+  const char* serviceUUID;
+  const char* cmdUUID;
+  const char* stateUUID;
+  const ProtocolCodec* codec;
+  const CommandStream* streams;
+  uint8_t streamCount;          // Máx. MAX_SLOT_STREAMS
+  void (*authenticate)(PeripheralSlot* slot);  // nullptr = sin autenticación
+  bool pipelined;               // Acepta tramas secuenciadas (cmd_pipeline.h)
+  LinkProfile idleLink;         // Perfil de conexión en reposo (conn_params.h)
+  const TelemetrySubscription* telemetry;  // nullptr = solo telemetría completa
+};
+
+// Entrada de la flota: dispositivo concreto a buscar y su perfil
+struct FleetEntry {
+  const char* tag;              // Prefijo de los logs
+  const char* name;             // Nombre anunciado
+  const DeviceProfile* profile;
+};
+
+// Dispositivo visto por el escaneo. Celdas de un pool fijo (devicePool):
+// descubrir y reconectar no reserva memoria dinámica.
+struct DeviceRecord {
+  esp_bd_addr_t addr;
+  esp_ble_addr_type_t addrType;
+  int8_t rssi;
+  unsigned long seenAt;         // millis() del anuncio
+};
+
+// Comando del modo soak ya escrito (o descartado), de ioTask a appTask
+struct SoakProbe {
+  uint8_t reply;                // Opcode de la respuesta esperada
+  bool sent;                    // false = enlace caído o escritura fallida
+  uint32_t sentUs;              // micros() de la escritura
+};
+
+// Emparejado y resultados del modo soak de un enlace (appTask)
+struct SoakStats {
+  uint32_t generated;           // Comandos generados (acumulado)
+  uint32_t resolved;            // Sondas respondidas, perdidas o no enviadas (acumulado)
+  uint32_t answered;            // Del intervalo en curso
+  uint32_t lost;
+  uint32_t unsent;
+  uint16_t connectsAtStart;     // slot->connects al empezar el intervalo
+  unsigned long intervalStart;
+  LatencyHistogram latency;     // RTT en µs
+};
+
+// Lee length bytes de la imagen a partir de offset; false si no puede
+typedef bool (*BulkSource)(uint32_t offset, uint8_t* out, size_t length);
+
+enum BulkPhase : uint8_t {
+  BULK_IDLE,
+  BULK_BEGIN,                   // BEGIN por enviar en cuanto el enlace esté en READY
+  BULK_OPENING,                 // BEGIN enviado, esperando el ACK con el punto de partida
+  BULK_SENDING,
+  BULK_VERIFYING                // Todo entregado, esperando BULK_DONE
+};
+
+// Transferencia masiva saliente de un slot (ioTask)
+struct BulkSend {
+  BulkPhase phase;
+  BulkSource source;
+  uint8_t kind;
+  uint32_t id;                  // CRC-32 de la imagen
+  uint32_t size;
+  uint16_t chunk;               // Fijado en cada BEGIN con el MTU del enlace
+  uint16_t blocks;
+  uint16_t block;               // Bloque en curso y su geometría
+  uint16_t blockLength;
+  uint16_t chunks;
+  uint8_t crc[BULK_CRC_LEN];
+  uint16_t next;                // Primer chunk sin confirmar
+  uint16_t cursor;              // Siguiente chunk nuevo
+  uint16_t repairFrom;          // Chunks por reenviar: los no confirmados de [repairFrom, repairTo)
+  uint16_t repairTo;
+  uint8_t acked[BULK_CHUNK_MAP];
+  unsigned long ackAt;          // millis() del último ACK (o del último reenvío por timeout)
+  unsigned long startedAt;
+  uint32_t resent;              // Chunks reenviados en toda la transferencia
+};
+
+// Estado en tiempo de ejecución de cada enlace
+struct PeripheralSlot {
+  const char* tag;
+  const char* name;
+  const DeviceProfile* profile;
+
+  volatile LinkState state;
+  unsigned long stateSince;     // millis() de la última transición
+  unsigned long linkStartedAt;  // millis() al pasar a CONNECTING
+  unsigned long readyMs;        // Tiempo de CONNECTING a READY del último enlace
+  uint16_t connects;            // Conexiones establecidas por este slot
+  unsigned long backoffMs;      // Backoff actual (se duplica en cada fallo)
+
+  BLEClient* client;            // Se crea una vez y se reutiliza en reconexiones
+  uint8_t serviceUuid[16];      // UUID del servicio tal como viaja en el anuncio (LE)
+  DeviceRecord* volatile device;  // Celda de devicePool que rellena el escaneo (nullptr = no visto)
+  bool addrKnown;               // peerAddr es pública y está en la lista del controlador
+  esp_bd_addr_t peerAddr;       // Dirección del enlace actual
+  esp_gatt_if_t gattcIf;        // App GATTC del enlace actual: BLEClient la registra en cada connect()
+  uint16_t connId;
+  volatile uint16_t mtu;        // MTU ATT negociado del enlace actual
+  LinkProfile linkProfile;      // Último perfil solicitado (LINK_PROFILE_COUNT = el de la conexión)
+  unsigned long boostUntil;     // millis() hasta el que se mantiene LOW_LATENCY
+  volatile uint16_t connInterval;  // Intervalo aplicado (x 1.25 ms), 0 = desconocido
+  GattHandles handles;          // 0 = sin handles válidos
+  bool handlesFromCache;        // Enlace levantado sin descubrimiento de servicios
+  bool handlesVerified;         // Handles confirmados por una escritura con respuesta
+  volatile bool cccdConfirmed;  // Escritura del CCCD de STATE confirmada (tarea BLE)
+  volatile bool disconnected;   // Desconexión vista por la tarea BLE, pendiente en ioTask
+  
+  uint8_t ticket[p2::TICKET_LEN];  // Ticket de reanudación del último login aceptado
+  uint16_t ticketUser;
+  bool ticketValid;
+  volatile bool authRestart;    // Ticket rechazado: repetir con PIN (ioTask)
+  volatile bool authDone;       // Respuesta de autenticación recibida (appTask -> ioTask)
+
+  StreamState streams[MAX_SLOT_STREAMS];  // Uno por flujo del perfil (appTask)
+  bool streamsArmed;            // Flujos en la rueda (appTask)
+  SpscRing<QueuedCommand, CMD_RING_SIZE> cmdRing;  // appTask -> ioTask
+  TelemetryMirror telemetry;    // Instantáneas reconstruidas de la suscripción (appTask)
+
+  uint8_t pipeSent;             // Último SEQ enviado
+  uint8_t pipeAcked;            // Último SEQ confirmado que ha aplicado ioTask
+  unsigned long pipeAckAt;      // millis() del último ack o del primer envío pendiente
+  volatile uint16_t pipeAckRx;  // Último ack recibido, [nº de acks][SEQ] (solo la tarea BLE)
+  uint8_t pipeAckSeen;          // Nº de acks de pipeAckRx ya aplicados (ioTask)
+
+  SpscRing<SoakProbe, SOAK_WINDOW> soakProbes;  // ioTask -> appTask
+  SoakStats soak;
+
+  BulkSend bulk;
+  SpscRing<BulkAck, BULK_ACK_RING> bulkAcks;    // Bluedroid -> ioTask
+};
+
+PeripheralSlot slots[MAX_PERIPHERALS];
+uint8_t slotCount = 0;
+
+// Un slot retiene como mucho una celda, así que el pool nunca se agota
+#define DEVICE_POOL_SIZE      MAX_PERIPHERALS
 
-BLEAdvertisedDevice* p1Device = nullptr;
-BLEAdvertisedDevice* p2Device = nullptr;
+DeviceRecord devicePool[DEVICE_POOL_SIZE];
+QueueHandle_t deviceFreeQueue = nullptr;  // Índices libres de devicePool
 
-unsigned long lastP1Command = 0;
-unsigned long lastP2Command = 0;
+// Caché de handles GATT por dirección del periférico
+#define GATT_CACHE_SIZE       (MAX_PERIPHERALS * 2)
+
+struct GattCacheEntry {
+  esp_bd_addr_t addr;
+  GattHandles handles;
+  bool valid;
+};
+
+GattCacheEntry gattCache[GATT_CACHE_SIZE];
+uint8_t gattCacheNext = 0;            // Siguiente entrada a reemplazar (FIFO)
+volatile bool gattCacheDirty = false; // Pendiente de guardar en NVS
+
+volatile bool scanRunning = false;
+uint8_t scanLevel = 0;               // Intervalo de escaneo = SCAN_INTERVAL_MIN_MS << scanLevel (ioTask)
+volatile bool scanWindowEmpty = false;  // Ventana completa sin resultados (tarea BLE -> ioTask)
+volatile bool scanLevelReset = false;   // Enlace perdido: volver al duty máximo (-> ioTask)
+QueueHandle_t linkQueue = nullptr;   // PeripheralSlot* pendientes de conectar
+
+// Notificación STATE copiada en la tarea BLE y decodificada en appTask
+struct NotifyEntry {
+  PeripheralSlot* slot;
+  uint16_t length;
+  uint32_t receivedUs;          // micros() en el callback (solo modo soak)
+  uint8_t data[ATT_MAX_PAYLOAD];
+};
+
+SpscRing<NotifyEntry, NOTIFY_RING_SIZE> notifyRing;  // Bluedroid -> appTask
+TaskHandle_t ioTaskHandle = nullptr;
+TaskHandle_t appTaskHandle = nullptr;
+bool scheduleQueued = false;         // appTask ha encolado comandos: despertar a ioTask
 
 void logEvent(const char* device, const char* category, const char* message) {
-  Serial.printf("[%08lu] [%s-%s] %s\n", millis(), device, category, message);
+  logSegments(device, category, &message, 1);
 }
 
-// Callback de notificaciones P1
-void p1NotifyCallback(BLERemoteCharacteristic* pChar, uint8_t* pData, size_t length, bool isNotify) {
-  char hexStr[64] = "";
-  for (size_t i = 0; i < length; i++) {
-    char temp[8];
-    sprintf(temp, "%02X ", pData[i]);
-    strcat(hexStr, temp);
+void setLinkState(PeripheralSlot* slot, LinkState state) {
+  slot->state = state;
+  slot->stateSince = millis();
+  if (state == LINK_CONNECTING) {
+    slot->linkStartedAt = slot->stateSince;
+  } else if (state == LINK_READY) {
+    slot->readyMs = slot->stateSince - slot->linkStartedAt;
+    metricsGaugeMax(MET_READY_MS_MAX, slot->readyMs);
   }
-  char msg[128];
-  sprintf(msg, "Notification: [%s]", hexStr);
-  logEvent("P1", "RX", msg);
+  logEvent(slot->tag, "LINK", LINK_STATE_NAMES[state]);
+  if (appTaskHandle) xTaskNotifyGive(appTaskHandle);  // Arranca o para los flujos del enlace
 }
 
-// Callback de notificaciones P2
-void p2NotifyCallback(BLERemoteCharacteristic* pChar, uint8_t* pData, size_t length, bool isNotify) {
-  char hexStr[64] = "";
-  for (size_t i = 0; i < length; i++) {
-    char temp[8];
-    sprintf(temp, "%02X ", pData[i]);
-    strcat(hexStr, temp);
+// Fallo o desconexión: se invalidan los handles y se programa el reintento.
+// El siguiente escaneo vuelve a empezar con el duty máximo (scanTick()).
+void enterBackoff(PeripheralSlot* slot) {
+  slot->handles.cmd = 0;
+  scanLevelReset = true;
+  setLinkState(slot, LINK_BACKOFF);
+}
+
+// ==================== CACHÉ DE HANDLES GATT ====================
+GattCacheEntry* gattCacheFind(const uint8_t* addr) {
+  for (uint8_t i = 0; i < GATT_CACHE_SIZE; i++) {
+    if (gattCache[i].valid && memcmp(gattCache[i].addr, addr, sizeof(esp_bd_addr_t)) == 0) {
+      return &gattCache[i];
+    }
+  }
+  return nullptr;
+}
+
+void gattCacheStore(const uint8_t* addr, const GattHandles& handles) {
+  GattCacheEntry* entry = gattCacheFind(addr);
+  if (!entry) {
+    entry = &gattCache[gattCacheNext];
+    gattCacheNext = (gattCacheNext + 1) % GATT_CACHE_SIZE;
+    memcpy(entry->addr, addr, sizeof(esp_bd_addr_t));
+  }
+  entry->handles = handles;
+  entry->valid = true;
+  gattCacheDirty = true;
+}
+
+void gattCacheInvalidate(const uint8_t* addr) {
+  GattCacheEntry* entry = gattCacheFind(addr);
+  if (entry) {
+    entry->valid = false;
+    gattCacheDirty = true;
+  }
+}
+
+void gattCacheLoad() {
+#if GATT_CACHE_PERSIST
+  Preferences prefs;
+  prefs.begin("gattcache", true);
+  if (prefs.getBytesLength("table") == sizeof(gattCache)) {
+    prefs.getBytes("table", gattCache, sizeof(gattCache));
+  }
+  prefs.end();
+#endif
+}
+
+// Escritura diferida a NVS (desde linkTask, nunca desde callbacks BLE)
+void gattCacheFlush() {
+#if GATT_CACHE_PERSIST
+  if (!gattCacheDirty) return;
+  gattCacheDirty = false;
+  Preferences prefs;
+  prefs.begin("gattcache", false);
+  prefs.putBytes("table", gattCache, sizeof(gattCache));
+  prefs.end();
+#endif
+}
+
+// Ticket de la respuesta para reanudar en la siguiente reconexión (appTask)
+void ticketStore(PeripheralSlot* slot, const p2::AuthResult& result) {
+  slot->ticketValid = result.ok && result.hasTicket;
+  if (!slot->ticketValid) return;
+  slot->ticketUser = result.userId;
+  memcpy(slot->ticket, result.ticket, sizeof(slot->ticket));
+}
+
+// Resultado de la autenticación (lo invoca el decodificador del perfil en
+// appTask). La transición a READY la hace ioTask, dueña del estado del enlace.
+void authResult(PeripheralSlot* slot, bool ok) {
+  if (ok) {
+    logEvent(slot->tag, "AUTH", "✅ Authentication successful!");
+  } else {
+    logEvent(slot->tag, "AUTH", "❌ Authentication failed!");
+  }
+  // Como antes, la secuencia de comandos arranca aunque el PIN falle
+  slot->authDone = true;
+  xTaskNotifyGive(ioTaskHandle);
+}
+
+// Solo en modo texto: en binario el payload ya sale crudo con streamAtt()
+void logHexFrame(PeripheralSlot* slot, const char* category, const char* action,
+                 const uint8_t* data, size_t length) {
+  if (logBinaryActive()) return;
+  logHex(slot->tag, category, action, data, length);
+}
+
+// Texto de la telemetría decodificada: en binario va en STREAM_TELEM
+bool telemetryText() {
+  return TELEMETRY_LOG_TEXT && !logBinaryActive();
+}
+
+// ==================== STREAMING BINARIO ====================
+// Tramas del master en el modo binario de ble_log.h. Cuerpos:
+//
+//   STREAM_ATT_TX / STREAM_ATT_RX   [slot] [payload ATT tal como viaja]
+//   STREAM_TELEM                    [slot] [flags] {[tipo] [len] [datos]}...
+//
+// tipo y flags son los de telemetry_capture.h (familia | bit del campo,
+// CAPTURE_FLAG_*) y los datos van en big-endian como en la trama, así que
+// el PC decodifica ambos flujos con la misma tabla de campos.
+enum StreamFrameType : uint8_t {
+  STREAM_ATT_TX = LOG_FRAME_USER,
+  STREAM_ATT_RX,
+  STREAM_TELEM
+};
+
+void streamAtt(PeripheralSlot* slot, uint8_t type, const uint8_t* data, size_t length) {
+  if (!logBinaryActive()) return;
+  uint8_t body[LOG_PAYLOAD_MAX];
+  size_t n = min(length, sizeof(body) - 1);
+  body[0] = slot - slots;
+  memcpy(body + 1, data, n);
+  logFrame(slot->tag, type, body, n + 1);
+}
+
+void streamTelemetry(PeripheralSlot* slot, uint8_t family, const TelemetryFieldView* fields, int n, uint8_t flags) {
+  if (!logBinaryActive()) return;
+  uint8_t body[2 + TELEM_MAX_FIELDS * (2 + TELEM_FIELD_MAX_SIZE)];
+  size_t pos = 0;
+  body[pos++] = slot - slots;
+  body[pos++] = flags;
+  for (int i = 0; i < n && i < TELEM_MAX_FIELDS; i++) {
+    uint8_t size = min(fields[i].size, (uint8_t)TELEM_FIELD_MAX_SIZE);
+    body[pos++] = family | __builtin_ctz(fields[i].bit);
+    body[pos++] = size;
+    memcpy(body + pos, fields[i].data, size);
+    pos += size;
+  }
+  logFrame(slot->tag, STREAM_TELEM, body, pos);
+}
+
+// ==================== TELEMETRÍA SUSCRITA ====================
+// Alta en la telemetría por cambios del perfil (appTask, al llegar a READY);
+// la réplica se vacía porque el periférico empieza con un keyframe
+void telemetrySubscribe(PeripheralSlot* slot) {
+  const TelemetrySubscription* sub = slot->profile->telemetry;
+  QueuedCommand* out = sub ? slot->cmdRing.reserve() : nullptr;
+  if (!out) return;
+  telemMirrorReset(&slot->telemetry);
+  out->cmd = sub->subscribeOpcode;
+  out->payloadLen = 1 + sub->fieldCount;
+  out->payload[0] = sub->keyframeEvery;
+  memcpy(out->payload + 1, sub->thresholds, sub->fieldCount);
+  slot->cmdRing.commit();
+  scheduleQueued = true;
+}
+
+// Keyframe o delta (appTask): reconstruye la instantánea, la confirma para
+// que el periférico la use como base y devuelve sus campos. -1 si la base
+// ya no está en la réplica (el siguiente keyframe lo arregla).
+int telemetryReceive(PeripheralSlot* slot, const uint8_t* data, size_t length, TelemetryFieldView* fields) {
+  const TelemetrySubscription* sub = slot->profile->telemetry;
+  const TelemetrySnapshot* snapshot =
+    sub ? telemMirrorApply(&slot->telemetry, sub->layouts, sub->fieldCount, data, length) : nullptr;
+  if (!snapshot) {
+    logHexFrame(slot, "RX", "Telemetry delta without base", data, length);
+    return -1;
+  }
+  
+  QueuedCommand* ack = slot->cmdRing.reserve();
+  if (ack) {
+    ack->cmd = sub->ackOpcode;
+    ack->payloadLen = 1;
+    ack->payload[0] = snapshot->seq;
+    slot->cmdRing.commit();
+    scheduleQueued = true;
+  }
+  return telemSnapshotFields(snapshot, sub->layouts, sub->fieldCount, fields, TELEM_MAX_FIELDS);
+}
+
+// ==================== CAPTURA ====================
+// Un registro binario por campo (appTask, telemetry_capture.h) y, en modo
+// binario, la misma instantánea hacia el PC en una trama STREAM_TELEM
+void captureTelemetry(PeripheralSlot* slot, uint8_t family, const TelemetryFieldView* fields, int n, uint8_t flags) {
+  for (int i = 0; i < n; i++) {
+    captureRecord(slot - slots, family | __builtin_ctz(fields[i].bit), fields[i].data, fields[i].size, flags);
+  }
+  streamTelemetry(slot, family, fields, n, flags);
+}
+
+// ==================== CODECS ====================
+// Trama CMD de la familia del perfil (device_profile.h): P1 [CMD, P1, P2, P3],
+// P2 [CMD, LEN, DATA]. Una instancia por familia, resuelta al compilar.
+template <typename Profile>
+size_t encodeCommand(uint8_t cmd, const uint8_t* payload, uint8_t payloadLen,
+                     uint8_t* out, size_t outSize) {
+  return Profile::encodeFrame(cmd, payload, payloadLen, ByteSpan(out, outSize));
+}
+
+// ==================== CODEC P1 ====================
+
+void logTelemetryP1(PeripheralSlot* slot, const TelemetryFieldView* fields, int n) {
+  char msg[96];
+  size_t pos = snprintf(msg, sizeof(msg), "🌡️  TELEMETRY:");
+  for (int i = 0; i < n && pos < sizeof(msg); i++) {
+    p1::telemetry::Temperature temperature;
+    p1::telemetry::Humidity humidity;
+    if (decodeField(fields[i], temperature)) {
+      pos += snprintf(msg + pos, sizeof(msg) - pos, " Temp=%.1f°C", temperature.deciCelsius / 10.0);
+    } else if (decodeField(fields[i], humidity)) {
+      pos += snprintf(msg + pos, sizeof(msg) - pos, " Hum=%.1f%%", humidity.permille / 10.0);
+    }
+  }
+  logEvent(slot->tag, "TELEM", msg);
+}
+
+void decodeNotifyP1(PeripheralSlot* slot, const uint8_t* pData, size_t length) {
+  TelemetryFieldView fields[TELEM_MAX_FIELDS];
+  
+  // Telemetría empaquetada: [0xA1, bitmap, temp, humedad]
+  if (pData[0] == TELEM_FRAME_PACKED) {
+    int n = telemetryDecode(pData, length, P1Profile::fieldSizes(), P1Profile::TELEMETRY_FIELDS,
+                            fields, TELEM_MAX_FIELDS);
+    if (n > 0) {
+      captureTelemetry(slot, CAPTURE_P1, fields, n, 0);
+      if (telemetryText()) logTelemetryP1(slot, fields, n);
+      return;
+    }
+  }
+  // Telemetría suscrita: se registra la instantánea reconstruida entera
+  else if (pData[0] == TELEM_FRAME_KEY || pData[0] == TELEM_FRAME_DELTA) {
+    int n = telemetryReceive(slot, pData, length, fields);
+    if (n <= 0) return;
+    captureTelemetry(slot, CAPTURE_P1, fields, n, CAPTURE_FLAG_SUBSCRIBED);
+    if (telemetryText()) logTelemetryP1(slot, fields, n);
+    return;
   }
   
+  logHexFrame(slot, "RX", "Notification", pData, length);
+}
+
+// ==================== CODEC P2 ====================
+
+void logTelemetryP2(PeripheralSlot* slot, const TelemetryFieldView* fields, int n) {
+  char msg[128];
+  size_t pos = snprintf(msg, sizeof(msg), "📡 TELEMETRY:");
+  for (int i = 0; i < n && pos < sizeof(msg); i++) {
+    p2::telemetry::Vitals vitals;
+    p2::telemetry::Activity activity;
+    p2::telemetry::Gps gps;
+    if (decodeField(fields[i], vitals)) {
+      pos += snprintf(msg + pos, sizeof(msg) - pos, " Temp=%.1f°C, HR=%d bpm;",
+                      vitals.deciCelsius / 10.0, vitals.heartRate);
+    } else if (decodeField(fields[i], activity)) {
+      pos += snprintf(msg + pos, sizeof(msg) - pos, " Steps=%d, Battery=%d%%;",
+                      activity.steps, activity.battery);
+    } else if (decodeField(fields[i], gps)) {
+      pos += snprintf(msg + pos, sizeof(msg) - pos, " GPS=(%.2f,%.2f)",
+                      gps.latitude / 100.0, gps.longitude / 100.0);
+    }
+  }
+  logEvent(slot->tag, "TELEM", msg);
+}
+
+void decodeNotifyP2(PeripheralSlot* slot, const uint8_t* pData, size_t length) {
+  ConstByteSpan body(pData + 1, length - 1);
+  
   // Detectar respuesta de autenticación
-  if (pData[0] == 0x01) {
-    if (length > 1 && pData[1] == 0x01) {
-      logEvent("P2", "AUTH", "✅ Authentication successful!");
-    } else {
-      logEvent("P2", "AUTH", "❌ Authentication failed!");
+  if (pData[0] == p2::AuthPin::OPCODE) {
+    p2::AuthResult result;
+    bool ok = decodeFrom(body, result) && result.ok;
+    ticketStore(slot, result);
+    authResult(slot, ok);
+  }
+  // Reanudación: aceptada equivale a un PIN correcto; rechazada (caducado,
+  // periférico reiniciado) se repite con PIN desde ioTask
+  else if (pData[0] == p2::SessionResume::OPCODE) {
+    p2::AuthResult result;
+    bool ok = decodeFrom(body, result) && result.ok;
+    ticketStore(slot, result);
+    if (ok) {
+      logEvent(slot->tag, "AUTH", "⚡ Session resumed with ticket");
+      authResult(slot, true);
+    } else if (slot->state == LINK_AUTHENTICATING) {
+      logEvent(slot->tag, "AUTH", "Ticket rejected, falling back to PIN");
+      slot->authRestart = true;
+      xTaskNotifyGive(ioTaskHandle);
+    }
+  }
+  // Telemetría empaquetada (0xA1): instantánea completa en una notificación
+  else if (pData[0] == TELEM_FRAME_PACKED) {
+    TelemetryFieldView fields[TELEM_MAX_FIELDS];
+    int n = telemetryDecode(pData, length, P2Profile::fieldSizes(), P2Profile::TELEMETRY_FIELDS,
+                            fields, TELEM_MAX_FIELDS);
+    if (n <= 0) {
+      logHexFrame(slot, "RX", "Malformed telemetry", pData, length);
+      return;
     }
+    captureTelemetry(slot, CAPTURE_P2, fields, n, 0);
+    if (telemetryText()) logTelemetryP2(slot, fields, n);
+    return;
+  }
+  // Telemetría suscrita (0xA3 / 0xA2): instantánea reconstruida entera
+  else if (pData[0] == TELEM_FRAME_KEY || pData[0] == TELEM_FRAME_DELTA) {
+    TelemetryFieldView fields[TELEM_MAX_FIELDS];
+    int n = telemetryReceive(slot, pData, length, fields);
+    if (n <= 0) return;
+    captureTelemetry(slot, CAPTURE_P2, fields, n, CAPTURE_FLAG_SUBSCRIBED);
+    if (telemetryText()) logTelemetryP2(slot, fields, n);
+    return;
   }
-  // Decodificar telemetría (0xA0)
+  // Telemetría antigua (0xA0): un campo por notificación, [0xA0, tipo, campo]
   else if (pData[0] == 0xA0 && length > 1) {
-    uint8_t telemetryType = pData[1];
+    ConstByteSpan field(pData + 2, length - 2);
     char telemetryMsg[128];
+    // Tipos 0x01-0x03 = bits 0-2 del bitmap de 0xA1
+    if (pData[1] >= 0x01 && pData[1] <= 0x03) {
+      TelemetryFieldView view = {(uint8_t)(1 << (pData[1] - 1)), (uint8_t)(length - 2), pData + 2};
+      captureTelemetry(slot, CAPTURE_P2, &view, 1, 0);
+    }
+    if (!telemetryText()) return;
     
-    switch (telemetryType) {
-      case 0x01: // Vitales
-        if (length >= 5) {
-          int16_t temp = (pData[2] << 8) | pData[3];
-          uint8_t hr = pData[4];
-          sprintf(telemetryMsg, "📊 VITALS: Temp=%.1f°C, HR=%d bpm", temp / 10.0, hr);
-          logEvent("P2", "TELEM", telemetryMsg);
+    switch (pData[1]) {
+      case 0x01: { // Vitales
+        p2::telemetry::Vitals vitals;
+        if (decodeFrom(field, vitals)) {
+          sprintf(telemetryMsg, "📊 VITALS: Temp=%.1f°C, HR=%d bpm", vitals.deciCelsius / 10.0, vitals.heartRate);
+          logEvent(slot->tag, "TELEM", telemetryMsg);
         }
         break;
+      }
         
-      case 0x02: // Actividad
-        if (length >= 5) {
-          uint16_t steps = (pData[2] << 8) | pData[3];
-          uint8_t battery = pData[4];
-          sprintf(telemetryMsg, "🏃 ACTIVITY: Steps=%d, Battery=%d%%", steps, battery);
-          logEvent("P2", "TELEM", telemetryMsg);
+      case 0x02: { // Actividad
+        p2::telemetry::Activity activity;
+        if (decodeFrom(field, activity)) {
+          sprintf(telemetryMsg, "🏃 ACTIVITY: Steps=%d, Battery=%d%%", activity.steps, activity.battery);
+          logEvent(slot->tag, "TELEM", telemetryMsg);
         }
         break;
+      }
         
-      case 0x03: // GPS
-        if (length >= 6) {
-          int16_t lat = (pData[2] << 8) | pData[3];
-          int16_t lon = (pData[4] << 8) | pData[5];
-          sprintf(telemetryMsg, "📍 GPS: Lat=%.2f, Lon=%.2f", lat / 100.0, lon / 100.0);
-          logEvent("P2", "TELEM", telemetryMsg);
+      case 0x03: { // GPS
+        p2::telemetry::Gps gps;
+        if (decodeFrom(field, gps)) {
+          sprintf(telemetryMsg, "📍 GPS: Lat=%.2f, Lon=%.2f", gps.latitude / 100.0, gps.longitude / 100.0);
+          logEvent(slot->tag, "TELEM", telemetryMsg);
         }
         break;
+      }
     }
     return; // No mostrar hex para telemetría
   }
   
-  char msg[128];
-  sprintf(msg, "Notification: [%s]", hexStr);
-  logEvent("P2", "RX", msg);
+  logHexFrame(slot, "RX", "Notification", pData, length);
 }
 
-// Enviar comando a P1 (formato antiguo - 4 bytes fijos)
-void sendCommandP1(uint8_t cmd, uint8_t param1 = 0, uint8_t param2 = 0, uint8_t param3 = 0) {
-  if (!p1Connected || !pP1CmdChar) return;
+bool sendCommand(PeripheralSlot* slot, uint8_t cmd, const uint8_t* payload, uint8_t payloadLen);
+
+// Autenticar con P2: con ticket, un solo intercambio y sin PIN
+void authenticateP2(PeripheralSlot* slot) {
+  if (slot->ticketValid) {
+    logEvent(slot->tag, "AUTH", "⚡ Resuming session with ticket...");
+    p2::SessionResume resume;
+    resume.userId = slot->ticketUser;
+    memcpy(resume.ticket, slot->ticket, sizeof(resume.ticket));
+    slot->ticketValid = false;  // Un solo uso: la respuesta trae el siguiente
+    uint8_t payload[p2::SessionResume::SIZE];
+    sendCommand(slot, p2::SessionResume::OPCODE, payload, encodeInto(resume, ByteSpan(payload, sizeof(payload))));
+    return;
+  }
   
-  uint8_t data[4] = {cmd, param1, param2, param3};
-  pP1CmdChar->writeValue(data, 4);
+  logEvent(slot->tag, "AUTH", "🔐 Sending PIN authentication (PLAINTEXT!)...");
   
-  char msg[64];
-  sprintf(msg, "CMD sent: [%02X %02X %02X %02X]", data[0], data[1], data[2], data[3]);
-  logEvent("P1", "TX", msg);
+  // User ID = 1; PIN "123456" -> bytes 0x12, 0x34, 0x56, 0x00 (BCD-like)
+  p2::AuthPin auth = {0x0001, {0x12, 0x34, 0x56, 0x00}};
+  
+  char pinMsg[128];
+  sprintf(pinMsg, "⚠️  Transmitting PIN in CLEAR: User=1, PIN=%s", P2_PIN);
+  logEvent(slot->tag, "VULN", pinMsg);
+  
+  uint8_t payload[p2::AuthPin::SIZE];
+  sendCommand(slot, p2::AuthPin::OPCODE, payload, encodeInto(auth, ByteSpan(payload, sizeof(payload))));
 }
 
-// Enviar comando a P2 (formato nuevo - CMD+LEN+DATA)
-void sendCommandP2(uint8_t cmd, uint8_t* payload, uint8_t payloadLen) {
-  if (!p2Connected || !pP2CmdChar) return;
-  
-  uint8_t data[20] = {cmd, payloadLen};
-  if (payloadLen > 0 && payloadLen < 18) {
-    memcpy(data + 2, payload, payloadLen);
+// ==================== MODO SOAK ====================
+// Cada comando con reply sale de ioTask como una sonda en soakProbes y
+// appTask la empareja con la primera notificación de ese opcode. Las
+// respuestas no llevan secuencia, pero los periféricos atienden en orden:
+// las sondas que quedan delante de la que casa se dan por perdidas.
+
+// ioTask, tras intentar la escritura. Cabe siempre: generateSoak no deja
+// más de SOAK_WINDOW comandos sin resolver.
+void soakSent(PeripheralSlot* slot, uint8_t reply, bool sent, uint32_t sentUs) {
+  SoakProbe* probe = slot->soakProbes.reserve();
+  if (!probe) return;
+  probe->reply = reply;
+  probe->sent = sent;
+  probe->sentUs = sentUs;
+  slot->soakProbes.commit();
+}
+
+// Retira la sonda de cabeza sin respuesta
+void soakDrop(PeripheralSlot* slot) {
+  SoakStats* soak = &slot->soak;
+  if (slot->soakProbes.front()->sent) soak->lost++;
+  else soak->unsent++;
+  soak->resolved++;
+  slot->soakProbes.pop();
+}
+
+// Resuelve las sondas de cabeza no enviadas o vencidas (appTask)
+void soakExpire(PeripheralSlot* slot) {
+  uint32_t nowUs = micros();
+  for (SoakProbe* probe = slot->soakProbes.front(); probe; probe = slot->soakProbes.front()) {
+    if (probe->sent && nowUs - probe->sentUs < SOAK_TIMEOUT_MS * 1000UL) return;
+    soakDrop(slot);
   }
+}
+
+// Notificación recibida (appTask). Si ninguna sonda espera su opcode no es
+// una respuesta (telemetría, errores) y no toca las sondas.
+void soakMatch(PeripheralSlot* slot, uint8_t opcode, uint32_t receivedUs) {
+  uint32_t i = 0;
+  SoakProbe* probe;
+  for (; (probe = slot->soakProbes.peek(i)); i++) {
+    if (probe->sent && probe->reply == opcode) break;
+  }
+  if (!probe) return;
   
-  pP2CmdChar->writeValue(data, 2 + payloadLen);
+  SoakStats* soak = &slot->soak;
+  latRecord(&soak->latency, receivedUs - probe->sentUs);
+  for (; i > 0; i--) soakDrop(slot);
+  soak->answered++;
+  soak->resolved++;
+  slot->soakProbes.pop();
+}
+
+bool generateSequence(StreamState* state, unsigned long now, QueuedCommand* out);
+
+// Generador del modo soak: los pasos en ciclo, como las secuencias de demo,
+// mientras haya menos de SOAK_WINDOW comandos sin resolver
+bool generateSoak(StreamState* state, unsigned long now, QueuedCommand* out) {
+  SoakStats* soak = &state->slot->soak;
+  soakExpire(state->slot);
+  if (soak->generated - soak->resolved >= SOAK_WINDOW) return false;
+  soak->generated++;
+  return generateSequence(state, now, out);
+}
+
+// Informe de un enlace y comienzo del intervalo siguiente
+void soakReport(PeripheralSlot* slot, uint32_t now) {
+  SoakStats* soak = &slot->soak;
+  soakExpire(slot);
+  uint32_t elapsed = max(now - soak->intervalStart, 1UL);
+  uint32_t resolved = soak->answered + soak->lost + soak->unsent;
+  uint32_t dropped = soak->lost + soak->unsent;
+  uint32_t dropPermille = resolved ? (uint64_t)dropped * 1000 / resolved : 0;
+  uint32_t rateTenths = (uint64_t)soak->answered * 10000 / elapsed;
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%lu cmds, %lu answered (%lu.%lu/s), dropped %lu.%lu%% (%lu lost, %lu unsent), reconnects %u",
+          (unsigned long)resolved, (unsigned long)soak->answered, (unsigned long)(rateTenths / 10),
+          (unsigned long)(rateTenths % 10), (unsigned long)(dropPermille / 10), (unsigned long)(dropPermille % 10),
+          (unsigned long)soak->lost, (unsigned long)soak->unsent, (unsigned)(uint16_t)(slot->connects - soak->connectsAtStart));
+  logEvent(slot->tag, "SOAK", msg);
   
-  char hexStr[64] = "";
-  for (int i = 0; i < 2 + payloadLen; i++) {
-    char temp[8];
-    sprintf(temp, "%02X ", data[i]);
-    strcat(hexStr, temp);
+  if (soak->latency.total) {
+    const uint16_t PERMILLE[] = {500, 990, 999};
+    uint32_t us[4];
+    for (uint8_t i = 0; i < 3; i++) us[i] = latPercentile(&soak->latency, PERMILLE[i]);
+    us[3] = soak->latency.maxUs;
+    snprintf(msg, sizeof(msg), "rtt p50 %lu.%02lu ms, p99 %lu.%02lu ms, p999 %lu.%02lu ms, max %lu.%02lu ms",
+            (unsigned long)(us[0] / 1000), (unsigned long)(us[0] % 1000 / 10),
+            (unsigned long)(us[1] / 1000), (unsigned long)(us[1] % 1000 / 10),
+            (unsigned long)(us[2] / 1000), (unsigned long)(us[2] % 1000 / 10),
+            (unsigned long)(us[3] / 1000), (unsigned long)(us[3] % 1000 / 10));
+    logEvent(slot->tag, "SOAK", msg);
   }
-  char msg[128];
-  sprintf(msg, "CMD sent: [%s]", hexStr);
-  logEvent("P2", "TX", msg);
+  
+  soak->answered = 0;
+  soak->lost = 0;
+  soak->unsent = 0;
+  soak->connectsAtStart = slot->connects;
+  soak->intervalStart = now;
+  latReset(&soak->latency);
 }
 
-// Autenticar con P2
-void authenticateP2() {
-  logEvent("P2", "AUTH", "🔐 Sending PIN authentication (PLAINTEXT!)...");
+// ==================== PERFILES Y FLOTA ====================
+const ProtocolCodec CODEC_P1 = {encodeCommand<P1Profile>, decodeNotifyP1};
+const ProtocolCodec CODEC_P2 = {encodeCommand<P2Profile>, decodeNotifyP2};
+
+// Generador de las secuencias de demo: siguiente paso del ciclo, con
+// millis() en los 4 primeros bytes si el paso lo pide
+bool generateSequence(StreamState* state, unsigned long now, QueuedCommand* out) {
+  const CommandStream* stream = state->stream;
+  const ScheduledCommand& step = stream->steps[state->seq % stream->stepCount];
+  out->cmd = step.cmd;
+  out->payloadLen = step.payloadLen;
+  out->reply = step.reply;
+  memcpy(out->payload, step.payload, step.payloadLen);
+  if (step.flags & SCHED_STAMP_MILLIS) {
+    out->payload[0] = (now >> 24) & 0xFF;
+    out->payload[1] = (now >> 16) & 0xFF;
+    out->payload[2] = (now >> 8) & 0xFF;
+    out->payload[3] = now & 0xFF;
+  }
+  state->seq++;
+  return true;
+}
+
+// P1: cada 3 segundos. La telemetría llega por suscripción, sin GET_TELEMETRY.
+const ScheduledCommand SCHEDULE_P1_STEPS[] = {
+  {0x01, 1, {0x01}, 0, 0},   // ECO mode
+  {0x03, 1, {80}, 0, 0},     // Brightness 80
+  {0x02, 0, {0}, 0, 0},      // Get status
+};
+const CommandStream STREAMS_P1[] = {
+  {3000, 0, 1, generateSequence, SCHEDULE_P1_STEPS, 3},
+};
+
+// Soak de P1: estado (eco 0x02) y telemetría empaquetada (0xA1)
+const ScheduledCommand SOAK_P1_STEPS[] = {
+  {0x02, 0, {0}, 0, 0x02},                // Get status
+  {0x05, 0, {0}, 0, TELEM_FRAME_PACKED},  // Get telemetry
+};
+
+// Keyframe cada 6 ticks (30 s); cambios de 0.5 °C o 1 % de humedad
+const TelemetrySubscription TELEMETRY_P1 = {P1Profile::Subscribe::OPCODE, P1Profile::Ack::OPCODE,
+                                            P1Profile::fieldLayouts(), P1Profile::TELEMETRY_FIELDS, 6, {5, 10}};
+
+// P2: cada 4 segundos; con pipeline se envía la configuración entera de golpe
+const ScheduledCommand SCHEDULE_P2_STEPS[] = {
+  {0x02, 5, {0, 0, 0, 0, 0x01}, SCHED_STAMP_MILLIS, 0}, // Session start (tipo infantil)
+  {0x10, 1, {0x02}, 0, 0},                              // Set mode TURBO
+  {0x11, 1, {75}, 0, 0},                                // Set intensity 75%
+  {0x12, 2, {0x00, 0x2D}, 0, 0},                        // Set timer 45 min
+  {0x20, 3, {0x01, 0x05, 0xDC}, 0, 0},                  // Event: Game complete, score 1500
+  {0x21, 2, {0x05, 0x03}, 0, 0},                        // Reward: Level 5, 3 badges
+};
+const CommandStream STREAMS_P2[] = {
+  {4000, 1, 6, generateSequence, SCHEDULE_P2_STEPS, 6},
+};
+
+// Soak de P2: keepalive y configuración; cada uno responde con su opcode
+const ScheduledCommand SOAK_P2_STEPS[] = {
+  {0x03, 1, {0x01}, 0, 0x03},              // Keepalive
+  {0x10, 1, {0x01}, 0, 0x10},              // Set mode NORMAL
+  {0x11, 1, {50}, 0, 0x11},                // Set intensity 50%
+  {0x12, 2, {0x00, 0x1E}, 0, 0x12},        // Set timer 30 min
+  {0x13, 2, {0x01, 0x07}, 0, 0x13},        // Set profile
+  {0x20, 3, {0x00, 0x00, 0x01}, 0, 0x20},  // Event
+  {0x21, 2, {0x01, 0x01}, 0, 0x21},        // Reward: Level 1, 1 badge
+};
+
+// Lazo cerrado: la rueda lo dispara cada ms y generateSoak limita a SOAK_WINDOW
+#define SOAK_INTERVAL_MS (SOAK_RATE_HZ == 0 || SOAK_RATE_HZ >= 1000 ? 1 : 1000 / SOAK_RATE_HZ)
+#define SOAK_BURST       (SOAK_RATE_HZ == 0 ? SOAK_WINDOW : 1)
+
+const CommandStream SOAK_STREAMS_P1[] = {
+  {SOAK_INTERVAL_MS, 0, SOAK_BURST, generateSoak, SOAK_P1_STEPS, 2},
+};
+const CommandStream SOAK_STREAMS_P2[] = {
+  {SOAK_INTERVAL_MS, 1, SOAK_BURST, generateSoak, SOAK_P2_STEPS, 7},
+};
+
+// Keyframe cada 6 ticks (1 min); vitales ±0.3 °C / 3 bpm, actividad en
+// cualquier cambio, GPS ±0.02°
+const TelemetrySubscription TELEMETRY_P2 = {P2Profile::Subscribe::OPCODE, P2Profile::Ack::OPCODE,
+                                            P2Profile::fieldLayouts(), P2Profile::TELEMETRY_FIELDS, 6, {3, 0, 2}};
+
+// Lo que cada slot necesita en tiempo de ejecución (la flota es heterogénea),
+// tomado de los perfiles de compilación
+const DeviceProfile PROFILE_P1 = {P1Profile::SERVICE_UUID, P1Profile::CMD_UUID, P1Profile::STATE_UUID,
+                                  &CODEC_P1, SOAK_MODE ? SOAK_STREAMS_P1 : STREAMS_P1, 1, nullptr, P1Profile::PIPELINED, LINK_PROFILE_BALANCED,
+                                  &TELEMETRY_P1};
+const DeviceProfile PROFILE_P2 = {P2Profile::SERVICE_UUID, P2Profile::CMD_UUID, P2Profile::STATE_UUID,
+                                  &CODEC_P2, SOAK_MODE ? SOAK_STREAMS_P2 : STREAMS_P2, 1, authenticateP2, P2Profile::PIPELINED,
+                                  LINK_PROFILE_LOW_POWER, &TELEMETRY_P2};
+
+// Dispositivos gestionados por este central (máx. MAX_PERIPHERALS)
+const FleetEntry FLEET[] = {
+  {"P1", P1Profile::NAME, &PROFILE_P1},
+  {"P2", P2Profile::NAME, &PROFILE_P2},
+};
+
+// ==================== ENVÍO DE COMANDOS ====================
+// Pipeline solo con handles confirmados: mientras se verifican, con respuesta
+bool pipelineActive(const PeripheralSlot* slot) {
+  return CMD_PIPELINE && slot->profile->pipelined && slot->handlesVerified;
+}
+
+bool sendCommand(PeripheralSlot* slot, uint8_t cmd, const uint8_t* payload, uint8_t payloadLen) {
+  // La autenticación se envía antes de READY, desde linkTask
+  uint16_t cmdHandle = slot->handles.cmd;
+  if ((slot->state != LINK_READY && slot->state != LINK_AUTHENTICATING) || !cmdHandle) return false;
   
-  uint8_t authData[6];
-  authData[0] = 0x00; // User ID high byte
-  authData[1] = 0x01; // User ID low byte (User = 1)
+  bool piped = pipelineActive(slot);
+  uint8_t inFlight = pipeInFlight(slot->pipeSent, slot->pipeAcked);
+  if (piped && inFlight >= PIPE_WINDOW) return false;  // Sin créditos: reintentar más tarde
   
-  // PIN "123456" → bytes 0x12, 0x34, 0x56, 0x00 (BCD-like)
-  authData[2] = 0x12;
-  authData[3] = 0x34;
-  authData[4] = 0x56;
-  authData[5] = 0x00; // Padding
+  uint8_t data[ATT_MAX_PAYLOAD];
+  size_t offset = piped ? PIPE_HEADER_LEN : 0;
+  size_t len = slot->profile->codec->encodeCommand(cmd, payload, payloadLen, data + offset,
+                                                   attPayload(slot->mtu) - offset);
+  if (len == 0) {
+    logEvent(slot->tag, "ERROR", "Command does not fit in frame");
+    return false;
+  }
+  if (piped) {
+    data[0] = PIPE_FRAME_CMD;
+    data[1] = slot->pipeSent + 1;
+    len += PIPE_HEADER_LEN;
+  }
   
-  char pinMsg[128];
-  sprintf(pinMsg, "⚠️  Transmitting PIN in CLEAR: User=1, PIN=%s", P2_PIN);
-  logEvent("P2", "VULN", pinMsg);
+  // Con respuesta por defecto: un fallo llega a cachedWriteFailed() y unos
+  // handles de caché obsoletos se redescubren. Solo el pipeline (opcional,
+  // y solo con handles ya confirmados) escribe sin respuesta.
+  esp_gatt_write_type_t type = piped ? ESP_GATT_WRITE_TYPE_NO_RSP : ESP_GATT_WRITE_TYPE_RSP;
+  if (esp_ble_gattc_write_char(slot->gattcIf, slot->connId, cmdHandle, len, data,
+                               type, ESP_GATT_AUTH_REQ_NONE) != ESP_OK) {
+    metricsCount(MET_WRITE_FAIL);
+    logEvent(slot->tag, "ERROR", "Write failed");
+    return false;
+  }
+  metricsCount(MET_COMMANDS);
+  if (piped) {
+    if (inFlight == 0) slot->pipeAckAt = millis();
+    slot->pipeSent++;
+  }
+  logHexFrame(slot, "TX", "CMD sent", data, len);
+  streamAtt(slot, STREAM_ATT_TX, data, len);
+  return true;
+}
+
+// Ack acumulativo [0xF1][SEQ] (tarea BLE); true si la trama era un ack. Solo
+// se publica en pipeAckRx, con un contador para que ioTask distinga un ack
+// nuevo de uno ya aplicado; la ventana (pipeAcked) es solo de ioTask.
+bool pipelineAck(PeripheralSlot* slot, const uint8_t* data, size_t length) {
+  if (!slot->profile->pipelined || length < PIPE_HEADER_LEN || data[0] != PIPE_FRAME_ACK) return false;
+  uint8_t count = (slot->pipeAckRx >> 8) + 1;
+  slot->pipeAckRx = (uint16_t)(count << 8 | data[1]);  // Una sola escritura de 16 bits
+  return true;
+}
+
+// Aplica el último ack publicado por la tarea BLE (ioTask). Un ack que llega
+// después de un reinicio de la ventana ya no avanza y se ignora.
+void pipelineTakeAck(PeripheralSlot* slot, unsigned long now) {
+  uint16_t rx = slot->pipeAckRx;
+  uint8_t count = rx >> 8;
+  if (count == slot->pipeAckSeen) return;
+  slot->pipeAckSeen = count;
+  if (pipeAckAdvances((uint8_t)rx, slot->pipeSent, slot->pipeAcked)) {
+    slot->pipeAcked = (uint8_t)rx;
+    slot->pipeAckAt = now;
+  }
+}
+
+// Ack perdido o periférico saturado: se recuperan los créditos
+void pipelineCheckTimeout(PeripheralSlot* slot, unsigned long now) {
+  pipelineTakeAck(slot, now);
+  if (pipeInFlight(slot->pipeSent, slot->pipeAcked) == 0 || now - slot->pipeAckAt <= PIPE_ACK_TIMEOUT_MS) return;
+  logEvent(slot->tag, "WARN", "Pipeline ack timeout, window reset");
+  slot->pipeAcked = slot->pipeSent;
+}
+
+// Escribe los comandos que appTask ha dejado en el cmdRing (ioTask). Sin
+// créditos del pipeline el primero se queda en cabeza hasta el siguiente ack;
+// cualquier otro fallo ya está contado y registrado y el paso se descarta.
+// Con el enlace fuera de READY se vacía el anillo. Los comandos del modo
+// soak dejan su sonda, también los que no se han podido escribir.
+void flushCommands(PeripheralSlot* slot) {
+  for (QueuedCommand* queued = slot->cmdRing.front(); queued; queued = slot->cmdRing.front()) {
+    bool sent = false;
+    uint32_t sentUs = micros();
+    if (slot->state == LINK_READY) {
+      if (pipelineActive(slot) && pipeInFlight(slot->pipeSent, slot->pipeAcked) >= PIPE_WINDOW) return;
+      sent = sendCommand(slot, queued->cmd, queued->payload, queued->payloadLen);
+    }
+    if (queued->reply) soakSent(slot, queued->reply, sent, sentUs);
+    slot->cmdRing.pop();
+  }
+}
+
+// ==================== PLANIFICADOR ====================
+TimerWheel scheduleWheel;            // Flujos de todos los slots y los informes (appTask)
+WheelTimer reportTimer;
+WheelTimer soakTimer;
+
+// Disparo de un flujo: hasta burst comandos al cmdRing del slot y
+// reprogramación sin deriva (vencimiento + intervalo). Con el anillo lleno
+// el resto espera al siguiente disparo.
+void streamFire(WheelTimer* timer, uint32_t now) {
+  StreamState* state = (StreamState*)timer->owner;
+  PeripheralSlot* slot = state->slot;
+  const CommandStream* stream = state->stream;
+  uint8_t burst = pipelineActive(slot) ? stream->burst : 1;
+  for (uint8_t i = 0; i < burst; i++) {
+    QueuedCommand* out = slot->cmdRing.reserve();
+    if (!out || !stream->generate(state, now, out)) break;
+    slot->cmdRing.commit();
+    scheduleQueued = true;
+  }
+  wheelAdd(&scheduleWheel, timer, timer->expires + stream->intervalMs);
+}
+
+// Mete en la rueda los flujos de los enlaces que han llegado a READY (primer
+// disparo inmediato) y saca los de los que lo han dejado
+void scheduleSync(uint32_t now) {
+  for (uint8_t i = 0; i < slotCount; i++) {
+    PeripheralSlot* slot = &slots[i];
+    bool ready = slot->state == LINK_READY;
+    if (ready == slot->streamsArmed) continue;
+    slot->streamsArmed = ready;
+    if (ready) {
+      captureRecord(i, CAPTURE_LINK, slot->peerAddr, sizeof(esp_bd_addr_t));
+      telemetrySubscribe(slot);  // Antes del primer disparo de los flujos
+    }
+    for (uint8_t j = 0; j < slot->profile->streamCount; j++) {
+      if (ready) wheelAdd(&scheduleWheel, &slot->streams[j].timer, now);
+      else wheelRemove(&scheduleWheel, &slot->streams[j].timer);
+    }
+  }
+}
+
+// Cada flujo ha completado una vuelta: configuración inicial enviada
+bool streamsWarm(const PeripheralSlot* slot) {
+  for (uint8_t j = 0; j < slot->profile->streamCount; j++) {
+    if (slot->streams[j].seq < slot->profile->streams[j].stepCount) return false;
+  }
+  return true;
+}
+
+// ==================== PARÁMETROS DE CONEXIÓN ====================
+// Solicita un perfil de conn_params.h si no es ya el pedido para el enlace
+void requestLinkProfile(PeripheralSlot* slot, LinkProfile profile) {
+  if (slot->linkProfile == profile) return;
+  if (!connParamsRequest(slot->peerAddr, profile)) {
+    logEvent(slot->tag, "ERROR", "Conn params update failed");
+    return;
+  }
+  slot->linkProfile = profile;
+  char msg[48];
+  sprintf(msg, "Requesting %s link", CONN_PROFILES[profile].name);
+  logEvent(slot->tag, "BLE", msg);
+}
+
+// LOW_LATENCY durante al menos ms (descubrimiento, ráfagas de configuración)
+void linkBoost(PeripheralSlot* slot, unsigned long ms) {
+  unsigned long until = millis() + ms;
+  if ((long)(until - slot->boostUntil) > 0) slot->boostUntil = until;
+  requestLinkProfile(slot, LINK_PROFILE_LOW_LATENCY);
+}
+
+// Vuelta al perfil de reposo cuando expira el boost y la configuración
+// inicial (una vuelta completa de la secuencia) ya se ha enviado
+void linkProfileTick(PeripheralSlot* slot, unsigned long now) {
+  const DeviceProfile* profile = slot->profile;
+  if (slot->linkProfile == profile->idleLink || (long)(now - slot->boostUntil) < 0) return;
+  if (!streamsWarm(slot)) return;
+  requestLinkProfile(slot, profile->idleLink);
+}
+
+// ==================== TRANSFERENCIA MASIVA ====================
+// ACK de bulk_transfer.h (tarea BLE): a bulkAcks para ioTask; true si lo era
+bool bulkAckReceived(PeripheralSlot* slot, const uint8_t* data, size_t length) {
+  if (length < 1 + BulkAck::SIZE || data[0] != BULK_FRAME_ACK) return false;
+  BulkAck* ack = slot->bulkAcks.reserve();
+  if (!ack) {
+    metricsCount(MET_NOTIFY_DROPPED);
+    return true;
+  }
+  decodeFrom(ConstByteSpan(data + 1, length - 1), *ack);
+  slot->bulkAcks.commit();
+  return true;
+}
+
+void bulkAbort(PeripheralSlot* slot, const char* reason) {
+  slot->bulk.phase = BULK_IDLE;
+  logEvent(slot->tag, "BULK", reason);
+}
+
+// Geometría y CRC del bloque; ningún chunk confirmado todavía
+bool bulkLoadBlock(PeripheralSlot* slot, uint16_t block) {
+  BulkSend* send = &slot->bulk;
+  send->block = block;
+  send->blockLength = bulkBlockLength(send->size, block);
+  send->chunks = bulkChunks(send->blockLength, send->chunk);
+  send->next = 0;
+  send->cursor = 0;
+  send->repairFrom = 0;
+  send->repairTo = 0;
+  memset(send->acked, 0, sizeof(send->acked));
   
-  sendCommandP2(0x01, authData, 6); // CMD_AUTH_PIN
+  uint8_t data[256];
+  uint32_t crc = 0;
+  uint32_t base = (uint32_t)block * BULK_BLOCK_SIZE;
+  for (uint16_t offset = 0; offset < send->blockLength; offset += sizeof(data)) {
+    size_t length = min((size_t)(send->blockLength - offset), sizeof(data));
+    if (!send->source(base + offset, data, length)) return false;
+    crc = crc32Update(crc, data, length);
+  }
+  send->crc[0] = crc >> 24;
+  send->crc[1] = crc >> 16;
+  send->crc[2] = crc >> 8;
+  send->crc[3] = crc;
+  return true;
 }
 
-// Conectar a P1
-void connectToP1() {
-  if (!p1Device) return;
+// Programa la imagen para el slot (ioTask, o setup() antes de lanzarla):
+// sale al llegar a READY y se reanuda sola tras cada reconexión
+bool bulkStart(PeripheralSlot* slot, uint8_t kind, BulkSource source, uint32_t size) {
+  BulkSend* send = &slot->bulk;
+  uint8_t data[256];
+  uint32_t crc = 0;
+  for (uint32_t offset = 0; offset < size; offset += sizeof(data)) {
+    size_t length = min((size_t)(size - offset), sizeof(data));
+    if (!source(offset, data, length)) return false;
+    crc = crc32Update(crc, data, length);
+  }
+  send->source = source;
+  send->kind = kind;
+  send->id = crc;
+  send->size = size;
+  send->blocks = bulkBlocks(size);
+  send->resent = 0;
+  send->startedAt = millis();
+  send->phase = BULK_BEGIN;
   
-  logEvent("P1", "BLE", "Attempting connection...");
+  char msg[64];
+  sprintf(msg, "Bulk transfer queued: %lu bytes, id %08lX", (unsigned long)size, (unsigned long)crc);
+  logEvent(slot->tag, "BULK", msg);
+  return true;
+}
+
+// [0xB2][bloque][índice][bytes]: imagen y, en los últimos, el CRC del bloque
+bool bulkSendChunk(PeripheralSlot* slot, uint16_t index) {
+  BulkSend* send = &slot->bulk;
+  uint8_t frame[ATT_MAX_PAYLOAD];
+  uint16_t length = bulkChunkLength(send->blockLength, send->chunk, index);
+  uint16_t start = index * send->chunk;
+  frame[0] = BULK_FRAME_DATA;
+  frame[1] = send->block >> 8;
+  frame[2] = send->block;
+  frame[3] = index >> 8;
+  frame[4] = index;
+  uint8_t* out = frame + BULK_DATA_HEADER;
+  uint16_t dataLength = start < send->blockLength ? min(length, (uint16_t)(send->blockLength - start)) : 0;
+  if (dataLength && !send->source((uint32_t)send->block * BULK_BLOCK_SIZE + start, out, dataLength)) return false;
+  for (uint16_t i = dataLength; i < length; i++) {
+    out[i] = send->crc[start + i - send->blockLength];
+  }
+  return esp_ble_gattc_write_char(slot->gattcIf, slot->connId, slot->handles.cmd, BULK_DATA_HEADER + length, frame,
+                                  ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE) == ESP_OK;
+}
+
+// BEGIN con respuesta ATT: también confirma unos handles de caché
+bool bulkSendBegin(PeripheralSlot* slot) {
+  BulkSend* send = &slot->bulk;
+  send->chunk = min(max(attPayload(slot->mtu) - BULK_DATA_HEADER, (size_t)BULK_CHUNK_MIN), (size_t)BULK_CHUNK_MAX);
+  BulkBegin begin = {send->kind, send->id, send->size, send->chunk};
+  uint8_t frame[1 + BulkBegin::SIZE];
+  size_t length = bulkEncode(BULK_FRAME_BEGIN, begin, ByteSpan(frame, sizeof(frame)));
+  if (esp_ble_gattc_write_char(slot->gattcIf, slot->connId, slot->handles.cmd, length, frame,
+                               ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE) != ESP_OK) return false;
+  logHexFrame(slot, "TX", "BULK begin", frame, length);
+  return true;
+}
+
+void bulkFinished(PeripheralSlot* slot) {
+  BulkSend* send = &slot->bulk;
+  unsigned long elapsed = max(millis() - send->startedAt, 1UL);
+  char msg[96];
+  sprintf(msg, "Bulk transfer done: %lu bytes in %lu ms (%lu B/s), %lu chunks resent", (unsigned long)send->size,
+          elapsed, (unsigned long)((uint64_t)send->size * 1000 / elapsed), (unsigned long)send->resent);
+  send->phase = BULK_IDLE;
+  logEvent(slot->tag, "BULK", msg);
+}
+
+// ACK del periférico: confirma chunks del bloque en curso, lo cierra o
+// devuelve la transferencia a un bloque anterior
+void bulkOnAck(PeripheralSlot* slot, const BulkAck& ack, unsigned long now) {
+  BulkSend* send = &slot->bulk;
+  if (send->phase == BULK_IDLE || send->phase == BULK_BEGIN) return;
+  if (ack.status == BULK_DONE) {
+    bulkFinished(slot);
+    return;
+  }
+  if (ack.status == BULK_REJECTED || ack.status == BULK_FAILED) {
+    bulkAbort(slot, ack.status == BULK_REJECTED ? "Bulk transfer rejected" : "Bulk image verification failed");
+    return;
+  }
   
-  pClientP1 = BLEDevice::createClient();
-  pClientP1->connect(p1Device);
+  // Respuesta a BEGIN: el periférico dice por dónde sigue
+  if (send->phase == BULK_OPENING) {
+    if (ack.block >= send->blocks) {
+      send->phase = BULK_VERIFYING;
+    } else if (bulkLoadBlock(slot, ack.block)) {
+      send->phase = BULK_SENDING;
+    } else {
+      bulkAbort(slot, "Bulk source read failed");
+      return;
+    }
+    if (ack.block > 0) {
+      char msg[48];
+      sprintf(msg, "Bulk transfer resumed at block %u/%u", ack.block, send->blocks);
+      logEvent(slot->tag, "BULK", msg);
+    }
+  } else if (ack.status == BULK_RESEND && ack.block < send->blocks &&
+             (ack.block < send->block || send->phase == BULK_VERIFYING)) {
+    // Bloque con CRC o escritura fallida en el periférico: se repite entero
+    if (!bulkLoadBlock(slot, ack.block)) {
+      bulkAbort(slot, "Bulk source read failed");
+      return;
+    }
+    send->phase = BULK_SENDING;
+  }
+  if (send->phase != BULK_SENDING || ack.block != send->block) return;  // ACK atrasado
+  send->ackAt = now;
   
-  logEvent("P1", "BLE", "Connected!");
+  if (ack.next >= send->chunks) {
+    if (send->block + 1 >= send->blocks) send->phase = BULK_VERIFYING;
+    else if (!bulkLoadBlock(slot, send->block + 1)) bulkAbort(slot, "Bulk source read failed");
+    return;
+  }
+  for (uint16_t i = send->next; i < ack.next; i++) bulkMapSet(send->acked, i);
+  send->next = max(send->next, ack.next);
+  uint16_t highest = ack.next;
+  for (uint8_t i = 0; i < 32; i++) {
+    if (!(ack.bits & (1UL << i))) continue;
+    highest = ack.next + 1 + i;
+    if (highest < send->chunks) bulkMapSet(send->acked, highest);
+  }
+  send->cursor = max(send->cursor, send->next);
   
-  BLERemoteService* pService = pClientP1->getService(P1_SERVICE_UUID);
-  if (!pService) {
-    logEvent("P1", "ERROR", "Service not found");
-    pClientP1->disconnect();
+  // Por debajo del último confirmado todo lo que falta se perdió; con
+  // BULK_RESEND, todo lo enviado
+  uint16_t repairTo = ack.status == BULK_RESEND ? send->cursor : highest;
+  if (repairTo > send->next) {
+    send->repairFrom = send->next;
+    send->repairTo = max(send->repairTo, repairTo);
+  }
+}
+
+// Reenvíos primero y luego chunks nuevos, sin pasar de BULK_WINDOW por
+// delante del primero sin confirmar. Una escritura rechazada (pila llena)
+// se reintenta en la siguiente vuelta de ioTask.
+void bulkPump(PeripheralSlot* slot) {
+  BulkSend* send = &slot->bulk;
+  linkBoost(slot, LINK_BOOST_MS);
+  for (;;) {
+    uint16_t index;
+    bool repair = send->repairFrom < send->repairTo;
+    if (repair) {
+      index = send->repairFrom;
+      if (index < send->next || bulkMapGet(send->acked, index)) {
+        send->repairFrom++;
+        continue;
+      }
+    } else if (send->cursor < send->chunks && send->cursor < send->next + BULK_WINDOW) {
+      index = send->cursor;
+    } else {
+      return;
+    }
+    
+    if (!bulkSendChunk(slot, index)) return;
+    if (repair) {
+      send->repairFrom++;
+      send->resent++;
+    } else {
+      send->cursor++;
+    }
+  }
+}
+
+// Avance de la transferencia del slot (ioTask). Fuera de READY vuelve a
+// BEGIN: al reconectar, el periférico dice desde dónde seguir.
+void bulkTick(PeripheralSlot* slot, unsigned long now) {
+  BulkSend* send = &slot->bulk;
+  for (BulkAck* ack = slot->bulkAcks.front(); ack; ack = slot->bulkAcks.front()) {
+    bulkOnAck(slot, *ack, now);
+    slot->bulkAcks.pop();
+  }
+  if (send->phase == BULK_IDLE) return;
+  if (slot->state != LINK_READY) {
+    send->phase = BULK_BEGIN;
     return;
   }
   
-  pP1CmdChar = pService->getCharacteristic(P1_CMD_UUID);
-  BLERemoteCharacteristic* pStateChar = pService->getCharacteristic(P1_STATE_UUID);
+  switch (send->phase) {
+    case BULK_BEGIN:
+      if (bulkSendBegin(slot)) {
+        send->phase = BULK_OPENING;
+        send->ackAt = now;
+      }
+      break;
+      
+    case BULK_OPENING:
+      if (now - send->ackAt > BULK_ACK_TIMEOUT_MS * 4) send->phase = BULK_BEGIN;
+      break;
+      
+    case BULK_SENDING:
+      if (!slot->handlesVerified) break;  // Handles de caché sin confirmar: esperar a la respuesta de BEGIN
+      if (send->cursor > send->next && now - send->ackAt > BULK_ACK_TIMEOUT_MS) {
+        send->repairFrom = send->next;  // Sin noticias: se repite lo que iba en vuelo
+        send->repairTo = send->cursor;
+        send->ackAt = now;
+      }
+      bulkPump(slot);
+      break;
+      
+    case BULK_VERIFYING:
+      if (now - send->ackAt > BULK_VERIFY_TIMEOUT_MS) send->phase = BULK_BEGIN;
+      break;
+      
+    default:
+      break;
+  }
+}
+
+// Imagen de prueba (BULK_DEMO_BYTES): bytes pseudoaleatorios que dependen
+// solo del offset, sin ocupar RAM ni flash
+bool bulkDemoSource(uint32_t offset, uint8_t* out, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    out[i] = ((offset + i) * 2654435761UL) >> 24;
+  }
+  return true;
+}
+
+// ==================== ESCANEO ====================
+// Campo AD de tipo type en data ([LEN][TIPO][DATOS]...); nullptr si no está
+const uint8_t* advField(const uint8_t* data, size_t length, uint8_t type, uint8_t* fieldLen) {
+  size_t pos = 0;
+  while (pos + 1 < length && data[pos] != 0) {
+    uint8_t len = data[pos];
+    if (pos + 1 + len > length) break;
+    if (data[pos + 1] == type) {
+      *fieldLen = len - 1;
+      return data + pos + 2;
+    }
+    pos += 1 + len;
+  }
+  return nullptr;
+}
+
+// Lista completa o parcial de UUID de 128 bits que contiene uuid
+bool advHasService(const uint8_t* data, size_t length, const uint8_t* uuid) {
+  for (uint8_t type = ESP_BLE_AD_TYPE_128SRV_PART; type <= ESP_BLE_AD_TYPE_128SRV_CMPL; type++) {
+    uint8_t fieldLen;
+    const uint8_t* field = advField(data, length, type, &fieldLen);
+    for (uint8_t offset = 0; field && offset + 16 <= fieldLen; offset += 16) {
+      if (memcmp(field + offset, uuid, 16) == 0) return true;
+    }
+  }
+  return false;
+}
+
+bool advNameIs(const uint8_t* data, size_t length, const char* name) {
+  uint8_t fieldLen;
+  const uint8_t* field = advField(data, length, ESP_BLE_AD_TYPE_NAME_CMPL, &fieldLen);
+  return field && fieldLen == strlen(name) && memcmp(field, name, fieldLen) == 0;
+}
+
+// "4fafc201-1fb5-..." a los 16 bytes little-endian con que viaja en el anuncio
+void uuid128FromString(const char* text, uint8_t* out) {
+  uint8_t nibbles = 0;
+  for (const char* c = text; *c && nibbles < 32; c++) {
+    uint8_t value;
+    if (*c >= '0' && *c <= '9') value = *c - '0';
+    else if (*c >= 'a' && *c <= 'f') value = *c - 'a' + 10;
+    else if (*c >= 'A' && *c <= 'F') value = *c - 'A' + 10;
+    else continue;
+    uint8_t index = 15 - nibbles / 2;
+    out[index] = (nibbles & 1) ? (out[index] | value) : (value << 4);
+    nibbles++;
+  }
+}
+
+// Celda libre del pool (tarea BLE); nullptr si está agotado
+DeviceRecord* deviceAcquire() {
+  uint8_t index;
+  if (xQueueReceive(deviceFreeQueue, &index, 0) != pdTRUE) return nullptr;
+  return &devicePool[index];
+}
+
+// Devuelve la celda del slot al pool (fuera de LINK_SCANNING)
+void deviceRelease(PeripheralSlot* slot) {
+  if (!slot->device) return;
+  uint8_t index = slot->device - devicePool;
+  slot->device = nullptr;
+  xQueueSend(deviceFreeQueue, &index, 0);
+}
+
+// Slot que espera este anuncio. Primero la dirección ya conocida; si no,
+// UUID de servicio y, solo si coincide, el nombre.
+PeripheralSlot* scanMatch(const uint8_t* addr, const uint8_t* adv, size_t advLen) {
+  for (uint8_t i = 0; i < slotCount; i++) {
+    PeripheralSlot* slot = &slots[i];
+    if (slot->state != LINK_SCANNING || slot->device) continue;
+    if (slot->addrKnown && memcmp(slot->peerAddr, addr, sizeof(esp_bd_addr_t)) == 0) return slot;
+    if (advHasService(adv, advLen, slot->serviceUuid) && advNameIs(adv, advLen, slot->name)) return slot;
+  }
+  return nullptr;
+}
+
+// Resultado de escaneo (tarea BLE): sin copias ni objetos por anuncio
+void scanResult(esp_ble_gap_cb_param_t* param) {
+  if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT) {
+    // Ventana completa sin encontrar nada: ioTask baja el duty de la siguiente
+    scanWindowEmpty = true;
+    scanRunning = false;
+    xTaskNotifyGive(ioTaskHandle);
+    return;
+  }
+  if (param->scan_rst.search_evt != ESP_GAP_SEARCH_INQ_RES_EVT) return;
   
-  if (!pP1CmdChar || !pStateChar) {
-    logEvent("P1", "ERROR", "Characteristics not found");
-    pClientP1->disconnect();
+  PeripheralSlot* slot = scanMatch(param->scan_rst.bda, param->scan_rst.ble_adv,
+                                   param->scan_rst.adv_data_len + param->scan_rst.scan_rsp_len);
+  if (!slot) return;
+  DeviceRecord* record = deviceAcquire();
+  if (!record) {
+    logEvent("SCAN", "ERROR", "Device pool exhausted");
     return;
   }
+  memcpy(record->addr, param->scan_rst.bda, sizeof(esp_bd_addr_t));
+  record->addrType = param->scan_rst.ble_addr_type;
+  record->rssi = param->scan_rst.rssi;
+  record->seenAt = millis();
+  slot->device = record;
   
-  pStateChar->registerForNotify(p1NotifyCallback);
-  logEvent("P1", "GATT", "Notifications enabled");
+  char msg[48];
+  sprintf(msg, "%s detected!", slot->name);
+  logEvent("SCAN", "FOUND", msg);
+  esp_ble_gap_stop_scanning(); // scanRunning = false con ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT
+}
+
+// Dirección pública de un enlace establecido: filtro directo en los
+// siguientes escaneos y entrada en la lista de aceptación del controlador
+void scanAddressLearned(PeripheralSlot* slot) {
+  if (slot->addrKnown || slot->device->addrType != BLE_ADDR_TYPE_PUBLIC) return;
+  slot->addrKnown = true;
+#if SCAN_ACCEPT_LIST
+  esp_ble_gap_update_whitelist(true, slot->peerAddr, BLE_WL_ADDR_TYPE_PUBLIC);
+#endif
+}
+
+// Ventana de escaneo con el duty actual. Con todas las direcciones buscadas
+// en la lista de aceptación, el controlador descarta el resto de anuncios.
+bool scanStart(bool acceptListOnly) {
+  esp_ble_scan_params_t params;
+  params.scan_type = BLE_SCAN_TYPE_ACTIVE;
+  params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+  params.scan_filter_policy = acceptListOnly ? BLE_SCAN_FILTER_ALLOW_ONLY_WLST : BLE_SCAN_FILTER_ALLOW_ALL;
+  params.scan_interval = ((SCAN_INTERVAL_MIN_MS << scanLevel) * 8) / 5;  // Unidades de 0.625 ms
+  params.scan_window = (SCAN_WINDOW_MS * 8) / 5;
+  params.scan_duplicate = BLE_SCAN_DUPLICATE_DISABLE;
+  return esp_ble_gap_set_scan_params(&params) == ESP_OK;
+}
+
+// ==================== GESTIÓN DE ENLACES ====================
+PeripheralSlot* slotForConn(esp_gatt_if_t gattcIf, uint16_t connId) {
+  for (uint8_t i = 0; i < slotCount; i++) {
+    PeripheralSlot* slot = &slots[i];
+    if (slot->handles.cmd && slot->gattcIf == gattcIf && slot->connId == connId) return slot;
+  }
+  return nullptr;
+}
+
+PeripheralSlot* slotForAddr(const uint8_t* addr) {
+  for (uint8_t i = 0; i < slotCount; i++) {
+    if (slots[i].client && memcmp(slots[i].peerAddr, addr, sizeof(esp_bd_addr_t)) == 0) return &slots[i];
+  }
+  return nullptr;
+}
+
+PeripheralSlot* slotForGattcIf(esp_gatt_if_t gattcIf) {
+  for (uint8_t i = 0; i < slotCount; i++) {
+    if (slots[i].client && slots[i].gattcIf == gattcIf) return &slots[i];
+  }
+  return nullptr;
+}
+
+// Un handle de caché ha sido rechazado: se olvida y se fuerza el descubrimiento
+void cachedWriteFailed(PeripheralSlot* slot, esp_gatt_status_t status) {
+  metricsCount(MET_WRITE_FAIL);
+  char msg[64];
+  sprintf(msg, "Write failed (status 0x%02X)", status);
+  logEvent(slot->tag, "GATT", msg);
+  if (!slot->handlesFromCache) return;
   
-  p1Connected = true;
-  logEvent("P1", "SYSTEM", "== READY ==");
+  logEvent(slot->tag, "GATT", "Cached handles rejected, rediscovering");
+  gattCacheInvalidate(slot->peerAddr);
+  slot->client->disconnect();
+}
+
+// Eventos GATTC en bruto: notificaciones y resultado de escrituras por handle
+void gattcEventHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t* param) {
+  switch (event) {
+    // Los acks (pipeline y masivos) van directos a ioTask y la despiertan; el resto
+    // se copia a notifyRing y se decodifica en appTask, en el otro núcleo
+    case ESP_GATTC_NOTIFY_EVT: {
+      PeripheralSlot* slot = slotForConn(gattcIf, param->notify.conn_id);
+      uint16_t length = param->notify.value_len;
+      if (!slot || param->notify.handle != slot->handles.state || length == 0) break;
+      metricsCount(MET_NOTIFY_RX);
+      if (pipelineAck(slot, param->notify.value, length) || bulkAckReceived(slot, param->notify.value, length)) {
+        xTaskNotifyGive(ioTaskHandle);
+        break;
+      }
+      NotifyEntry* entry = length <= ATT_MAX_PAYLOAD ? notifyRing.reserve() : nullptr;
+      if (!entry) {
+        metricsCount(MET_NOTIFY_DROPPED);
+        break;
+      }
+      entry->slot = slot;
+      entry->length = length;
+      if (SOAK_MODE) entry->receivedUs = micros();
+      memcpy(entry->data, param->notify.value, length);
+      notifyRing.commit();
+      xTaskNotifyGive(appTaskHandle);
+      break;
+    }
+    
+    // Enlace abierto dentro de connect(): app GATTC y conn_id de esta conexión
+    case ESP_GATTC_OPEN_EVT: {
+      PeripheralSlot* slot = slotForAddr(param->open.remote_bda);
+      if (!slot || param->open.status != ESP_GATT_OK) break;
+      slot->gattcIf = gattcIf;
+      slot->connId = param->open.conn_id;
+      break;
+    }
+    
+    // Resultado del intercambio de MTU que BLEClient lanza al conectar
+    case ESP_GATTC_CFG_MTU_EVT: {
+      PeripheralSlot* slot = slotForGattcIf(gattcIf);
+      if (!slot || param->cfg_mtu.status != ESP_GATT_OK) break;
+      slot->mtu = param->cfg_mtu.mtu;
+      char msg[48];
+      sprintf(msg, "MTU negotiated: %u", slot->mtu);
+      logEvent(slot->tag, "GATT", msg);
+      break;
+    }
+    
+    case ESP_GATTC_WRITE_CHAR_EVT:
+    case ESP_GATTC_WRITE_DESCR_EVT: {
+      PeripheralSlot* slot = slotForConn(gattcIf, param->write.conn_id);
+      if (!slot) break;
+      if (param->write.status != ESP_GATT_OK) {
+        cachedWriteFailed(slot, param->write.status);
+      } else if (event == ESP_GATTC_WRITE_CHAR_EVT && param->write.handle == slot->handles.cmd) {
+        slot->handlesVerified = true;
+      } else if (event == ESP_GATTC_WRITE_DESCR_EVT && param->write.handle == slot->handles.stateCccd) {
+        slot->cccdConfirmed = true;  // ioTask continúa sin esperar a su tick
+        xTaskNotifyGive(ioTaskHandle);
+      }
+      break;
+    }
+    
+    default:
+      break;
+  }
+}
+
+// Parámetros de conexión aplicados por el controlador
+void connParamsUpdated(esp_ble_gap_cb_param_t* param) {
+  PeripheralSlot* slot = slotForAddr(param->update_conn_params.bda);
+  if (!slot) return;
+  if (param->update_conn_params.status != ESP_BT_STATUS_SUCCESS) {
+    logEvent(slot->tag, "BLE", "Conn params update rejected by peer");
+    slot->linkProfile = LINK_PROFILE_COUNT;  // Reintento de linkProfileTick tras LINK_BOOST_MS
+    slot->boostUntil = millis() + LINK_BOOST_MS;
+    return;
+  }
+  slot->connInterval = param->update_conn_params.conn_int;
+  char msg[80];
+  connParamsFormat(msg, sizeof(msg), slot->connInterval, param->update_conn_params.latency,
+                   param->update_conn_params.timeout);
+  logEvent(slot->tag, "BLE", msg);
 }
 
-// Conectar a P2
-void connectToP2() {
-  if (!p2Device) return;
+// Eventos GAP en bruto: escaneo propio (sin BLEScan) y parámetros de conexión
+void gapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+  switch (event) {
+    case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
+      if (param->scan_param_cmpl.status != ESP_BT_STATUS_SUCCESS ||
+          esp_ble_gap_start_scanning(SCAN_DURATION_S) != ESP_OK) {
+        scanRunning = false;
+      }
+      break;
+      
+    case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
+      if (param->scan_start_cmpl.status != ESP_BT_STATUS_SUCCESS) scanRunning = false;
+      break;
+      
+    case ESP_GAP_BLE_SCAN_RESULT_EVT:
+      scanResult(param);
+      break;
+      
+    case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:
+      scanRunning = false;
+      break;
+      
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+      connParamsUpdated(param);
+      break;
+      
+    default:
+      break;
+  }
+}
+
+// Desconexión detectada por Bluedroid (tarea BLE): solo se avisa a ioTask,
+// que es quien pasa el enlace a BACKOFF (linkDropped())
+class SlotClientCallbacks : public BLEClientCallbacks {
+  PeripheralSlot* slot;
+ public:
+  SlotClientCallbacks(PeripheralSlot* s) : slot(s) {}
+  void onConnect(BLEClient* pClient) {}
+  void onDisconnect(BLEClient* pClient) {
+    slot->disconnected = true;
+    xTaskNotifyGive(ioTaskHandle);
+  }
+};
+
+// Descubrimiento completo de servicio y características (solo sin caché)
+bool discoverHandles(PeripheralSlot* slot, GattHandles* handles) {
+  const DeviceProfile* profile = slot->profile;
+  BLERemoteService* pService = slot->client->getService(profile->serviceUUID);
+  if (!pService) {
+    logEvent(slot->tag, "ERROR", "Service not found");
+    return false;
+  }
   
-  logEvent("P2", "BLE", "Attempting connection...");
+  BLERemoteCharacteristic* pCmdChar = pService->getCharacteristic(profile->cmdUUID);
+  BLERemoteCharacteristic* pStateChar = pService->getCharacteristic(profile->stateUUID);
   
-  pClientP2 = BLEDevice::createClient();
-  pClientP2->connect(p2Device);
+  if (!pCmdChar || !pStateChar) {
+    logEvent(slot->tag, "ERROR", "Characteristics not found");
+    return false;
+  }
   
-  logEvent("P2", "BLE", "Connected!");
+  BLERemoteDescriptor* pCccd = pStateChar->getDescriptor(BLEUUID((uint16_t)0x2902));
+  handles->cmd = pCmdChar->getHandle();
+  handles->state = pStateChar->getHandle();
+  handles->stateCccd = pCccd ? pCccd->getHandle() : pStateChar->getHandle() + 1;
+  return true;
+}
+
+// Secuencia bloqueante de conexión. Solo se ejecuta en linkTask, de modo que
+// ioTask sigue atendiendo al resto de periféricos mientras tanto.
+void connectSlot(PeripheralSlot* slot) {
+  logEvent(slot->tag, "BLE", "Attempting connection...");
   
-  BLERemoteService* pService = pClientP2->getService(P2_SERVICE_UUID);
-  if (!pService) {
-    logEvent("P2", "ERROR", "Service not found");
-    pClientP2->disconnect();
+  if (!slot->client) {
+    slot->client = BLEDevice::createClient();
+    slot->client->setClientCallbacks(new SlotClientCallbacks(slot));
+  }
+  
+  memcpy(slot->peerAddr, slot->device->addr, sizeof(esp_bd_addr_t));
+  slot->mtu = ATT_MTU_DEFAULT;
+  slot->linkProfile = LINK_PROFILE_COUNT;
+  slot->connInterval = 0;
+  slot->disconnected = false;  // Avisos del enlace anterior ya atendidos o caducados
+  if (!slot->client->connect(BLEAddress(slot->device->addr), slot->device->addrType)) {
+    logEvent(slot->tag, "ERROR", "Connection failed");
+    enterBackoff(slot);
     return;
   }
+  logEvent(slot->tag, "BLE", "Connected!");
+  scanAddressLearned(slot);
+  if (slot->connects++ > 0) metricsCount(MET_RECONNECTS);
+  metricsCount(MET_CONNECTS);
+  attRequestLinkUpgrade(slot->peerAddr);
+  linkBoost(slot, LINK_BOOST_MS);
   
-  pP2CmdChar = pService->getCharacteristic(P2_CMD_UUID);
-  BLERemoteCharacteristic* pStateChar = pService->getCharacteristic(P2_STATE_UUID);
+  setLinkState(slot, LINK_DISCOVERING);
+  GattHandles handles;
+  GattCacheEntry* cached = gattCacheFind(slot->peerAddr);
+  slot->handlesFromCache = cached != nullptr;
+  if (cached) {
+    handles = cached->handles;
+    logEvent(slot->tag, "GATT", "Using cached handles (discovery skipped)");
+  } else if (discoverHandles(slot, &handles)) {
+    gattCacheStore(slot->peerAddr, handles);
+  } else {
+    slot->client->disconnect();
+    enterBackoff(slot);
+    return;
+  }
+  gattCacheFlush();
   
-  if (!pP2CmdChar || !pStateChar) {
-    logEvent("P2", "ERROR", "Characteristics not found");
-    pClientP2->disconnect();
+  slot->handles = handles;
+  slot->handlesVerified = !slot->handlesFromCache;
+  slot->pipeSent = 0;
+  slot->pipeAcked = 0;
+  slot->pipeAckSeen = slot->pipeAckRx >> 8;  // Los acks del enlace anterior ya no cuentan
+  for (uint8_t j = 0; j < slot->profile->streamCount; j++) {
+    slot->streams[j].seq = 0;   // Cada enlace nuevo empieza por la configuración inicial
+  }
+  
+  // Suscripción directa por handle: la confirmación llega a gattcEventHandler
+  // y ioTask sigue desde ahí (subscribed()), sin pausas fijas en linkTask
+  slot->cccdConfirmed = false;
+  slot->authRestart = false;
+  slot->authDone = false;
+  setLinkState(slot, LINK_SUBSCRIBING);
+  uint8_t enable[2] = {0x01, 0x00};
+  esp_ble_gattc_register_for_notify(slot->gattcIf, slot->peerAddr, handles.state);
+  esp_ble_gattc_write_char_descr(slot->gattcIf, slot->connId, handles.stateCccd, sizeof(enable), enable,
+                                 ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+  
+  slot->backoffMs = BACKOFF_MIN_MS;
+}
+
+// CCCD confirmado (ioTask): el periférico ya puede notificar la respuesta,
+// así que la autenticación sale en la primera escritura del enlace
+void subscribed(PeripheralSlot* slot) {
+  logEvent(slot->tag, "GATT", "Notifications enabled");
+  if (!slot->profile->authenticate) {
+    setLinkState(slot, LINK_READY);
+    logEvent(slot->tag, "SYSTEM", "== READY ==");
     return;
   }
   
-  pStateChar->registerForNotify(p2NotifyCallback);
-  logEvent("P2", "GATT", "Notifications enabled");
+  setLinkState(slot, LINK_AUTHENTICATING);
+  logEvent(slot->tag, "SYSTEM", "== Connected - Authenticating... ==");
+  slot->profile->authenticate(slot);
+}
+
+// Tarea de gestión de enlaces: atiende los trabajos de conexión de uno en uno
+void linkTask(void* param) {
+  PeripheralSlot* slot;
+  for (;;) {
+    if (xQueueReceive(linkQueue, &slot, portMAX_DELAY) == pdTRUE) {
+      connectSlot(slot);
+    }
+    gattCacheFlush();
+  }
+}
+
+bool slotBusy(const PeripheralSlot* slot) {
+  return slot->state == LINK_CONNECTING || slot->state == LINK_DISCOVERING ||
+         slot->state == LINK_SUBSCRIBING;
+}
+
+// Desconexión pendiente (ioTask). CONNECTING y DISCOVERING son de linkTask:
+// el aviso espera a que entregue el enlace en SUBSCRIBING o BACKOFF, así que
+// ninguna tarea pisa el BACKOFF de otra.
+void linkDropped(PeripheralSlot* slot) {
+  if (slot->state == LINK_CONNECTING || slot->state == LINK_DISCOVERING) return;
+  slot->disconnected = false;
+  if (slot->state == LINK_BACKOFF || slot->state == LINK_SCANNING) return;
+  logEvent(slot->tag, "BLE", "Disconnected");
+  enterBackoff(slot);
+}
+
+// Avance no bloqueante de la máquina de estados (ioTask)
+void slotTick(PeripheralSlot* slot, unsigned long now) {
+  if (slot->disconnected) linkDropped(slot);
+  switch (slot->state) {
+    case LINK_SCANNING:
+      if (slot->device && !scanRunning) {
+        setLinkState(slot, LINK_CONNECTING);
+        xQueueSend(linkQueue, &slot, 0);
+        metricsGaugeMax(MET_QUEUE_MAX, uxQueueMessagesWaiting(linkQueue));
+      }
+      break;
+      
+    case LINK_SUBSCRIBING:
+      if (slot->cccdConfirmed) {
+        subscribed(slot);
+      } else if (now - slot->stateSince > SUBSCRIBE_TIMEOUT_MS) {
+        logEvent(slot->tag, "GATT", "No CCCD confirmation, continuing");
+        subscribed(slot);
+      }
+      break;
+      
+    case LINK_AUTHENTICATING:
+      if (slot->authRestart) {
+        slot->authRestart = false;
+        setLinkState(slot, LINK_AUTHENTICATING);  // Nuevo plazo para la respuesta al PIN
+        slot->profile->authenticate(slot);
+      } else if (slot->authDone) {
+        slot->authDone = false;
+        setLinkState(slot, LINK_READY);
+      } else if (now - slot->stateSince > AUTH_TIMEOUT_MS) {
+        logEvent(slot->tag, "AUTH", "No auth response, continuing");
+        setLinkState(slot, LINK_READY);
+      }
+      break;
+      
+    case LINK_READY:
+      pipelineCheckTimeout(slot, now);
+      linkProfileTick(slot, now);
+      break;
+      
+    case LINK_BACKOFF:
+      if (now - slot->stateSince >= slot->backoffMs) {
+        slot->backoffMs = min(slot->backoffMs * 2, (unsigned long)BACKOFF_MAX_MS);
+        deviceRelease(slot); // La dirección de P2 es aleatoria: volver a escanear
+        setLinkState(slot, LINK_SCANNING);
+      }
+      break;
+      
+    default:
+      break;
+  }
+}
+
+// Lanza una ventana de escaneo asíncrona si falta algún dispositivo y ningún
+// enlace está a mitad de conexión (Bluedroid no escanea y conecta a la vez)
+void scanTick() {
+  if (scanRunning) return;
+  
+  // Solo ioTask cambia scanLevel; un reinicio pendiente gana a la bajada
+  if (scanWindowEmpty) {
+    scanWindowEmpty = false;
+    if (scanLevel < SCAN_LEVEL_MAX) scanLevel++;
+  }
+  if (scanLevelReset) {
+    scanLevelReset = false;
+    scanLevel = 0;
+  }
   
-  p2Connected = true;
-  logEvent("P2", "SYSTEM", "== READY - Authenticating... ==");
+  bool missing = false;
+  bool allKnown = true;
+  for (uint8_t i = 0; i < slotCount; i++) {
+    if (slotBusy(&slots[i])) return;
+    if (slots[i].state == LINK_SCANNING && !slots[i].device) {
+      missing = true;
+      allKnown = allKnown && slots[i].addrKnown;
+    }
+  }
+  if (!missing) return;
   
-  delay(500);
-  authenticateP2(); // Enviar PIN inmediatamente
+  scanRunning = scanStart(SCAN_ACCEPT_LIST && allKnown);
 }
 
-// Escaneo de dispositivos
-class AdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
-  void onResult(BLEAdvertisedDevice advertisedDevice) {
-    String name = advertisedDevice.getName().c_str();
-    
-    if (name == "ESP32_P1" && !p1Connected && !p1Device) {
-      logEvent("SCAN", "FOUND", "ESP32_P1 detected!");
-      p1Device = new BLEAdvertisedDevice(advertisedDevice);
-      BLEDevice::getScan()->stop();
+// Decodifica hasta budget notificaciones de notifyRing (appTask); devuelve
+// cuántas ha procesado
+size_t decodeNotifications(size_t budget) {
+  size_t decoded = 0;
+  for (; decoded < budget; decoded++) {
+    NotifyEntry* entry = notifyRing.front();
+    if (!entry) break;
+    streamAtt(entry->slot, STREAM_ATT_RX, entry->data, entry->length);
+    if (SOAK_MODE) soakMatch(entry->slot, entry->data[0], entry->receivedUs);
+    uint32_t started = metricsCycles();
+    entry->slot->profile->codec->decodeNotify(entry->slot, entry->data, entry->length);
+    metricsSample(entry->data[0], metricsCycles() - started);
+    notifyRing.pop();
+  }
+  return decoded;
+}
+
+// Resumen periódico de métricas: globales y, por enlace, el último tiempo a READY
+void reportMetrics() {
+  metricsLogSummary("MASTER");
+  for (uint8_t i = 0; i < slotCount; i++) {
+    PeripheralSlot* slot = &slots[i];
+    uint32_t interval = connIntervalTenthsMs(slot->connInterval);
+    char msg[96];
+    sprintf(msg, "%s, connects %u, last ready %lu ms, interval %lu.%lu ms", LINK_STATE_NAMES[slot->state],
+            slot->connects, slot->readyMs, (unsigned long)(interval / 10), (unsigned long)(interval % 10));
+    logEvent(slot->tag, "METRICS", msg);
+  }
+  if (capturePartition) {
+    char msg[64];
+    sprintf(msg, "capture %u records, %u dropped", (unsigned)captureRecords, (unsigned)captureDropped);
+    logEvent("MASTER", "METRICS", msg);
+  }
+}
+
+// Núcleo BLE: máquina de estados, escaneo y escrituras. Se despierta cada
+// LOOP_TICK_MS y, antes, cuando appTask encola comandos o llega un ack.
+void ioTask(void* param) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOOP_TICK_MS));
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < slotCount; i++) {
+      slotTick(&slots[i], now);
+      flushCommands(&slots[i]);
+      bulkTick(&slots[i], now);
+    }
+    scanTick();
+  }
+}
+
+// Temporizador de la rueda: resumen cada METRICS_REPORT_MS
+void reportFire(WheelTimer* timer, uint32_t now) {
+  reportMetrics();
+  wheelAdd(&scheduleWheel, timer, timer->expires + METRICS_REPORT_MS);
+}
+
+// Temporizador de la rueda: informe del modo soak cada SOAK_REPORT_MS
+void soakFire(WheelTimer* timer, uint32_t now) {
+  for (uint8_t i = 0; i < slotCount; i++) {
+    soakReport(&slots[i], now);
+  }
+  wheelAdd(&scheduleWheel, timer, timer->expires + SOAK_REPORT_MS);
+}
+
+// Núcleo de aplicación: planificación, decodificación y métricas. Sin
+// notificaciones pendientes duerme hasta el siguiente evento de la rueda;
+// la despiertan antes Bluedroid (notifyRing) y setLinkState(). La rueda se
+// avanza antes de cada lote de APP_DECODE_BATCH notificaciones, así que una
+// ráfaga de telemetría no retrasa la planificación.
+void appTask(void* param) {
+  for (;;) {
+    if (notifyRing.empty()) {
+      int32_t wait = wheelNextEvent(&scheduleWheel) - millis();
+      if (wait > 0) ulTaskNotifyTake(pdTRUE, max(pdMS_TO_TICKS(wait), (TickType_t)1));
     }
+    uint32_t now = millis();
+    
+    scheduleSync(now);
+    wheelAdvance(&scheduleWheel, now);
+    decodeNotifications(APP_DECODE_BATCH);  // Puede encolar acks de telemetría
     
-    if (name == "ESP32_P2" && !p2Connected && !p2Device) {
-      logEvent("SCAN", "FOUND", "ESP32_P2 detected!");
-      p2Device = new BLEAdvertisedDevice(advertisedDevice);
-      BLEDevice::getScan()->stop();
+    if (scheduleQueued) {
+      scheduleQueued = false;
+      xTaskNotifyGive(ioTaskHandle);
     }
   }
-};
+}
 
 void setup() {
-  Serial.begin(115200);
+  Serial.begin(LOG_TEXT_BAUD);
+  logBegin();
   delay(1000);
   
   Serial.println("\n\n========================================");
@@ -271,102 +2023,62 @@ void setup() {
   Serial.println("Targets: ESP32_P1 (no auth) + ESP32_P2 (PIN)");
   Serial.println("========================================\n");
   
-  logEvent("SYSTEM", "INIT", "Initializing BLE...");
-  BLEDevice::init("ESP32_Master");
-  
-  BLEScan* pScan = BLEDevice::getScan();
-  pScan->setAdvertisedDeviceCallbacks(new AdvertisedDeviceCallbacks());
-  pScan->setActiveScan(true);
-  pScan->setInterval(100);
-  pScan->setWindow(99);
-  
-  logEvent("SYSTEM", "INIT", "Scanning for devices...");
-}
-
-void loop() {
-  // Conectar a dispositivos encontrados
-  if (p1Device && !p1Connected) {
-    connectToP1();
+  // Pool de dispositivos descubiertos: todas las celdas libres
+  deviceFreeQueue = xQueueCreate(DEVICE_POOL_SIZE, sizeof(uint8_t));
+  for (uint8_t i = 0; i < DEVICE_POOL_SIZE; i++) {
+    xQueueSend(deviceFreeQueue, &i, 0);
   }
   
-  if (p2Device && !p2Connected) {
-    connectToP2();
+  // Tabla de slots a partir de la flota configurada
+  for (size_t i = 0; i < sizeof(FLEET) / sizeof(FLEET[0]) && slotCount < MAX_PERIPHERALS; i++) {
+    PeripheralSlot* slot = &slots[slotCount++];
+    slot->tag = FLEET[i].tag;
+    slot->name = FLEET[i].name;
+    slot->profile = FLEET[i].profile;
+    slot->state = LINK_SCANNING;
+    slot->backoffMs = BACKOFF_MIN_MS;
+    uuid128FromString(slot->profile->serviceUUID, slot->serviceUuid);
+    if (BULK_DEMO_BYTES) bulkStart(slot, BULK_DEMO_KIND, bulkDemoSource, BULK_DEMO_BYTES);
   }
   
-  // Escanear si falta algún dispositivo
-  if ((!p1Device && !p1Connected) || (!p2Device && !p2Connected)) {
-    BLEDevice::getScan()->start(5, false);
-    delay(5000);
-  }
-  
-  // Si no hay conexiones activas, esperar
-  if (!p1Connected && !p2Connected) {
-    delay(1000);
-    return;
-  }
-  
-  unsigned long currentTime = millis();
-  
-  // Comandos para P1 (cada 3 segundos) - SOLO SI ESTÁ CONECTADO
-  if (p1Connected && (currentTime - lastP1Command > 3000)) {
-    lastP1Command = currentTime;
-    
-    static uint8_t p1CommandSeq = 0;
-    switch (p1CommandSeq++ % 4) {
-      case 0: sendCommandP1(0x01, 0x01); break; // ECO mode
-      case 1: sendCommandP1(0x03, 80); break;   // Brightness 80
-      case 2: sendCommandP1(0x02); break;        // Get status
-      case 3: sendCommandP1(0x05); break;        // Get telemetry
+  // Rueda de appTask: un temporizador por flujo de cada slot y el informe
+  wheelInit(&scheduleWheel, millis());
+  for (uint8_t i = 0; i < slotCount; i++) {
+    PeripheralSlot* slot = &slots[i];
+    for (uint8_t j = 0; j < slot->profile->streamCount; j++) {
+      StreamState* state = &slot->streams[j];
+      state->slot = slot;
+      state->stream = &slot->profile->streams[j];
+      wheelTimerInit(&state->timer, streamFire, state, state->stream->priority);
     }
   }
-  
-  // Comandos para P2 (cada 4 segundos) - SOLO SI ESTÁ CONECTADO
-  if (p2Connected && (currentTime - lastP2Command > 4000)) {
-    lastP2Command = currentTime;
-    
-    static uint8_t p2CommandSeq = 0;
-    uint8_t payload[10];
-    
-    switch (p2CommandSeq++ % 6) {
-      case 0: // Session start
-        payload[0] = (currentTime >> 24) & 0xFF;
-        payload[1] = (currentTime >> 16) & 0xFF;
-        payload[2] = (currentTime >> 8) & 0xFF;
-        payload[3] = currentTime & 0xFF;
-        payload[4] = 0x01; // Tipo infantil
-        sendCommandP2(0x02, payload, 5);
-        break;
-        
-      case 1: // Set mode TURBO
-        payload[0] = 0x02;
-        sendCommandP2(0x10, payload, 1);
-        break;
-        
-      case 2: // Set intensity 75%
-        payload[0] = 75;
-        sendCommandP2(0x11, payload, 1);
-        break;
-        
-      case 3: // Set timer 45 min
-        payload[0] = 0x00;
-        payload[1] = 0x2D;
-        sendCommandP2(0x12, payload, 2);
-        break;
-        
-      case 4: // Event: Game complete, score 1500
-        payload[0] = 0x01; // Game complete
-        payload[1] = 0x05; // Score high byte
-        payload[2] = 0xDC; // Score low byte (1500)
-        sendCommandP2(0x20, payload, 3);
-        break;
-        
-      case 5: // Reward: Level 5, 3 badges
-        payload[0] = 0x05;
-        payload[1] = 0x03;
-        sendCommandP2(0x21, payload, 2);
-        break;
+  wheelTimerInit(&reportTimer, reportFire, nullptr, UINT8_MAX);
+  wheelAdd(&scheduleWheel, &reportTimer, millis() + METRICS_REPORT_MS);
+  if (SOAK_MODE) {
+    for (uint8_t i = 0; i < slotCount; i++) {
+      slots[i].soak.intervalStart = millis();
     }
+    wheelTimerInit(&soakTimer, soakFire, nullptr, UINT8_MAX);
+    wheelAdd(&scheduleWheel, &soakTimer, millis() + SOAK_REPORT_MS);
   }
   
-  delay(100);
+  logEvent("SYSTEM", "INIT", "Initializing BLE...");
+  BLEDevice::init("ESP32_Master");
+  BLEDevice::setMTU(ATT_MTU_TARGET); // MTU local: BLEClient lo solicita al conectar
+  BLEDevice::setCustomGattcHandler(gattcEventHandler);
+  BLEDevice::setCustomGapHandler(gapEventHandler);
+  gattCacheLoad();
+  captureBegin(*BLEDevice::getAddress().getNative());  // Antes de appTask, su único productor
+  
+  linkQueue = xQueueCreate(MAX_PERIPHERALS, sizeof(PeripheralSlot*));
+  xTaskCreatePinnedToCore(linkTask, "linkTask", 4096, nullptr, LINK_TASK_PRIORITY, nullptr, BLE_CORE);
+  xTaskCreatePinnedToCore(ioTask, "ioTask", 4096, nullptr, IO_TASK_PRIORITY, &ioTaskHandle, BLE_CORE);
+  xTaskCreatePinnedToCore(appTask, "appTask", 4096, nullptr, APP_TASK_PRIORITY, &appTaskHandle, APP_CORE);
+  
+  logEvent("SYSTEM", "INIT", "Scanning for devices...");
+}
+
+// Todo el trabajo está en ioTask y appTask: la tarea de loop() sobra
+void loop() {
+  vTaskDelete(nullptr);
 }
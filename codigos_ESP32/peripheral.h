@@ -0,0 +1,308 @@
+/*
+ * Periférico BLE genérico (P1, P2)
+ *
+ * Peripheral<Device> es todo lo que los firmwares tenían repetido: servidor
+ * GATT con CMD, STATE y DIAG, tabla de centrales (central_link.h), eventos
+ * GATTS/GAP, limitador en onWrite, pipeline de comandos, diagnóstico y
+ * recepción de transferencias masivas (bulk_receiver.h).
+ * Device hereda de su perfil (device_profile.h) y aporta lo propio de su
+ * firmware como miembros estáticos:
+ *
+ *   Session                         estado por central (CentralLink::session)
+ *   Commands                        CommandSet de cmd_dispatch.h
+ *   TAG                             prefijo de los logs
+ *   linkOpened(count), linkClosed(count)
+ *                                   tarea BLE, tras abrir o cerrar un enlace
+ *   writeAuthenticated(link)        sesión vista desde la tarea BLE (seqlock)
+ *   clearLink(link)                 cmdTask, al aplicar el reset de un enlace
+ *   handleCommand(data, length)     cmdTask, trama ya sin cabecera de pipeline
+ *   statePublish()                  cmdTask, tras cada trama
+ *
+ * Todo se resuelve al compilar contra Device: no hay llamadas virtuales
+ * más allá de los callbacks que exige la librería BLE. Miembros estáticos
+ * porque los manejadores GATTS/GAP son punteros a función; el firmware
+ * declara una única instancia global (peripheral) para nombrarlos.
+ */
+
+#ifndef PERIPHERAL_H
+#define PERIPHERAL_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLE2902.h>
+#include "att_mtu.h"
+#include "ble_log.h"
+#include "ble_metrics.h"
+#include "bulk_receiver.h"
+#include "central_link.h"
+#include "cmd_dispatch.h"
+#include "cmd_pipeline.h"
+#include "cmd_queue.h"
+#include "conn_params.h"
+#include "rate_limit.h"
+
+template <typename Device>
+struct Peripheral {
+  typedef typename Device::Session Session;
+
+  static BLEServer* server;
+  static BLECharacteristic* cmdCharacteristic;
+  static BLECharacteristic* stateCharacteristic;
+  static BLECharacteristic* diagCharacteristic;
+  static BLE2902* stateCccd;
+  static BLE2902* diagCccd;
+
+  static CentralTable<Session> centrals;           // Centrales conectados
+  static uint8_t txLink;                           // Destino de sendStateFrame (cmdTask)
+  static uint8_t pipeLastSeq[CENTRAL_MAX_LINKS];   // Último comando secuenciado procesado
+
+  static void log(const char* category, const char* message) {
+    logSegments(Device::TAG, category, &message, 1);
+  }
+
+  static CentralLink<Session>& link() { return centrals.links[txLink]; }
+  static Session& session() { return centrals.links[txLink].session; }
+
+  // ==================== CALLBACKS ====================
+  // Eventos GATTS en bruto: MTU acordado y CCCD escritas por cada central
+  static void gattsEventHandler(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf, esp_ble_gatts_cb_param_t* param) {
+    if (event == ESP_GATTS_MTU_EVT) {
+      uint8_t i = centrals.find(param->mtu.conn_id);
+      if (i == CENTRAL_NONE) return;
+      centrals.links[i].mtu = param->mtu.mtu;
+      char msg[48];
+      sprintf(msg, "MTU negotiated: %u (conn %u)", param->mtu.mtu, param->mtu.conn_id);
+      log("BLE", msg);
+    } else if (event == ESP_GATTS_WRITE_EVT && !param->write.is_prep) {
+      uint16_t handle = param->write.handle;
+      uint8_t subscription = handle == stateCccd->getHandle() ? CENTRAL_SUB_STATE
+                           : handle == diagCccd->getHandle() ? CENTRAL_SUB_DIAG : 0;
+      if (subscription) centrals.subscribe(param->write.conn_id, subscription, param->write.value, param->write.len);
+    }
+  }
+
+  // Eventos GAP en bruto: parámetros de conexión aplicados a petición de cada central
+  static void gapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    if (event == ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT && param->update_conn_params.status == ESP_BT_STATUS_SUCCESS) {
+      uint8_t i = centrals.findPeer(param->update_conn_params.bda);
+      if (i == CENTRAL_NONE) return;
+      centrals.links[i].interval = param->update_conn_params.conn_int;
+      centrals.links[i].latency = param->update_conn_params.latency;
+      char msg[80];
+      connParamsFormat(msg, sizeof(msg), param->update_conn_params.conn_int,
+                       param->update_conn_params.latency, param->update_conn_params.timeout);
+      log("BLE", msg);
+    }
+  }
+
+  // Conexión y desconexión. Bluedroid deja de anunciarse al aceptar una
+  // conexión: se relanza mientras quede hueco
+  class ServerCallbacks : public BLEServerCallbacks {
+    void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+      uint16_t connId = param->connect.conn_id;
+      if (centrals.open(connId, param->connect.remote_bda, millis()) == CENTRAL_NONE) {
+        log("BLE", "No free link, disconnecting central");
+        pServer->disconnect(connId);
+        return;
+      }
+      if (metricsTotal(MET_CONNECTS) > 0) metricsCount(MET_RECONNECTS);
+      metricsCount(MET_CONNECTS);
+      uint8_t count = centrals.count();
+      char msg[48];
+      sprintf(msg, "Central connected (conn %u, %u/%u)", connId, count, CENTRAL_MAX_LINKS);
+      log("BLE", msg);
+      Device::linkOpened(count);
+      if (count < CENTRAL_MAX_LINKS) pServer->startAdvertising();
+    }
+
+    // cmdTask limpia la sesión del enlace; con la tabla llena el advertising
+    // estaba parado y se relanza aquí mismo
+    void onDisconnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+      bool wasFull = centrals.count() == CENTRAL_MAX_LINKS;
+      if (centrals.close(param->disconnect.conn_id) == CENTRAL_NONE) return;
+      uint8_t count = centrals.count();
+      char msg[48];
+      sprintf(msg, "Central disconnected (conn %u, %u/%u)", param->disconnect.conn_id, count, CENTRAL_MAX_LINKS);
+      log("BLE", msg);
+      Device::linkClosed(count);
+      if (wasFull) {
+        log("BLE", "Restarting advertising...");
+        pServer->startAdvertising();
+      }
+    }
+  };
+
+  // Sesión del enlace: la piden los comandos CMD_FLAG_AUTH y las tramas masivas
+  static bool linkAuthenticated(uint8_t link) {
+    return !Device::AUTH_REQUIRED || Device::writeAuthenticated(link);
+  }
+
+  // Cubeta del limitador para una escritura de CMD del central link, con o
+  // sin cabecera de pipeline
+  static RateClass writeClass(const uint8_t* data, size_t length, uint8_t link) {
+    if (bulkIsFrame(data, length)) return linkAuthenticated(link) ? RATE_BULK : RATE_INVALID;
+    if (Device::PIPELINED && length >= PIPE_HEADER_LEN && data[0] == PIPE_FRAME_CMD) {
+      data += PIPE_HEADER_LEN;
+      length -= PIPE_HEADER_LEN;
+    }
+    if (length < 2) return RATE_INVALID;
+    return rateClassify<typename Device::Commands>(data[0], Device::argLength(data, length), linkAuthenticated(link));
+  }
+
+  // Escritura en CMD (tarea BLE): limita con las cubetas del central que
+  // escribe y encola con su enlace, cmdTask procesa. Las tramas masivas van
+  // a bulkTask sin pasar por el pool de comandos.
+  class CmdCharacteristicCallbacks : public BLECharacteristicCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic, esp_ble_gatts_cb_param_t* param) {
+      std::string value = pCharacteristic->getValue();
+      const uint8_t* data = (const uint8_t*)value.data();
+      uint8_t link = centrals.find(param->write.conn_id);
+      if (value.length() == 0 || link == CENTRAL_NONE) return;
+      if (!rateAdmit(&centrals.links[link].limiter, writeClass(data, value.length(), link), millis())) return;
+      if (bulkIsFrame(data, value.length())) {
+        bulkPush(link, linkAuthenticated(link), data, value.length());
+        return;
+      }
+      if (!cmdQueuePush(data, value.length(), link)) {
+        log("ERROR", "Command dropped (queue full or too long)");
+      }
+    }
+  };
+
+  // ==================== PROCESAMIENTO DE COMANDOS ====================
+  // Trama STATE de longitud arbitraria (telemetría empaquetada) para el
+  // central txLink: el que escribió el comando o el suscriptor en curso
+  static void sendStateFrame(const uint8_t* frame, size_t length) {
+    if (!centrals.notify(txLink, CENTRAL_SUB_STATE, server->getGattsIf(), stateCharacteristic->getHandle(),
+                         frame, length)) return;
+    
+    logHex(Device::TAG, "TX", "STATE sent", frame, length);
+  }
+
+  // Tabla de comandos del Device sobre una trama sin cabecera de pipeline
+  static CmdStatus dispatch(const uint8_t* data, size_t length, bool authenticated) {
+    return Device::Commands::dispatch(data[0], data + Device::ARGS_OFFSET, Device::argLength(data, length),
+                                      authenticated, sendStateFrame);
+  }
+
+  // Los callbacks BLE solo marcan el enlace; cmdTask lo limpia antes de la
+  // siguiente trama o evento, así el estado tiene un único escritor
+  static void applyResets() {
+    centrals.applyResets(Device::clearLink);
+  }
+
+  // Punto de entrada de cmdTask: desenvuelve las tramas del modo pipeline
+  // y confirma con un solo ack todo lo procesado cuando no quedan tramas de
+  // ese central en la cola. La respuesta vuelve solo al central link.
+  static void processCommand(uint8_t* data, size_t length, uint8_t link = 0) {
+    applyResets();
+    txLink = link;
+    if (!Device::PIPELINED || length < PIPE_HEADER_LEN || data[0] != PIPE_FRAME_CMD) {
+      Device::handleCommand(data, length);
+      Device::statePublish();
+      return;
+    }
+    
+    pipeLastSeq[link] = data[1];
+    Device::handleCommand(data + PIPE_HEADER_LEN, length - PIPE_HEADER_LEN);
+    Device::statePublish();
+    if (cmdQueuePending(link) == 0) {
+      uint8_t ack[] = {PIPE_FRAME_ACK, pipeLastSeq[link]};
+      sendStateFrame(ack, sizeof(ack));
+    }
+  }
+
+  // ACK de transferencia masiva (bulkTask) al central que la alimenta
+  static void sendBulkFrame(uint8_t link, const uint8_t* frame, size_t length) {
+    centrals.notify(link, CENTRAL_SUB_STATE, server->getGattsIf(), stateCharacteristic->getHandle(), frame, length);
+  }
+
+  // ==================== DIAGNÓSTICO ====================
+  // Lectura de diag: instantánea completa (lectura larga si supera el MTU)
+  class DiagCharacteristicCallbacks : public BLECharacteristicCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+      uint8_t snapshot[METRICS_SNAPSHOT_MAX];
+      size_t length = metricsEncode(ByteSpan(snapshot, sizeof(snapshot)));
+      pCharacteristic->setValue(snapshot, length);
+    }
+  };
+
+  // Notificación periódica de diag a cada central suscrito: solo la parte de
+  // la instantánea que cabe en su MTU
+  static void sendDiagnostics() {
+    uint8_t snapshot[METRICS_SNAPSHOT_MAX];
+    size_t length = metricsEncode(ByteSpan(snapshot, sizeof(snapshot)));
+    for (uint8_t i = 0; i < CENTRAL_MAX_LINKS; i++) {
+      centrals.notify(i, CENTRAL_SUB_DIAG, server->getGattsIf(), diagCharacteristic->getHandle(), snapshot, length);
+    }
+  }
+
+  // ==================== SETUP ====================
+  // Servidor, servicio y advertising del perfil. Con stateCallbacks, STATE
+  // también se puede leer. Llamar después de cmdQueueBegin().
+  static void begin(BLECharacteristicCallbacks* stateCallbacks = nullptr) {
+    BLEDevice::init(Device::NAME);
+    BLEDevice::setMTU(ATT_MTU_TARGET);
+    BLEDevice::setCustomGattsHandler(gattsEventHandler);
+    BLEDevice::setCustomGapHandler(gapEventHandler);
+    
+    server = BLEDevice::createServer();
+    server->setCallbacks(new ServerCallbacks());
+    log("BLE", "BLE Server created");
+    
+    BLEService* service = server->createService(Device::SERVICE_UUID);
+    log("GATT", "Service created");
+    
+    // CMD (Write, Write NR)
+    cmdCharacteristic = service->createCharacteristic(
+      Device::CMD_UUID,
+      BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_WRITE_NR
+    );
+    cmdCharacteristic->setCallbacks(new CmdCharacteristicCallbacks());
+    log("GATT", "CMD characteristic created (Write, Write NR)");
+    
+    // STATE (Notify y, si el Device la atiende, Read)
+    uint32_t stateProperties = BLECharacteristic::PROPERTY_NOTIFY;
+    if (stateCallbacks) stateProperties |= BLECharacteristic::PROPERTY_READ;
+    stateCharacteristic = service->createCharacteristic(Device::STATE_UUID, stateProperties);
+    stateCccd = new BLE2902();
+    stateCharacteristic->addDescriptor(stateCccd);
+    if (stateCallbacks) stateCharacteristic->setCallbacks(stateCallbacks);
+    log("GATT", stateCallbacks ? "STATE characteristic created (Read, Notify)" : "STATE characteristic created (Notify)");
+    
+    // DIAG (Read, Notify): métricas de ble_metrics.h
+    diagCharacteristic = service->createCharacteristic(
+      Device::DIAG_UUID,
+      BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
+    );
+    diagCccd = new BLE2902();
+    diagCharacteristic->addDescriptor(diagCccd);
+    diagCharacteristic->setCallbacks(new DiagCharacteristicCallbacks());
+    log("GATT", "DIAG characteristic created (Read, Notify)");
+    
+    service->start();
+    log("GATT", "Service started");
+    bulkBegin(Device::TAG, sendBulkFrame);
+    
+    BLEAdvertising* advertising = BLEDevice::getAdvertising();
+    advertising->addServiceUUID(Device::SERVICE_UUID);
+    advertising->setScanResponse(true);
+    advertising->setMinPreferred(CONN_ADV_MIN_INTERVAL);
+    advertising->setMaxPreferred(CONN_ADV_MAX_INTERVAL);
+    BLEDevice::startAdvertising();
+    log("BLE", "Advertising started");
+  }
+};
+
+template <typename Device> BLEServer* Peripheral<Device>::server = nullptr;
+template <typename Device> BLECharacteristic* Peripheral<Device>::cmdCharacteristic = nullptr;
+template <typename Device> BLECharacteristic* Peripheral<Device>::stateCharacteristic = nullptr;
+template <typename Device> BLECharacteristic* Peripheral<Device>::diagCharacteristic = nullptr;
+template <typename Device> BLE2902* Peripheral<Device>::stateCccd = nullptr;
+template <typename Device> BLE2902* Peripheral<Device>::diagCccd = nullptr;
+template <typename Device> CentralTable<typename Peripheral<Device>::Session> Peripheral<Device>::centrals;
+template <typename Device> uint8_t Peripheral<Device>::txLink = CENTRAL_NONE;
+template <typename Device> uint8_t Peripheral<Device>::pipeLastSeq[CENTRAL_MAX_LINKS];
+
+#endif // PERIPHERAL_H
@@ -0,0 +1,55 @@
+/*
+ * Ahorro de energía de los periféricos (P1, P2)
+ *
+ * Los periféricos no sondean nada: comandos, telemetría y diagnóstico
+ * llegan a cmdTask como eventos (cmd_queue.h) y loop() no existe. Entre
+ * eventos BLE y vencimientos de esp_timer todas las tareas están
+ * bloqueadas, así que con gestión de energía el CPU entra solo en light
+ * sleep y baja la frecuencia (DFS) cuando no hay trabajo.
+ *
+ * Requiere un sdkconfig propio (el core precompilado de Arduino no lo trae):
+ *
+ *   CONFIG_PM_ENABLE=y
+ *   CONFIG_FREERTOS_USE_TICKLESS_IDLE=y
+ *   CONFIG_BTDM_CTRL_MODEM_SLEEP=y        controlador BLE dormido entre eventos
+ *   CONFIG_BTDM_CTRL_LOW_POWER_CLOCK_MAIN_XTAL o cristal de 32 kHz externo
+ *
+ * Sin CONFIG_PM_ENABLE powerBegin() solo lo deja anotado en el log.
+ */
+
+#ifndef POWER_SAVE_H
+#define POWER_SAVE_H
+
+#include <Arduino.h>
+#include "ble_log.h"
+
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#include <esp_idf_version.h>
+#endif
+
+#define POWER_MIN_FREQ_MHZ  40    // XTAL: la frecuencia mínima con el radio activo
+
+// Activa DFS y light sleep automático; devuelve true si quedan activos
+inline bool powerBegin(const char* device) {
+#if CONFIG_PM_ENABLE
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+  esp_pm_config_t config;
+#else
+  esp_pm_config_esp32_t config;
+#endif
+  config.max_freq_mhz = getCpuFrequencyMhz();
+  config.min_freq_mhz = POWER_MIN_FREQ_MHZ;
+  config.light_sleep_enable = true;
+  esp_err_t err = esp_pm_configure(&config);
+  const char* message = err == ESP_OK ? "Automatic light sleep enabled" : "Light sleep configuration failed";
+  logSegments(device, "POWER", &message, 1);
+  return err == ESP_OK;
+#else
+  const char* message = "Light sleep unavailable (CONFIG_PM_ENABLE off)";
+  logSegments(device, "POWER", &message, 1);
+  return false;
+#endif
+}
+
+#endif // POWER_SAVE_H
@@ -0,0 +1,115 @@
+/*
+ * Limitador de escrituras por token bucket (P1, P2)
+ *
+ * onWrite (tarea BLE) clasifica cada escritura de CMD antes de encolarla,
+ * con la misma tabla de comandos (CommandSet) que despacha cmdTask:
+ *
+ *   RATE_COMMAND     opcode conocido, permitido y con argumentos completos
+ *   RATE_CREDENTIAL  opcodes con CMD_FLAG_CREDENTIAL (AUTH_PIN, SESSION_RESUME)
+ *   RATE_BULK        tramas de transferencia masiva (bulk_transfer.h) con sesión
+ *   RATE_INVALID     lo que acabaría en una respuesta 0xFF: opcode
+ *                    desconocido, sin sesión o argumentos cortos
+ *
+ * Cada clase tiene su cubeta por conexión. Sin token la escritura se
+ * descarta allí mismo: sin copiarla a la cola, sin log y sin respuesta,
+ * solo MET_CMD_LIMITED. Un flood de basura agota su propia cubeta y los
+ * comandos legítimos siguen entrando a su ritmo.
+ *
+ * Las respuestas de error se agrupan: cada 0xFF lleva cuántas escrituras
+ * inválidas hubo desde la anterior, incluida la suya (rateErrorBatch()).
+ *
+ * La sesión que ve la tarea BLE es orientativa (la cambia cmdTask): una
+ * clasificación desfasada solo elige otra cubeta, dispatch() vuelve a
+ * comprobarlo todo. Las cubetas las toca solo la tarea BLE (onWrite y
+ * onConnect); el contador de rechazos es el único campo compartido.
+ */
+
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "ble_metrics.h"
+#include "cmd_dispatch.h"
+
+#define RATE_TOKEN_SCALE    1000  // Tokens en milésimas: rate tokens/s = rate milésimas/ms
+
+enum RateClass : uint8_t {
+  RATE_COMMAND,
+  RATE_CREDENTIAL,
+  RATE_BULK,
+  RATE_INVALID,
+  RATE_CLASS_COUNT
+};
+
+struct RateLimit {
+  uint16_t perSecond;     // Tokens repuestos por segundo
+  uint8_t burst;          // Capacidad de la cubeta
+};
+
+// El master mantiene hasta PIPE_WINDOW comandos en vuelo más los acks de
+// telemetría: RATE_COMMAND deja margen de sobra para eso
+static const RateLimit RATE_LIMITS[RATE_CLASS_COUNT] = {
+  {40, 16},               // RATE_COMMAND
+  {1, 3},                 // RATE_CREDENTIAL: ~1 intento de PIN por segundo
+  {2000, 64},             // RATE_BULK: por encima de lo que da el enlace a 7.5 ms
+  {2, 4}                  // RATE_INVALID
+};
+
+struct TokenBucket {
+  uint32_t tokens;        // Milésimas de token
+  uint32_t last;          // millis() del último repuesto
+};
+
+struct RateLimiter {
+  TokenBucket buckets[RATE_CLASS_COUNT];
+  std::atomic<uint16_t> rejected{0};  // Inválidas desde la última respuesta 0xFF
+};
+
+// Cubetas llenas: llamar en onConnect, cada central empieza de cero
+inline void rateReset(RateLimiter* limiter, uint32_t now) {
+  for (uint8_t i = 0; i < RATE_CLASS_COUNT; i++) {
+    limiter->buckets[i].tokens = RATE_LIMITS[i].burst * RATE_TOKEN_SCALE;
+    limiter->buckets[i].last = now;
+  }
+  limiter->rejected.store(0, std::memory_order_relaxed);
+}
+
+template <typename Commands>
+inline RateClass rateClassify(uint8_t opcode, size_t argLen, bool authenticated) {
+  CommandInfo info;
+  if (!Commands::lookup(opcode, &info) || argLen < info.minLen) return RATE_INVALID;
+  if ((info.flags & CMD_FLAG_AUTH) && !authenticated) return RATE_INVALID;
+  return (info.flags & CMD_FLAG_CREDENTIAL) ? RATE_CREDENTIAL : RATE_COMMAND;
+}
+
+// Repone según el tiempo transcurrido y consume un token si lo hay
+inline bool bucketTake(TokenBucket* bucket, const RateLimit& limit, uint32_t now) {
+  uint32_t capacity = limit.burst * RATE_TOKEN_SCALE;
+  uint32_t elapsed = now - bucket->last;
+  bucket->last = now;
+  // Tras un silencio largo basta con llenar: evita desbordar elapsed * rate
+  if (elapsed >= capacity / max((uint16_t)1, limit.perSecond)) bucket->tokens = capacity;
+  else bucket->tokens = min(capacity, bucket->tokens + elapsed * limit.perSecond);
+  
+  if (bucket->tokens < RATE_TOKEN_SCALE) return false;
+  bucket->tokens -= RATE_TOKEN_SCALE;
+  return true;
+}
+
+// Decide en la tarea BLE si la escritura entra en la cola
+inline bool rateAdmit(RateLimiter* limiter, RateClass cls, uint32_t now) {
+  if (cls == RATE_INVALID) limiter->rejected.fetch_add(1, std::memory_order_relaxed);
+  if (bucketTake(&limiter->buckets[cls], RATE_LIMITS[cls], now)) return true;
+  metricsCount(MET_CMD_LIMITED);
+  return false;
+}
+
+// Rechazos que resume esta respuesta 0xFF (al menos ella misma) y reinicia
+// la cuenta; satura en un byte
+inline uint8_t rateErrorBatch(RateLimiter* limiter) {
+  uint16_t count = limiter->rejected.exchange(0, std::memory_order_relaxed);
+  return count == 0 ? 1 : (uint8_t)min(count, (uint16_t)0xFF);
+}
+
+#endif // RATE_LIMIT_H
@@ -0,0 +1,69 @@
+/*
+ * Instantánea de estado con seqlock (P1, P2)
+ *
+ * cmdTask es el único escritor del estado del dispositivo; las tareas que
+ * solo lo consultan (callbacks de Bluedroid: lecturas GATT, clasificación
+ * de escrituras) leen una copia publicada con Seqlock<T> en vez de los
+ * campos sueltos, así que nunca ven un estado a medio actualizar y nadie
+ * toma un mutex.
+ *
+ * Dos copias: el escritor rellena la inactiva y la activa con seq; el
+ * lector copia la activa y la da por buena si seq no ha cambiado:
+ *
+ *   escritor   copia en words[(seq + 1) & 1] -> seq + 1 (release)
+ *   lector     seq -> copia words[seq & 1] -> mismo seq al terminar
+ *
+ * Un escritor a media publicación, corra en el otro núcleo o esté
+ * expropiado en el mismo, solo toca la copia inactiva: el lector nunca lo
+ * espera ni cede el CPU (se llama desde la tarea de Bluedroid). Reintenta
+ * únicamente si durante su copia se completó una publicación, es decir,
+ * si el escritor avanzó.
+ *
+ * La copia va en palabras atómicas relajadas (no hay carrera formal de
+ * C++) y T debe ser trivialmente copiable. Usar solo como global o static
+ * (los atómicos quedan a cero). Un único escritor: dos publish()
+ * concurrentes no están soportados.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <Arduino.h>
+#include <atomic>
+
+template <typename T>
+struct Seqlock {
+  static const size_t WORDS = (sizeof(T) + 3) / 4;
+
+  std::atomic<uint32_t> seq{0};   // Publicaciones completadas; la copia activa es seq & 1
+  std::atomic<uint32_t> words[2][WORDS];
+
+  // ==================== ESCRITOR ====================
+  void publish(const T& value) {
+    uint32_t buffer[WORDS] = {0};
+    memcpy(buffer, &value, sizeof(T));
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    std::atomic<uint32_t>* target = words[(s + 1) & 1];
+    std::atomic_thread_fence(std::memory_order_release);  // La publicación anterior, antes que estas escrituras
+    for (size_t i = 0; i < WORDS; i++) target[i].store(buffer[i], std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_release);
+  }
+
+  // ==================== LECTORES ====================
+  T read() const {
+    uint32_t buffer[WORDS];
+    uint32_t before, after;
+    do {
+      before = seq.load(std::memory_order_acquire);
+      const std::atomic<uint32_t>* source = words[before & 1];
+      for (size_t i = 0; i < WORDS; i++) buffer[i] = source[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = seq.load(std::memory_order_relaxed);
+    } while (before != after);
+    T value;
+    memcpy(&value, buffer, sizeof(T));
+    return value;
+  }
+};
+
+#endif // SEQLOCK_H
@@ -0,0 +1,83 @@
+/*
+ * Anillo SPSC sin locks (master)
+ *
+ * Un único productor y un único consumidor, cada uno en su tarea (y
+ * normalmente en su núcleo). El productor solo escribe head y el
+ * consumidor solo tail, así que basta un par de atómicos con
+ * acquire/release: sin CAS, sin secciones críticas y sin esperas.
+ *
+ * Los elementos viven dentro del anillo. El productor escribe en sitio
+ * (reserve() + commit()) y el consumidor puede leer la cabeza sin
+ * retirarla (front() + pop()), de modo que un elemento que aún no se puede
+ * atender se queda en su posición.
+ *
+ * N debe ser potencia de 2. head y tail crecen sin límite y se comparan
+ * por diferencia, así que caben exactamente N elementos.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+
+template <typename T, uint32_t N>
+struct SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of 2");
+
+  T items[N];
+  std::atomic<uint32_t> head{0};  // Siguiente posición a escribir (productor)
+  std::atomic<uint32_t> tail{0};  // Siguiente posición a leer (consumidor)
+
+  // ==================== PRODUCTOR ====================
+  // Celda libre para rellenar en sitio; nullptr si el anillo está lleno
+  T* reserve() {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= N) return nullptr;
+    return &items[h & (N - 1)];
+  }
+
+  // Publica la celda devuelta por reserve()
+  void commit() {
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  bool push(const T& item) {
+    T* slot = reserve();
+    if (!slot) return false;
+    *slot = item;
+    commit();
+    return true;
+  }
+
+  // ==================== CONSUMIDOR ====================
+  // Elemento más antiguo sin retirarlo; nullptr si el anillo está vacío
+  T* front() {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return nullptr;
+    return &items[t & (N - 1)];
+  }
+
+  // i-ésimo elemento desde la cabeza sin retirarlo; nullptr si no hay tantos
+  T* peek(uint32_t i) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) - t <= i) return nullptr;
+    return &items[(t + i) & (N - 1)];
+  }
+
+  // Libera la celda devuelta por front() para el productor
+  void pop() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // Aproximado desde la otra tarea; exacto desde cualquiera de las dos en reposo
+  uint32_t size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,230 @@
+/*
+ * Captura binaria de telemetría en flash (master)
+ *
+ * appTask añade un registro de tamaño fijo por cada campo de telemetría
+ * decodificado, sin formatear texto ni pasar por Serial. Los registros se
+ * construyen en sitio dentro de captureRing, en páginas de
+ * CAPTURE_PAGE_SIZE (la página de programación de la flash), y captureTask
+ * escribe cada página llena con un único esp_partition_write() alineado.
+ *
+ * La partición es un anillo de sectores de 4 KiB. La primera celda de cada
+ * sector es una cabecera con su número de orden: al arrancar se retoma en
+ * el sector siguiente al más reciente y el lector ordena los sectores sin
+ * índice aparte. Entrar en un sector cuesta un borrado (~45 ms con la caché
+ * de flash desactivada) cada CAPTURE_SECTOR_CELLS - 1 registros.
+ *
+ * Celda (16 bytes, little-endian):
+ *
+ *   registro   [ms:4] [slot] [tipo] [len] [flags] [datos:8]
+ *   cabecera   [CAPTURE_MAGIC:4] [orden:4] [arranque:4] [reservado:4]
+ *
+ * Tipos: CAPTURE_BOOT (datos = dirección del master) al arrancar,
+ * CAPTURE_LINK (dirección del periférico) al llegar a READY y, por campo,
+ * familia | índice del campo en el bitmap de telemetry_frame.h, con los
+ * bytes del campo tal como viajan (big-endian). Una celda a 0xFF está
+ * libre. BOOT y los LINK vigentes se repiten al principio de cada sector:
+ * cuando el anillo da la vuelta, cada sector sigue diciendo de quién es.
+ *
+ * Un corte de alimentación pierde como mucho la página en construcción.
+ * Con el anillo de páginas lleno se descartan registros (captureDropped),
+ * nunca se bloquea appTask. El único productor es appTask.
+ *
+ * Lectura en el PC: dataset/export_capture.py.
+ */
+
+#ifndef TELEMETRY_CAPTURE_H
+#define TELEMETRY_CAPTURE_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "ble_log.h"
+#include "spsc_ring.h"
+
+#define CAPTURE_PARTITION_LABEL "spiffs"  // Partición de datos de la tabla por defecto
+#define CAPTURE_MAGIC         0x43505431  // "CPT1"
+#define CAPTURE_CELL_SIZE     16
+#define CAPTURE_PAGE_SIZE     256         // Página de programación de la flash
+#define CAPTURE_SECTOR_SIZE   4096        // Unidad de borrado
+#define CAPTURE_PAGE_CELLS    (CAPTURE_PAGE_SIZE / CAPTURE_CELL_SIZE)
+#define CAPTURE_SECTOR_CELLS  (CAPTURE_SECTOR_SIZE / CAPTURE_CELL_SIZE)
+#define CAPTURE_DATA_MAX      8
+#define CAPTURE_RING_PAGES    4           // Páginas pendientes de escribir (potencia de 2)
+#define CAPTURE_MAX_SLOTS     8           // Slots con dirección registrada (LINK)
+#define CAPTURE_TASK_PRIORITY 1
+#define CAPTURE_TASK_STACK    3072
+
+enum CaptureType : uint8_t {
+  CAPTURE_BOOT    = 0x00,   // Arranque del master
+  CAPTURE_LINK    = 0x01,   // Slot en READY
+  CAPTURE_P1      = 0x10,   // | bit del campo (p1::telemetry)
+  CAPTURE_P2      = 0x20,   // | bit del campo (p2::telemetry)
+  CAPTURE_FREE    = 0xFF    // Celda borrada
+};
+
+#define CAPTURE_FLAG_SUBSCRIBED 0x01  // Campo reconstruido de una trama 0xA2/0xA3
+
+struct CapturePage {
+  uint32_t offset;                    // Posición en la partición (alineada a página)
+  uint8_t data[CAPTURE_PAGE_SIZE];
+};
+
+static const esp_partition_t* capturePartition = nullptr;
+static uint32_t captureSize = 0;            // Sectores enteros de la partición
+static SpscRing<CapturePage, CAPTURE_RING_PAGES> captureRing;
+static TaskHandle_t captureTaskHandle = nullptr;
+
+// Estado del productor (appTask)
+static CapturePage* capturePage = nullptr;  // Página en construcción (reservada en captureRing)
+static uint8_t captureFill = 0;             // Celdas ocupadas en capturePage
+static uint32_t captureOffset = 0;          // Posición de la página en construcción
+static uint32_t captureSequence = 0;        // Orden del sector de captureOffset
+static uint32_t captureBoot = 0;
+static uint32_t captureRecords = 0;
+static uint32_t captureDropped = 0;
+static uint8_t captureCentral[6];
+static uint8_t captureLinks[CAPTURE_MAX_SLOTS][6];
+static uint8_t captureLinkMask = 0;
+
+inline void capturePut32(uint8_t* out, uint32_t value) {
+  out[0] = value;
+  out[1] = value >> 8;
+  out[2] = value >> 16;
+  out[3] = value >> 24;
+}
+
+inline uint32_t captureGet32(const uint8_t* in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// ==================== ESCRITURA (captureTask) ====================
+// Escribe las páginas llenas; la primera de cada sector lo borra antes
+inline void captureFlush() {
+  while (CapturePage* page = captureRing.front()) {
+    if (page->offset % CAPTURE_SECTOR_SIZE == 0) {
+      esp_partition_erase_range(capturePartition, page->offset, CAPTURE_SECTOR_SIZE);
+    }
+    esp_partition_write(capturePartition, page->offset, page->data, CAPTURE_PAGE_SIZE);
+    captureRing.pop();
+  }
+}
+
+inline void captureTask(void* param) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    captureFlush();
+  }
+}
+
+// ==================== REGISTROS (appTask) ====================
+// Celda libre en la página en construcción; nullptr si no hay página
+inline uint8_t* captureCell() {
+  if (!capturePage) {
+    capturePage = captureRing.reserve();
+    if (!capturePage) return nullptr;
+    capturePage->offset = captureOffset;
+    memset(capturePage->data, 0xFF, CAPTURE_PAGE_SIZE);
+    captureFill = 0;
+    if (captureOffset % CAPTURE_SECTOR_SIZE == 0) {
+      uint8_t* header = capturePage->data;
+      capturePut32(header, CAPTURE_MAGIC);
+      capturePut32(header + 4, captureSequence);
+      capturePut32(header + 8, captureBoot);
+      captureFill = 1;
+    }
+  }
+  return capturePage->data + captureFill * CAPTURE_CELL_SIZE;
+}
+
+// Página llena: pasa a captureTask y la siguiente empieza detrás
+inline void captureCommit() {
+  if (++captureFill < CAPTURE_PAGE_CELLS) return;
+  capturePage = nullptr;
+  captureRing.commit();
+  xTaskNotifyGive(captureTaskHandle);
+  
+  captureOffset += CAPTURE_PAGE_SIZE;
+  if (captureOffset >= captureSize) captureOffset = 0;
+  if (captureOffset % CAPTURE_SECTOR_SIZE == 0) captureSequence++;
+}
+
+inline void captureAppend(uint8_t slot, uint8_t type, const uint8_t* data, uint8_t length, uint8_t flags) {
+  uint8_t* cell = captureCell();
+  if (!cell) {
+    captureDropped++;
+    return;
+  }
+  length = min(length, (uint8_t)CAPTURE_DATA_MAX);
+  capturePut32(cell, millis());
+  cell[4] = slot;
+  cell[5] = type;
+  cell[6] = length;
+  cell[7] = flags;
+  memcpy(cell + 8, data, length);
+  captureRecords++;
+  captureCommit();
+}
+
+inline void captureRecord(uint8_t slot, uint8_t type, const uint8_t* data, uint8_t length, uint8_t flags = 0) {
+  if (!capturePartition) return;
+  if (type == CAPTURE_BOOT) memcpy(captureCentral, data, sizeof(captureCentral));
+  if (type == CAPTURE_LINK && slot < CAPTURE_MAX_SLOTS) {
+    memcpy(captureLinks[slot], data, sizeof(captureLinks[slot]));
+    captureLinkMask |= 1 << slot;
+  }
+  // Sector nuevo: antes que nada, el contexto vigente
+  if (!capturePage && captureOffset % CAPTURE_SECTOR_SIZE == 0 && type != CAPTURE_BOOT) {
+    captureAppend(0, CAPTURE_BOOT, captureCentral, sizeof(captureCentral), 0);
+    for (uint8_t i = 0; i < CAPTURE_MAX_SLOTS; i++) {
+      if (captureLinkMask & (1 << i)) captureAppend(i, CAPTURE_LINK, captureLinks[i], sizeof(captureLinks[i]), 0);
+    }
+  }
+  captureAppend(slot, type, data, length, flags);
+}
+
+// ==================== ARRANQUE ====================
+// Retoma el anillo tras el sector más reciente y lanza captureTask.
+// false si no hay partición (la captura queda desactivada).
+inline bool captureBegin(const uint8_t* centralAddr) {
+  const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                              ESP_PARTITION_SUBTYPE_ANY, CAPTURE_PARTITION_LABEL);
+  if (!partition || partition->size < 2 * CAPTURE_SECTOR_SIZE) {
+    const char* message = "No capture partition, telemetry capture disabled";
+    logSegments("CAPTURE", "INIT", &message, 1);
+    return false;
+  }
+  
+  uint32_t sectors = partition->size / CAPTURE_SECTOR_SIZE;
+  bool found = false;
+  uint32_t newest = 0;
+  for (uint32_t i = 0; i < sectors; i++) {
+    uint8_t header[12];
+    if (esp_partition_read(partition, i * CAPTURE_SECTOR_SIZE, header, sizeof(header)) != ESP_OK) continue;
+    if (captureGet32(header) != CAPTURE_MAGIC) continue;
+    uint32_t sequence = captureGet32(header + 4);
+    if (!found || (int32_t)(sequence - captureSequence) > 0) {
+      captureSequence = sequence;
+      newest = i;
+    }
+    captureBoot = max(captureBoot, captureGet32(header + 8) + 1);
+    found = true;
+  }
+  if (found) {
+    captureSequence++;
+    captureOffset = ((newest + 1) % sectors) * CAPTURE_SECTOR_SIZE;
+  }
+  capturePartition = partition;
+  captureSize = sectors * CAPTURE_SECTOR_SIZE;  // El resto de la partición no se toca
+  
+  xTaskCreatePinnedToCore(captureTask, "captureTask", CAPTURE_TASK_STACK, nullptr, CAPTURE_TASK_PRIORITY,
+                          &captureTaskHandle, LOG_TASK_CORE);
+  captureRecord(0, CAPTURE_BOOT, centralAddr, 6);
+  
+  char message[64];
+  snprintf(message, sizeof(message), "Capture ring %u KiB, boot %u, sector %u",
+           (unsigned)(captureSize / 1024), (unsigned)captureBoot, (unsigned)(captureOffset / CAPTURE_SECTOR_SIZE));
+  const char* segments[] = {message};
+  logSegments("CAPTURE", "INIT", segments, 1);
+  return true;
+}
+
+#endif // TELEMETRY_CAPTURE_H
@@ -0,0 +1,348 @@
+/*
+ * Trama de telemetría empaquetada (STATE notify)
+ *
+ *   [0xA1] [bitmap] [campo bit0] [campo bit1] ...
+ *
+ * El bitmap indica qué campos van en la trama, siempre en orden de bit
+ * creciente y con tamaño fijo por campo (big-endian). Una sola notificación
+ * lleva la instantánea completa; si no cabe en el payload ATT disponible se
+ * parte en varias tramas por límites de campo, cada una con su propio
+ * bitmap, así que el receptor no necesita reensamblar.
+ *
+ * Modo suscripción (por cambios): el central registra un umbral por campo y
+ * cada cuántos ticks quiere un keyframe; el periférico solo envía los
+ * campos que se han alejado más que su umbral de la última instantánea
+ * confirmada (ack del central), codificados como diferencia:
+ *
+ *   [0xA3] [bitmap] [SEQ] [campo bit0] ...                    keyframe
+ *   [0xA2] [bitmap] [absolutos] [SEQ] [BASE] [campo bit0] ... delta
+ *
+ * En un delta cada componente del campo (TelemetryLayout) viaja como int8
+ * con la diferencia respecto a la instantánea BASE, módulo su anchura; si
+ * alguna no cabe, el campo va entero y su bit se marca en "absolutos". Los
+ * campos ausentes valen lo mismo que en BASE. Como la base solo avanza con
+ * un ack, perder un delta no rompe nada: el siguiente vuelve a ir contra la
+ * misma base. Estas tramas no se fragmentan (las familias actuales caben en
+ * el ATT por defecto).
+ *
+ * Compartido por master.cpp (decodificación) y los periféricos (codificación).
+ * Los campos de cada familia (bit, tamaño, formato) están en ble_protocol.h.
+ */
+
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <Arduino.h>
+
+#define TELEM_FRAME_PACKED      0xA1
+#define TELEM_FRAME_DELTA       0xA2
+#define TELEM_FRAME_KEY         0xA3
+#define TELEM_HEADER_LEN        2     // Tipo + bitmap
+#define TELEM_KEY_HEADER_LEN    3     // Tipo + bitmap + SEQ
+#define TELEM_DELTA_HEADER_LEN  5     // Tipo + bitmap + absolutos + SEQ + BASE
+#define TELEM_MAX_FIELDS        8
+#define TELEM_FIELD_MAX_SIZE    4
+#define TELEM_HISTORY           4     // Instantáneas que el central guarda como posibles bases
+
+struct TelemetryField {
+  uint8_t bit;
+  uint8_t size;
+  uint8_t data[TELEM_FIELD_MAX_SIZE];
+};
+
+struct TelemetryFieldView {
+  uint8_t bit;
+  uint8_t size;
+  const uint8_t* data;
+};
+
+typedef void (*TelemetrySink)(const uint8_t* frame, size_t length);
+
+inline void telemPut16(uint8_t* out, uint16_t value) {
+  out[0] = value >> 8;
+  out[1] = value & 0xFF;
+}
+
+inline uint16_t telemGet16(const uint8_t* in) {
+  return (uint16_t)((in[0] << 8) | in[1]);
+}
+
+// Empaqueta los campos (en orden de bit) en el menor número de tramas de
+// como mucho maxFrame bytes y las entrega a sink. Devuelve las tramas enviadas.
+inline size_t telemetrySendPacked(const TelemetryField* fields, size_t count,
+                                  size_t maxFrame, TelemetrySink sink) {
+  uint8_t frame[TELEM_HEADER_LEN + TELEM_MAX_FIELDS * TELEM_FIELD_MAX_SIZE];
+  if (maxFrame > sizeof(frame)) maxFrame = sizeof(frame);
+
+  size_t frames = 0;
+  size_t len = TELEM_HEADER_LEN;
+  frame[0] = TELEM_FRAME_PACKED;
+  frame[1] = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    if (len + fields[i].size > maxFrame && frame[1]) {
+      sink(frame, len);  // Fragmentación: cerrar la trama actual
+      frames++;
+      len = TELEM_HEADER_LEN;
+      frame[1] = 0;
+    }
+    if (len + fields[i].size > maxFrame) continue;  // Campo mayor que el MTU
+    frame[1] |= fields[i].bit;
+    memcpy(frame + len, fields[i].data, fields[i].size);
+    len += fields[i].size;
+  }
+
+  if (frame[1]) {
+    sink(frame, len);
+    frames++;
+  }
+  return frames;
+}
+
+// Recorre los campos de una trama empaquetada. sizes[i] es el tamaño del
+// campo de bit (1 << i). Devuelve el número de campos o -1 si está mal formada.
+inline int telemetryDecode(const uint8_t* frame, size_t length,
+                           const uint8_t* sizes, uint8_t sizeCount,
+                           TelemetryFieldView* out, uint8_t maxOut) {
+  if (length < TELEM_HEADER_LEN || frame[0] != TELEM_FRAME_PACKED) return -1;
+
+  uint8_t bitmap = frame[1];
+  size_t pos = TELEM_HEADER_LEN;
+  int n = 0;
+  for (uint8_t i = 0; i < TELEM_MAX_FIELDS && bitmap; i++) {
+    uint8_t bit = 1 << i;
+    if (!(bitmap & bit)) continue;
+    bitmap &= ~bit;
+    if (i >= sizeCount || n >= maxOut || pos + sizes[i] > length) return -1;
+    out[n].bit = bit;
+    out[n].size = sizes[i];
+    out[n].data = frame + pos;
+    pos += sizes[i];
+    n++;
+  }
+  return n;
+}
+
+// ==================== MODO SUSCRIPCIÓN ====================
+// Componentes big-endian de un campo; bit j de wide = componente j de 16 bits
+struct TelemetryLayout {
+  uint8_t components;
+  uint8_t wide;
+};
+
+// Valores de todos los campos en una instantánea, indexados por bit
+struct TelemetrySnapshot {
+  uint8_t seq;
+  uint8_t fields;               // Bitmap de campos con valor
+  uint8_t data[TELEM_MAX_FIELDS][TELEM_FIELD_MAX_SIZE];
+};
+
+// Estado del periférico (cmdTask)
+struct TelemetryStream {
+  TelemetrySnapshot base;       // Última confirmada por el central
+  TelemetrySnapshot sent;       // Última enviada, pendiente de ack
+  uint8_t thresholds[TELEM_MAX_FIELDS];
+  uint8_t keyframeEvery;        // Ticks entre keyframes; 0 = sin suscripción
+  uint8_t sinceKeyframe;
+  uint8_t nextSeq;
+  bool baseValid;
+};
+
+// Réplica del central: últimas instantáneas reconstruidas (appTask)
+struct TelemetryMirror {
+  TelemetrySnapshot history[TELEM_HISTORY];
+  uint8_t count;
+  uint8_t next;                 // Posición que se sobrescribe
+};
+
+inline uint8_t telemLayoutSize(const TelemetryLayout& layout) {
+  return layout.components + __builtin_popcount(layout.wide);
+}
+
+// Diferencia por componente de current respecto a base, módulo su anchura.
+// compact = todas caben en int8. Devuelve true si alguna supera threshold.
+inline bool telemFieldDelta(const TelemetryLayout& layout, const uint8_t* base, const uint8_t* current,
+                            uint8_t threshold, int8_t* deltas, bool* compact) {
+  bool changed = false;
+  *compact = true;
+  size_t pos = 0;
+  for (uint8_t j = 0; j < layout.components; j++) {
+    bool wide = layout.wide & (1 << j);
+    int32_t delta = wide ? (int16_t)(uint16_t)(telemGet16(current + pos) - telemGet16(base + pos))
+                         : (int8_t)(uint8_t)(current[pos] - base[pos]);
+    if (delta > threshold || -delta > threshold) changed = true;
+    if (delta < -128 || delta > 127) *compact = false;
+    else deltas[j] = (int8_t)delta;
+    pos += wide ? 2 : 1;
+  }
+  return changed;
+}
+
+inline void telemFieldApply(const TelemetryLayout& layout, uint8_t* value, const int8_t* deltas) {
+  size_t pos = 0;
+  for (uint8_t j = 0; j < layout.components; j++) {
+    if (layout.wide & (1 << j)) {
+      telemPut16(value + pos, telemGet16(value + pos) + deltas[j]);
+      pos += 2;
+    } else {
+      value[pos++] += deltas[j];
+    }
+  }
+}
+
+// Alta (keyframeEvery > 0) o baja de la suscripción; el siguiente envío es un keyframe
+inline void telemStreamSubscribe(TelemetryStream* stream, uint8_t keyframeEvery,
+                                 const uint8_t* thresholds, uint8_t count) {
+  memset(stream->thresholds, 0, sizeof(stream->thresholds));
+  memcpy(stream->thresholds, thresholds, min(count, (uint8_t)TELEM_MAX_FIELDS));
+  stream->keyframeEvery = keyframeEvery;
+  stream->sinceKeyframe = 0;
+  stream->baseValid = false;
+}
+
+inline bool telemStreamActive(const TelemetryStream* stream) {
+  return stream->keyframeEvery != 0;
+}
+
+// Ack del central: solo la última enviada pasa a ser la base. Un ack que
+// llega tarde (ya se envió otra) se ignora; el central aún guarda la base.
+inline void telemStreamAck(TelemetryStream* stream, uint8_t seq) {
+  if (seq != stream->sent.seq) return;
+  stream->base = stream->sent;
+  stream->baseValid = true;
+}
+
+// Un tick de telemetría suscrita: keyframe si toca o no hay base, si no un
+// delta con los campos que superan su umbral. fields en orden de bit, como
+// para telemetrySendPacked(). Devuelve los bytes enviados (0 = sin cambios).
+inline size_t telemStreamSend(TelemetryStream* stream, const TelemetryLayout* layouts,
+                              const TelemetryField* fields, size_t count,
+                              size_t maxFrame, TelemetrySink sink) {
+  uint8_t frame[TELEM_DELTA_HEADER_LEN + TELEM_MAX_FIELDS * TELEM_FIELD_MAX_SIZE];
+  TelemetrySnapshot next = stream->base;
+  next.seq = stream->nextSeq;
+  stream->sinceKeyframe++;
+  bool key = !stream->baseValid || stream->sinceKeyframe >= stream->keyframeEvery;
+  
+  size_t len = key ? TELEM_KEY_HEADER_LEN : TELEM_DELTA_HEADER_LEN;
+  uint8_t bitmap = 0;
+  uint8_t absolute = 0;
+  if (key) next.fields = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint8_t index = __builtin_ctz(fields[i].bit);
+    if (index >= TELEM_MAX_FIELDS) continue;
+    const TelemetryLayout& layout = layouts[index];
+    uint8_t* value = next.data[index];
+    int8_t deltas[TELEM_FIELD_MAX_SIZE];
+    bool compact = false;
+    bool known = stream->baseValid && (stream->base.fields & fields[i].bit);
+    if (!key && known &&
+        !telemFieldDelta(layout, value, fields[i].data, stream->thresholds[index], deltas, &compact)) {
+      continue;  // Dentro del umbral: el central se queda con el valor de la base
+    }
+    if (!key && compact) {
+      memcpy(frame + len, deltas, layout.components);
+      len += layout.components;
+    } else {
+      memcpy(frame + len, fields[i].data, fields[i].size);
+      len += fields[i].size;
+      absolute |= fields[i].bit;
+    }
+    memcpy(value, fields[i].data, fields[i].size);
+    bitmap |= fields[i].bit;
+    next.fields |= fields[i].bit;
+  }
+  
+  if (len > maxFrame) return 0;
+  if (key) {
+    frame[0] = TELEM_FRAME_KEY;
+    frame[1] = bitmap;
+    frame[2] = next.seq;
+    stream->sinceKeyframe = 0;
+  } else {
+    if (!bitmap) return 0;
+    frame[0] = TELEM_FRAME_DELTA;
+    frame[1] = bitmap;
+    frame[2] = absolute;
+    frame[3] = next.seq;
+    frame[4] = stream->base.seq;
+  }
+  stream->sent = next;
+  stream->nextSeq++;
+  sink(frame, len);
+  return len;
+}
+
+inline void telemMirrorReset(TelemetryMirror* mirror) {
+  mirror->count = 0;
+  mirror->next = 0;
+}
+
+inline const TelemetrySnapshot* telemMirrorFind(const TelemetryMirror* mirror, uint8_t seq) {
+  for (uint8_t i = 0; i < mirror->count; i++) {
+    if (mirror->history[i].seq == seq) return &mirror->history[i];
+  }
+  return nullptr;
+}
+
+// Reconstruye la instantánea de un keyframe o delta y la guarda como posible
+// base. nullptr si está mal formada o su base ya no está en el historial.
+inline const TelemetrySnapshot* telemMirrorApply(TelemetryMirror* mirror, const TelemetryLayout* layouts,
+                                                 uint8_t layoutCount, const uint8_t* frame, size_t length) {
+  bool key = length >= TELEM_KEY_HEADER_LEN && frame[0] == TELEM_FRAME_KEY;
+  if (!key && (length < TELEM_DELTA_HEADER_LEN || frame[0] != TELEM_FRAME_DELTA)) return nullptr;
+  
+  TelemetrySnapshot next;
+  uint8_t bitmap = frame[1];
+  uint8_t absolute = key ? bitmap : frame[2];
+  size_t pos = key ? TELEM_KEY_HEADER_LEN : TELEM_DELTA_HEADER_LEN;
+  if (key) {
+    next.fields = 0;
+  } else {
+    const TelemetrySnapshot* base = telemMirrorFind(mirror, frame[4]);
+    if (!base) return nullptr;
+    next = *base;
+  }
+  next.seq = frame[key ? 2 : 3];
+  
+  for (uint8_t i = 0; i < TELEM_MAX_FIELDS && bitmap; i++) {
+    uint8_t bit = 1 << i;
+    if (!(bitmap & bit)) continue;
+    bitmap &= ~bit;
+    if (i >= layoutCount) return nullptr;
+    const TelemetryLayout& layout = layouts[i];
+    if (absolute & bit) {
+      uint8_t size = telemLayoutSize(layout);
+      if (pos + size > length) return nullptr;
+      memcpy(next.data[i], frame + pos, size);
+      pos += size;
+    } else {
+      if (pos + layout.components > length || !(next.fields & bit)) return nullptr;
+      telemFieldApply(layout, next.data[i], (const int8_t*)(frame + pos));
+      pos += layout.components;
+    }
+    next.fields |= bit;
+  }
+  
+  TelemetrySnapshot* slot = &mirror->history[mirror->next];
+  *slot = next;
+  mirror->next = (mirror->next + 1) % TELEM_HISTORY;
+  if (mirror->count < TELEM_HISTORY) mirror->count++;
+  return slot;
+}
+
+// Campos de una instantánea reconstruida, como los de telemetryDecode()
+inline int telemSnapshotFields(const TelemetrySnapshot* snapshot, const TelemetryLayout* layouts,
+                               uint8_t layoutCount, TelemetryFieldView* out, uint8_t maxOut) {
+  int n = 0;
+  for (uint8_t i = 0; i < layoutCount && i < TELEM_MAX_FIELDS && n < maxOut; i++) {
+    if (!(snapshot->fields & (1 << i))) continue;
+    out[n].bit = 1 << i;
+    out[n].size = telemLayoutSize(layouts[i]);
+    out[n].data = snapshot->data[i];
+    n++;
+  }
+  return n;
+}
+
+#endif // TELEMETRY_FRAME_H
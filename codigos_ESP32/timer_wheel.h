@@ -0,0 +1,191 @@
+/*
+ * Rueda de temporizadores jerárquica (master)
+ *
+ * WHEEL_LEVELS niveles de WHEEL_SIZE cubetas con resolución de 1 ms en el
+ * nivel 0 y WHEEL_SIZE veces más gruesa en cada nivel siguiente:
+ *
+ *   nivel 0  1 ms     hasta 64 ms
+ *   nivel 1  64 ms    hasta ~4 s
+ *   nivel 2  4096 ms  hasta ~4.4 min (más lejos: se reubica al llegar)
+ *
+ * Los temporizadores son nodos intrusivos (sin heap): añadir y quitar es
+ * O(1). Un temporizador va al nivel más bajo cuyo bloque actual está a
+ * menos de WHEEL_SIZE bloques de su vencimiento; al empezar un bloque, su
+ * cubeta del nivel superior se reparte en los inferiores (cascada).
+ *
+ * Un bitmap de ocupación por nivel permite calcular el siguiente evento
+ * (vencimiento o cascada) con una rotación y __builtin_ctzll por nivel, así
+ * que la tarea dueña puede dormir hasta ese instante exacto y wheelAdvance()
+ * salta los milisegundos vacíos sin recorrerlos.
+ *
+ * Dentro de la misma cubeta del nivel 0 (mismo ms) los temporizadores se
+ * disparan por prioridad (menor valor antes). La rueda no es reentrante:
+ * todas las llamadas desde una única tarea, incluidos los callbacks.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <Arduino.h>
+
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_LEVELS    3
+#define WHEEL_IDLE_MS   60000   // Espera máxima con la rueda vacía
+
+struct WheelTimer;
+typedef void (*WheelCallback)(WheelTimer* timer, uint32_t now);
+
+struct WheelTimer {
+  WheelTimer* next;
+  WheelTimer* prev;
+  uint32_t expires;             // ms absolutos (millis())
+  WheelCallback fire;
+  void* owner;                  // Contexto del callback
+  uint8_t priority;             // 0 = primero si vencen en el mismo ms
+  uint8_t level;
+  uint8_t index;
+  bool pending;                 // Enlazado en una cubeta
+};
+
+struct TimerWheel {
+  WheelTimer* buckets[WHEEL_LEVELS][WHEEL_SIZE];
+  uint64_t occupied[WHEEL_LEVELS];
+  WheelTimer* firing;           // Cubeta vencida que se está disparando
+  uint32_t now;                 // Primer ms aún no procesado
+};
+
+#define WHEEL_FIRING    WHEEL_LEVELS  // level de los temporizadores de firing
+
+inline void wheelInit(TimerWheel* wheel, uint32_t now) {
+  memset(wheel, 0, sizeof(*wheel));
+  wheel->now = now;
+}
+
+inline void wheelTimerInit(WheelTimer* timer, WheelCallback fire, void* owner, uint8_t priority) {
+  memset(timer, 0, sizeof(*timer));
+  timer->fire = fire;
+  timer->owner = owner;
+  timer->priority = priority;
+}
+
+// Enlaza en la cubeta que corresponde a expires respecto a wheel->now
+inline void wheelPlace(TimerWheel* wheel, WheelTimer* timer) {
+  uint8_t level = 0;
+  uint32_t block = timer->expires;
+  while (level < WHEEL_LEVELS - 1 &&
+         (timer->expires >> (level * WHEEL_BITS)) - (wheel->now >> (level * WHEEL_BITS)) >= WHEEL_SIZE) {
+    level++;
+    block = timer->expires >> (level * WHEEL_BITS);
+  }
+  // Más allá del último nivel: última cubeta alcanzable, se reubica al llegar
+  uint32_t current = wheel->now >> (level * WHEEL_BITS);
+  if (block - current >= WHEEL_SIZE) block = current + WHEEL_SIZE - 1;
+  
+  uint8_t index = block & (WHEEL_SIZE - 1);
+  WheelTimer** link = &wheel->buckets[level][index];
+  WheelTimer* prev = nullptr;
+  if (level == 0) {
+    while (*link && (*link)->priority <= timer->priority) {
+      prev = *link;
+      link = &(*link)->next;
+    }
+  }
+  timer->next = *link;
+  timer->prev = prev;
+  if (*link) (*link)->prev = timer;
+  *link = timer;
+  timer->level = level;
+  timer->index = index;
+  timer->pending = true;
+  wheel->occupied[level] |= 1ULL << index;
+}
+
+// Desenlaza de su cubeta; no hace nada si no estaba pendiente
+inline void wheelRemove(TimerWheel* wheel, WheelTimer* timer) {
+  if (!timer->pending) return;
+  bool firing = timer->level == WHEEL_FIRING;
+  WheelTimer** head = firing ? &wheel->firing : &wheel->buckets[timer->level][timer->index];
+  if (timer->prev) timer->prev->next = timer->next;
+  else *head = timer->next;
+  if (timer->next) timer->next->prev = timer->prev;
+  if (!*head && !firing) wheel->occupied[timer->level] &= ~(1ULL << timer->index);
+  timer->pending = false;
+}
+
+// Programa (o reprograma) timer para expires. Un vencimiento ya pasado se
+// dispara en el siguiente wheelAdvance().
+inline void wheelAdd(TimerWheel* wheel, WheelTimer* timer, uint32_t expires) {
+  wheelRemove(wheel, timer);
+  timer->expires = (int32_t)(expires - wheel->now) < 0 ? wheel->now : expires;
+  wheelPlace(wheel, timer);
+}
+
+// ms absoluto del siguiente evento: vencimiento en el nivel 0 o inicio del
+// bloque que toca repartir en los superiores. now + WHEEL_IDLE_MS si está vacía.
+inline uint32_t wheelNextEvent(const TimerWheel* wheel) {
+  uint32_t next = wheel->now + WHEEL_IDLE_MS;
+  for (uint8_t level = 0; level < WHEEL_LEVELS; level++) {
+    uint64_t bits = wheel->occupied[level];
+    if (!bits) continue;
+    uint8_t shift = level * WHEEL_BITS;
+    // Primer bloque que empieza en now o después: el bloque en curso de un
+    // nivel superior ya se repartió al empezar
+    uint32_t first = (wheel->now + (1UL << shift) - 1) >> shift;
+    uint8_t rotate = first & (WHEEL_SIZE - 1);
+    uint64_t rotated = rotate ? (bits >> rotate) | (bits << (WHEEL_SIZE - rotate)) : bits;
+    uint32_t at = (first + __builtin_ctzll(rotated)) << shift;
+    if ((int32_t)(at - next) < 0) next = at;
+  }
+  return next;
+}
+
+// Reparte en niveles inferiores la cubeta de level que empieza en wheel->now
+inline void wheelCascade(TimerWheel* wheel, uint8_t level) {
+  uint8_t index = (wheel->now >> (level * WHEEL_BITS)) & (WHEEL_SIZE - 1);
+  WheelTimer* timer = wheel->buckets[level][index];
+  wheel->buckets[level][index] = nullptr;
+  wheel->occupied[level] &= ~(1ULL << index);
+  while (timer) {
+    WheelTimer* next = timer->next;
+    wheelPlace(wheel, timer);
+    timer = next;
+  }
+}
+
+// Procesa hasta until (incluido) y dispara lo vencido en orden de tiempo y
+// prioridad. Los callbacks pueden volver a programar su temporizador.
+// Devuelve el número de disparos.
+inline size_t wheelAdvance(TimerWheel* wheel, uint32_t until) {
+  size_t fired = 0;
+  while ((int32_t)(until - wheel->now) >= 0) {
+    uint32_t event = wheelNextEvent(wheel);
+    if ((int32_t)(event - until) > 0) {
+      wheel->now = until + 1;
+      break;
+    }
+    wheel->now = event;
+    
+    for (uint8_t level = WHEEL_LEVELS - 1; level > 0; level--) {
+      if ((wheel->now & ((1UL << (level * WHEEL_BITS)) - 1)) == 0) wheelCascade(wheel, level);
+    }
+    
+    // La cubeta pasa a firing antes de disparar: lo que se reprograma cae en
+    // la rueda (aunque sea en esta misma cubeta, 64 ms después) y un callback
+    // puede cancelar cualquier temporizador que aún no se ha disparado
+    uint8_t index = wheel->now & (WHEEL_SIZE - 1);
+    wheel->firing = wheel->buckets[0][index];
+    wheel->buckets[0][index] = nullptr;
+    wheel->occupied[0] &= ~(1ULL << index);
+    for (WheelTimer* timer = wheel->firing; timer; timer = timer->next) timer->level = WHEEL_FIRING;
+    uint32_t now = wheel->now++;
+    while (WheelTimer* timer = wheel->firing) {
+      wheelRemove(wheel, timer);
+      timer->fire(timer, now);
+      fired++;
+    }
+  }
+  return fired;
+}
+
+#endif // TIMER_WHEEL_H
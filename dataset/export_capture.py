@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""
+Exporta la captura binaria de telemetría del master (telemetry_capture.h)
+a CSV con las columnas de bluetooth_gatt_dataset.csv.
+
+Volcado de la partición (tabla por defecto de Arduino-ESP32, "spiffs"):
+
+    esptool.py read_flash 0x290000 0x160000 capture.bin
+
+Cada registro del anillo es un campo de telemetría y sale como una fila
+de notificación ATT (btatt.opcode 27) con btatt.value = bytes del campo
+tal como viajan. Las longitudes son las de una notificación que llevase
+solo ese campo. Las direcciones salen de los registros BOOT (master) y
+LINK (periférico de cada slot); el reloj es millis() del master, así que
+frame.time_epoch = --epoch + segundos desde el primer arranque capturado
+(cada arranque continúa donde acabó el anterior).
+
+Uso: python3 export_capture.py capture.bin salida.csv [--epoch T] [--decoded]
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+CAPTURE_MAGIC = 0x43505431
+CELL_SIZE = 16
+SECTOR_SIZE = 4096
+
+CAPTURE_BOOT = 0x00
+CAPTURE_LINK = 0x01
+CAPTURE_P1 = 0x10
+CAPTURE_P2 = 0x20
+CAPTURE_FREE = 0xFF
+
+ATT_NOTIFICATION = 27
+ATT_HEADER = 3           # Opcode + handle
+L2CAP_HEADER = 4
+FRAME_OVERHEAD = 26      # frame.len - btle.length en el dataset
+
+COLUMNS = [
+    "frame.number", "frame.time_epoch", "frame.len", "btle.length",
+    "btle.central_bd_addr", "btle.peripheral_bd_addr", "btle.access_address",
+    "btle.data_header.llid", "btatt.opcode", "btatt.handle", "btatt.value",
+    "inter_arrival_time", "type",
+]
+
+# Campos por familia (bit del bitmap -> nombre, formato big-endian, escalas)
+FIELDS = {
+    CAPTURE_P1: {
+        0: ("temperature", ">h", (0.1,)),
+        1: ("humidity", ">H", (0.1,)),
+    },
+    CAPTURE_P2: {
+        0: ("vitals", ">hB", (0.1, 1)),
+        1: ("activity", ">HB", (1, 1)),
+        2: ("gps", ">hh", (0.01, 0.01)),
+    },
+}
+
+
+def format_addr(raw):
+    return ":".join(f"{b:02x}" for b in raw[:6])
+
+
+def read_sectors(image):
+    """Sectores con cabecera válida, del más antiguo al más reciente."""
+    sectors = []
+    for offset in range(0, len(image) - SECTOR_SIZE + 1, SECTOR_SIZE):
+        magic, sequence, boot = struct.unpack_from("<III", image, offset)
+        if magic == CAPTURE_MAGIC:
+            sectors.append((sequence, boot, offset))
+    return sorted(sectors)
+
+
+def read_records(image):
+    """(arranque, ms, slot, tipo, flags, datos) en orden de escritura."""
+    for _, boot, offset in read_sectors(image):
+        for cell in range(offset + CELL_SIZE, offset + SECTOR_SIZE, CELL_SIZE):
+            ms, slot, kind, length, flags = struct.unpack_from("<IBBBB", image, cell)
+            if kind == CAPTURE_FREE:
+                break
+            yield boot, ms, slot, kind, flags, image[cell + 8:cell + 8 + min(length, 8)]
+
+
+def decode_field(kind, data):
+    family, bit = kind & 0xF0, kind & 0x0F
+    name, fmt, scales = FIELDS.get(family, {}).get(bit, (f"0x{kind:02x}", None, ()))
+    if fmt is None or len(data) != struct.calcsize(fmt):
+        return name, data.hex()
+    values = struct.unpack(fmt, data)
+    return name, ";".join(f"{v * s:g}" for v, s in zip(values, scales))
+
+
+def export(image, output, epoch, decoded):
+    central = ""
+    peripherals = {}
+    boot_base = 0.0      # Segundos acumulados de los arranques anteriores
+    boot_last = None
+    last_time = None
+    previous = None
+    rows = 0
+
+    writer = csv.writer(output)
+    writer.writerow(COLUMNS + (["slot", "field", "value"] if decoded else []))
+    for boot, ms, slot, kind, flags, data in read_records(image):
+        if boot != boot_last:
+            if last_time is not None:
+                boot_base = last_time
+            boot_last = boot
+        timestamp = boot_base + ms / 1000.0
+        last_time = timestamp
+
+        if kind == CAPTURE_BOOT:
+            central = format_addr(data)
+            continue
+        if kind == CAPTURE_LINK:
+            peripherals[slot] = format_addr(data)
+            continue
+
+        rows += 1
+        btle_length = L2CAP_HEADER + ATT_HEADER + len(data)
+        row = [
+            rows, f"{epoch + timestamp:.6f}", btle_length + FRAME_OVERHEAD, btle_length,
+            central, peripherals.get(slot, ""), "", "0x02", ATT_NOTIFICATION, -1, data.hex(),
+            0.0 if previous is None else timestamp - previous, "normal",
+        ]
+        if decoded:
+            row += [slot, *decode_field(kind, data)]
+        writer.writerow(row)
+        previous = timestamp
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Exportar la captura binaria del master a CSV")
+    parser.add_argument("image", help="Volcado de la partición de captura")
+    parser.add_argument("output", nargs="?", help="CSV de salida (por defecto, stdout)")
+    parser.add_argument("--epoch", type=float, default=0.0, help="Epoch del primer arranque capturado")
+    parser.add_argument("--decoded", action="store_true", help="Añadir columnas slot, field y value")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if args.output:
+        with open(args.output, "w", newline="") as out:
+            rows = export(image, out, args.epoch, args.decoded)
+        print(f"✓ {rows} registros exportados a {args.output}")
+    else:
+        export(image, sys.stdout, args.epoch, args.decoded)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""
+Lee el streaming binario del master (modo binario de ble_log.h) desde el
+puerto serie o desde un volcado, y lo muestra como el log de texto o
+exporta la telemetría a CSV.
+
+Cada trama va codificada con COBS y terminada en 0x00; decodificada es
+
+    [tipo] [seq] [ms:4] [cuerpo] [crc16:2]
+
+con CRC-16/CCITT-FALSE de tipo..cuerpo (little-endian). Las tramas con CRC
+erróneo se descartan y los saltos de seq cuentan como tramas perdidas.
+
+Con --port se abre el puerto a 115200 baudios, se envía 'B' para pasar a
+binario y se sigue a --baud (921600 por defecto); al salir se envía 'T'
+y el master vuelve al texto. Requiere pyserial.
+
+Uso: python3 read_stream.py (volcado.bin | --port /dev/ttyUSB0) [--csv telemetria.csv]
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+from export_capture import decode_field
+
+TEXT_BAUD = 115200
+BINARY_CMD = b"B"
+TEXT_CMD = b"T"
+
+# ble_log.h
+FRAME_TEXT = 0x01
+FRAME_HEX = 0x02
+FRAME_DROP = 0x03
+# master.cpp (LOG_FRAME_USER + n)
+STREAM_ATT_TX = 0x10
+STREAM_ATT_RX = 0x11
+STREAM_TELEM = 0x12
+
+HEADER = struct.Struct("<BBI")
+LOG_REC_TRUNCATED = 0x80
+
+
+def crc16_ccitt(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    """None si la trama está mal formada."""
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        code = data[pos]
+        if code == 0 or pos + code > len(data):
+            return None
+        out += data[pos + 1:pos + code]
+        pos += code
+        if code < 0xFF and pos < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class StreamReader:
+    def __init__(self):
+        self.buffer = bytearray()
+        self.frames = 0
+        self.errors = 0
+        self.lost = 0
+        self.seq = None
+
+    def feed(self, chunk):
+        """(tipo, ms, cuerpo) de cada trama completa y válida."""
+        self.buffer += chunk
+        while True:
+            end = self.buffer.find(0)
+            if end < 0:
+                return
+            raw = bytes(self.buffer[:end])
+            del self.buffer[:end + 1]
+            if not raw:
+                continue
+            frame = cobs_decode(raw)
+            if frame is None or len(frame) < HEADER.size + 2 or \
+                    crc16_ccitt(frame[:-2]) != struct.unpack_from("<H", frame, len(frame) - 2)[0]:
+                self.errors += 1  # Texto previo al cambio de modo o bytes corruptos
+                continue
+            kind, seq, ms = HEADER.unpack_from(frame)
+            if self.seq is not None:
+                self.lost += (seq - self.seq - 1) & 0xFF
+            self.seq = seq
+            self.frames += 1
+            yield kind, ms, frame[HEADER.size:-2]
+
+
+def split_strings(body, count):
+    parts = body.split(b"\0", count)
+    parts += [b""] * (count + 1 - len(parts))
+    return [p.decode("utf-8", "replace") for p in parts[:count]], parts[count]
+
+
+def hex_bytes(data):
+    return " ".join(f"{b:02X}" for b in data)
+
+
+def format_frame(kind, body):
+    if kind == FRAME_TEXT:
+        (device, category), text = split_strings(body, 2)
+        return f"[{device}-{category}] {text.decode('utf-8', 'replace')}"
+    if kind == FRAME_HEX and body:
+        (device, category, action), data = split_strings(body[1:], 3)
+        more = ".." if body[0] & LOG_REC_TRUNCATED else ""
+        return f"[{device}-{category}] {action}: [{hex_bytes(data)}{more}]"
+    if kind == FRAME_DROP and len(body) == 4:
+        return f"[LOG-DROP] {struct.unpack('<I', body)[0]} records dropped (ring full)"
+    if kind in (STREAM_ATT_TX, STREAM_ATT_RX) and body:
+        direction = "TX" if kind == STREAM_ATT_TX else "RX"
+        return f"[slot{body[0]}-{direction}] [{hex_bytes(body[1:])}]"
+    if kind == STREAM_TELEM:
+        fields = " ".join(f"{name}={value}" for _, name, value in telemetry_fields(body))
+        return f"[slot{body[0]}-TELEM] {fields}"
+    return f"[0x{kind:02x}] [{hex_bytes(body)}]"
+
+
+def telemetry_fields(body):
+    """(tipo, nombre, valor) de cada campo de una trama STREAM_TELEM."""
+    pos = 2
+    while pos + 2 <= len(body):
+        kind, length = body[pos], body[pos + 1]
+        data = body[pos + 2:pos + 2 + length]
+        pos += 2 + length
+        yield (kind, *decode_field(kind, data))
+
+
+def open_port(port, baud):
+    import serial
+    link = serial.Serial(port, TEXT_BAUD, timeout=0.1)
+    link.write(BINARY_CMD)
+    link.flush()
+    link.baudrate = baud
+    return link
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Leer el streaming binario del master")
+    parser.add_argument("dump", nargs="?", help="Volcado del puerto serie (en lugar de --port)")
+    parser.add_argument("--port", help="Puerto serie del master")
+    parser.add_argument("--baud", type=int, default=921600, help="LOG_BINARY_BAUD del firmware")
+    parser.add_argument("--csv", help="Exportar la telemetría a CSV en lugar de mostrar el log")
+    args = parser.parse_args()
+    if not args.dump and not args.port:
+        parser.error("se necesita un volcado o --port")
+
+    link = open_port(args.port, args.baud) if args.port else None
+    source = open(args.dump, "rb") if args.dump else None
+    out = open(args.csv, "w", newline="") if args.csv else None
+    writer = csv.writer(out) if out else None
+    if writer:
+        writer.writerow(["ms", "slot", "subscribed", "field", "value"])
+
+    reader = StreamReader()
+    try:
+        while True:
+            chunk = link.read(4096) if link else source.read(65536)
+            if not chunk and not link:
+                break
+            for kind, ms, body in reader.feed(chunk):
+                if writer:
+                    if kind == STREAM_TELEM and len(body) >= 2:
+                        for _, name, value in telemetry_fields(body):
+                            writer.writerow([ms, body[0], body[1] & 1, name, value])
+                else:
+                    print(f"[{ms:08d}] {format_frame(kind, body)}")
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if link:
+            link.write(TEXT_CMD)
+            link.close()
+        if out:
+            out.close()
+    print(f"✓ {reader.frames} tramas, {reader.errors} descartadas, {reader.lost} perdidas", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()